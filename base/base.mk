@@ -5,6 +5,7 @@ LIBBASE_SOURCES := \
         parse_context.cc \
 	thread_pool.cc \
 	parallel.cc \
+	cancellation.cc \
 	optimized_path.cc
 
 LIBBASE_LINK :=	arch boost_thread gc
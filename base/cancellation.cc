@@ -0,0 +1,135 @@
+/** cancellation.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of cancellation tokens.
+*/
+
+#include "cancellation.h"
+#include <chrono>
+
+
+namespace Datacratic {
+
+namespace {
+
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+__thread CancellationToken * currentToken = nullptr;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+CancellationToken::
+CancellationToken()
+    : cancelled_(false), deadline_(0), memoryLimit_(0), memoryUsed_(0),
+      httpCode(400)
+{
+}
+
+void
+CancellationToken::
+cancel(const std::string & reason, int httpCode)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    if (cancelled_.load())
+        return;
+    this->reason = reason;
+    this->httpCode = httpCode;
+    cancelled_ = true;
+}
+
+void
+CancellationToken::
+setTimeout(double seconds)
+{
+    if (seconds <= 0.0)
+        deadline_ = 0;
+    else deadline_ = steadyNanoseconds() + (int64_t)(seconds * 1e9);
+}
+
+void
+CancellationToken::
+setMemoryLimit(size_t bytes)
+{
+    memoryLimit_ = bytes;
+}
+
+bool
+CancellationToken::
+isCancelled()
+{
+    if (cancelled_.load(std::memory_order_relaxed))
+        return true;
+
+    int64_t deadline = deadline_.load(std::memory_order_relaxed);
+    if (deadline != 0 && steadyNanoseconds() > deadline) {
+        cancel("Operation exceeded its timeout", 504);
+        return true;
+    }
+
+    return false;
+}
+
+void
+CancellationToken::
+check()
+{
+    if (!isCancelled())
+        return;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    throw CancellationException(reason, httpCode);
+}
+
+void
+CancellationToken::
+allocate(size_t bytes)
+{
+    size_t used = memoryUsed_.fetch_add(bytes) + bytes;
+    size_t limit = memoryLimit_.load(std::memory_order_relaxed);
+    if (limit != 0 && used > limit) {
+        cancel("Operation exceeded its memory limit of "
+               + std::to_string(limit) + " bytes", 400);
+        check();
+    }
+}
+
+void
+CancellationToken::
+release(size_t bytes)
+{
+    memoryUsed_.fetch_sub(bytes);
+}
+
+
+/*****************************************************************************/
+/* CANCELLATION SCOPE                                                        */
+/*****************************************************************************/
+
+CancellationToken * currentCancellationToken()
+{
+    return currentToken;
+}
+
+CancellationScope::
+CancellationScope(CancellationToken * token)
+    : previous(currentToken)
+{
+    currentToken = token;
+}
+
+CancellationScope::
+~CancellationScope()
+{
+    currentToken = previous;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,135 @@
+/** cancellation.h                                                 -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Cancellation tokens, which allow a long running operation (a query or
+    a procedure run) to be cancelled, given a deadline or given a memory
+    budget.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* CANCELLATION EXCEPTION                                                    */
+/*****************************************************************************/
+
+/** Exception thrown out of an operation that was cancelled.  The HTTP code
+    is used when the exception is returned over REST.
+*/
+struct CancellationException: public std::runtime_error {
+    CancellationException(const std::string & reason, int httpCode)
+        : std::runtime_error(reason), httpCode(httpCode)
+    {
+    }
+
+    int httpCode;
+};
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+/** Shared state that allows an operation to be stopped from outside.  The
+    operation polls it with check() (normally via checkCancellation()),
+    which throws a CancellationException once it was cancelled, its
+    deadline has passed or its memory budget was exceeded.
+
+    All methods are thread safe.
+*/
+
+struct CancellationToken {
+    CancellationToken();
+
+    /** Cancel the operation.  Only the first reason given is kept. */
+    void cancel(const std::string & reason = "Operation was cancelled",
+                int httpCode = 400);
+
+    /** Cancel the operation once the given number of seconds have
+        elapsed, with HTTP code 504.  Zero or less means no deadline.
+    */
+    void setTimeout(double seconds);
+
+    /** Cancel the operation once more than the given number of bytes are
+        accounted to it with allocate().  Zero means no limit.
+    */
+    void setMemoryLimit(size_t bytes);
+
+    /** Return true if the operation was cancelled or is past its
+        deadline.
+    */
+    bool isCancelled();
+
+    /** Throw a CancellationException if the operation was cancelled. */
+    void check();
+
+    /** Account memory held by the operation.  This cancels it and throws
+        if it is now over its memory limit.
+    */
+    void allocate(size_t bytes);
+
+    /** Account memory released by the operation. */
+    void release(size_t bytes);
+
+    /** Return the number of bytes currently accounted to the operation. */
+    size_t memoryUsed() const
+    {
+        return memoryUsed_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> cancelled_;
+    std::atomic<int64_t> deadline_;      ///< Steady clock ns; 0 is none
+    std::atomic<size_t> memoryLimit_;
+    std::atomic<size_t> memoryUsed_;
+
+    std::mutex mutex;                    ///< Protects the fields below
+    std::string reason;
+    int httpCode;
+};
+
+
+/*****************************************************************************/
+/* CANCELLATION SCOPE                                                        */
+/*****************************************************************************/
+
+/** Return the cancellation token of the operation that the calling thread
+    is working on, or a null pointer if there is none.
+*/
+CancellationToken * currentCancellationToken();
+
+/** Make the given token the current one for the calling thread while the
+    object is in scope.  A null token is permitted.  parallelMap() and
+    friends install the caller's token in the threads that do their work.
+*/
+struct CancellationScope {
+    explicit CancellationScope(CancellationToken * token);
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope &) = delete;
+    void operator = (const CancellationScope &) = delete;
+
+private:
+    CancellationToken * previous;
+};
+
+/** Throw a CancellationException if the calling thread's operation was
+    cancelled.  This is cheap enough to be called once per row.
+*/
+inline void checkCancellation()
+{
+    CancellationToken * token = currentCancellationToken();
+    if (token)
+        token->check();
+}
+
+} // namespace Datacratic
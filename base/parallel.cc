@@ -9,6 +9,7 @@
 #include "mldb/compiler/compiler.h"
 #include "mldb/base/exc_assert.h"
 #include "thread_pool.h"
+#include "cancellation.h"
 #include <atomic>
 #include <mutex>
 
@@ -35,13 +36,19 @@ void parallelMap(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    // Work done on our behalf is cancelled along with the caller's
+    CancellationToken * token = currentCancellationToken();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
             while (!hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
                 try {
+                    if (token)
+                        token->check();
                     doWork(myindex);
                 } JML_CATCH_ALL {
                     if (hasException.fetch_add(1) == 0) {
@@ -87,14 +94,19 @@ bool parallelMapHaltable(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
+    CancellationToken * token = currentCancellationToken();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
             while (!stop.load(std::memory_order_relaxed)
                    && !hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
                 try {
+                    if (token)
+                        token->check();
                     if (!doWork(myindex)) {
                         stop = true;
                         return;
@@ -147,14 +159,19 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
+    CancellationToken * token = currentCancellationToken();
+
     auto worker = [&] ()
         {
+            CancellationScope scope(token);
             while (!hasException.load(std::memory_order_relaxed)) {
                 size_t myindex = index.fetch_add(chunkSize);
                 if (myindex >= last)
                     return;
                 size_t indexEnd = std::min(last, myindex + chunkSize);
                 try {
+                    if (token)
+                        token->check();
                     doWork(myindex, indexEnd);
                 } JML_CATCH_ALL {
                     if (hasException.fetch_add(1) == 0) {
@@ -34,6 +34,11 @@ namespace Datacratic {
     Different behaviour can be obtained by using a try block inside the
     doWork function, or by using another mechanism apart from exceptions
     to signal errors.
+
+    The calling thread's cancellation token (see cancellation.h) is made
+    current in the threads that call doWork(), and is checked before each
+    call; once it is cancelled, the CancellationException is handled as
+    above.
 */
 void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
@@ -15,6 +15,7 @@
 #include "mldb/arch/timers.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 
 #include <boost/test/unit_test.hpp>
 #include <atomic>
@@ -227,6 +228,161 @@ void RunBasicTest(Int64ThreadQueue* q) {
     BOOST_CHECK_EQUAL(q->Steal(), 0);
 };
 
+BOOST_AUTO_TEST_CASE(parallel_map_cancellation)
+{
+    CancellationToken token;
+    CancellationScope scope(&token);
+
+    // Work items see the caller's token, and stop being started once it
+    // is cancelled
+    std::atomic<int> numDone(0), numWithToken(0);
+    auto doWork = [&] (size_t i)
+        {
+            if (currentCancellationToken() == &token)
+                ++numWithToken;
+            if (++numDone == 100)
+                token.cancel("stop", 499);
+        };
+
+    try {
+        parallelMap(0, 100000, doWork);
+        BOOST_CHECK(false);
+    } catch (const CancellationException & exc) {
+        BOOST_CHECK_EQUAL(exc.what(), std::string("stop"));
+        BOOST_CHECK_EQUAL(exc.httpCode, 499);
+    }
+
+    BOOST_CHECK_EQUAL(numDone, numWithToken);
+    BOOST_CHECK_LT(numDone, 100000);
+    BOOST_CHECK_THROW(checkCancellation(), CancellationException);
+}
+
+BOOST_AUTO_TEST_CASE(cancellation_timeout_and_memory)
+{
+    CancellationToken timeout;
+    timeout.setTimeout(0.01);
+    BOOST_CHECK(!timeout.isCancelled());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    try {
+        timeout.check();
+        BOOST_CHECK(false);
+    } catch (const CancellationException & exc) {
+        BOOST_CHECK_EQUAL(exc.httpCode, 504);
+    }
+
+    CancellationToken memory;
+    memory.setMemoryLimit(1000);
+    memory.allocate(800);
+    memory.release(500);
+    memory.allocate(600);
+    BOOST_CHECK_EQUAL(memory.memoryUsed(), 900);
+    BOOST_CHECK_THROW(memory.allocate(200), CancellationException);
+    BOOST_CHECK(memory.isCancelled());
+}
+
+BOOST_AUTO_TEST_CASE(workload_thread_limit)
+{
+    int oldLimit = getWorkloadThreadLimit(WORKLOAD_BATCH);
+    setWorkloadThreadLimit(WORKLOAD_BATCH, 2);
+
+    WorkloadStats before = getWorkloadStats(WORKLOAD_BATCH);
+
+    std::atomic<int> running(0), maxRunning(0), numBatch(0);
+    auto doWork = [&] (size_t i)
+        {
+            if (currentWorkloadClass() == WORKLOAD_BATCH)
+                ++numBatch;
+            int r = ++running;
+            int m = maxRunning;
+            while (r > m && !maxRunning.compare_exchange_weak(m, r)) ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+        };
+
+    BOOST_CHECK_EQUAL(currentWorkloadClass(), WORKLOAD_INTERACTIVE);
+    {
+        WorkloadScope scope(WORKLOAD_BATCH);
+        parallelMap(0, 200, doWork);
+    }
+    BOOST_CHECK_EQUAL(currentWorkloadClass(), WORKLOAD_INTERACTIVE);
+
+    WorkloadStats after = getWorkloadStats(WORKLOAD_BATCH);
+
+    // Two threads of the global pool plus the calling thread
+    BOOST_CHECK_LE(maxRunning, 3);
+    if (numCpus() > 1)
+        BOOST_CHECK_GE(maxRunning, 2);
+    BOOST_CHECK_EQUAL(numBatch, 200);
+    BOOST_CHECK_GT(after.jobsSubmitted, before.jobsSubmitted);
+    BOOST_CHECK_EQUAL(after.jobsSubmitted - before.jobsSubmitted,
+                      after.jobsFinished - before.jobsFinished);
+    BOOST_CHECK_EQUAL(after.threadLimit, 2);
+
+    // Interactive work is not limited
+    running = 0;
+    maxRunning = 0;
+    parallelMap(0, 200, doWork);
+    if (numCpus() > 3)
+        BOOST_CHECK_GT(maxRunning, 3);
+
+    setWorkloadThreadLimit(WORKLOAD_BATCH, oldLimit);
+}
+
+BOOST_AUTO_TEST_CASE(workload_admission)
+{
+    setWorkloadAdmissionLimit(WORKLOAD_BATCH, 1);
+
+    std::atomic<bool> secondAdmitted(false);
+    std::thread second;
+    {
+        WorkloadAdmission first(WORKLOAD_BATCH);
+        BOOST_CHECK_EQUAL(currentWorkloadClass(), WORKLOAD_BATCH);
+
+        // Nested operations of the same class are not counted again
+        {
+            WorkloadAdmission nested(WORKLOAD_BATCH);
+        }
+
+        second = std::thread([&] ()
+            {
+                WorkloadAdmission admission(WORKLOAD_BATCH);
+                secondAdmitted = true;
+            });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        BOOST_CHECK(!secondAdmitted);
+        BOOST_CHECK_EQUAL(getWorkloadStats(WORKLOAD_BATCH).operationsWaiting,
+                          1);
+
+        // Waiting for admission can time out
+        int httpCode = 0;
+        std::thread third([&] ()
+            {
+                CancellationToken token;
+                CancellationScope scope(&token);
+                token.setTimeout(0.05);
+                try {
+                    WorkloadAdmission admission(WORKLOAD_BATCH);
+                } catch (const CancellationException & exc) {
+                    httpCode = exc.httpCode;
+                }
+            });
+        third.join();
+        BOOST_CHECK_EQUAL(httpCode, 504);
+        BOOST_CHECK(!secondAdmitted);
+    }
+
+    second.join();
+    BOOST_CHECK(secondAdmitted);
+    BOOST_CHECK_EQUAL(currentWorkloadClass(), WORKLOAD_INTERACTIVE);
+
+    WorkloadStats stats = getWorkloadStats(WORKLOAD_BATCH);
+    BOOST_CHECK_EQUAL(stats.operationsRunning, 0);
+    BOOST_CHECK_EQUAL(stats.operationsWaiting, 0);
+
+    setWorkloadAdmissionLimit(WORKLOAD_BATCH, 0);
+}
+
 // Check basic functionality and invariants in one thread
 BOOST_AUTO_TEST_CASE(Basics) {
     Int64ThreadQueue q;
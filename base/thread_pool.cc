@@ -9,11 +9,14 @@
 
 #include "thread_pool.h"
 #include "thread_pool_impl.h"
+#include "cancellation.h"
 #include "mldb/arch/thread_specific.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/jml/utils/environment.h"
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <vector>
 #include <thread>
 #include <iostream>
@@ -32,6 +35,67 @@ int numCpus()
     return NUM_CPUS;
 }
 
+
+/*****************************************************************************/
+/* WORKLOAD CLASS STATE                                                      */
+/*****************************************************************************/
+
+namespace {
+
+__thread WorkloadClass currentClass = WORKLOAD_INTERACTIVE;
+
+/** Global state of a workload class, shared by all of its pools. */
+struct WorkloadClassState {
+    WorkloadClassState()
+        : jobsSubmitted(0), jobsFinished(0), jobsStolen(0),
+          jobsWithFullQueue(0), jobsRunLocally(0), numWaiting(0),
+          threadLimit(-1), threadsActive(0),
+          admissionLimit(0), operationsRunning(0), operationsWaiting(0)
+    {
+    }
+
+    /// Job counters, summed over the pools of the class
+    std::atomic<uint64_t> jobsSubmitted, jobsFinished;
+    std::atomic<uint64_t> jobsStolen, jobsWithFullQueue, jobsRunLocally;
+
+    /// Size of waiting, readable without the lock
+    std::atomic<int> numWaiting;
+
+    std::mutex mutex;       ///< Protects the fields below
+    int threadLimit;        ///< Max global pool threads; -1 is no limit
+    int threadsActive;      ///< Global pool threads running our workers
+
+    /// Pools that want a worker but couldn't get a thread, in the order
+    /// they asked for it.  Weak since they may be gone by their turn,
+    /// and untyped as ThreadPool::Itl is private.
+    std::deque<std::weak_ptr<void> > waiting;
+
+    int admissionLimit;     ///< Max operations in flight; 0 is no limit
+    int operationsRunning;
+    int operationsWaiting;
+    std::condition_variable admissionCv;
+};
+
+WorkloadClassState & getClassState(WorkloadClass cls)
+{
+    // Never destroyed, since pool threads may still use it during
+    // shutdown.
+    static WorkloadClassState * states = [] ()
+        {
+            auto result = new WorkloadClassState[NUM_WORKLOAD_CLASSES];
+            int reserved = std::max(1, numCpus() / 4);
+            result[WORKLOAD_BATCH].threadLimit
+                = std::max(1, numCpus() - reserved);
+            return result;
+        } ();
+
+    ExcAssertGreaterEqual(cls, 0);
+    ExcAssertLess(cls, NUM_WORKLOAD_CLASSES);
+    return states[cls];
+}
+
+} // file scope
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -168,6 +232,15 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /// The maximum number of parallel jobs in the parent
     size_t maxParentJobs;
 
+    /// The workload class of the pool, and its shared state.  Only
+    /// child pools have one.
+    WorkloadClass workloadClass;
+    WorkloadClassState * classState;
+
+    /// True if our parent is the global pool, in which case we only
+    /// get as many of its threads as our workload class allows.
+    bool limitThreads;
+
     /** Return the number of jobs running.  If there are more than
         2^31 jobs running, this may give the wrong answer.
     */
@@ -201,7 +274,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
           queues(new Queues(threadCreationEpoch)),
           parent(nullptr),
           parentJobs(0),
-          maxParentJobs(0)
+          maxParentJobs(0),
+          workloadClass(WORKLOAD_INTERACTIVE),
+          classState(nullptr),
+          limitThreads(false)
     {
         submitted = 0;
         finished = 0;
@@ -223,7 +299,10 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
           queues(new Queues(threadCreationEpoch)),
           parent(&parent),
           parentJobs(0),
-          maxParentJobs(maxParentJobs)
+          maxParentJobs(maxParentJobs),
+          workloadClass(currentClass),
+          classState(&getClassState(workloadClass)),
+          limitThreads(&parent == ThreadPool::instance().itl.get())
     {
         submitted = 0;
         finished = 0;
@@ -263,10 +342,160 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         return *threadEntry;
     }
 
-    void runParentWorker()
+    /** Run our jobs in a thread of our parent, until there are none
+        left.  Returns false if, instead, we gave up the thread to let the
+        pools of our class that are waiting for one have their turn; in
+        that case we're back in line and parentJobs still counts us.
+    */
+    bool runParentWorker()
     {
-        while (!shutdown && (this->work())) ;
+        WorkloadScope scope(workloadClass);
+
+        // How long we keep a thread while others of our class wait
+        static constexpr auto timeSlice = std::chrono::milliseconds(10);
+        std::chrono::steady_clock::time_point sliceEnd;
+        bool haveSliceEnd = false;
+
+        while (!shutdown && (this->work())) {
+            if (!limitThreads
+                || classState->numWaiting.load(std::memory_order_relaxed) == 0)
+                continue;
+
+            auto now = std::chrono::steady_clock::now();
+            if (!haveSliceEnd) {
+                sliceEnd = now + timeSlice;
+                haveSliceEnd = true;
+            }
+            else if (now >= sliceEnd) {
+                std::unique_lock<std::mutex> guard(classState->mutex);
+                classState->waiting.emplace_back(shared_from_this());
+                ++classState->numWaiting;
+                return false;
+            }
+        }
         --this->parentJobs;
+        return true;
+    }
+
+    /** Return a job that runs a worker for the given pool in the global
+        pool, and then hands the thread over to the next pool of the class
+        that is waiting for one.
+    */
+    static ThreadJob
+    limitedParentJob(std::weak_ptr<Itl> weakPool, WorkloadClassState * state)
+    {
+        return [weakPool, state] ()
+            {
+                if (!weakPool.expired()) {
+                    JML_TRACE_EXCEPTIONS(false);
+                    auto pool = weakPool.lock();
+                    if (pool)
+                        pool->runParentWorker();
+                }
+                releaseThread(state);
+            };
+    }
+
+    /** Take the first pool off the class's waiting list.  Must be called
+        with the class's mutex held.
+    */
+    static std::weak_ptr<Itl> popWaiting(WorkloadClassState * state)
+    {
+        std::weak_ptr<void> next = std::move(state->waiting.front());
+        state->waiting.pop_front();
+        --state->numWaiting;
+        if (next.expired())
+            return std::weak_ptr<Itl>();
+        JML_TRACE_EXCEPTIONS(false);
+        return std::static_pointer_cast<Itl>(next.lock());
+    }
+
+    /** One of the class's threads has finished running a worker.  Give it
+        to the first waiting pool that is still alive, or release it.
+    */
+    static void releaseThread(WorkloadClassState * state)
+    {
+        std::unique_lock<std::mutex> guard(state->mutex);
+        while (!state->waiting.empty()
+               && (state->threadLimit < 0
+                   || state->threadsActive <= state->threadLimit)) {
+            std::weak_ptr<Itl> next = popWaiting(state);
+            if (next.expired())
+                continue;
+            guard.unlock();
+            ThreadPool::instance().itl->add
+                (limitedParentJob(std::move(next), state));
+
+            // If the limit was raised, others may have a thread too
+            startWaiting(state);
+            return;
+        }
+        --state->threadsActive;
+    }
+
+    /** Start workers for the waiting pools of the class, as far as its
+        thread limit allows.
+    */
+    static void startWaiting(WorkloadClassState * state)
+    {
+        for (;;) {
+            std::weak_ptr<Itl> next;
+            {
+                std::unique_lock<std::mutex> guard(state->mutex);
+                if (state->waiting.empty()
+                    || (state->threadLimit >= 0
+                        && state->threadsActive >= state->threadLimit))
+                    return;
+                next = popWaiting(state);
+                if (next.expired())
+                    continue;
+                ++state->threadsActive;
+            }
+            ThreadPool::instance().itl->add
+                (limitedParentJob(std::move(next), state));
+        }
+    }
+
+    /** Submit a worker for this pool to our parent.  If our parent is
+        the global pool and our class already occupies all of the threads
+        it's allowed, we wait in line for one of them to be released.
+    */
+    void submitParentJob()
+    {
+        // Get a weak pointer to ourself so that we can know
+        // if we're still alive or not.
+        auto weakThis = std::weak_ptr<Itl>(this->shared_from_this());
+
+        if (limitThreads) {
+            {
+                std::unique_lock<std::mutex> guard(classState->mutex);
+                if (classState->threadLimit >= 0
+                    && classState->threadsActive >= classState->threadLimit) {
+                    classState->waiting.emplace_back(std::move(weakThis));
+                    ++classState->numWaiting;
+                    return;
+                }
+                ++classState->threadsActive;
+            }
+            parent->add(limitedParentJob(std::move(weakThis), classState));
+            return;
+        }
+
+        auto parentJob = [weakThis] ()
+            {
+                // GCC 4.8 uses a try/catch to implement lock()
+                // we avoid logging an exception message here
+                // by trying first, and then disabling exceptions.
+                if (weakThis.expired())
+                    return;
+                JML_TRACE_EXCEPTIONS(false);
+                auto strongThis = weakThis.lock();
+                if (strongThis)
+                    strongThis->runParentWorker();
+            };
+
+        if (!weakThis.expired())
+            parent->add(parentJob);
     }
 
     /** Add a new job to be run.  This is lock-free except for the very
@@ -280,6 +509,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     void add(ThreadJob job)
     {
         submitted += 1;
+        if (classState)
+            classState->jobsSubmitted.fetch_add(1, std::memory_order_relaxed);
 
         std::unique_ptr<ThreadJob> overflow
             (getEntry().queue->push(new ThreadJob(std::move(job))));
@@ -293,25 +524,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
                     --parentJobs;
                 }
                 else {
-                    // Get a weak pointer to ourself so that we can know
-                    // if we're still alive or not.
-                    auto weakThis = std::weak_ptr<Itl>(this->shared_from_this());
-
-                    auto parentJob = [weakThis] ()
-                        {
-                            // GCC 4.8 uses a try/catch to implement lock()
-                            // we avoid logging an exception message here
-                            // by trying first, and then disabling exceptions.
-                            if (weakThis.expired())
-                                return;
-                            JML_TRACE_EXCEPTIONS(false);
-                            auto strongThis = weakThis.lock();
-                            if (strongThis)
-                                strongThis->runParentWorker();
-                        };
-
-                    if (!weakThis.expired())
-                        parent->add(parentJob);
+                    submitParentJob();
                 }
             }
             else {
@@ -329,6 +542,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             // The queue was full.  Do the work here, hopefully someone
             // will steal some work in the meantime.
             ++jobsWithFullQueue;
+            if (classState)
+                classState->jobsWithFullQueue
+                    .fetch_add(1, std::memory_order_relaxed);
             runJob(*overflow);
         }
     }
@@ -345,6 +561,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         while ((job = entry.queue->pop())) {
             result = true;
             ++jobsRunLocally;
+            if (classState)
+                classState->jobsRunLocally
+                    .fetch_add(1, std::memory_order_relaxed);
             runJob(*job);
             delete job;
         }
@@ -388,6 +607,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
                     entry.lastFound = n;
 
                     ++jobsStolen;
+                    if (classState)
+                        classState->jobsStolen
+                            .fetch_add(1, std::memory_order_relaxed);
 
                     runJob(*job);
                     foundWork = true;
@@ -422,6 +644,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         try {
             job();
             finished += 1;
+            if (classState)
+                classState->jobsFinished
+                    .fetch_add(1, std::memory_order_relaxed);
         } catch (const std::exception & exc) {
             finished += 1;
             cerr << "ERROR: job submitted to ThreadPool of type "
@@ -653,11 +878,11 @@ waitForAll() const
     itl->waitForAll();
 }
 
-void
+bool
 ThreadPool::
 work() const
 {
-    itl->work();
+    return itl->work();
 }
 
 uint64_t
@@ -710,4 +935,133 @@ instance()
     return result;
 }
 
+
+/*****************************************************************************/
+/* WORKLOAD CLASSES                                                          */
+/*****************************************************************************/
+
+const char * workloadClassName(WorkloadClass cls)
+{
+    switch (cls) {
+    case WORKLOAD_INTERACTIVE:  return "interactive";
+    case WORKLOAD_BATCH:        return "batch";
+    default:                    return "unknown";
+    }
+}
+
+WorkloadClass currentWorkloadClass()
+{
+    return currentClass;
+}
+
+WorkloadScope::
+WorkloadScope(WorkloadClass cls)
+    : previous(currentClass)
+{
+    currentClass = cls;
+}
+
+WorkloadScope::
+~WorkloadScope()
+{
+    currentClass = previous;
+}
+
+WorkloadAdmission::
+WorkloadAdmission(WorkloadClass cls)
+    : cls(cls), previous(currentClass), admitted(false)
+{
+    if (previous != cls) {
+        WorkloadClassState & state = getClassState(cls);
+        CancellationToken * token = currentCancellationToken();
+
+        std::unique_lock<std::mutex> guard(state.mutex);
+        ++state.operationsWaiting;
+        while (state.admissionLimit > 0
+               && state.operationsRunning >= state.admissionLimit) {
+            // Wake up now and again to see if we were cancelled while
+            // waiting
+            state.admissionCv.wait_for(guard, std::chrono::milliseconds(100));
+            if (token && token->isCancelled()) {
+                --state.operationsWaiting;
+                guard.unlock();
+                token->check();
+            }
+        }
+        --state.operationsWaiting;
+        ++state.operationsRunning;
+        admitted = true;
+    }
+
+    currentClass = cls;
+}
+
+WorkloadAdmission::
+~WorkloadAdmission()
+{
+    currentClass = previous;
+
+    if (!admitted)
+        return;
+
+    WorkloadClassState & state = getClassState(cls);
+    {
+        std::unique_lock<std::mutex> guard(state.mutex);
+        --state.operationsRunning;
+    }
+    state.admissionCv.notify_one();
+}
+
+void setWorkloadThreadLimit(WorkloadClass cls, int numThreads)
+{
+    WorkloadClassState & state = getClassState(cls);
+    std::unique_lock<std::mutex> guard(state.mutex);
+    state.threadLimit = numThreads < 0 ? -1 : std::max(numThreads, 1);
+}
+
+int getWorkloadThreadLimit(WorkloadClass cls)
+{
+    WorkloadClassState & state = getClassState(cls);
+    std::unique_lock<std::mutex> guard(state.mutex);
+    return state.threadLimit;
+}
+
+void setWorkloadAdmissionLimit(WorkloadClass cls, int maxOperations)
+{
+    WorkloadClassState & state = getClassState(cls);
+    {
+        std::unique_lock<std::mutex> guard(state.mutex);
+        state.admissionLimit = std::max(maxOperations, 0);
+    }
+    state.admissionCv.notify_all();
+}
+
+int getWorkloadAdmissionLimit(WorkloadClass cls)
+{
+    WorkloadClassState & state = getClassState(cls);
+    std::unique_lock<std::mutex> guard(state.mutex);
+    return state.admissionLimit;
+}
+
+WorkloadStats getWorkloadStats(WorkloadClass cls)
+{
+    WorkloadClassState & state = getClassState(cls);
+
+    WorkloadStats result;
+    result.jobsSubmitted = state.jobsSubmitted;
+    result.jobsFinished = state.jobsFinished;
+    result.jobsStolen = state.jobsStolen;
+    result.jobsWithFullQueue = state.jobsWithFullQueue;
+    result.jobsRunLocally = state.jobsRunLocally;
+
+    std::unique_lock<std::mutex> guard(state.mutex);
+    result.threadLimit = state.threadLimit;
+    result.threadsActive = state.threadsActive;
+    result.threadsWaiting = state.waiting.size();
+    result.admissionLimit = state.admissionLimit;
+    result.operationsRunning = state.operationsRunning;
+    result.operationsWaiting = state.operationsWaiting;
+    return result;
+}
+
 } // namespace Datacratic
@@ -12,6 +12,7 @@
 
 #include <functional>
 #include <memory>
+#include <cstdint>
 
 namespace Datacratic {
 
@@ -27,6 +28,12 @@ int numCpus();
 
 /** Thread pool abstraction, to allow work to be farmed out over multiple
     threads.
+
+    A pool constructed with a parent (normally the global instance()) has
+    no threads of its own; it submits workers to its parent which run its
+    jobs.  Such a pool belongs to the workload class that was current in
+    the thread that created it, which limits how many of the parent's
+    threads it may occupy (see WorkloadClass below).
 */
 
 struct ThreadPool {
@@ -55,7 +62,10 @@ struct ThreadPool {
 
     void waitForAll() const;
 
-    void work() const;
+    /** Run one of the pool's jobs in the calling thread, if there is one
+        waiting.  Returns true if a job was run.
+    */
+    bool work() const;
 
     uint64_t jobsRunning() const;
     uint64_t jobsSubmitted() const;
@@ -72,4 +82,101 @@ private:
     std::shared_ptr<Itl> itl;
 };
 
+
+/*****************************************************************************/
+/* WORKLOAD CLASSES                                                          */
+/*****************************************************************************/
+
+/** Classes of work that share the global thread pool.
+
+    Interactive work (REST calls that need to return in a few milliseconds)
+    is never throttled.  Batch work (procedure runs) may only occupy a
+    limited number of the global pool's threads at once, which guarantees
+    a slice of the cores to interactive work, and only a limited number of
+    batch operations may be in flight at the same time.  Batch operations
+    that are waiting for a thread get them in turn, so that one long
+    operation can't hold all of the batch threads while others wait.
+*/
+enum WorkloadClass {
+    WORKLOAD_INTERACTIVE,
+    WORKLOAD_BATCH,
+    NUM_WORKLOAD_CLASSES
+};
+
+/** Return the name of the workload class, as used in statistics. */
+const char * workloadClassName(WorkloadClass cls);
+
+/** Return the workload class of the calling thread.  Threads are
+    interactive unless they're within a WorkloadScope or WorkloadAdmission.
+    Threads running jobs of a child pool are in the class of that pool.
+*/
+WorkloadClass currentWorkloadClass();
+
+/** Put the calling thread in the given workload class while the object is
+    in scope.
+*/
+struct WorkloadScope {
+    explicit WorkloadScope(WorkloadClass cls);
+    ~WorkloadScope();
+
+    WorkloadScope(const WorkloadScope &) = delete;
+    void operator = (const WorkloadScope &) = delete;
+
+private:
+    WorkloadClass previous;
+};
+
+/** Admit one operation of the given class, blocking until fewer than the
+    class's admission limit are in flight, and put the calling thread in
+    the class while the object is in scope.  Waiting honors the thread's
+    cancellation token.  An operation started from a thread that is
+    already in the class (for example a procedure run from within another
+    one) is not counted again.
+*/
+struct WorkloadAdmission {
+    explicit WorkloadAdmission(WorkloadClass cls);
+    ~WorkloadAdmission();
+
+    WorkloadAdmission(const WorkloadAdmission &) = delete;
+    void operator = (const WorkloadAdmission &) = delete;
+
+private:
+    WorkloadClass cls;
+    WorkloadClass previous;
+    bool admitted;
+};
+
+/** Set the number of threads of the global pool that the workers of
+    the class's pools may occupy at once.  -1 means no limit, which is
+    the default for interactive work; batch work defaults to all but a
+    quarter of the cores.  A new limit applies as running workers finish.
+*/
+void setWorkloadThreadLimit(WorkloadClass cls, int numThreads);
+int getWorkloadThreadLimit(WorkloadClass cls);
+
+/** Set the number of operations of the class that may be admitted at
+    once.  Zero (the default) means no limit.
+*/
+void setWorkloadAdmissionLimit(WorkloadClass cls, int maxOperations);
+int getWorkloadAdmissionLimit(WorkloadClass cls);
+
+/** Statistics for a workload class.  The job counters are the same as
+    those of ThreadPool, summed over all of the child pools of the class.
+*/
+struct WorkloadStats {
+    uint64_t jobsSubmitted;
+    uint64_t jobsFinished;
+    uint64_t jobsStolen;
+    uint64_t jobsWithFullQueue;
+    uint64_t jobsRunLocally;
+    int threadLimit;         ///< -1 is no limit
+    int threadsActive;       ///< Global pool threads occupied by the class
+    int threadsWaiting;      ///< Workers waiting for a thread
+    int admissionLimit;      ///< 0 is no limit
+    int operationsRunning;   ///< Admitted operations
+    int operationsWaiting;   ///< Operations waiting for admission
+};
+
+WorkloadStats getWorkloadStats(WorkloadClass cls);
+
 } // namespace Datacratic
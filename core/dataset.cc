@@ -15,6 +15,7 @@
 #include "mldb/server/analytics.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/statement_cache.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/jml/utils/profile.h"
 #include "mldb/server/dataset_context.h"
@@ -57,6 +58,13 @@ namespace MLDB {
 
 namespace {
 
+/// Number of rows over which a where expression is evaluated at once when
+/// scanning a table
+static constexpr size_t WHERE_BATCH_SIZE = 1024;
+
+/// Number of rows in each batch of the default forEachColumnBatch()
+static constexpr size_t COLUMN_BATCH_SIZE = 1024;
+
 struct SortByRowHash {
     bool operator () (const RowName & row1, const RowName & row2)
     {
@@ -761,6 +769,77 @@ getRowExpr(const RowName & row) const
     return std::move(flattened.columns);
 }
 
+ExpressionValue
+Dataset::
+getRowColumnsExpr(const RowName & row,
+                  const std::vector<ColumnName> & columnNames) const
+{
+    MatrixNamedRow flattened = getMatrixView()->getRow(row);
+
+    std::vector<std::tuple<ColumnName, CellValue, Date> > result;
+    for (auto & c: flattened.columns) {
+        if (std::binary_search(columnNames.begin(), columnNames.end(),
+                               std::get<0>(c)))
+            result.emplace_back(std::move(c));
+    }
+    return std::move(result);
+}
+
+bool
+Dataset::
+forEachColumnBatch(const std::vector<ColumnName> & columnNames,
+                   ssize_t start,
+                   ssize_t limit,
+                   const OnColumnBatch & onBatch) const
+{
+    auto matrix = getMatrixView();
+    auto rows = matrix->getRowNames(start, limit);
+
+    size_t numBatches
+        = (rows.size() + COLUMN_BATCH_SIZE - 1) / COLUMN_BATCH_SIZE;
+
+    auto doBatch = [&] (size_t b) -> bool
+        {
+            size_t begin = b * COLUMN_BATCH_SIZE;
+            size_t end = std::min(begin + COLUMN_BATCH_SIZE, rows.size());
+
+            ColumnBatch batch;
+            batch.rowIndex = start + begin;
+            batch.rowNames.assign(rows.begin() + begin, rows.begin() + end);
+            batch.columns.resize(columnNames.size());
+            for (auto & c: batch.columns) {
+                c.values.reserve(end - begin);
+                c.timestamps.reserve(end - begin);
+            }
+
+            ExpressionValue storage;
+            for (size_t i = begin;  i < end;  ++i) {
+                MatrixNamedRow row = matrix->getRow(rows[i]);
+                for (size_t j = 0;  j < columnNames.size();  ++j) {
+                    auto & column = batch.columns[j];
+                    // Same choice of value as reading the column in a
+                    // row scope
+                    const ExpressionValue * val
+                        = searchRow(row.columns, columnNames[j],
+                                    GET_LATEST, storage);
+                    if (val) {
+                        column.values.push_back(val->getAtom());
+                        column.timestamps.push_back
+                            (val->getEffectiveTimestamp());
+                    }
+                    else {
+                        column.values.emplace_back();
+                        column.timestamps.push_back(Date::negativeInfinity());
+                    }
+                }
+            }
+
+            return onBatch(batch);
+        };
+
+    return parallelMapHaltable(0, numBatches, doBatch);
+}
+
 std::vector<MatrixNamedRow>
 Dataset::
 queryStructured(const SelectExpression & select,
@@ -773,11 +852,37 @@ queryStructured(const SelectExpression & select,
                 ssize_t offset,
                 ssize_t limit,
                 Utf8String alias) const
+{
+    std::vector<MatrixNamedRow> output;
+
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            output.emplace_back(std::move(row));
+            return true;
+        };
+
+    queryStructuredStreaming(onRow, select, when, where, orderBy, groupBy,
+                             having, rowName, offset, limit, alias);
+
+    return output;
+}
+
+bool
+Dataset::
+queryStructuredStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                         const SelectExpression & select,
+                         const WhenExpression & when,
+                         const SqlExpression & where,
+                         const OrderByExpression & orderBy,
+                         const TupleExpression & groupBy,
+                         const std::shared_ptr<SqlExpression> having,
+                         const std::shared_ptr<SqlExpression> rowName,
+                         ssize_t offset,
+                         ssize_t limit,
+                         Utf8String alias) const
 {
     ExcAssert(having);
     ExcAssert(rowName);
-    std::mutex lock;
-    std::vector<MatrixNamedRow> output;
 
     if (!having->isConstantTrue() && groupBy.clauses.empty())
         throw HttpReturnException(400, "HAVING expression requires a GROUP BY expression");
@@ -801,14 +906,13 @@ queryStructured(const SelectExpression & select,
                 MatrixNamedRow row = row_.flattenDestructive();
                 row.rowName = getValidatedRowName(calc.at(0));
                 row.rowHash = row.rowName;
-                output.emplace_back(std::move(row));
-                return true;
+                return onRow(row);
             };
 
         //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
         
         //cerr << "orderBy_ = " << jsonEncode(orderBy_) << endl;
-        iterateDataset(select, *this, alias, when, where,
+        return iterateDataset(select, *this, alias, when, where,
                        { rowName->shallowCopy() }, {processor, false/*processInParallel*/}, orderBy, offset, limit,
                        nullptr);
     }
@@ -822,18 +926,15 @@ queryStructured(const SelectExpression & select,
         auto processor = [&] (NamedRowValue & row_)
             {
                 MatrixNamedRow row = row_.flattenDestructive();
-                output.emplace_back(row);
-                return true;
+                return onRow(row);
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
-        iterateDatasetGrouped(select, *this, alias, when, where,
+        return iterateDatasetGrouped(select, *this, alias, when, where,
                               groupBy, aggregators, *having, *rowName,
                               {processor, false/*processInParallel*/}, orderBy, offset, limit,
                               nullptr);
     }
-
-    return output;
 }
 
 bool
@@ -1789,6 +1890,20 @@ generateRowsWhere(const SqlBindingScope & scope,
     // Look for a free variable
     bool needsColumns = unbound.needsRow();
 
+    // If the where expression can be evaluated over a batch of rows at a
+    // time, we do that rather than going row by row.
+    bool useBatches = needsColumns && whereBound.execBatch;
+
+    // An expression that can be evaluated in batches does nothing but read
+    // columns, so we can ask for just those columns, column by column.
+    bool useColumnBatches = useBatches
+        && unbound.tables.empty() && unbound.wildcards.empty();
+    std::vector<ColumnName> batchColumns;
+    if (useColumnBatches) {
+        for (auto & v: unbound.vars)
+            batchColumns.push_back(dsScope.resolveColumnName("", v.first));
+    }
+
 
     //cerr << "needsColumns for " << where.print() << " returned "
     //     << jsonEncode(unbound) << " and result " << needsColumns << endl;
@@ -1806,13 +1921,68 @@ generateRowsWhere(const SqlBindingScope & scope,
                 if (!token.empty())
                     start = token.convert<size_t>();
 
+                std::vector<RowName> rowsToKeep;
+
+                if (useColumnBatches) {
+                    std::mutex mutex;
+                    std::vector<std::pair<size_t, std::vector<RowName> > > kept;
+                    std::atomic<size_t> numScanned(0);
+
+                    auto onColumnBatch = [&] (ColumnBatch & columns) -> bool
+                        {
+                            SqlExpressionDatasetScope::RowBatch
+                                batch(columns, batchColumns, &params);
+                            BatchColumn keep;
+                            whereBound.execRowBatch(batch, keep);
+
+                            std::vector<RowName> batchKept;
+                            for (size_t i = 0;  i < columns.size();  ++i) {
+                                if (keep.isTrue(i))
+                                    batchKept.emplace_back
+                                        (std::move(columns.rowNames[i]));
+                            }
+                            numScanned += columns.size();
+
+                            std::unique_lock<std::mutex> guard(mutex);
+                            kept.emplace_back(columns.rowIndex,
+                                              std::move(batchKept));
+                            return true;
+                        };
+
+                    this->forEachColumnBatch(batchColumns, start, limit,
+                                             onColumnBatch);
+
+                    // Put the batches back in order, and then order the
+                    // same way as a row by row scan
+                    std::sort(kept.begin(), kept.end(),
+                              [] (const std::pair<size_t, std::vector<RowName> > & p1,
+                                  const std::pair<size_t, std::vector<RowName> > & p2)
+                              {
+                                  return p1.first < p2.first;
+                              });
+                    for (auto & k: kept) {
+                        rowsToKeep.insert(rowsToKeep.end(),
+                                          std::make_move_iterator(k.second.begin()),
+                                          std::make_move_iterator(k.second.end()));
+                    }
+                    if (numScanned.load() >= 1000)
+                        parallelQuickSortRecursive<RowName, SortByRowHash>
+                            (rowsToKeep.begin(), rowsToKeep.end());
+
+                    start += numScanned.load();
+                    Any newToken;
+                    if ((ssize_t)numScanned.load() == limit)
+                        newToken = start;
+
+                    return std::move(make_pair(std::move(rowsToKeep),
+                                               std::move(newToken)));
+                }
+
                 auto matrix = this->getMatrixView();
 
                 //Row names can be returned in an arbitrary order as long as it is deterministic.
                 auto rows = matrix->getRowNames(start, limit);
 
-                std::vector<RowName> rowsToKeep;
-
                 PerThreadAccumulator<std::vector<RowName> > accum;
                 
                 auto onRow = [&] (size_t n)
@@ -1834,8 +2004,43 @@ generateRowsWhere(const SqlBindingScope & scope,
                             accum.get().push_back(r);
                     };
 
+                auto onBatch = [&] (size_t b)
+                    {
+                        size_t begin = b * WHERE_BATCH_SIZE;
+                        size_t end = std::min(begin + WHERE_BATCH_SIZE,
+                                              rows.size());
+
+                        std::vector<MatrixNamedRow> batchRows;
+                        batchRows.reserve(end - begin);
+                        for (size_t i = begin;  i < end;  ++i)
+                            batchRows.emplace_back(matrix->getRow(rows[i]));
+
+                        SqlExpressionDatasetScope::RowBatch
+                            batch(std::move(batchRows), &params);
+                        BatchColumn keep;
+                        whereBound.execRowBatch(batch, keep);
+
+                        auto & output = accum.get();
+                        for (size_t i = begin;  i < end;  ++i) {
+                            if (keep.isTrue(i - begin))
+                                output.push_back(rows[i]);
+                        }
+                    };
+
                 bool needSort = false;
-                if (rows.size() >= 1000) {
+                if (useBatches) {
+                    size_t numBatches = (rows.size() + WHERE_BATCH_SIZE - 1)
+                        / WHERE_BATCH_SIZE;
+                    if (rows.size() >= 1000) {
+                        parallelMap(0, numBatches, onBatch);
+                        needSort = true;
+                    }
+                    else {
+                        for (size_t b = 0;  b < numBatches;  ++b)
+                            onBatch(b);
+                    }
+                }
+                else if (rows.size() >= 1000) {
                     // Scan the whole lot with the when in parallel
                     parallelMap(0, rows.size(), onRow);
                     needSort = true;
@@ -2085,7 +2290,8 @@ std::vector<MatrixNamedRow>
 Dataset::
 queryString(const Utf8String & query) const
 {
-    auto stm = SelectStatement::parse(query);
+    auto statement = getCachedSelectStatement(query);
+    const SelectStatement & stm = *statement;
     ExcCheck(!stm.from, "FROM clauses are not allowed on dataset queries");
     ExcAssert(stm.where && stm.having && stm.rowName);
 
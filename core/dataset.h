@@ -372,6 +372,49 @@ private:
 
 
 
+/*****************************************************************************/
+/* COLUMN BATCH                                                              */
+/*****************************************************************************/
+
+/** The values of a subset of the columns of a dataset over a contiguous
+    range of its rows, as produced by Dataset::forEachColumnBatch().  Rows
+    are in the same order as for MatrixView::getRowNames().
+*/
+
+struct ColumnBatch {
+    ColumnBatch()
+        : rowIndex(0)
+    {
+    }
+
+    /// Slice of a single column over the rows in the batch
+    struct Column {
+        /// Latest value of the column for each row; empty means null
+        std::vector<CellValue> values;
+
+        /// Timestamp of each value, or negative infinity if the row has
+        /// no value for the column
+        std::vector<Date> timestamps;
+    };
+
+    /// Index of the first row of the batch in the order of getRowNames()
+    size_t rowIndex;
+
+    /// Name of each row in the batch
+    std::vector<RowName> rowNames;
+
+    /// One entry per requested column, in the order they were requested
+    std::vector<Column> columns;
+
+    size_t size() const
+    {
+        return rowNames.size();
+    }
+};
+
+typedef std::function<bool (ColumnBatch & batch)> OnColumnBatch;
+
+
 /*****************************************************************************/
 /* DATASET                                                                   */
 /*****************************************************************************/
@@ -510,6 +553,18 @@ struct Dataset: public MldbEntity {
     */
     virtual ExpressionValue getRowExpr(const RowName & row) const;
 
+    /** Return a row as an expression value, with just the given columns,
+        which must be sorted.  This allows a query that reads a few columns
+        of a wide dataset to avoid reconstructing each row in full.
+
+        The default implementation filters the row from the matrix view's
+        getRow() function.  Datasets that can read a column of a row
+        without reading the others should override it.
+    */
+    virtual ExpressionValue
+    getRowColumnsExpr(const RowName & row,
+                      const std::vector<ColumnName> & columnNames) const;
+
 
     /** Commit changes to the database.  Default is a no-op.
 
@@ -533,6 +588,24 @@ struct Dataset: public MldbEntity {
                     ssize_t limit,
                     Utf8String alias = "") const;
 
+    /** Select from the database, passing each row of the output to onRow
+        in the same order as queryStructured() would return them, rather
+        than accumulating them.  Stops and returns false as soon as onRow
+        returns false.
+    */
+    virtual bool
+    queryStructuredStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                             const SelectExpression & select,
+                             const WhenExpression & when,
+                             const SqlExpression & where,
+                             const OrderByExpression & orderBy,
+                             const TupleExpression & groupBy,
+                             const std::shared_ptr<SqlExpression> having,
+                             const std::shared_ptr<SqlExpression> rowName,
+                             ssize_t offset,
+                             ssize_t limit,
+                             Utf8String alias = "") const;
+
     /** Select from the database. */
     virtual bool
     queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
@@ -649,6 +722,26 @@ struct Dataset: public MldbEntity {
     */
     virtual void getChildAliases(std::vector<Utf8String>&) const {};
 
+    /** Scan the rows from start to start + limit (all of them if limit is
+        -1) in the order of getRowNames(), passing the values of just the
+        given columns to onBatch in column-oriented batches.  This allows
+        a scan that touches a few columns of a wide dataset to avoid
+        reconstructing each row in full.
+
+        Batches don't overlap and may be passed to onBatch from multiple
+        threads at once, in any order; the rowIndex of each batch tells
+        where it belongs.  If onBatch returns false, the scan stops as
+        soon as possible and false is returned.
+
+        The default implementation reads each row with the matrix view.
+        Datasets with columnar storage should override it.
+    */
+    virtual bool
+    forEachColumnBatch(const std::vector<ColumnName> & columnNames,
+                       ssize_t start,
+                       ssize_t limit,
+                       const OnColumnBatch & onBatch) const;
+
     virtual std::shared_ptr<MatrixView> getMatrixView() const = 0;
     virtual std::shared_ptr<ColumnIndex> getColumnIndex() const = 0;
     virtual std::shared_ptr<RowStream> getRowStream() const { return std::shared_ptr<RowStream>(); } //optional but recommanded for performance
@@ -15,6 +15,7 @@
 #include "mldb/types/map_description.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/rest_request_router.h"
+#include "mldb/base/parallel.h"
 
 
 using namespace std;
@@ -84,6 +85,14 @@ apply(const ExpressionValue & input) const
     return function->apply(*this, input);
 }
 
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    ExcAssert(function);
+    return function->applyBatch(*this, inputs);
+}
+
 
 /*****************************************************************************/
 /* FUNCTION                                                                  */
@@ -127,6 +136,35 @@ bind(SqlBindingScope & outerContext,
     return result;
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & contexts) const
+{
+    std::vector<ExpressionValue> result;
+    result.reserve(contexts.size());
+    for (auto & c: contexts)
+        result.emplace_back(apply(applier, c));
+    return result;
+}
+
+std::vector<ExpressionValue>
+Function::
+applyBatchParallel(const FunctionApplier & applier,
+                   const std::vector<ExpressionValue> & contexts) const
+{
+    std::vector<ExpressionValue> result(contexts.size());
+
+    auto doRow = [&] (size_t i)
+        {
+            result[i] = apply(applier, contexts[i]);
+        };
+
+    parallelMap(0, contexts.size(), doRow);
+
+    return result;
+}
+
 FunctionInfo
 Function::
 getFunctionInfo() const
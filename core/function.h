@@ -95,6 +95,10 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to each of the given contexts
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
 };
 
 
@@ -167,6 +171,14 @@ struct Function: public MldbEntity {
     */
     ExpressionValue call(const ExpressionValue & input) const;
 
+    /** Call an unbound function with each of the given inputs.  The
+        function is bound once for the whole batch, which is much more
+        efficient than calling call() once per input.  All inputs should
+        have the same structure.
+    */
+    std::vector<ExpressionValue>
+    callBatch(const std::vector<ExpressionValue> & inputs) const;
+
     /** Method to overwrite to handle a request.  By default, the function
         will return that it can't handle any requests.  Used to expose
         function-specific functionality.
@@ -184,6 +196,23 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Used by the FunctionApplier to apply the function to a batch of
+        inputs, returning one output per input.  Functions may override
+        to share work over the batch (feature extraction, model
+        evaluation) or to apply it in parallel.  The default calls apply()
+        on each input in turn.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const;
+
+    /** Apply the function to a batch of inputs in parallel.  Functions
+        whose apply() is thread safe can implement applyBatch() with this.
+    */
+    std::vector<ExpressionValue>
+    applyBatchParallel(const FunctionApplier & applier,
+                       const std::vector<ExpressionValue> & contexts) const;
+
     friend class FunctionApplier;
 };
 
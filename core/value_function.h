@@ -10,6 +10,7 @@
 #pragma once
 
 #include "function.h"
+#include "mldb/base/exc_assert.h"
 
 namespace Datacratic {
 namespace MLDB {
@@ -151,6 +152,19 @@ struct ValueFunctionT: public ValueFunction {
     {
         return call(std::move(input));
     }
+
+    /** Batch interface, for functions that can share work over many
+        inputs.  The default calls applyT() on each input in turn.
+    */
+    virtual std::vector<Output> applyBatchT(const ApplierT & applier,
+                                            std::vector<Input> inputs) const
+    {
+        std::vector<Output> result;
+        result.reserve(inputs.size());
+        for (auto & i: inputs)
+            result.emplace_back(applyT(applier, std::move(i)));
+        return result;
+    }
     
     virtual std::unique_ptr<Applier>
     bindT(SqlBindingScope & outerContext,
@@ -190,6 +204,30 @@ private:
         return toOutput(&out);
     }
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const override
+    {
+        const auto * downcast
+            = dynamic_cast<const FunctionApplierT<Input, Output> *>(&applier);
+        if (!downcast) {
+            throw HttpReturnException(500, "Couldn't downcast applier");
+        }
+
+        std::vector<Input> in(contexts.size());
+        for (size_t i = 0;  i < contexts.size();  ++i)
+            fromInput(&in[i], contexts[i]);
+
+        std::vector<Output> out = applyBatchT(*downcast, std::move(in));
+        ExcAssertEqual(out.size(), contexts.size());
+
+        std::vector<ExpressionValue> result;
+        result.reserve(out.size());
+        for (auto & o: out)
+            result.emplace_back(toOutput(&o));
+        return result;
+    }
+
     template<typename InputT, typename OutputT>
     friend class FunctionApplierT;
 };
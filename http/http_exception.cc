@@ -7,6 +7,7 @@
 
 #include "http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/cancellation.h"
 
 
 using namespace std;
@@ -19,6 +20,10 @@ void rethrowHttpException(int httpCode, const Utf8String & message, Any details)
     JML_TRACE_EXCEPTIONS(false);
     try {
         std::rethrow_exception(std::current_exception());
+    } catch (const CancellationException &) {
+        // Cancellation isn't an error in what was being done; pass it
+        // through untouched
+        throw;
     } catch (const HttpReturnException & http) {
         Json::Value details2 = jsonEncode(details);
         details2["context"]["details"] = jsonEncode(http.details);
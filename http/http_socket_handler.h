@@ -41,13 +41,15 @@ struct HttpSocketHandler : public TcpSocketHandler {
     /* Callback used to report the end of a response. */
     virtual void onDone(bool requireClose) = 0;
 
-private:
+protected:
     /* TcpSocketHandler interface */
-    virtual void bootstrap();
-    virtual void onReceivedData(const char * buffer, size_t bufferSize);
     virtual void onReceiveError(const boost::system::error_code & ec,
                                 size_t bufferSize);
 
+private:
+    virtual void bootstrap();
+    virtual void onReceivedData(const char * buffer, size_t bufferSize);
+
     HttpRequestParser parser_;
 };
 
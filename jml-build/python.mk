@@ -4,6 +4,7 @@ PYTHON_VERSION_DETECTED := $(shell $(JML_BUILD)/detect_python.sh)
 PYTHON_VERSION ?= $(PYTHON_VERSION_DETECTED)
 
 PYTHON_INCLUDE_PATH ?= $(VIRTUALENV)/include/python$(PYTHON_VERSION)
+NUMPY_INCLUDE_PATH ?= $(VIRTUALENV)/lib/python$(PYTHON_VERSION)/site-packages/numpy/core/include
 PYTHON ?= python$(PYTHON_VERSION)
 PIP ?= pip
 PYFLAKES ?= true
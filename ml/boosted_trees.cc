@@ -0,0 +1,646 @@
+/** boosted_trees.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Gradient boosted decision trees for binary classification.
+*/
+
+#include "boosted_trees.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/arch/timers.h"
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Number of rows handled by each task when working over all rows
+constexpr size_t ROWS_PER_BLOCK = 65536;
+
+/// Number of features handled by each task when building a histogram
+constexpr size_t FEATURES_PER_GROUP = 16;
+
+/// Sum of the gradient and hessian of the loss over a set of rows
+struct HistogramBin {
+    HistogramBin()
+        : grad(0), hess(0), count(0)
+    {
+    }
+
+    double grad;
+    double hess;
+    uint64_t count;
+
+    void add(float g, float h)
+    {
+        grad += g;
+        hess += h;
+        count += 1;
+    }
+
+    HistogramBin & operator += (const HistogramBin & other)
+    {
+        grad += other.grad;
+        hess += other.hess;
+        count += other.count;
+        return *this;
+    }
+
+    HistogramBin & operator -= (const HistogramBin & other)
+    {
+        grad -= other.grad;
+        hess -= other.hess;
+        count -= other.count;
+        return *this;
+    }
+
+    HistogramBin operator - (const HistogramBin & other) const
+    {
+        HistogramBin result = *this;
+        result -= other;
+        return result;
+    }
+};
+
+/// Best way found to split a leaf
+struct SplitCandidate {
+    SplitCandidate()
+        : feature(-1), bucket(-1), nullsLeft(false), gain(0)
+    {
+    }
+
+    int feature;        ///< Index into PartitionData::features; -1 for none
+    int bucket;         ///< Bucket (and below, if ordinal) that goes left
+    bool nullsLeft;     ///< Whether rows where the feature is null go left
+    double gain;        ///< Reduction in the loss
+    HistogramBin left;  ///< Totals for the rows that go left
+};
+
+/** Node of a tree being trained.  Leaves have a feature of -1.  Rows for
+    which the split is true go left.
+*/
+struct TrainingNode {
+    TrainingNode()
+        : feature(-1), bucket(-1), ordinal(true), nullsLeft(false),
+          left(-1), right(-1), gain(0)
+    {
+    }
+
+    int feature;
+    int bucket;
+    bool ordinal;
+    bool nullsLeft;
+    int left;
+    int right;
+    double gain;
+    HistogramBin total;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* BOOSTED TREES TRAINER                                                     */
+/*****************************************************************************/
+
+struct BoostedTreesTrainer::Impl {
+
+    Impl(const PartitionData & data, const BoostedTreesParams & params)
+        : data(data), params(params), numBins(0),
+          grad(data.rows.size()), hess(data.rows.size())
+    {
+        for (size_t i = 0;  i < data.features.size();  ++i) {
+            if (!data.features[i].active)
+                continue;
+            features.push_back(i);
+            offsets.push_back(numBins);
+            numBins += data.features[i].buckets.numBuckets;
+        }
+        offsets.push_back(numBins);
+    }
+
+    const PartitionData & data;
+    const BoostedTreesParams & params;
+
+    /// Features that can be split on
+    std::vector<int> features;
+
+    /// Where the bins of each of those features start in a histogram
+    std::vector<size_t> offsets;
+
+    /// Total number of bins in a histogram
+    size_t numBins;
+
+    /// Gradient and hessian of the loss for each row of data
+    std::vector<float> grad, hess;
+
+    /// Output of a leaf holding the given rows
+    double leafValue(const HistogramBin & total) const
+    {
+        return -params.learningRate * total.grad
+            / (total.hess + params.l2Regularization);
+    }
+
+    /// How much a leaf with the given rows reduces the loss, up to a factor
+    double score(const HistogramBin & total) const
+    {
+        return total.grad * total.grad
+            / (total.hess + params.l2Regularization);
+    }
+
+    /// Whether bucket 0 of the feature holds the rows where it's null
+    bool hasNulls(int feature) const
+    {
+        return data.features[feature].info->bucketDescriptions.hasNulls;
+    }
+
+    bool goesLeft(int feature, int bucket, bool ordinal, bool nullsLeft,
+                  size_t row) const
+    {
+        uint32_t b = data.features[feature].buckets[data.rows[row].exampleNum];
+        if (b == 0 && hasNulls(feature))
+            return nullsLeft;
+        return ordinal ? (int)b <= bucket : (int)b == bucket;
+    }
+
+    /** Set grad and hess from the predictions, and return the loss. */
+    double updateGradients(const std::vector<double> & predictions)
+    {
+        size_t numRows = data.rows.size();
+        size_t numBlocks = (numRows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+        std::vector<double> blockLoss(numBlocks);
+
+        auto doBlock = [&] (size_t block)
+            {
+                size_t begin = block * ROWS_PER_BLOCK;
+                size_t end = std::min(begin + ROWS_PER_BLOCK, numRows);
+                double loss = 0;
+                for (size_t i = begin;  i < end;  ++i) {
+                    const PartitionData::Row & row = data.rows[i];
+                    double p = 1.0 / (1.0 + exp(-predictions[i]));
+                    p = std::min(std::max(p, 1e-15), 1.0 - 1e-15);
+                    grad[i] = row.weight * (p - row.label);
+                    hess[i] = row.weight * p * (1.0 - p);
+                    loss -= row.weight * log(row.label ? p : 1.0 - p);
+                }
+                blockLoss[block] = loss;
+            };
+
+        parallelMap(0, numBlocks, doBlock);
+
+        double loss = 0;
+        for (double l: blockLoss)
+            loss += l;
+        return loss;
+    }
+
+    /** Fill in the histogram of the given rows. */
+    void buildHistogram(const uint32_t * rows, size_t numRows,
+                        HistogramBin * out) const
+    {
+        size_t numGroups
+            = (features.size() + FEATURES_PER_GROUP - 1) / FEATURES_PER_GROUP;
+        size_t numBlocks
+            = std::min<size_t>((numRows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK,
+                               numCpus());
+
+        std::fill(out, out + numBins, HistogramBin());
+
+        // Add the rows in [begin, end) to the bins of a group of features
+        // in hist, which is laid out like a whole histogram
+        auto accumulate = [&] (size_t group, size_t begin, size_t end,
+                               HistogramBin * hist)
+            {
+                size_t first = group * FEATURES_PER_GROUP;
+                size_t last = std::min(first + FEATURES_PER_GROUP,
+                                       features.size());
+                for (size_t f = first;  f < last;  ++f) {
+                    const BucketList & buckets
+                        = data.features[features[f]].buckets;
+                    HistogramBin * bins = hist + offsets[f];
+                    for (size_t i = begin;  i < end;  ++i) {
+                        uint32_t row = rows[i];
+                        bins[buckets[data.rows[row].exampleNum]]
+                            .add(grad[row], hess[row]);
+                    }
+                }
+            };
+
+        if (numBlocks <= 1) {
+            auto doGroup = [&] (size_t group)
+                {
+                    accumulate(group, 0, numRows, out);
+                };
+            parallelMap(0, numGroups, doGroup);
+            return;
+        }
+
+        // Each block of rows gets its own histogram, and then they're
+        // added together.
+        std::vector<HistogramBin> partial(numBlocks * numBins);
+
+        auto doTask = [&] (size_t task)
+            {
+                size_t block = task / numGroups;
+                size_t group = task % numGroups;
+                accumulate(group,
+                           numRows * block / numBlocks,
+                           numRows * (block + 1) / numBlocks,
+                           partial.data() + block * numBins);
+            };
+
+        parallelMap(0, numBlocks * numGroups, doTask);
+
+        auto doGroup = [&] (size_t group)
+            {
+                size_t first = offsets[group * FEATURES_PER_GROUP];
+                size_t last = offsets[std::min((group + 1) * FEATURES_PER_GROUP,
+                                               features.size())];
+                for (size_t block = 0;  block < numBlocks;  ++block) {
+                    const HistogramBin * bins = partial.data() + block * numBins;
+                    for (size_t i = first;  i < last;  ++i)
+                        out[i] += bins[i];
+                }
+            };
+
+        parallelMap(0, numGroups, doGroup);
+    }
+
+    /** Find the best split of a leaf with the given histogram and totals. */
+    SplitCandidate findBestSplit(const HistogramBin * histogram,
+                                 const HistogramBin & total) const
+    {
+        std::vector<SplitCandidate> best(features.size());
+        double parentScore = score(total);
+
+        auto tryLeft = [&] (SplitCandidate & candidate, int f, int bucket,
+                            bool nullsLeft, const HistogramBin & left)
+            {
+                HistogramBin right = total - left;
+                if (left.count < params.minLeafExamples
+                    || right.count < params.minLeafExamples
+                    || left.hess < params.minLeafHessian
+                    || right.hess < params.minLeafHessian)
+                    return;
+
+                double gain = score(left) + score(right) - parentScore;
+                if (gain > candidate.gain) {
+                    candidate.feature = features[f];
+                    candidate.bucket = bucket;
+                    candidate.nullsLeft = nullsLeft;
+                    candidate.gain = gain;
+                    candidate.left = left;
+                }
+            };
+
+        auto doFeature = [&] (size_t f)
+            {
+                const HistogramBin * bins = histogram + offsets[f];
+                int numBuckets = offsets[f + 1] - offsets[f];
+
+                // Nulls aren't ordered with respect to the other values,
+                // so they are never split on.  Instead, each split of the
+                // other values is tried with the nulls going either way.
+                int first = 0;
+                HistogramBin nulls;
+                if (hasNulls(features[f])) {
+                    nulls = bins[0];
+                    first = 1;
+                }
+
+                auto trySplit = [&] (int j, const HistogramBin & left)
+                    {
+                        tryLeft(best[f], f, j, false, left);
+                        if (nulls.count > 0) {
+                            HistogramBin withNulls = left;
+                            withNulls += nulls;
+                            tryLeft(best[f], f, j, true, withNulls);
+                        }
+                    };
+
+                if (data.features[features[f]].ordinal) {
+                    HistogramBin left;
+                    for (int j = first;  j < numBuckets - 1;  ++j) {
+                        if (bins[j].count == 0)
+                            continue;
+                        left += bins[j];
+                        trySplit(j, left);
+                    }
+                }
+                else {
+                    for (int j = first;  j < numBuckets;  ++j) {
+                        if (bins[j].count == 0)
+                            continue;
+                        trySplit(j, bins[j]);
+                    }
+                }
+            };
+
+        parallelMap(0, features.size(), doFeature);
+
+        SplitCandidate result;
+        for (auto & candidate: best) {
+            if (candidate.gain > result.gain)
+                result = candidate;
+        }
+        return result;
+    }
+
+    /** Grow a tree over the given rows, which are reordered so that those
+        of each leaf are together.
+    */
+    std::vector<TrainingNode> trainTree(std::vector<uint32_t> & rows) const
+    {
+        struct Leaf {
+            int node;
+            size_t begin;
+            size_t end;
+            int depth;
+            std::vector<HistogramBin> histogram;
+            SplitCandidate best;
+        };
+
+        std::vector<TrainingNode> nodes(1);
+        for (uint32_t row: rows)
+            nodes[0].total.add(grad[row], hess[row]);
+
+        std::vector<Leaf> leaves(1);
+        leaves[0].node = 0;
+        leaves[0].begin = 0;
+        leaves[0].end = rows.size();
+        leaves[0].depth = 0;
+
+        if (params.maxLeaves < 2 || params.maxDepth < 1)
+            return nodes;
+
+        leaves[0].histogram.resize(numBins);
+        buildHistogram(rows.data(), rows.size(), leaves[0].histogram.data());
+        leaves[0].best = findBestSplit(leaves[0].histogram.data(),
+                                       nodes[0].total);
+
+        while (leaves.size() < params.maxLeaves) {
+            // Split the leaf that reduces the loss the most
+            int toSplit = -1;
+            for (size_t i = 0;  i < leaves.size();  ++i) {
+                if (leaves[i].best.feature == -1)
+                    continue;
+                if (toSplit == -1
+                    || leaves[i].best.gain > leaves[toSplit].best.gain)
+                    toSplit = i;
+            }
+
+            if (toSplit == -1)
+                break;
+
+            Leaf parent = std::move(leaves[toSplit]);
+            const SplitCandidate & split = parent.best;
+            bool ordinal = data.features[split.feature].ordinal;
+
+            auto mid = std::stable_partition
+                (rows.begin() + parent.begin, rows.begin() + parent.end,
+                 [&] (uint32_t row)
+                 {
+                     return goesLeft(split.feature, split.bucket, ordinal,
+                                     split.nullsLeft, row);
+                 });
+            size_t numLeft = mid - (rows.begin() + parent.begin);
+            ExcAssertEqual(numLeft, split.left.count);
+
+            int leftNode = nodes.size();
+            int rightNode = leftNode + 1;
+            nodes.resize(nodes.size() + 2);
+
+            TrainingNode & node = nodes[parent.node];
+            node.feature = split.feature;
+            node.bucket = split.bucket;
+            node.ordinal = ordinal;
+            node.nullsLeft = split.nullsLeft;
+            node.left = leftNode;
+            node.right = rightNode;
+            node.gain = split.gain;
+            nodes[leftNode].total = split.left;
+            nodes[rightNode].total = node.total - split.left;
+
+            Leaf left, right;
+            left.node = leftNode;
+            left.begin = parent.begin;
+            left.end = parent.begin + numLeft;
+            right.node = rightNode;
+            right.begin = parent.begin + numLeft;
+            right.end = parent.end;
+            left.depth = right.depth = parent.depth + 1;
+
+            // Only leaves that may be split again need a histogram
+            bool canSplitAgain = left.depth < params.maxDepth
+                && leaves.size() + 1 < params.maxLeaves;
+
+            if (canSplitAgain) {
+                bool leftSmaller = left.end - left.begin
+                    < right.end - right.begin;
+                Leaf & smaller = leftSmaller ? left : right;
+                Leaf & larger = leftSmaller ? right : left;
+
+                smaller.histogram.resize(numBins);
+                buildHistogram(rows.data() + smaller.begin,
+                               smaller.end - smaller.begin,
+                               smaller.histogram.data());
+
+                larger.histogram = std::move(parent.histogram);
+                for (size_t i = 0;  i < numBins;  ++i)
+                    larger.histogram[i] -= smaller.histogram[i];
+
+                left.best = findBestSplit(left.histogram.data(),
+                                          nodes[leftNode].total);
+                right.best = findBestSplit(right.histogram.data(),
+                                           nodes[rightNode].total);
+            }
+
+            leaves[toSplit] = std::move(left);
+            leaves.emplace_back(std::move(right));
+        }
+
+        return nodes;
+    }
+
+    /** Return the output of the tree for the given row. */
+    double predict(const std::vector<TrainingNode> & nodes, size_t row) const
+    {
+        int n = 0;
+        while (nodes[n].feature != -1) {
+            const TrainingNode & node = nodes[n];
+            n = goesLeft(node.feature, node.bucket, node.ordinal,
+                         node.nullsLeft, row)
+                ? node.left : node.right;
+        }
+        return leafValue(nodes[n].total);
+    }
+
+    static void fillinBase(ML::Tree::Base * base, const HistogramBin & total,
+                           float value)
+    {
+        base->examples = total.count;
+        base->pred = { -value, value };
+    }
+
+    /** Convert the given node of a tree into the jml representation. */
+    ML::Tree::Ptr toTree(const std::vector<TrainingNode> & nodes, int n,
+                         ML::Tree & tree) const
+    {
+        const TrainingNode & node = nodes[n];
+        float value = leafValue(node.total);
+
+        if (node.feature == -1) {
+            ML::Tree::Leaf * leaf = tree.new_leaf();
+            fillinBase(leaf, node.total, value);
+            return leaf;
+        }
+
+        const PartitionData::Feature & feature = data.features[node.feature];
+
+        float splitVal = node.bucket;
+        if (node.ordinal) {
+            auto splitCell = feature.info->bucketDescriptions
+                .getSplit(node.bucket);
+            if (splitCell.isNumeric())
+                splitVal = splitCell.toDouble();
+        }
+
+        ML::Tree::Node * result = tree.new_node();
+        result->split = ML::Split(data.fs->getFeature(feature.info->columnName),
+                                  splitVal,
+                                  node.ordinal
+                                  ? ML::Split::LESS : ML::Split::EQUAL);
+        result->child_true = toTree(nodes, node.left, tree);
+        result->child_false = toTree(nodes, node.right, tree);
+
+        if (hasNulls(node.feature)) {
+            // Rows with a missing value get the output of the side that
+            // the nulls went to in training.  A subtree can't be shared,
+            // and copying it at every split on a feature with nulls would
+            // make the exported tree exponential in its depth, so they
+            // stop there rather than being split any further.
+            const TrainingNode & nullSide
+                = nodes[node.nullsLeft ? node.left : node.right];
+            ML::Tree::Leaf * missing = tree.new_leaf();
+            fillinBase(missing, nullSide.total, leafValue(nullSide.total));
+            result->child_missing = missing;
+        }
+        else {
+            // The feature was never null in training, so rows with a
+            // missing value get the output of this node, as if the tree
+            // stopped here
+            ML::Tree::Leaf * missing = tree.new_leaf();
+            fillinBase(missing, HistogramBin(), value);
+            result->child_missing = missing;
+        }
+
+        result->z = node.gain;
+        fillinBase(result, node.total, value);
+        return result;
+    }
+};
+
+BoostedTreesTrainer::
+BoostedTreesTrainer(const PartitionData & data,
+                    const BoostedTreesParams & params)
+    : data(data), params(params)
+{
+}
+
+std::shared_ptr<ML::Committee>
+BoostedTreesTrainer::
+train(std::shared_ptr<const DatasetFeatureSpace> outputFs,
+      const std::function<bool (int round, double loss)> & onRound) const
+{
+    Impl impl(data, params);
+    size_t numRows = data.rows.size();
+
+    // Start from the log odds of the label
+    double wTrue = 0, wFalse = 0;
+    for (auto & r: data.rows)
+        (r.label ? wTrue : wFalse) += r.weight;
+
+    if (wTrue == 0 || wFalse == 0)
+        throw HttpReturnException(400, "Training boosted trees requires "
+                                  "examples with both a true and a false label");
+
+    double bias = log(wTrue / wFalse);
+    std::vector<double> predictions(numRows, bias);
+
+    auto result = std::make_shared<ML::Committee>(outputFs, labelFeature);
+    result->encoding = ML::OE_PM_INF;
+
+    std::vector<uint32_t> rows;
+    rows.reserve(numRows);
+
+    for (int round = 0;  ;  ++round) {
+        ML::Timer timer;
+
+        double loss = impl.updateGradients(predictions);
+
+        if (params.verbose)
+            cerr << "round " << round << " loss " << loss / numRows << endl;
+
+        if (onRound && !onRound(round, loss))
+            break;
+        if (round == params.numRounds)
+            break;
+
+        rows.clear();
+        if (params.rowSamplingProp < 1.0) {
+            boost::mt19937 rng(round + 1);
+            boost::uniform_01<boost::mt19937> sample(rng);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                if (sample() < params.rowSamplingProp)
+                    rows.push_back(i);
+            }
+        }
+        else {
+            for (size_t i = 0;  i < numRows;  ++i)
+                rows.push_back(i);
+        }
+
+        std::vector<TrainingNode> nodes = impl.trainTree(rows);
+
+        // Rows that weren't sampled also need their predictions updated,
+        // so we run them all through the tree.
+        auto doBlock = [&] (size_t begin, size_t end)
+            {
+                for (size_t i = begin;  i < end;  ++i)
+                    predictions[i] += impl.predict(nodes, i);
+            };
+
+        parallelMapChunked(0, numRows, ROWS_PER_BLOCK, doBlock);
+
+        ML::Tree tree;
+        tree.root = impl.toTree(nodes, 0, tree);
+
+        auto dtree = std::make_shared<ML::Decision_Tree>(outputFs, labelFeature);
+        dtree->tree = std::move(tree);
+        dtree->encoding = ML::OE_PM_INF;
+        result->add(dtree, 1.0);
+
+        if (params.verbose)
+            cerr << "round " << round << " tree has " << (nodes.size() + 1) / 2
+                 << " leaves and took " << timer.elapsed() << endl;
+    }
+
+    // Set after the trees are added, as adding the first one resets it
+    result->bias = { -(float)bias, (float)bias };
+
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
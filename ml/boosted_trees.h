@@ -0,0 +1,90 @@
+/** boosted_trees.h                                                -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Gradient boosted decision trees for binary classification, trained on
+    the same bucketed data as the random forest.
+*/
+
+#pragma once
+
+#include "mldb/ml/randomforest.h"
+#include <functional>
+
+namespace ML {
+class Committee;
+} // namespace ML
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BOOSTED TREES PARAMETERS                                                  */
+/*****************************************************************************/
+
+struct BoostedTreesParams {
+    BoostedTreesParams()
+        : numRounds(100), learningRate(0.1), maxLeaves(31), maxDepth(12),
+          minLeafExamples(20), minLeafHessian(1e-3), l2Regularization(1.0),
+          rowSamplingProp(1.0), verbose(false)
+    {
+    }
+
+    int numRounds;            ///< Number of trees to train
+    double learningRate;      ///< Shrinkage applied to each tree's outputs
+    int maxLeaves;            ///< Maximum number of leaves per tree
+    int maxDepth;             ///< Maximum depth of each tree
+    int minLeafExamples;      ///< Minimum number of examples in a leaf
+    double minLeafHessian;    ///< Minimum sum of the hessian in a leaf
+    double l2Regularization;  ///< L2 penalty on the leaf outputs
+    float rowSamplingProp;    ///< Proportion of rows used for each tree
+    bool verbose;
+};
+
+
+/*****************************************************************************/
+/* BOOSTED TREES TRAINER                                                     */
+/*****************************************************************************/
+
+/** Trains gradient boosted trees with the logistic loss on the rows and
+    bucketed features of a PartitionData.
+
+    Each tree is grown leaf-wise: the leaf whose best split reduces the
+    loss the most is split next, until there are maxLeaves of them.  The
+    best split of a leaf is found from a histogram holding the sum of the
+    gradient and hessian of the loss for each bucket of each feature.  When
+    a leaf is split, only the histogram of the child with fewer rows is
+    built from its rows; that of the other child is the parent's minus
+    that one.  Histograms are built in parallel over blocks of rows and
+    groups of features.
+*/
+
+struct BoostedTreesTrainer {
+
+    BoostedTreesTrainer(const PartitionData & data,
+                        const BoostedTreesParams & params);
+
+    /** Train the trees.  The result predicts the log odds of the label
+        being true; each tree is a Decision_Tree whose leaves predict
+        {-v, v} for an output of v, and the committee's bias holds the
+        log odds of the label over the whole training set.  The trees
+        use outputFs as their feature space.
+
+        onRound is called before each tree is trained, and once more after
+        the last one, with the number of trees so far and their total loss
+        on the training set.  It may return false to stop training there.
+    */
+    std::shared_ptr<ML::Committee>
+    train(std::shared_ptr<const DatasetFeatureSpace> outputFs,
+          const std::function<bool (int round, double loss)> & onRound
+              = nullptr) const;
+
+private:
+    struct Impl;
+
+    const PartitionData & data;
+    BoostedTreesParams params;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
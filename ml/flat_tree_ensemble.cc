@@ -0,0 +1,194 @@
+/** flat_tree_ensemble.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compiled form of a decision tree ensemble for fast scoring.
+*/
+
+#include "flat_tree_ensemble.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include <deque>
+#include <map>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Number of rows that predictBatch() runs through each tree at once
+constexpr size_t ROWS_PER_BLOCK = 64;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* FLAT TREE ENSEMBLE                                                        */
+/*****************************************************************************/
+
+constexpr uint8_t FlatTreeEnsemble::LEAF;
+
+struct FlatTreeEnsemble::Compiler {
+    Compiler(FlatTreeEnsemble & result,
+             const std::vector<ML::Feature> & features)
+        : result(result)
+    {
+        for (unsigned i = 0;  i < features.size();  ++i)
+            featureIndexes.insert(std::make_pair(features[i], i));
+    }
+
+    FlatTreeEnsemble & result;
+    std::map<ML::Feature, uint32_t> featureIndexes;
+
+    /** Add the given classifier, whose outputs are multiplied by weight.
+        Returns false if it can't be compiled.
+    */
+    bool add(const ML::Classifier_Impl & classifier, double weight)
+    {
+        if (auto committee = dynamic_cast<const ML::Committee *>(&classifier)) {
+            if (committee->bias.size() != result.numLabels)
+                return false;
+            for (unsigned i = 0;  i < result.numLabels;  ++i)
+                result.bias[i] += weight * committee->bias[i];
+
+            for (unsigned i = 0;  i < committee->classifiers.size();  ++i) {
+                if (committee->weights[i] == 0.0)
+                    continue;
+                if (!add(*committee->classifiers[i],
+                         weight * committee->weights[i]))
+                    return false;
+            }
+            return true;
+        }
+
+        if (auto tree = dynamic_cast<const ML::Decision_Tree *>(&classifier)) {
+            // An empty tree adds nothing
+            if (tree->tree.root)
+                return addTree(tree->tree.root, weight);
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Add a tree, laying its nodes out breadth first. */
+    bool addTree(const ML::Tree::Ptr & root, double weight)
+    {
+        result.roots.push_back(newNode());
+
+        std::deque<std::pair<ML::Tree::Ptr, uint32_t> > toDo;
+        toDo.emplace_back(root, result.roots.back());
+
+        while (!toDo.empty()) {
+            ML::Tree::Ptr ptr = toDo.front().first;
+            uint32_t node = toDo.front().second;
+            toDo.pop_front();
+
+            // A null child contributes nothing, like an all-zero leaf
+            if (!ptr || !ptr.node()) {
+                result.ops[node] = LEAF;
+                result.children[node] = result.leafValues.size();
+                if (ptr) {
+                    const ML::Label_Dist & pred = ptr.leaf()->pred;
+                    if (pred.size() != result.numLabels)
+                        return false;
+                    for (float p: pred)
+                        result.leafValues.push_back(weight * p);
+                }
+                else {
+                    result.leafValues.resize(result.leafValues.size()
+                                             + result.numLabels);
+                }
+                continue;
+            }
+
+            const ML::Tree::Node & n = *ptr.node();
+            auto it = featureIndexes.find(n.split.feature());
+            if (it == featureIndexes.end())
+                return false;
+
+            result.ops[node] = n.split.op();
+            result.featureIndexes[node] = it->second;
+            result.splitValues[node] = n.split.split_val();
+
+            // Children are in the order of the values of Split::apply()
+            uint32_t first = newNode();
+            newNode();
+            newNode();
+            result.children[node] = first;
+            toDo.emplace_back(n.child_false, first);
+            toDo.emplace_back(n.child_true, first + 1);
+            toDo.emplace_back(n.child_missing, first + 2);
+        }
+
+        return true;
+    }
+
+    uint32_t newNode()
+    {
+        uint32_t result = this->result.ops.size();
+        this->result.ops.push_back(LEAF);
+        this->result.featureIndexes.push_back(0);
+        this->result.splitValues.push_back(0);
+        this->result.children.push_back(0);
+        return result;
+    }
+};
+
+std::shared_ptr<const FlatTreeEnsemble>
+FlatTreeEnsemble::
+compile(const ML::Classifier_Impl & classifier,
+        const std::vector<ML::Feature> & features)
+{
+    auto result = std::make_shared<FlatTreeEnsemble>();
+    result->numLabels = classifier.label_count();
+    result->bias.resize(result->numLabels);
+
+    Compiler compiler(*result, features);
+    if (!compiler.add(classifier, 1.0))
+        return nullptr;
+
+    return result;
+}
+
+void
+FlatTreeEnsemble::
+predict(const float * features, double * scores) const
+{
+    std::copy(bias.begin(), bias.end(), scores);
+
+    for (uint32_t root: roots) {
+        const double * values = &leafValues[findLeaf(root, features)];
+        for (int i = 0;  i < numLabels;  ++i)
+            scores[i] += values[i];
+    }
+}
+
+void
+FlatTreeEnsemble::
+predictBatch(const float * features, size_t numRows,
+             size_t rowStride, double * scores) const
+{
+    for (size_t i = 0;  i < numRows;  ++i)
+        std::copy(bias.begin(), bias.end(), scores + i * numLabels);
+
+    for (size_t begin = 0;  begin < numRows;  begin += ROWS_PER_BLOCK) {
+        size_t end = std::min(begin + ROWS_PER_BLOCK, numRows);
+
+        for (uint32_t root: roots) {
+            for (size_t i = begin;  i < end;  ++i) {
+                const double * values
+                    = &leafValues[findLeaf(root, features + i * rowStride)];
+                double * rowScores = scores + i * numLabels;
+                for (int j = 0;  j < numLabels;  ++j)
+                    rowScores[j] += values[j];
+            }
+        }
+    }
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,128 @@
+/** flat_tree_ensemble.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compiled form of a decision tree ensemble for fast scoring.
+*/
+
+#pragma once
+
+#include "mldb/ml/jml/split.h"
+#include <memory>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+namespace ML {
+class Classifier_Impl;
+} // namespace ML
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FLAT TREE ENSEMBLE                                                        */
+/*****************************************************************************/
+
+/** A decision tree, or a committee (possibly nested) of decision trees, as
+    produced by bagging, the random forest or boosted trees procedures,
+    compiled into flat arrays for scoring dense feature vectors.
+
+    The nodes of all trees are held in parallel arrays, with each tree laid
+    out breadth first and the three children (false, true, missing) of a
+    node next to each other, so that walking a tree is a few array lookups
+    per level rather than pointer chasing through Tree::Node and Split
+    objects.  Committee weights are folded into the leaf outputs, so the
+    score for a row is the bias plus the sum of the leaf reached in each
+    tree, exactly as Committee and Decision_Tree compute it.
+*/
+
+struct FlatTreeEnsemble {
+
+    /** Compile the given classifier, for dense feature vectors whose
+        values are in the order of features.  Returns null if the
+        classifier is of a kind that can't be compiled.
+    */
+    static std::shared_ptr<const FlatTreeEnsemble>
+    compile(const ML::Classifier_Impl & classifier,
+            const std::vector<ML::Feature> & features);
+
+    /// Number of scores output for each row
+    int labelCount() const
+    {
+        return numLabels;
+    }
+
+    /// Number of trees in the ensemble
+    size_t numTrees() const
+    {
+        return roots.size();
+    }
+
+    /** Set scores[0..labelCount()) to the scores of the given dense row. */
+    void predict(const float * features, double * scores) const;
+
+    /** Score numRows dense rows, where row i starts at
+        features + i * rowStride, putting its scores at
+        scores + i * labelCount().  Blocks of rows are run through each tree
+        in turn, so that the tree stays in cache.
+    */
+    void predictBatch(const float * features, size_t numRows,
+                      size_t rowStride, double * scores) const;
+
+private:
+    struct Compiler;
+
+    /// Op of a leaf; others are those of ML::Split
+    static constexpr uint8_t LEAF = 255;
+
+    /** Return where the values start of the leaf that the given row
+        reaches from the given node.
+    */
+    uint32_t findLeaf(uint32_t node, const float * features) const
+    {
+        for (;;) {
+            uint8_t op = ops[node];
+            if (op == LEAF)
+                return children[node];
+
+            // Same as ML::Split::apply()
+            float val = features[featureIndexes[node]];
+            int branch;
+            if (std::isnan(val))
+                branch = ML::MISSING;
+            else if (op == ML::Split::LESS)
+                branch = val < splitValues[node];
+            else if (op == ML::Split::EQUAL)
+                branch = val == splitValues[node];
+            else branch = true;
+
+            node = children[node] + branch;
+        }
+    }
+
+    int numLabels;
+    std::vector<double> bias;
+
+    /// Node number of the root of each tree
+    std::vector<uint32_t> roots;
+
+    /// Per node: the ML::Split::Op of its split, or LEAF
+    std::vector<uint8_t> ops;
+
+    /// Per node: index in the dense vector of the feature it splits on
+    std::vector<uint32_t> featureIndexes;
+
+    /// Per node: value that it splits at
+    std::vector<float> splitValues;
+
+    /// Per node: its first child (the false one) or, for a leaf, where its
+    /// values start in leafValues
+    std::vector<uint32_t> children;
+
+    /// numLabels values per leaf, already multiplied by the tree's weight
+    std::vector<double> leafValues;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,384 @@
+/** hnsw_index.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Hierarchical navigable small world graph for approximate nearest
+    neighbour queries.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include <unordered_set>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Levels above this are never used, whatever the random draw
+constexpr int MAX_LEVEL = 32;
+
+/// Mix the bits of x (splitmix64 finalizer)
+uint64_t mixBits(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+constexpr int HnswIndex::NUM_NODE_MUTEXES;
+
+HnswIndex::
+HnswIndex(const HnswIndexParams & params)
+    : params_(params), entryPoint(-1), maxLevel(-1),
+      nodeMutexes(new std::mutex[NUM_NODE_MUTEXES])
+{
+    ExcAssertGreater(params_.m, 1);
+}
+
+HnswIndex::
+HnswIndex(const HnswIndex & other)
+    : params_(other.params_), nodes(other.nodes),
+      entryPoint(other.entryPoint), maxLevel(other.maxLevel),
+      nodeMutexes(new std::mutex[NUM_NODE_MUTEXES])
+{
+}
+
+HnswIndex::
+~HnswIndex()
+{
+}
+
+int
+HnswIndex::
+chooseLevel(int item) const
+{
+    // Levels are exponentially distributed with a scale of 1 / ln(m), so
+    // that each level has about m times fewer items than the one below.
+    // The draw only depends on the item, so inserting in parallel gives
+    // the same levels.
+    uint64_t bits = mixBits(params_.seed * 0x2545f4914f6cdd1dULL + item);
+    double u = ((bits >> 11) + 1) * (1.0 / 9007199254740992.0);
+    int level = -std::log(u) / std::log((double)params_.m);
+    return std::min(level, MAX_LEVEL);
+}
+
+void
+HnswIndex::
+insert(int end, const ItemDistance & distance)
+{
+    int begin = nodes.size();
+    if (end <= begin)
+        return;
+
+    nodes.resize(end);
+    for (int i = begin;  i < end;  ++i)
+        nodes[i].links.resize(chooseLevel(i) + 1);
+
+    if (entryPoint == -1) {
+        entryPoint = begin;
+        maxLevel = nodes[begin].links.size() - 1;
+        ++begin;
+    }
+
+    auto doItem = [&] (size_t i)
+        {
+            insertItem(i, distance);
+        };
+
+    parallelMap(begin, end, doItem);
+}
+
+void
+HnswIndex::
+insertItem(int item, const ItemDistance & distance)
+{
+    int level = nodes[item].links.size() - 1;
+
+    // A new top level needs to be held onto until the item is linked into
+    // the levels below, so that nobody enters the graph through it before
+    std::unique_lock<std::mutex> entryGuard(entryMutex);
+    int topLevel = maxLevel;
+    std::pair<float, int> closest(0.0f, entryPoint);
+    if (level <= topLevel)
+        entryGuard.unlock();
+
+    auto queryDistance = [&] (int other) -> float
+        {
+            return distance(item, other);
+        };
+
+    closest.first = queryDistance(closest.second);
+
+    for (int l = topLevel;  l > level;  --l)
+        closest = closestOnLevel(queryDistance, closest, l, true /* locked */);
+
+    for (int l = std::min(level, topLevel);  l >= 0;  --l) {
+        Neighbors candidates
+            = searchLevel(queryDistance, closest, params_.efConstruction,
+                          l, true /* locked */);
+        std::vector<int> links = selectLinks(candidates, params_.m, distance);
+
+        {
+            std::unique_lock<std::mutex> guard
+                (nodeMutexes[item % NUM_NODE_MUTEXES]);
+            nodes[item].links[l] = links;
+        }
+
+        // Link back from each neighbour, pruning its links if it has too
+        // many
+        for (int other: links) {
+            std::unique_lock<std::mutex> guard
+                (nodeMutexes[other % NUM_NODE_MUTEXES]);
+            std::vector<int> & otherLinks = nodes[other].links[l];
+            if (otherLinks.size() < maxLinks(l)) {
+                otherLinks.push_back(item);
+                continue;
+            }
+
+            Neighbors otherCandidates;
+            otherCandidates.reserve(otherLinks.size() + 1);
+            otherCandidates.emplace_back(distance(other, item), item);
+            for (int o: otherLinks)
+                otherCandidates.emplace_back(distance(other, o), o);
+            std::sort(otherCandidates.begin(), otherCandidates.end());
+
+            otherLinks = selectLinks(otherCandidates, maxLinks(l), distance);
+        }
+
+        closest = candidates.at(0);
+    }
+
+    if (level > topLevel) {
+        maxLevel = level;
+        entryPoint = item;
+    }
+}
+
+std::pair<float, int>
+HnswIndex::
+closestOnLevel(const QueryDistance & distance, std::pair<float, int> start,
+               int level, bool locked) const
+{
+    std::pair<float, int> result = start;
+    std::vector<int> links;
+
+    for (bool changed = true;  changed;) {
+        changed = false;
+
+        if (locked) {
+            std::unique_lock<std::mutex> guard
+                (nodeMutexes[result.second % NUM_NODE_MUTEXES]);
+            links = nodes[result.second].links[level];
+        }
+        else links = nodes[result.second].links[level];
+
+        for (int other: links) {
+            float dist = distance(other);
+            if (dist < result.first) {
+                result = { dist, other };
+                changed = true;
+            }
+        }
+    }
+
+    return result;
+}
+
+HnswIndex::Neighbors
+HnswIndex::
+searchLevel(const QueryDistance & distance, std::pair<float, int> start,
+            int ef, int level, bool locked) const
+{
+    // Closest first
+    std::priority_queue<std::pair<float, int>, Neighbors,
+                        std::greater<std::pair<float, int> > > toVisit;
+    // Furthest first
+    std::priority_queue<std::pair<float, int> > found;
+
+    std::unordered_set<int> visited;
+    visited.reserve(ef * params_.m * 4);
+
+    toVisit.push(start);
+    found.push(start);
+    visited.insert(start.second);
+
+    std::vector<int> scratch;
+
+    while (!toVisit.empty()) {
+        std::pair<float, int> current = toVisit.top();
+        if (current.first > found.top().first && found.size() >= ef)
+            break;
+        toVisit.pop();
+
+        const std::vector<int> * links = &nodes[current.second].links[level];
+        if (locked) {
+            std::unique_lock<std::mutex> guard
+                (nodeMutexes[current.second % NUM_NODE_MUTEXES]);
+            scratch = *links;
+            links = &scratch;
+        }
+
+        for (int other: *links) {
+            if (!visited.insert(other).second)
+                continue;
+            float dist = distance(other);
+            if (found.size() < ef || dist < found.top().first) {
+                toVisit.emplace(dist, other);
+                found.emplace(dist, other);
+                if (found.size() > ef)
+                    found.pop();
+            }
+        }
+    }
+
+    Neighbors result(found.size());
+    for (size_t i = result.size();  i > 0;  --i) {
+        result[i - 1] = found.top();
+        found.pop();
+    }
+
+    return result;
+}
+
+std::vector<int>
+HnswIndex::
+selectLinks(const Neighbors & candidates, int maxLinks,
+            const ItemDistance & distance) const
+{
+    std::vector<int> result;
+    result.reserve(maxLinks);
+
+    for (auto & c: candidates) {
+        if (result.size() >= maxLinks)
+            break;
+
+        bool keep = true;
+        for (int r: result) {
+            if (distance(c.second, r) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+
+        if (keep)
+            result.push_back(c.second);
+    }
+
+    return result;
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const QueryDistance & distance, int n, float maxDist,
+       int efSearch) const
+{
+    if (entryPoint == -1 || n <= 0)
+        return {};
+
+    if (efSearch == -1)
+        efSearch = params_.efSearch;
+
+    std::pair<float, int> closest(distance(entryPoint), entryPoint);
+
+    for (int l = maxLevel;  l > 0;  --l)
+        closest = closestOnLevel(distance, closest, l, false /* locked */);
+
+    Neighbors result = searchLevel(distance, closest, std::max(efSearch, n),
+                                   0, false /* locked */);
+
+    while (!result.empty() && result.back().first > maxDist)
+        result.pop_back();
+    if (result.size() > n)
+        result.resize(n);
+
+    return result;
+}
+
+void
+HnswIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    using ML::DB::compact_size_t;
+
+    store << string("HNSW_INDEX") << compact_size_t(1);  // version
+    store << compact_size_t(params_.m)
+          << compact_size_t(params_.efConstruction)
+          << compact_size_t(params_.efSearch)
+          << params_.seed;
+    store << compact_size_t(nodes.size()) << compact_size_t(entryPoint + 1);
+
+    for (auto & n: nodes) {
+        store << compact_size_t(n.links.size());
+        for (auto & l: n.links) {
+            store << compact_size_t(l.size());
+            for (int i: l)
+                store << compact_size_t(i);
+        }
+    }
+}
+
+void
+HnswIndex::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    using ML::DB::compact_size_t;
+
+    string canary;
+    store >> canary;
+    if (canary != "HNSW_INDEX")
+        throw ML::Exception("Expected HNSW index; got '" + canary + "'");
+
+    compact_size_t version(store);
+    if (version != 1)
+        throw ML::Exception("Unknown HNSW index version %d", (int)version);
+
+    compact_size_t m(store), efConstruction(store), efSearch(store);
+    params_.m = m;
+    params_.efConstruction = efConstruction;
+    params_.efSearch = efSearch;
+    store >> params_.seed;
+
+    compact_size_t numNodes(store), entryPointPlusOne(store);
+    nodes.clear();
+    nodes.resize(numNodes);
+    entryPoint = (int)entryPointPlusOne - 1;
+    maxLevel = -1;
+
+    for (auto & n: nodes) {
+        compact_size_t numLevels(store);
+        n.links.resize(numLevels);
+        for (auto & l: n.links) {
+            compact_size_t numLinks(store);
+            l.resize(numLinks);
+            for (int & i: l) {
+                compact_size_t link(store);
+                i = link;
+            }
+        }
+    }
+
+    if (entryPoint != -1)
+        maxLevel = nodes.at(entryPoint).links.size() - 1;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,151 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Hierarchical navigable small world graph for approximate nearest
+    neighbour queries.
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "mldb/jml/db/persistent_fwd.h"
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX PARAMS                                                         */
+/*****************************************************************************/
+
+struct HnswIndexParams {
+    HnswIndexParams()
+        : m(16), efConstruction(200), efSearch(50), seed(1)
+    {
+    }
+
+    int m;                ///< Links per item per level (2m on level 0)
+    int efConstruction;   ///< Candidates considered when inserting an item
+    int efSearch;         ///< Candidates considered when searching
+    uint64_t seed;        ///< Seed for choosing the level of each item
+};
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbour index over items numbered 0, 1, 2, ...
+    as described in "Efficient and robust approximate nearest neighbor
+    search using Hierarchical Navigable Small World graphs" (Malkov and
+    Yashunin).
+
+    Like ML::VantagePointTreeT, the index doesn't hold the items themselves;
+    distances are obtained through functions passed in when inserting and
+    searching, so that the caller can use cached norms and its own SIMD
+    kernels.  Unlike the VP tree, items can be added to an existing index
+    without rebuilding it.
+*/
+
+struct HnswIndex {
+
+    /// Distance between two items of the index
+    typedef std::function<float (int item1, int item2)> ItemDistance;
+
+    /// Distance between the query and an item of the index
+    typedef std::function<float (int item)> QueryDistance;
+
+    HnswIndex(const HnswIndexParams & params = HnswIndexParams());
+
+    /** Copy the index.  This must not be done while items are being
+        inserted into other.
+    */
+    HnswIndex(const HnswIndex & other);
+
+    HnswIndex & operator = (const HnswIndex & other) = delete;
+
+    ~HnswIndex();
+
+    /// Number of items in the index
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    const HnswIndexParams & params() const
+    {
+        return params_;
+    }
+
+    /** Insert items size() up to end - 1 into the index, in parallel.
+        distance must be callable from multiple threads at once.  The index
+        must not be searched while this is running.
+    */
+    void insert(int end, const ItemDistance & distance);
+
+    /** Return the (approximately) n closest items to the query, with their
+        distance, closest first.  Only items with a distance of at most
+        maxDist are returned.  If efSearch is -1, that of the params is
+        used.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & distance, int n, float maxDist,
+           int efSearch = -1) const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    struct Node {
+        /// Items linked to on each level that the item is in
+        std::vector<std::vector<int> > links;
+    };
+
+    HnswIndexParams params_;
+    std::vector<Node> nodes;
+    int entryPoint;
+    int maxLevel;
+
+    /// Protects entryPoint and maxLevel during insertion
+    std::mutex entryMutex;
+
+    /// Protect the links of nodes during insertion; node i uses
+    /// nodeMutexes[i % NUM_NODE_MUTEXES]
+    static constexpr int NUM_NODE_MUTEXES = 1024;
+    std::unique_ptr<std::mutex[]> nodeMutexes;
+
+    typedef std::vector<std::pair<float, int> > Neighbors;
+
+    int chooseLevel(int item) const;
+
+    void insertItem(int item, const ItemDistance & distance);
+
+    /// Greedily walk level towards the closest item to the query
+    std::pair<float, int>
+    closestOnLevel(const QueryDistance & distance, std::pair<float, int> start,
+                   int level, bool locked) const;
+
+    /// Search level for the ef closest items to the query, closest first
+    Neighbors searchLevel(const QueryDistance & distance,
+                          std::pair<float, int> start,
+                          int ef, int level, bool locked) const;
+
+    /** Choose at most maxLinks of the candidates (which are sorted by
+        distance to the item being linked) to link to, preferring those
+        that aren't closer to an already chosen one than to the item.
+    */
+    std::vector<int> selectLinks(const Neighbors & candidates, int maxLinks,
+                                 const ItemDistance & distance) const;
+
+    int maxLinks(int level) const
+    {
+        return level == 0 ? 2 * params_.m : params_.m;
+    }
+};
+
+} // namespace MLDB
+} // namespace Datacratic
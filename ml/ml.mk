@@ -19,7 +19,11 @@ LIBML_SOURCES := \
 	value_descriptions.cc \
 	confidence_intervals.cc \
 	svd_utils.cc \
-    randomforest.cc
+    randomforest.cc \
+    boosted_trees.cc \
+    flat_tree_ensemble.cc \
+    hnsw_index.cc \
+    quantized_vectors.cc
 
 
 LIBML_LINK := boosting neural boost_filesystem jsoncpp types value_description algebra
@@ -0,0 +1,244 @@
+/** quantized_vectors.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compact storage of float vectors as 8 bit integers.
+*/
+
+#include "quantized_vectors.h"
+#include "mldb/arch/arch.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include <cmath>
+#include <algorithm>
+#if JML_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/** Dot product of two vectors of codes. */
+int64_t dotprodCodes(const int8_t * a, const int8_t * b, int n)
+{
+    int64_t result = 0;
+    int i = 0;
+
+#if JML_INTEL_ISA
+    // Codes are in [-127, 127], so each 32 bit lane gains at most 4 * 127^2
+    // per 16 codes; flush them well before they could overflow
+    static constexpr int BLOCK = 16 * 8192;
+
+    const __m128i zero = _mm_setzero_si128();
+
+    while (n - i >= 16) {
+        __m128i acc = zero;
+        int blockEnd = std::min(n - 15, i + BLOCK);
+
+        for (; i < blockEnd;  i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+            // Sign extend to 16 bits and multiply-add pairs into 32 bits
+            __m128i sa = _mm_cmpgt_epi8(zero, va);
+            __m128i sb = _mm_cmpgt_epi8(zero, vb);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, sa),
+                                                    _mm_unpacklo_epi8(vb, sb)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, sa),
+                                                    _mm_unpackhi_epi8(vb, sb)));
+        }
+
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        result += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < n;  ++i)
+        result += (int32_t)a[i] * b[i];
+
+    return result;
+}
+
+/** Dot product of a vector of codes and one of floats. */
+double dotprodCodesFloats(const int8_t * a, const float * b, int n)
+{
+    double result = 0;
+    int i = 0;
+
+#if JML_INTEL_ISA
+    const __m128i zero = _mm_setzero_si128();
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+
+    for (; n - i >= 16;  i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+
+        // Sign extend to 16 then 32 bits, and convert to float
+        __m128i sa = _mm_cmpgt_epi8(zero, va);
+        __m128i lo = _mm_unpacklo_epi8(va, sa);
+        __m128i hi = _mm_unpackhi_epi8(va, sa);
+        __m128i slo = _mm_srai_epi16(lo, 15);
+        __m128i shi = _mm_srai_epi16(hi, 15);
+
+        __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, slo));
+        __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, slo));
+        __m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, shi));
+        __m128 f3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, shi));
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(f0, _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(f1, _mm_loadu_ps(b + i + 4)));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(f2, _mm_loadu_ps(b + i + 8)));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(f3, _mm_loadu_ps(b + i + 12)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(_mm_add_ps(acc0, acc1),
+                                    _mm_add_ps(acc2, acc3)));
+    result = (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    for (; i < n;  ++i)
+        result += a[i] * b[i];
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* QUANTIZED VECTORS                                                         */
+/*****************************************************************************/
+
+QuantizedVectors::
+QuantizedVectors(int numDims)
+    : numDims_(numDims)
+{
+}
+
+void
+QuantizedVectors::
+add(const float * coords)
+{
+    float maxAbs = 0.0;
+    for (int i = 0;  i < numDims_;  ++i) {
+        if (!std::isfinite(coords[i]))
+            throw ML::Exception("Attempt to quantize a non-finite value");
+        maxAbs = std::max(maxAbs, std::abs(coords[i]));
+    }
+
+    float scale = maxAbs / 127.0f;
+    float invScale = maxAbs == 0.0f ? 0.0f : 127.0f / maxAbs;
+
+    size_t start = codes_.size();
+    codes_.resize(start + numDims_);
+    int8_t * codes = &codes_[start];
+
+    int64_t sumSquares = 0;
+    for (int i = 0;  i < numDims_;  ++i) {
+        int code = std::lrint(coords[i] * invScale);
+        code = std::max(-127, std::min(127, code));
+        codes[i] = code;
+        sumSquares += code * code;
+    }
+
+    scales.push_back(scale);
+    sqNorms.push_back((double)sumSquares * scale * scale);
+}
+
+void
+QuantizedVectors::
+decode(size_t vec, float * coords) const
+{
+    ExcAssertLess(vec, size());
+    const int8_t * codes = &codes_[vec * numDims_];
+    float scale = scales[vec];
+    for (int i = 0;  i < numDims_;  ++i)
+        coords[i] = codes[i] * scale;
+}
+
+double
+QuantizedVectors::
+dotprod(size_t vec1, size_t vec2) const
+{
+    ExcAssertLess(vec1, size());
+    ExcAssertLess(vec2, size());
+    int64_t result = dotprodCodes(&codes_[vec1 * numDims_],
+                                  &codes_[vec2 * numDims_], numDims_);
+    return (double)result * scales[vec1] * scales[vec2];
+}
+
+double
+QuantizedVectors::
+dotprod(size_t vec, const float * coords) const
+{
+    ExcAssertLess(vec, size());
+    return dotprodCodesFloats(&codes_[vec * numDims_], coords, numDims_)
+        * scales[vec];
+}
+
+size_t
+QuantizedVectors::
+memusage() const
+{
+    return sizeof(*this)
+        + codes_.capacity() * sizeof(int8_t)
+        + scales.capacity() * sizeof(float)
+        + sqNorms.capacity() * sizeof(double);
+}
+
+void
+QuantizedVectors::
+serialize(ML::DB::Store_Writer & store) const
+{
+    using ML::DB::compact_size_t;
+
+    store << string("QUANTIZED_VECTORS") << compact_size_t(1);  // version
+    store << compact_size_t(numDims_) << compact_size_t(size());
+    store.save_binary(codes_.data(), codes_.size());
+    for (float scale: scales)
+        store << scale;
+}
+
+void
+QuantizedVectors::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    using ML::DB::compact_size_t;
+
+    string canary;
+    store >> canary;
+    if (canary != "QUANTIZED_VECTORS")
+        throw ML::Exception("Expected quantized vectors; got '" + canary + "'");
+
+    compact_size_t version(store);
+    if (version != 1)
+        throw ML::Exception("Unknown quantized vectors version %d",
+                            (int)version);
+
+    compact_size_t numDims(store), numVecs(store);
+    numDims_ = numDims;
+    codes_.resize(numDims * numVecs);
+    scales.resize(numVecs);
+    store.load_binary(codes_.data(), codes_.size());
+    for (float & scale: scales)
+        store >> scale;
+
+    sqNorms.resize(numVecs);
+    for (size_t i = 0;  i < numVecs;  ++i) {
+        int64_t sumSquares = dotprodCodes(&codes_[i * numDims_],
+                                          &codes_[i * numDims_], numDims_);
+        sqNorms[i] = (double)sumSquares * scales[i] * scales[i];
+    }
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,89 @@
+/** quantized_vectors.h                                            -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Compact storage of float vectors as 8 bit integers.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "mldb/jml/db/persistent_fwd.h"
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUANTIZED VECTORS                                                         */
+/*****************************************************************************/
+
+/** A set of vectors with the same number of dimensions, each of which is
+    stored as one signed byte per dimension and a scale, so that value i
+    of a vector is approximately codes[i] * scale.  The scale is chosen
+    per vector so that its largest magnitude value maps onto 127, which
+    needs no training and lets vectors be added one at a time.
+
+    This takes a quarter of the memory of the float vectors.  The dot
+    product of two stored vectors is calculated on the bytes; that of a
+    stored vector and a float query (the asymmetric distance) converts the
+    bytes as it goes, without decoding the vector first.
+*/
+
+struct QuantizedVectors {
+
+    QuantizedVectors(int numDims = 0);
+
+    int numDims() const
+    {
+        return numDims_;
+    }
+
+    /// Number of vectors stored
+    size_t size() const
+    {
+        return scales.size();
+    }
+
+    /** Add a vector of numDims() values.  Throws if any of them isn't
+        finite, in which case nothing is added.
+    */
+    void add(const float * coords);
+
+    /// Approximate value of the given dimension of the given vector
+    float value(size_t vec, int dim) const
+    {
+        return codes_[vec * numDims_ + dim] * scales[vec];
+    }
+
+    /// Write the approximate values of the given vector to coords
+    void decode(size_t vec, float * coords) const;
+
+    /// Dot product of two stored vectors (as decoded)
+    double dotprod(size_t vec1, size_t vec2) const;
+
+    /// Dot product of a stored vector (as decoded) and numDims() floats
+    double dotprod(size_t vec, const float * coords) const;
+
+    /// Squared two norm of a stored vector (as decoded)
+    double sqNorm(size_t vec) const
+    {
+        return sqNorms[vec];
+    }
+
+    /// Bytes of memory used
+    size_t memusage() const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
+private:
+    int numDims_;
+    std::vector<int8_t> codes_;    ///< numDims_ codes per vector
+    std::vector<float> scales;     ///< Scale of each vector
+    std::vector<double> sqNorms;   ///< Squared norm of each decoded vector
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,192 @@
+/** flat_tree_ensemble_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that the flattened tree ensembles score rows exactly as the jml
+    classifiers that they were compiled from.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+
+#include "mldb/ml/flat_tree_ensemble.h"
+#include "mldb/ml/jml/classifier_generator.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/jml/utils/configuration.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic::MLDB;
+
+
+namespace {
+
+const char * config_options = "\
+dt {\n\
+    type=decision_tree\n\
+    max_depth=6\n\
+    verbosity=0\n\
+}\n\
+bs {\n\
+    type=boosting\n\
+    min_iter=10\n\
+    max_iter=10\n\
+    verbosity=0\n\
+    weak_learner {\n\
+        type=decision_tree\n\
+        max_depth=1\n\
+        verbosity=0\n\
+        update_alg=gentle\n\
+    }\n\
+}\n\
+bbdt {\n\
+    type=bagging\n\
+    num_bags=3\n\
+    verbosity=0\n\
+    weak_learner {\n\
+        type=boosting\n\
+        min_iter=5\n\
+        max_iter=5\n\
+        verbosity=0\n\
+        weak_learner {\n\
+            type=decision_tree\n\
+            max_depth=3\n\
+            verbosity=0\n\
+            update_alg=gentle\n\
+        }\n\
+    }\n\
+}\n\
+stumps {\n\
+    type=boosted_stumps\n\
+    min_iter=10\n\
+    max_iter=10\n\
+    verbosity=0\n\
+}\n\
+";
+
+constexpr int NUM_FEATURES = 5;
+
+/** Dense rows with a label followed by NUM_FEATURES values, each of which is
+    missing (NaN) one time in five.  The label can only be learnt with
+    several splits, and depends on whether the first feature is missing.
+*/
+struct Fixture {
+    Fixture()
+        : fs(new Dense_Feature_Space()), rng(42), uniform(rng)
+    {
+        fs->add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        for (int i = 0;  i < NUM_FEATURES;  ++i)
+            fs->add_feature("feature" + to_string(i), REAL);
+    }
+
+    distribution<float> randomRow()
+    {
+        distribution<float> row(NUM_FEATURES + 1);
+        for (int i = 1;  i <= NUM_FEATURES;  ++i) {
+            if (uniform() < 0.2)
+                row[i] = NAN;
+            else row[i] = uniform() * 2.0 - 1.0;
+        }
+        if (std::isnan(row[1]))
+            row[0] = row[2] > 0.5;
+        else row[0] = (row[1] > 0) != (row[2] * row[3] > 0);
+        return row;
+    }
+
+    std::shared_ptr<Classifier_Impl> train(const std::string & name)
+    {
+        Training_Data data(fs);
+        for (unsigned i = 0;  i < 2000;  ++i)
+            data.add_example(fs->encode(randomRow()));
+
+        Configuration config;
+        config.parse_string(config_options, "inbuilt config file");
+
+        auto generator = get_trainer(name, config);
+        generator->init(fs, fs->features()[0]);
+
+        std::vector<Feature> features = fs->features();
+        features.erase(features.begin());
+
+        Thread_Context context;
+        return generator->generate(context, data,
+                                   distribution<float>(data.example_count(), 1),
+                                   features);
+    }
+
+    /** Check that the flattened ensemble gives the same scores as the
+        classifier, for predict() and predictBatch().
+    */
+    void check(const Classifier_Impl & classifier)
+    {
+        auto flat = FlatTreeEnsemble::compile(classifier, fs->features());
+        BOOST_REQUIRE(flat);
+        BOOST_REQUIRE_EQUAL(flat->labelCount(), classifier.label_count());
+        int nl = flat->labelCount();
+
+        // Rows of the batch are padded, to check the row stride
+        size_t numRows = 1000, stride = NUM_FEATURES + 3;
+        std::vector<float> batch(numRows * stride, NAN);
+        std::vector<Label_Dist> expected;
+
+        for (size_t i = 0;  i < numRows;  ++i) {
+            distribution<float> row = randomRow();
+            std::copy(row.begin(), row.end(), batch.begin() + i * stride);
+            expected.push_back(classifier.predict(*fs->encode(row)));
+        }
+
+        std::vector<double> scores(nl);
+        std::vector<double> batchScores(numRows * nl);
+        flat->predictBatch(batch.data(), numRows, stride, batchScores.data());
+
+        for (size_t i = 0;  i < numRows;  ++i) {
+            flat->predict(batch.data() + i * stride, scores.data());
+            for (int j = 0;  j < nl;  ++j) {
+                // The classifiers accumulate in float, so we allow for its
+                // rounding
+                BOOST_CHECK_SMALL(scores[j] - expected[i][j], 1e-4);
+                BOOST_CHECK_EQUAL(batchScores[i * nl + j], scores[j]);
+            }
+        }
+    }
+
+    std::shared_ptr<Dense_Feature_Space> fs;
+    boost::mt19937 rng;
+    boost::uniform_01<boost::mt19937 &> uniform;
+};
+
+} // file scope
+
+BOOST_FIXTURE_TEST_CASE( test_decision_tree, Fixture )
+{
+    check(*train("dt"));
+}
+
+BOOST_FIXTURE_TEST_CASE( test_boosted_stumps, Fixture )
+{
+    // Boosted decision trees of depth one, which is how the classifier
+    // procedure's boosted stumps are usually configured
+    check(*train("bs"));
+}
+
+BOOST_FIXTURE_TEST_CASE( test_bagged_boosted_trees, Fixture )
+{
+    check(*train("bbdt"));
+}
+
+BOOST_FIXTURE_TEST_CASE( test_boosted_stumps_classifier_not_compiled, Fixture )
+{
+    // Boosted_Stumps isn't made of trees, so it's left to the classifier
+    auto classifier = train("stumps");
+    BOOST_CHECK(!FlatTreeEnsemble::compile(*classifier, fs->features()));
+}
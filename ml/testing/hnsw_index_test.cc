@@ -0,0 +1,153 @@
+/** hnsw_index_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the HNSW approximate nearest neighbours index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/ml/hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+namespace {
+
+struct Points {
+    Points(int numPoints, int numDims)
+        : coords(numPoints, vector<float>(numDims))
+    {
+        std::mt19937 rng(42);
+        std::normal_distribution<float> normal;
+        for (auto & c: coords)
+            for (auto & v: c)
+                v = normal(rng);
+    }
+
+    float dist(const vector<float> & c1, const vector<float> & c2) const
+    {
+        float result = 0;
+        for (unsigned i = 0;  i < c1.size();  ++i)
+            result += (c1[i] - c2[i]) * (c1[i] - c2[i]);
+        return sqrt(result);
+    }
+
+    float dist(int item1, int item2) const
+    {
+        return dist(coords[item1], coords[item2]);
+    }
+
+    /// Proportion of the true n nearest of the first numItems points to
+    /// the query that the index finds
+    double recall(const HnswIndex & index, int numItems,
+                  const vector<float> & query, int n, int efSearch) const
+    {
+        vector<pair<float, int> > exact;
+        for (int i = 0;  i < numItems;  ++i)
+            exact.emplace_back(dist(coords[i], query), i);
+        std::partial_sort(exact.begin(), exact.begin() + n, exact.end());
+
+        auto found = index.search([&] (int item) { return dist(coords[item], query); },
+                                  n, INFINITY, efSearch);
+        BOOST_CHECK_LE(found.size(), n);
+        for (unsigned i = 1;  i < found.size();  ++i)
+            BOOST_CHECK_LE(found[i - 1].first, found[i].first);
+
+        int hits = 0;
+        for (auto & f: found)
+            for (int i = 0;  i < n;  ++i)
+                hits += f.second == exact[i].second;
+        return 1.0 * hits / n;
+    }
+
+    vector<vector<float> > coords;
+};
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_empty_index )
+{
+    HnswIndex index;
+    BOOST_CHECK_EQUAL(index.size(), 0);
+    BOOST_CHECK(index.search([] (int) { return 0.0f; }, 10, INFINITY).empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_recall )
+{
+    Points points(5100, 16);
+    auto dist = [&] (int item1, int item2) { return points.dist(item1, item2); };
+
+    HnswIndex index;
+
+    // Insert in two goes, to check that adding to an index works
+    index.insert(2000, dist);
+    BOOST_CHECK_EQUAL(index.size(), 2000);
+    index.insert(5000, dist);
+    BOOST_CHECK_EQUAL(index.size(), 5000);
+
+    double recall = 0;
+    for (int q = 5000;  q < 5100;  ++q)
+        recall += points.recall(index, 5000, points.coords[q], 10, 100);
+    recall /= 100;
+
+    cerr << "recall@10 = " << recall << endl;
+    BOOST_CHECK_GT(recall, 0.9);
+
+    // Each item is its own nearest neighbour
+    for (int i = 0;  i < 100;  ++i) {
+        auto found = index.search([&] (int item) { return dist(item, i); },
+                                  1, INFINITY);
+        BOOST_REQUIRE_EQUAL(found.size(), 1);
+        BOOST_CHECK_EQUAL(found[0].first, 0.0f);
+    }
+
+    // maxDist is honoured
+    auto found = index.search([&] (int item) { return dist(item, 0); },
+                              100, 4.0f);
+    for (auto & f: found)
+        BOOST_CHECK_LE(f.first, 4.0f);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialization )
+{
+    Points points(1000, 8);
+    auto dist = [&] (int item1, int item2) { return points.dist(item1, item2); };
+
+    HnswIndexParams params;
+    params.m = 8;
+    params.efSearch = 20;
+    HnswIndex index(params);
+    index.insert(1000, dist);
+
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        index.serialize(store);
+    }
+
+    HnswIndex reconstituted;
+    std::istringstream istream(stream.str());
+    ML::DB::Store_Reader store(istream);
+    reconstituted.reconstitute(store);
+
+    BOOST_CHECK_EQUAL(reconstituted.size(), 1000);
+    BOOST_CHECK_EQUAL(reconstituted.params().m, 8);
+    BOOST_CHECK_EQUAL(reconstituted.params().efSearch, 20);
+
+    // A copy of the reconstituted index gives exactly the same results
+    HnswIndex copied(reconstituted);
+
+    for (int i = 0;  i < 20;  ++i) {
+        auto query = [&] (int item) { return dist(item, i); };
+        auto found1 = index.search(query, 5, INFINITY);
+        auto found2 = copied.search(query, 5, INFINITY);
+        BOOST_CHECK(found1 == found2);
+    }
+}
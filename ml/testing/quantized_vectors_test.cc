@@ -0,0 +1,114 @@
+/** quantized_vectors_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of int8 quantized vector storage.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/ml/quantized_vectors.h"
+#include "mldb/jml/db/persistent.h"
+#include <random>
+#include <sstream>
+#include <cmath>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_quantization )
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal;
+
+    // Odd sizes exercise the tails after the vectorized loops
+    for (int numDims: { 1, 7, 16, 33, 300 }) {
+        QuantizedVectors vecs(numDims);
+        vector<vector<float> > coords(20, vector<float>(numDims));
+        for (auto & c: coords) {
+            for (auto & v: c)
+                v = normal(rng) * 10;
+            vecs.add(c.data());
+        }
+
+        BOOST_CHECK_EQUAL(vecs.size(), 20);
+
+        vector<vector<float> > decoded(20, vector<float>(numDims));
+        for (unsigned i = 0;  i < 20;  ++i) {
+            vecs.decode(i, decoded[i].data());
+
+            float maxAbs = 0;
+            for (auto & v: coords[i])
+                maxAbs = std::max(maxAbs, std::abs(v));
+
+            double sqNorm = 0;
+            for (unsigned j = 0;  j < numDims;  ++j) {
+                BOOST_CHECK_LE(std::abs(decoded[i][j] - coords[i][j]),
+                               maxAbs / 254 * 1.001);
+                BOOST_CHECK_EQUAL(decoded[i][j], vecs.value(i, j));
+                sqNorm += decoded[i][j] * decoded[i][j];
+            }
+            BOOST_CHECK_CLOSE(vecs.sqNorm(i), sqNorm, 1e-3);
+        }
+
+        // Dot products are those of the decoded vectors
+        for (unsigned i = 0;  i < 20;  ++i) {
+            for (unsigned k = 0;  k < 20;  ++k) {
+                double expected = 0, expectedQuery = 0;
+                for (unsigned j = 0;  j < numDims;  ++j) {
+                    expected += decoded[i][j] * decoded[k][j];
+                    expectedQuery += decoded[i][j] * coords[k][j];
+                }
+                BOOST_CHECK_SMALL(vecs.dotprod(i, k) - expected,
+                                  1e-3 * (1 + std::abs(expected)));
+                BOOST_CHECK_SMALL(vecs.dotprod(i, coords[k].data())
+                                  - expectedQuery,
+                                  1e-3 * (1 + std::abs(expectedQuery)));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_zero_and_invalid )
+{
+    QuantizedVectors vecs(3);
+    float zero[3] = { 0, 0, 0 };
+    vecs.add(zero);
+    BOOST_CHECK_EQUAL(vecs.sqNorm(0), 0.0);
+    BOOST_CHECK_EQUAL(vecs.value(0, 1), 0.0f);
+
+    float bad[3] = { 1, NAN, 2 };
+    BOOST_CHECK_THROW(vecs.add(bad), std::exception);
+    BOOST_CHECK_EQUAL(vecs.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialization )
+{
+    QuantizedVectors vecs(5);
+    float c1[5] = { 1, -2, 3, -4, 5 };
+    float c2[5] = { 0.1, 0.2, 0.3, 0.4, -0.5 };
+    vecs.add(c1);
+    vecs.add(c2);
+
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        vecs.serialize(store);
+    }
+
+    QuantizedVectors reconstituted;
+    std::istringstream istream(stream.str());
+    ML::DB::Store_Reader store(istream);
+    reconstituted.reconstitute(store);
+
+    BOOST_CHECK_EQUAL(reconstituted.numDims(), 5);
+    BOOST_REQUIRE_EQUAL(reconstituted.size(), 2);
+    for (unsigned i = 0;  i < 2;  ++i) {
+        BOOST_CHECK_EQUAL(reconstituted.sqNorm(i), vecs.sqNorm(i));
+        for (unsigned j = 0;  j < 5;  ++j)
+            BOOST_CHECK_EQUAL(reconstituted.value(i, j), vecs.value(i, j));
+    }
+    BOOST_CHECK_EQUAL(reconstituted.dotprod(0, 1), vecs.dotprod(0, 1));
+}
@@ -0,0 +1,253 @@
+/** boosted_trees_procedure.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Procedure to train a gradient boosted trees binary classifier.
+*/
+
+#include "boosted_trees_procedure.h"
+#include "mldb/arch/timers.h"
+#include "mldb/ml/boosted_trees.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/value_descriptions.h"
+#include "mldb/plugins/sql_expression_extractors.h"
+#include "mldb/plugins/classifier.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/plugins/sql_config_validator.h"
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(BoostedTreesProcedureConfig);
+
+BoostedTreesProcedureConfigDescription::
+BoostedTreesProcedureConfigDescription()
+{
+    addField("trainingData", &BoostedTreesProcedureConfig::trainingData,
+             "Specification of the data for input to the procedure. "
+             "The select expression must contain these two sub-expressions: one row expression "
+             "to identify the features on which to train and one scalar expression "
+             "to identify the label.  The type of the label expression must be a boolean (0 or 1). "
+             "The select statement does not support groupby and having clauses. "
+             "Also, unlike most select expressions, this one can only select whole columns, "
+             "not expressions involving columns. So X will work, but not X + 1. "
+             "If you need derived values in the select expression, create a dataset with "
+             "the derived columns as a previous step and run the procedure over that dataset instead.");
+    addField("modelFileUrl", &BoostedTreesProcedureConfig::modelFileUrl,
+             "URL where the model file (with extension '.cls') should be saved. "
+             "This file can be loaded by the ![](%%doclink classifier function). ");
+    addField("numRounds", &BoostedTreesProcedureConfig::numRounds,
+             "Number of rounds of boosting, each of which trains one tree.", 100);
+    addField("learningRate", &BoostedTreesProcedureConfig::learningRate,
+             "Factor by which the output of each tree is multiplied.  Smaller "
+             "values need more rounds, but generalize better.", 0.1);
+    addField("maxLeaves", &BoostedTreesProcedureConfig::maxLeaves,
+             "Maximum number of leaves of each tree.", 31);
+    addField("maxDepth", &BoostedTreesProcedureConfig::maxDepth,
+             "Maximum depth of each tree.", 12);
+    addField("minLeafExamples", &BoostedTreesProcedureConfig::minLeafExamples,
+             "Minimum number of training examples in each leaf.", 20);
+    addField("l2Regularization", &BoostedTreesProcedureConfig::l2Regularization,
+             "L2 regularization of the output of each leaf.", 1.0);
+    addField("rowSamplingProp", &BoostedTreesProcedureConfig::rowSamplingProp,
+             "Proportion of the training rows, chosen at random, used to "
+             "train each tree.", 1.0f);
+    addField("functionName", &BoostedTreesProcedureConfig::functionName,
+             "If specified, an instance of the ![](%%doclink classifier function) of this name will be created using "
+             "the trained model. Note that to use this parameter, the `modelFileUrl` must "
+             "also be provided.");
+    addField("verbosity", &BoostedTreesProcedureConfig::verbosity,
+             "Should the procedure be verbose for debugging and tuning purposes", false);
+    addParent<ProcedureConfig>();
+
+    onPostValidate = chain(validateQuery(&BoostedTreesProcedureConfig::trainingData,
+                                         NoGroupByHaving(),
+                                         PlainColumnSelect(),
+                                         MustContainFrom(),
+                                         FeaturesLabelSelect()),
+                           validateFunction<BoostedTreesProcedureConfig>());
+}
+
+
+/*****************************************************************************/
+/* BOOSTED TREES PROCEDURE                                                   */
+/*****************************************************************************/
+
+BoostedTreesProcedure::
+BoostedTreesProcedure(MldbServer * owner,
+                      PolyConfig config,
+                      const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    this->procedureConfig = config.params.convert<BoostedTreesProcedureConfig>();
+}
+
+Any
+BoostedTreesProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+RunOutput
+BoostedTreesProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    BoostedTreesProcedureConfig runProcConf =
+        applyRunConfOverProcConf(procedureConfig, run);
+
+    ML::Timer timer;
+
+    // this includes being empty
+    if(!runProcConf.modelFileUrl.valid()) {
+         throw ML::Exception("modelFileUrl is not valid");
+    }
+
+    if (runProcConf.numRounds < 1 || runProcConf.maxLeaves < 1
+        || runProcConf.maxDepth < 0 || runProcConf.learningRate <= 0
+        || runProcConf.rowSamplingProp <= 0 || runProcConf.rowSamplingProp > 1)
+        throw HttpReturnException(400, "Invalid parameters for boosted trees",
+                                  "config", runProcConf);
+
+    checkWritability(runProcConf.modelFileUrl.toDecodedString(),
+                     "modelFileUrl");
+
+    // 1.  Get the input dataset
+    SqlExpressionMldbScope context(server);
+
+    auto boundDataset = runProcConf.trainingData.stm->from->bind(context);
+
+    ML::Mutable_Feature_Info labelInfo = ML::Mutable_Feature_Info(ML::BOOLEAN);
+    labelInfo.set_biased(true);
+
+    auto extractWithinExpression = [](std::shared_ptr<SqlExpression> expr)
+        -> std::shared_ptr<SqlRowExpression>
+        {
+            auto withinExpression = std::dynamic_pointer_cast<const SelectWithinExpression>(expr);
+            if (withinExpression)
+                return withinExpression->select;
+
+            return nullptr;
+        };
+
+    auto label = extractNamedSubSelect("label", runProcConf.trainingData.stm->select)->expression;
+    auto features = extractNamedSubSelect("features", runProcConf.trainingData.stm->select)->expression;
+    shared_ptr<SqlRowExpression> subSelect = extractWithinExpression(features);
+
+    if (!label || !subSelect)
+        throw HttpReturnException(400, "trainingData must return a 'features' row and a 'label'");
+
+    ColumnScope colScope(server, boundDataset.dataset);
+    auto boundLabel = label->bind(colScope);
+
+    std::vector<CellValue> labels(std::move(colScope.run({boundLabel})[0]));
+
+    SelectExpression select({subSelect});
+
+    std::set<ColumnName> knownInputColumns;
+    {
+        // Find only those variables used
+        SqlExpressionDatasetScope scope(boundDataset);
+        auto selectBound = select.bind(scope);
+        for (auto & c : selectBound.info->getKnownColumns())
+            knownInputColumns.insert(c.columnName);
+    }
+
+    auto featureSpace = std::make_shared<DatasetFeatureSpace>
+        (boundDataset.dataset, labelInfo, knownInputColumns, true /* bucketize */);
+
+    cerr << "feature space construction took " << timer.elapsed() << endl;
+    timer.restart();
+
+    size_t numRows = boundDataset.dataset->getMatrixView()->getRowCount();
+
+    PartitionData allData(featureSpace);
+
+    allData.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        allData.addRow(labels[i].isTrue(), 1.0 /* weight */, i);
+    }
+
+    // As for the random forest, the classifier is saved with the
+    // unbucketized feature space
+    auto contFeatureSpace = std::make_shared<DatasetFeatureSpace>
+        (boundDataset.dataset, labelInfo, knownInputColumns, false /* bucketize */);
+
+    BoostedTreesParams params;
+    params.numRounds = runProcConf.numRounds;
+    params.learningRate = runProcConf.learningRate;
+    params.maxLeaves = runProcConf.maxLeaves;
+    params.maxDepth = runProcConf.maxDepth;
+    params.minLeafExamples = runProcConf.minLeafExamples;
+    params.l2Regularization = runProcConf.l2Regularization;
+    params.rowSamplingProp = runProcConf.rowSamplingProp;
+    params.verbose = runProcConf.verbosity;
+
+    double trainingLoss = 0;
+
+    auto onRound = [&] (int round, double loss)
+        {
+            trainingLoss = loss / numRows;
+
+            Json::Value progress;
+            progress["round"] = round;
+            progress["numRounds"] = runProcConf.numRounds;
+            progress["trainingLoss"] = trainingLoss;
+            return onProgress(progress);
+        };
+
+    BoostedTreesTrainer trainer(allData, params);
+    std::shared_ptr<Committee> result = trainer.train(contFeatureSpace, onRound);
+
+    cerr << "training " << result->classifiers.size() << " trees took "
+         << timer.elapsed() << endl;
+
+    ML::Classifier classifier(result);
+
+    //Save the model, create the function
+
+    bool saved = true;
+    try {
+        Datacratic::makeUriDirectory(
+            runProcConf.modelFileUrl.toDecodedString());
+        classifier.save(runProcConf.modelFileUrl.toString());
+    }
+    catch (const std::exception & exc) {
+        saved = false;
+        cerr << "Error saving classifier: " << exc.what() << endl;
+    }
+
+    if(saved && !runProcConf.functionName.empty()) {
+        PolyConfig clsFuncPC;
+        clsFuncPC.type = "classifier";
+        clsFuncPC.id = runProcConf.functionName;
+        clsFuncPC.params = ClassifyFunctionConfig(runProcConf.modelFileUrl);
+
+        obtainFunction(server, clsFuncPC, onProgress);
+    }
+
+    Json::Value output;
+    output["numTrees"] = (int)result->classifiers.size();
+    output["trainingLoss"] = trainingLoss;
+    return RunOutput(output);
+}
+
+namespace {
+
+static RegisterProcedureType<BoostedTreesProcedure, BoostedTreesProcedureConfig>
+regBoostedTrees(builtinPackage(),
+                "Train a supervised binary gradient boosted trees classifier",
+                "procedures/BoostedTrees.md.html");
+
+} // file scope
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,90 @@
+/** boosted_trees_procedure.h                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Procedure to train a gradient boosted trees binary classifier.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/core/function.h"
+#include "matrix.h"
+#include "mldb/types/value_description_fwd.h"
+
+namespace Datacratic {
+namespace MLDB {
+
+
+struct BoostedTreesProcedureConfig : public ProcedureConfig {
+    static constexpr const char * name = "boostedtrees.binary.train";
+
+    BoostedTreesProcedureConfig()
+        : numRounds(100),
+          learningRate(0.1),
+          maxLeaves(31),
+          maxDepth(12),
+          minLeafExamples(20),
+          l2Regularization(1.0),
+          rowSamplingProp(1.0f),
+          verbosity(false)
+    {
+    }
+
+    /// Query to select the training data
+    InputQuery trainingData;
+
+    /// Where to save the classifier to
+    Url modelFileUrl;
+
+    /// Number of trees to train
+    int numRounds;
+
+    /// Shrinkage applied to the output of each tree
+    double learningRate;
+
+    /// Maximum number of leaves of each tree
+    int maxLeaves;
+
+    /// Maximum depth of each tree
+    int maxDepth;
+
+    /// Minimum number of examples in each leaf
+    int minLeafExamples;
+
+    /// L2 regularization of the leaf outputs
+    double l2Regularization;
+
+    /// Proportion of the rows used to train each tree
+    float rowSamplingProp;
+
+    /// Debug verbosity
+    bool verbosity;
+
+    /// Function name
+    Utf8String functionName;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(BoostedTreesProcedureConfig);
+
+
+/*****************************************************************************/
+/* BOOSTED TREES PROCEDURE                                                   */
+/*****************************************************************************/
+
+struct BoostedTreesProcedure: public Procedure {
+
+    BoostedTreesProcedure(MldbServer * owner,
+                          PolyConfig config,
+                          const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    BoostedTreesProcedureConfig procedureConfig;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -24,6 +24,7 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/set_description.h"
 #include "mldb/ml/value_descriptions.h"
+#include "mldb/ml/flat_tree_ensemble.h"
 #include "mldb/plugins/sql_config_validator.h"
 #include "mldb/plugins/sql_expression_extractors.h"
 #include "mldb/types/tuple_description.h"
@@ -736,6 +737,22 @@ struct ClassifyFunction::Itl {
     std::shared_ptr<const DatasetFeatureSpace> featureSpace;
     ML::Feature_Info labelInfo;
     ClassifierMode mode;
+
+    /// Compiled form of the classifier if it's made of decision trees,
+    /// used to score dense feature vectors
+    std::shared_ptr<const FlatTreeEnsemble> flat;
+
+    /// Features in the order of the dense feature vectors
+    std::vector<ML::Feature> denseFeatures() const
+    {
+        // Assume there is one of each features
+        std::vector<ML::Feature> features(featureSpace->columnInfo.size());
+
+        for (auto & col: featureSpace->columnInfo)
+            features[col.second.index] = featureSpace->getFeature(col.first);
+
+        return features;
+    }
 };
 
 ClassifyFunction::
@@ -757,6 +774,9 @@ ClassifyFunction(MldbServer * owner,
     itl->labelInfo = labelInfo;
 
     isRegression = itl->classifier.label_count() == 1;
+
+    itl->flat = FlatTreeEnsemble::compile(*itl->classifier.impl,
+                                          itl->denseFeatures());
 }
 
 ClassifyFunction::
@@ -887,6 +907,9 @@ struct ClassifyFunctionApplier: public FunctionApplier {
     }
 
     ML::Optimization_Info optInfo;
+
+    /// Names of the scores of a categorical classifier, by label
+    std::vector<PathElement> labelNames;
 };
 
 std::unique_ptr<FunctionApplier>
@@ -894,19 +917,55 @@ ClassifyFunction::
 bind(SqlBindingScope & outerContext,
      const std::shared_ptr<RowValueInfo> & input) const
 {
-    // Assume there is one of each features
-    vector<ML::Feature> features(itl->featureSpace->columnInfo.size());
-
-    for (auto & col: itl->featureSpace->columnInfo)
-        features[col.second.index] = itl->featureSpace->getFeature(col.first);
-
     std::unique_ptr<ClassifyFunctionApplier> result
         (new ClassifyFunctionApplier(this));
-    result->optInfo = itl->classifier.impl->optimize(features);
+    result->optInfo = itl->classifier.impl->optimize(itl->denseFeatures());
+
+    if (auto cat = itl->labelInfo.categorical()) {
+        int labelCount = itl->classifier.label_count();
+        for (unsigned i = 0;  i < labelCount;  ++i)
+            result->labelNames.emplace_back(cat->print(i));
+    }
+
+    return std::move(result);
+}
+
+namespace {
+
+/** Output of the classifier function given the scores for each label of a
+    row from a FlatTreeEnsemble.
+*/
+ExpressionValue
+flatOutput(const ML::Feature_Info & labelInfo,
+           const std::vector<PathElement> & labelNames,
+           const double * scores, int labelCount, Date ts)
+{
+    StructValue result;
+    result.reserve(1);
+
+    if (labelInfo.categorical()) {
+        vector<tuple<PathElement, ExpressionValue> > row;
+        for (unsigned i = 0;  i < labelCount;  ++i) {
+            row.emplace_back(labelNames[i],
+                             ExpressionValue((float)scores[i], ts));
+        }
+
+        result.emplace_back("scores", std::move(row));
+    }
+    else if (labelInfo.type() == ML::REAL) {
+        ExcAssertEqual(labelCount, 1);
+        result.emplace_back("score", ExpressionValue((float)scores[0], ts));
+    }
+    else {
+        ExcAssertEqual(labelCount, 2);
+        result.emplace_back("score", ExpressionValue((float)scores[1], ts));
+    }
 
     return std::move(result);
 }
 
+} // file scope
+
 ExpressionValue
 ClassifyFunction::
 apply(const FunctionApplier & applier_,
@@ -921,7 +980,15 @@ apply(const FunctionApplier & applier_,
     Date ts;
 
     std::tie(dense, fset, ts)
-        = getFeatureSet(context, applier.optInfo /* try to optimize */);
+        = getFeatureSet(context, applier.optInfo || itl->flat
+                        /* try to optimize */);
+
+    if (!dense.empty() && itl->flat) {
+        std::vector<double> scores(labelCount);
+        itl->flat->predict(dense.data(), scores.data());
+        return flatOutput(itl->labelInfo, applier.labelNames,
+                          scores.data(), labelCount, ts);
+    }
 
     StructValue result;
     result.reserve(1);
@@ -935,7 +1002,7 @@ apply(const FunctionApplier & applier_,
 
             vector<tuple<PathElement, ExpressionValue> > row;
             for (unsigned i = 0;  i < labelCount;  ++i) {
-                row.emplace_back(PathElement(cat->print(i)),
+                row.emplace_back(applier.labelNames[i],
                                  ExpressionValue(scores[i], ts));
             }
 
@@ -967,7 +1034,7 @@ apply(const FunctionApplier & applier_,
             vector<tuple<PathElement, ExpressionValue> > row;
 
             for (unsigned i = 0;  i < labelCount;  ++i) {
-                row.emplace_back(PathElement(cat->print(i)),
+                row.emplace_back(applier.labelNames[i],
                                  ExpressionValue(scores[i], ts));
             }
             result.emplace_back("scores", std::move(row));
@@ -987,6 +1054,70 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const std::vector<ExpressionValue> & contexts) const
+{
+    if (!itl->flat)
+        return applyBatchParallel(applier_, contexts);
+
+    std::vector<ExpressionValue> result(contexts.size());
+
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    // Extract a dense feature vector for each row, and score them a block
+    // at a time with the flattened trees.  Rows that can't be made dense
+    // (a feature with more than one value) go through apply().
+    int labelCount = itl->flat->labelCount();
+    size_t numFeatures = itl->featureSpace->columnInfo.size();
+    size_t numRows = contexts.size();
+
+    static constexpr size_t ROWS_PER_CHUNK = 256;
+
+    auto doChunk = [&] (size_t begin, size_t end)
+        {
+            std::vector<float> features;
+            features.reserve((end - begin) * numFeatures);
+            std::vector<size_t> rows;
+            std::vector<Date> timestamps;
+
+            for (size_t i = begin;  i < end;  ++i) {
+                std::vector<float> dense;
+                std::shared_ptr<ML::Mutable_Feature_Set> fset;
+                Date ts;
+
+                std::tie(dense, fset, ts)
+                    = getFeatureSet(contexts[i], true /* attempt dense */);
+
+                if (dense.empty()) {
+                    result[i] = this->apply(applier, contexts[i]);
+                    continue;
+                }
+
+                features.insert(features.end(), dense.begin(), dense.end());
+                rows.push_back(i);
+                timestamps.push_back(ts);
+            }
+
+            std::vector<double> scores(rows.size() * labelCount);
+            itl->flat->predictBatch(features.data(), rows.size(),
+                                    numFeatures, scores.data());
+
+            for (size_t j = 0;  j < rows.size();  ++j) {
+                result[rows[j]]
+                    = flatOutput(itl->labelInfo, applier.labelNames,
+                                 &scores[j * labelCount], labelCount,
+                                 timestamps[j]);
+            }
+        };
+
+    if (numRows > 0)
+        parallelMapChunked(0, numRows, ROWS_PER_CHUNK, doChunk);
+
+    return result;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
@@ -134,6 +134,14 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Apply to a batch of rows.  The classifier was already optimized
+        once for the batch when it was bound; the rows are scored in
+        parallel.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const;
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
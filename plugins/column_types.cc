@@ -9,6 +9,7 @@
 #include "mldb/sql/cell_value.h"
 #include "mldb/sql/expression_value.h"
 #include "mldb/types/structure_description.h"
+#include "mldb/jml/db/persistent.h"
 
 
 namespace Datacratic {
@@ -119,6 +120,26 @@ update(const ColumnTypes & other)
     numOther = numOther + other.numOther;
 }
 
+void
+ColumnTypes::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << numNulls << numZeros << numIntegers
+          << minNegativeInteger << maxNegativeInteger
+          << minPositiveInteger << maxPositiveInteger
+          << numReals << numStrings << numBlobs << numOther;
+}
+
+void
+ColumnTypes::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    store >> numNulls >> numZeros >> numIntegers
+          >> minNegativeInteger >> maxNegativeInteger
+          >> minPositiveInteger >> maxPositiveInteger
+          >> numReals >> numStrings >> numBlobs >> numOther;
+}
+
 std::shared_ptr<ExpressionValueInfo>
 ColumnTypes::   
 getExpressionValueInfo() const
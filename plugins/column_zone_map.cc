@@ -0,0 +1,482 @@
+/** column_zone_map.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of zone maps for tabular dataset chunks.
+*/
+
+#include "column_zone_map.h"
+#include "frozen_column.h"
+#include "tabular_dataset_column.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/base/exc_assert.h"
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Maximum number of distinct values recorded in a zone map
+static constexpr size_t ZONE_MAP_MAX_DISTINCT_VALUES = 16;
+
+// Integers beyond this can't be held exactly in a double
+static constexpr double MAX_EXACT_DOUBLE_INT = 9007199254740992.0;  // 2^53
+
+/// Is the value a number which compares exactly when converted to double?
+bool isExactNumber(const CellValue & val)
+{
+    if (val.isInt64())
+        return std::abs((double)val.toInt()) <= MAX_EXACT_DOUBLE_INT;
+    if (val.isDouble())
+        return !std::isnan(val.toDouble());
+    return false;
+}
+
+/// Evaluate `val <op> constant` with the same semantics as SQL
+bool compareCells(const CellValue & val,
+                  ColumnZoneMap::Comparison op,
+                  const CellValue & constant)
+{
+    switch (op) {
+    case ColumnZoneMap::EQ:  return val == constant;
+    case ColumnZoneMap::NE:  return val != constant;
+    case ColumnZoneMap::LT:  return val < constant;
+    case ColumnZoneMap::LE:  return !(constant < val);
+    case ColumnZoneMap::GT:  return constant < val;
+    case ColumnZoneMap::GE:  return !(val < constant);
+    }
+    ExcAssert(false);
+    return true;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+ColumnZoneMap::
+ColumnZoneMap()
+    : numNulls(0), numValues(0),
+      hasNumbers(false), numbersExact(true), minNumber(0), maxNumber(0),
+      hasStrings(false), hasTimestamps(false), hasOther(false),
+      distinctKnown(true)
+{
+}
+
+void
+ColumnZoneMap::
+addValue(const CellValue & val)
+{
+    if (val.empty())
+        return;
+
+    if (distinctKnown) {
+        if (distinctValues.size() < ZONE_MAP_MAX_DISTINCT_VALUES)
+            distinctValues.push_back(val);
+        else {
+            distinctKnown = false;
+            distinctValues.clear();
+        }
+    }
+
+    if (val.isNumeric()) {
+        if (!isExactNumber(val)) {
+            hasNumbers = true;
+            numbersExact = false;
+            return;
+        }
+        double d = val.toDouble();
+        if (!hasNumbers) {
+            minNumber = maxNumber = d;
+            hasNumbers = true;
+        }
+        else {
+            minNumber = std::min(minNumber, d);
+            maxNumber = std::max(maxNumber, d);
+        }
+    }
+    else if (val.isString()) {
+        if (!hasStrings) {
+            minString = maxString = val;
+            hasStrings = true;
+        }
+        else {
+            if (val < minString)
+                minString = val;
+            if (maxString < val)
+                maxString = val;
+        }
+    }
+    else if (val.isTimestamp() && val.toTimestamp().isADate()) {
+        Date ts = val.toTimestamp();
+        if (!hasTimestamps) {
+            minTimestamp = maxTimestamp = ts;
+            hasTimestamps = true;
+        }
+        else {
+            minTimestamp.setMin(ts);
+            maxTimestamp.setMax(ts);
+        }
+    }
+    else {
+        hasOther = true;
+    }
+}
+
+ColumnZoneMap
+ColumnZoneMap::
+fromColumn(const TabularDatasetColumn & column, size_t rowCount)
+{
+    ColumnZoneMap result;
+    result.numValues = column.sparseIndexes.size();
+    ExcAssertLessEqual(result.numValues, rowCount);
+    result.numNulls = rowCount - result.numValues;
+
+    // These are the distinct values; there may be some which were
+    // recorded but then ignored, which is OK as we're conservative
+    for (auto & v: column.indexedVals)
+        result.addValue(v);
+
+    return result;
+}
+
+ColumnZoneMap
+ColumnZoneMap::
+fromFrozen(const FrozenColumn & column, size_t rowCount)
+{
+    ColumnZoneMap result;
+    for (size_t i = 0;  i < rowCount;  ++i) {
+        if (column.get(i).empty())
+            ++result.numNulls;
+        else ++result.numValues;
+    }
+
+    auto onValue = [&] (const CellValue & val)
+        {
+            result.addValue(val);
+            return true;
+        };
+
+    column.forEachDistinctValue(onValue);
+
+    return result;
+}
+
+bool
+ColumnZoneMap::
+mayMatch(Comparison op, const CellValue & constant) const
+{
+    ExcAssert(!constant.empty());
+
+    // A comparison with null is null, which is never true
+    if (numValues == 0)
+        return false;
+
+    if (distinctKnown) {
+        for (auto & v: distinctValues) {
+            if (compareCells(v, op, constant))
+                return true;
+        }
+        return false;
+    }
+
+    if (op == NE)
+        return true;
+
+    // Otherwise, we use the ranges.  Numbers sort before strings; we don't
+    // try to reason about how other types sort against them.
+    if (constant.isNumeric()) {
+        if (!isExactNumber(constant) || !numbersExact
+            || hasTimestamps || hasOther)
+            return true;
+
+        double d = constant.toDouble();
+        switch (op) {
+        case EQ:  return hasNumbers && d >= minNumber && d <= maxNumber;
+        case LT:  return hasNumbers && minNumber < d;
+        case LE:  return hasNumbers && minNumber <= d;
+        case GT:  return (hasNumbers && maxNumber > d) || hasStrings;
+        case GE:  return (hasNumbers && maxNumber >= d) || hasStrings;
+        default:  return true;
+        }
+    }
+    else if (constant.isString()) {
+        if (hasTimestamps || hasOther)
+            return true;
+
+        switch (op) {
+        case EQ:
+            return hasStrings
+                && !(constant < minString) && !(maxString < constant);
+        case LT:  return hasNumbers || (hasStrings && minString < constant);
+        case LE:  return hasNumbers || (hasStrings && !(constant < minString));
+        case GT:  return hasStrings && constant < maxString;
+        case GE:  return hasStrings && !(maxString < constant);
+        default:  return true;
+        }
+    }
+    else if (constant.isTimestamp()) {
+        Date ts = constant.toTimestamp();
+        if (!ts.isADate() || hasNumbers || hasStrings || hasOther)
+            return true;
+        if (!hasTimestamps)
+            return false;
+
+        switch (op) {
+        case EQ:  return ts >= minTimestamp && ts <= maxTimestamp;
+        case LT:  return minTimestamp < ts;
+        case LE:  return minTimestamp <= ts;
+        case GT:  return maxTimestamp > ts;
+        case GE:  return maxTimestamp >= ts;
+        default:  return true;
+        }
+    }
+
+    return true;
+}
+
+void
+ColumnZoneMap::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << ML::DB::compact_size_t(numNulls)
+          << ML::DB::compact_size_t(numValues)
+          << hasNumbers << numbersExact << minNumber << maxNumber
+          << hasStrings;
+    if (hasStrings) {
+        minString.serialize(store);
+        maxString.serialize(store);
+    }
+    store << hasTimestamps << minTimestamp.secondsSinceEpoch()
+          << maxTimestamp.secondsSinceEpoch()
+          << hasOther << distinctKnown
+          << ML::DB::compact_size_t(distinctValues.size());
+    for (auto & v: distinctValues)
+        v.serialize(store);
+}
+
+void
+ColumnZoneMap::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    ML::DB::compact_size_t nulls(store), values(store);
+    numNulls = nulls;
+    numValues = values;
+    store >> hasNumbers >> numbersExact >> minNumber >> maxNumber
+          >> hasStrings;
+    if (hasStrings) {
+        minString.reconstitute(store);
+        maxString.reconstitute(store);
+    }
+    double minTs, maxTs;
+    store >> hasTimestamps >> minTs >> maxTs >> hasOther >> distinctKnown;
+    minTimestamp = Date::fromSecondsSinceEpoch(minTs);
+    maxTimestamp = Date::fromSecondsSinceEpoch(maxTs);
+    ML::DB::compact_size_t numDistinct(store);
+    distinctValues.resize(numDistinct);
+    for (auto & v: distinctValues)
+        v.reconstitute(store);
+}
+
+
+/*****************************************************************************/
+/* ZONE MAP PREDICATE                                                        */
+/*****************************************************************************/
+
+bool
+ZoneMapPredicate::
+mayMatch(const GetZoneMap & getZoneMap) const
+{
+    switch (kind) {
+    case COMPARE: {
+        const ColumnZoneMap * zoneMap = getZoneMap(columnName);
+        return zoneMap && zoneMap->mayMatch(op, constant);
+    }
+    case IS_NULL: {
+        const ColumnZoneMap * zoneMap = getZoneMap(columnName);
+        return !zoneMap || zoneMap->numNulls > 0;
+    }
+    case IS_NOT_NULL: {
+        const ColumnZoneMap * zoneMap = getZoneMap(columnName);
+        return zoneMap && zoneMap->numValues > 0;
+    }
+    case AND:
+        return lhs->mayMatch(getZoneMap) && rhs->mayMatch(getZoneMap);
+    case OR:
+        return lhs->mayMatch(getZoneMap) || rhs->mayMatch(getZoneMap);
+    }
+    ExcAssert(false);
+    return true;
+}
+
+namespace {
+
+/// Return the column read by the expression, or null if it's not a read
+const ReadColumnExpression * getColumn(const SqlExpression & expr)
+{
+    return dynamic_cast<const ReadColumnExpression *>(&expr);
+}
+
+/// Return the non-null atom the expression evaluates to, or an empty value
+/// if it's not such a constant
+CellValue getConstantAtom(const SqlExpression & expr)
+{
+    auto constant = dynamic_cast<const ConstantExpression *>(&expr);
+    if (!constant || !constant->constant.isAtom())
+        return CellValue();
+    return constant->constant.getAtom();
+}
+
+std::shared_ptr<ZoneMapPredicate>
+makeComparison(const ColumnName & columnName,
+               ColumnZoneMap::Comparison op,
+               CellValue constant)
+{
+    auto result = std::make_shared<ZoneMapPredicate>();
+    result->kind = ZoneMapPredicate::COMPARE;
+    result->columnName = columnName;
+    result->op = op;
+    result->constant = std::move(constant);
+    return result;
+}
+
+std::shared_ptr<ZoneMapPredicate>
+makeBoolean(ZoneMapPredicate::Kind kind,
+            std::shared_ptr<ZoneMapPredicate> lhs,
+            std::shared_ptr<ZoneMapPredicate> rhs)
+{
+    auto result = std::make_shared<ZoneMapPredicate>();
+    result->kind = kind;
+    result->lhs = std::move(lhs);
+    result->rhs = std::move(rhs);
+    return result;
+}
+
+} // file scope
+
+std::shared_ptr<ZoneMapPredicate>
+ZoneMapPredicate::
+fromExpression(const SqlExpression & where,
+               const std::function<ColumnName (const ColumnName &)>
+                   & resolveColumn)
+{
+    if (auto boolean
+        = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+        if (boolean->op == "AND" && boolean->lhs) {
+            // Either side not matching means the AND can't match
+            auto lhs = fromExpression(*boolean->lhs, resolveColumn);
+            auto rhs = fromExpression(*boolean->rhs, resolveColumn);
+            if (!lhs)
+                return rhs;
+            if (!rhs)
+                return lhs;
+            return makeBoolean(AND, std::move(lhs), std::move(rhs));
+        }
+        else if (boolean->op == "OR" && boolean->lhs) {
+            // Both sides need to be known not to match
+            auto lhs = fromExpression(*boolean->lhs, resolveColumn);
+            auto rhs = fromExpression(*boolean->rhs, resolveColumn);
+            if (!lhs || !rhs)
+                return nullptr;
+            return makeBoolean(OR, std::move(lhs), std::move(rhs));
+        }
+        return nullptr;
+    }
+
+    if (auto comparison
+        = dynamic_cast<const ComparisonExpression *>(&where)) {
+        ColumnZoneMap::Comparison op;
+        if (comparison->op == "=" || comparison->op == "==")
+            op = ColumnZoneMap::EQ;
+        else if (comparison->op == "!=")
+            op = ColumnZoneMap::NE;
+        else if (comparison->op == "<")
+            op = ColumnZoneMap::LT;
+        else if (comparison->op == "<=")
+            op = ColumnZoneMap::LE;
+        else if (comparison->op == ">")
+            op = ColumnZoneMap::GT;
+        else if (comparison->op == ">=")
+            op = ColumnZoneMap::GE;
+        else return nullptr;
+
+        const ReadColumnExpression * column = getColumn(*comparison->lhs);
+        CellValue constant = getConstantAtom(*comparison->rhs);
+
+        if (!column) {
+            // Try constant <op> column, which is column <reversed op> constant
+            column = getColumn(*comparison->rhs);
+            constant = getConstantAtom(*comparison->lhs);
+            switch (op) {
+            case ColumnZoneMap::LT:  op = ColumnZoneMap::GT;  break;
+            case ColumnZoneMap::LE:  op = ColumnZoneMap::GE;  break;
+            case ColumnZoneMap::GT:  op = ColumnZoneMap::LT;  break;
+            case ColumnZoneMap::GE:  op = ColumnZoneMap::LE;  break;
+            default:  break;
+            }
+        }
+
+        if (!column || constant.empty())
+            return nullptr;
+
+        return makeComparison(resolveColumn(column->columnName), op,
+                              std::move(constant));
+    }
+
+    if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+        const ReadColumnExpression * column = getColumn(*isType->expr);
+        if (!column || isType->type != "null")
+            return nullptr;
+        auto result = std::make_shared<ZoneMapPredicate>();
+        result->kind = isType->notType ? IS_NOT_NULL : IS_NULL;
+        result->columnName = resolveColumn(column->columnName);
+        return result;
+    }
+
+    if (auto between = dynamic_cast<const BetweenExpression *>(&where)) {
+        const ReadColumnExpression * column = getColumn(*between->expr);
+        CellValue lower = getConstantAtom(*between->lower);
+        CellValue upper = getConstantAtom(*between->upper);
+        if (!column || between->notBetween || lower.empty() || upper.empty())
+            return nullptr;
+        ColumnName columnName = resolveColumn(column->columnName);
+        return makeBoolean
+            (AND,
+             makeComparison(columnName, ColumnZoneMap::GE, std::move(lower)),
+             makeComparison(columnName, ColumnZoneMap::LE, std::move(upper)));
+    }
+
+    if (auto in = dynamic_cast<const InExpression *>(&where)) {
+        if (in->kind != InExpression::TUPLE || in->isnegative || !in->tuple)
+            return nullptr;
+        const ReadColumnExpression * column = getColumn(*in->expr);
+        if (!column || in->tuple->clauses.empty())
+            return nullptr;
+
+        ColumnName columnName = resolveColumn(column->columnName);
+        std::shared_ptr<ZoneMapPredicate> result;
+        for (auto & clause: in->tuple->clauses) {
+            CellValue constant = getConstantAtom(*clause);
+            if (constant.empty())
+                return nullptr;
+            auto eq = makeComparison(columnName, ColumnZoneMap::EQ,
+                                     std::move(constant));
+            result = result ? makeBoolean(OR, std::move(result), std::move(eq))
+                : std::move(eq);
+        }
+        return result;
+    }
+
+    return nullptr;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
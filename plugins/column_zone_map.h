@@ -0,0 +1,141 @@
+/** column_zone_map.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Summaries of the values of a column within a chunk of a tabular dataset
+    (zone maps), and predicates over them that allow whole chunks to be
+    skipped when scanning with a WHERE clause.
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include "mldb/sql/path.h"
+#include "mldb/jml/db/persistent_fwd.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Datacratic {
+namespace MLDB {
+
+struct TabularDatasetColumn;
+struct FrozenColumn;
+struct SqlExpression;
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+/** Summary of the values of a column over the rows of a single chunk.  It
+    records the number of null and non-null rows, the range of the values
+    of each broad type and, when there are only a few of them, the set of
+    distinct values.
+
+    The summary is conservative: it may describe values that don't occur
+    in the chunk, but every value that does occur is described.
+*/
+
+struct ColumnZoneMap {
+    ColumnZoneMap();
+
+    /// Comparison between the column and a constant
+    enum Comparison {
+        EQ, NE, LT, LE, GT, GE
+    };
+
+    uint64_t numNulls;        ///< Number of rows with no value
+    uint64_t numValues;       ///< Number of rows with a value
+
+    /// Numeric values.  The range is only usable if numbersExact is set;
+    /// it's cleared by NaN or by integers that can't be held in a double.
+    bool hasNumbers;
+    bool numbersExact;
+    double minNumber;
+    double maxNumber;
+
+    /// String values, with their range in CellValue order
+    bool hasStrings;
+    CellValue minString;
+    CellValue maxString;
+
+    /// Timestamp values and their range
+    bool hasTimestamps;
+    Date minTimestamp;
+    Date maxTimestamp;
+
+    /// Any other type (blobs, paths, intervals)
+    bool hasOther;
+
+    /// If set, distinctValues holds every distinct value
+    bool distinctKnown;
+    std::vector<CellValue> distinctValues;
+
+    /// Add the given distinct non-null value
+    void addValue(const CellValue & val);
+
+    /// Summarize a column as it is frozen into a chunk of rowCount rows
+    static ColumnZoneMap fromColumn(const TabularDatasetColumn & column,
+                                    size_t rowCount);
+
+    /// Summarize an already frozen column by scanning it
+    static ColumnZoneMap fromFrozen(const FrozenColumn & column,
+                                    size_t rowCount);
+
+    /** Could any row have a value for which `value <op> constant` is
+        true?  The constant must not be null.
+    */
+    bool mayMatch(Comparison op, const CellValue & constant) const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+};
+
+
+/*****************************************************************************/
+/* ZONE MAP PREDICATE                                                        */
+/*****************************************************************************/
+
+/** The parts of a WHERE clause that can be tested against the zone maps of
+    a chunk: comparisons, BETWEEN and IN between a column and constants,
+    IS [NOT] NULL, and AND / OR of these.  If the predicate doesn't match
+    a chunk, then no row of the chunk can match the WHERE clause.
+*/
+
+struct ZoneMapPredicate {
+    enum Kind {
+        COMPARE,       ///< column <op> constant
+        IS_NULL,       ///< column IS NULL
+        IS_NOT_NULL,   ///< column IS NOT NULL
+        AND,           ///< lhs AND rhs
+        OR             ///< lhs OR rhs
+    };
+
+    Kind kind;
+    ColumnName columnName;
+    ColumnZoneMap::Comparison op;
+    CellValue constant;
+    std::shared_ptr<ZoneMapPredicate> lhs;
+    std::shared_ptr<ZoneMapPredicate> rhs;
+
+    /** Return the zone map of the given column in a chunk, or null if the
+        chunk has no values for the column.
+    */
+    typedef std::function<const ColumnZoneMap * (const ColumnName & columnName)>
+        GetZoneMap;
+
+    /// Can the chunk described by the zone maps contain a matching row?
+    bool mayMatch(const GetZoneMap & getZoneMap) const;
+
+    /** Extract the predicate from a WHERE clause.  Column names are passed
+        through resolveColumn, to remove any table alias.  Returns null if
+        no part of the clause can be tested against zone maps.
+    */
+    static std::shared_ptr<ZoneMapPredicate>
+    fromExpression(const SqlExpression & where,
+                   const std::function<ColumnName (const ColumnName &)>
+                       & resolveColumn);
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -23,7 +23,17 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/soa/utils/csv_writer.h"
 #include "mldb/plugins/sql_config_validator.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/cancellation.h"
+#include "mldb/arch/format.h"
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <unordered_map>
 
 using namespace std;
 
@@ -61,6 +71,13 @@ CsvExportProcedureConfigDescription()
              "    [Built-in Functions](../sql/ValueExpression.md.html) documentation for the\n"
              "    complete list of aggregators.\n\n",
              false);
+    addField("numFiles", &CsvExportProcedureConfig::numFiles,
+             "Number of files to split the output into.  When greater "
+             "than 1, the files are named by inserting `-00000`, `-00001`, "
+             "... before the extension of `dataFileUrl`, and each gets its "
+             "own header line.  Rows are dealt out to the files in blocks, "
+             "so that the files are written (and compressed) in parallel.",
+             1);
 
     addParent<ProcedureConfig>();
 
@@ -73,10 +90,100 @@ CsvExportProcedureConfigDescription()
         if (cfg->quoteChar.size() != 1) {
             throw ML::Exception("Quotechar must be 1 char long.");
         }
+        if (cfg->numFiles < 1) {
+            throw ML::Exception("numFiles must be at least 1.");
+        }
         MustContainFrom()(cfg->exportData, CsvExportProcedureConfig::name);
     };
 }
 
+namespace {
+
+/** Return the URL of the given part of a multi-file export: the part
+    number is inserted before the first extension of the file name, so
+    that "out.csv.gz" becomes "out-00003.csv.gz".
+*/
+Url getPartUrl(const Url & url, int part)
+{
+    std::string str = url.toString();
+    size_t nameStart = str.rfind('/');
+    nameStart = (nameStart == std::string::npos ? 0 : nameStart + 1);
+    size_t ext = str.find('.', nameStart);
+    if (ext == std::string::npos)
+        ext = str.size();
+    return Url(str.substr(0, ext) + ML::format("-%05d", part)
+               + str.substr(ext));
+}
+
+/** Writes the formatted chunks of a CSV export to its files.  Chunks are
+    numbered in the order of their rows; chunk n goes to file
+    n % numFiles, and each file receives its chunks in order whatever
+    order they are finished in.  Each file has its own lock so that
+    different files are written, and compressed, in parallel.
+*/
+struct CsvChunkWriter {
+    CsvChunkWriter(const Url & url, int numFiles)
+    {
+        for (int i = 0;  i < numFiles;  ++i) {
+            files.emplace_back(new File());
+            files.back()->stream.open(numFiles == 1 ? url : getPartUrl(url, i));
+        }
+    }
+
+    /// Write the same text (ie, the header) at the start of each file
+    void writeToAll(const std::string & text)
+    {
+        for (auto & f: files)
+            f->stream << text;
+    }
+
+    void write(size_t chunkNum, std::string text)
+    {
+        File & file = *files[chunkNum % files.size()];
+        size_t seq = chunkNum / files.size();
+
+        std::unique_lock<std::mutex> guard(file.mutex);
+        if (seq != file.nextSeq) {
+            file.pending.emplace(seq, std::move(text));
+            return;
+        }
+
+        file.stream << text;
+        ++file.nextSeq;
+
+        // Write out anything that was waiting for us
+        for (auto it = file.pending.begin();
+             it != file.pending.end() && it->first == file.nextSeq;
+             it = file.pending.erase(it), ++file.nextSeq) {
+            file.stream << it->second;
+        }
+    }
+
+    void close()
+    {
+        for (auto & f: files) {
+            ExcAssert(f->pending.empty());
+            f->stream.close();
+        }
+    }
+
+    struct File {
+        File()
+            : nextSeq(0)
+        {
+        }
+
+        std::mutex mutex;
+        filter_ostream stream;
+        size_t nextSeq;                          ///< Next chunk to write
+        std::map<size_t, std::string> pending;   ///< Finished out of order
+    };
+
+    std::vector<std::unique_ptr<File> > files;
+};
+
+} // file scope
+
 CsvExportProcedure::
 CsvExportProcedure(MldbServer * owner,
                  PolyConfig config,
@@ -93,9 +200,9 @@ run(const ProcedureRunConfig & run,
 {
     auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
     SqlExpressionMldbScope context(server);
-    filter_ostream out(runProcConf.dataFileUrl);
-    CsvWriter csv(out, runProcConf.delimiter.at(0),
-                  runProcConf.quoteChar.at(0));
+    CsvChunkWriter writer(runProcConf.dataFileUrl, runProcConf.numFiles);
+    const char delimiter = runProcConf.delimiter.at(0);
+    const char quoteChar = runProcConf.quoteChar.at(0);
 
     auto boundDataset = runProcConf.exportData.stm->from->bind(context);
 
@@ -109,113 +216,175 @@ run(const ProcedureRunConfig & run,
                          calc);
 
     const auto columnNames = bsq.getSelectOutputInfo()->allColumnNames();
-    vector<string> lineBuffer; // keeps the data that cannot be outputed
-                               // yet to the csv due to the ordering difference
-                               // between columnNames and the order in which
-                               // columns are in the bound select query execute
     const auto lineSize = columnNames.size();
-    lineBuffer.resize(columnNames.size());
-    const auto columnNamesEnd = columnNames.end();
-    const auto columnNamesBegin = columnNames.begin();
-    auto outputCsvLine = [&] (NamedRowValue & row_,
-                              const vector<ExpressionValue> & calc)
+
+    // Output positions of each column.  A column can have more than one
+    // position when it's found both in an explicit statement and a star
+    // clause; its values then fill the positions in order.
+    std::unordered_map<ColumnName, std::vector<uint32_t>, PathNewHasher>
+        columnPositions;
+    for (size_t i = 0;  i < lineSize;  ++i)
+        columnPositions[columnNames[i]].push_back(i);
+
+    auto formatRow = [&] (NamedRowValue & row_, CsvWriter & csv,
+                          std::vector<const CellValue *> & line)
     {
         MatrixNamedRow row = row_.flattenDestructive();
-        ExcAssert(lineBuffer.size() == columnNames.size());
-        size_t lineBufferIndex = 0; // position of the buffered value ready to
-                                    // be outputed
-
-        auto outputLineBuffer = [&] () {
-            // inline function to make sure the index is set to "" after each
-            // use
-            csv << lineBuffer[lineBufferIndex];
-            lineBuffer[lineBufferIndex] = "";
-        };
+        line.assign(lineSize, nullptr);
 
         for (const auto & col: row.columns) {
-            const auto & seekColumn = std::get<0>(col); // the column to seek in
-                                                      // the csv ordering
-            auto columnNamesIt = columnNames.begin() + lineBufferIndex;
-            size_t columnIndex;
-
-            auto updatePointers = [&] () {
-                // Linear performance will hurt if there are many columns
-                for (; *columnNamesIt != seekColumn; ++ columnNamesIt) {
-                    // column must always be found, otherwise me should be in a
-                    // context where cells have multiple values.
-                    if (columnNamesIt == columnNamesEnd) {
-                        if(runProcConf.skipDuplicateCells)
-                            return false;
-
-                        throw ML::Exception(Utf8String("CSV export does not work over "
-                                "cells having multiple values, at row '" + row.rowName.toUtf8String() +
-                                "' for column '" + seekColumn.toUtf8String() + "'").utf8String());
+            const auto & columnName = std::get<0>(col);
+            auto it = columnPositions.find(columnName);
+            const CellValue ** slot = nullptr;
+            if (it != columnPositions.end()) {
+                for (uint32_t pos: it->second) {
+                    if (!line[pos]) {
+                        slot = &line[pos];
+                        break;
                     }
                 }
-                columnIndex = columnNamesIt - columnNamesBegin;
-                return true;
-            };
-            if(!updatePointers())
-                continue;
-
-            if (columnIndex == lineBufferIndex) {
-                // immediate output
-                csv << std::get<1>(col).toUtf8String().rawString();
-                ++ lineBufferIndex;
-
-                // check if the buffer is filled on the next position and
-                // output it as long as it is
-                for (; lineBufferIndex < lineSize
-                       && lineBuffer[lineBufferIndex] != "";
-                     ++ lineBufferIndex)
-                {
-                    outputLineBuffer();
-                }
             }
-            else {
-                // store for later
-
-                if (lineBuffer[columnIndex] != "") {
-                    // collision - Happens when a column is found both in an
-                    // explicit statement and a star clause. Since they don't
-                    // mingle, having a collision means we can output until the
-                    // current columnIndex
-                    for (; lineBufferIndex <= columnIndex
-                        && lineBuffer[lineBufferIndex] != "";
-                        ++ lineBufferIndex)
-                    {
-                        outputLineBuffer();
-                    }
-                    // find the next index where to store, collision are not
-                    // possible
-                    ++ columnNamesIt;
-                    if(!updatePointers())
-                        continue;
-                }
-                ExcAssert(lineBuffer[columnIndex] == "");
-                lineBuffer[columnIndex] =
-                    std::get<1>(col).toUtf8String().rawString();
+
+            // If there is nowhere to put the value, we must be in a context
+            // where cells have multiple values.
+            if (!slot) {
+                if (runProcConf.skipDuplicateCells)
+                    continue;
+                throw ML::Exception(Utf8String("CSV export does not work over "
+                        "cells having multiple values, at row '" + row.rowName.toUtf8String() +
+                        "' for column '" + columnName.toUtf8String() + "'").utf8String());
             }
+            *slot = &std::get<1>(col);
         }
 
-        // output until the end of the buffer
-        for (; lineBufferIndex < lineSize; ++ lineBufferIndex) {
-            outputLineBuffer();
-        }
+        for (auto & cell: line)
+            csv << (cell ? cell->toUtf8String() : Utf8String());
         csv.endl();
-        return true;
     };
 
     if (runProcConf.headers) {
-        for (const auto & name: bsq.getSelectOutputInfo()->allColumnNames()) {
+        std::ostringstream header;
+        CsvWriter csv(header, delimiter, quoteChar);
+        for (const auto & name: columnNames) {
             csv << name.toUtf8String();
         }
         csv.endl();
+        writer.writeToAll(header.str());
     }
-    bsq.execute({outputCsvLine, false/*processInParallel*/},
-                runProcConf.exportData.stm->offset,
-                runProcConf.exportData.stm->limit,
-                onProgress);
+
+    // Rows are gathered into chunks, which are formatted on the thread
+    // pool as the query produces the next ones.  We bound the number of
+    // chunks in flight so that a slow output doesn't make us hold the
+    // whole export in memory.  Once at the bound, we wait for the oldest
+    // chunk only, so that the others keep being formatted meanwhile.
+    static constexpr size_t ROWS_PER_CHUNK = 1024;
+    const size_t maxChunksInFlight = 4 * numCpus();
+
+    ThreadPool tp;
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+    std::deque<std::shared_ptr<bool> > inFlight;  ///< Done flags, oldest first
+    std::atomic<int> hasExc(false);
+    std::exception_ptr exc;
+    std::mutex excMutex;
+    CancellationToken * token = currentCancellationToken();
+
+    size_t chunkNum = 0;
+    auto chunk = std::make_shared<std::vector<NamedRowValue> >();
+    chunk->reserve(ROWS_PER_CHUNK);
+
+    auto rethrowIfFailed = [&] ()
+    {
+        if (hasExc) {
+            tp.waitForAll();
+            std::rethrow_exception(exc);
+        }
+    };
+
+    auto isDone = [&] (const std::shared_ptr<bool> & done)
+    {
+        std::unique_lock<std::mutex> guard(doneMutex);
+        return *done;
+    };
+
+    auto submitChunk = [&] ()
+    {
+        while (!inFlight.empty() && isDone(inFlight.front()))
+            inFlight.pop_front();
+
+        if (inFlight.size() >= maxChunksInFlight) {
+            // Help with the formatting while we wait for the oldest chunk
+            auto oldest = inFlight.front();
+            while (!isDone(oldest)) {
+                if (tp.work())
+                    continue;
+                std::unique_lock<std::mutex> guard(doneMutex);
+                doneCond.wait_for(guard, std::chrono::milliseconds(1),
+                                  [&] () { return *oldest; });
+            }
+            inFlight.pop_front();
+        }
+        rethrowIfFailed();
+
+        auto done = std::make_shared<bool>(false);
+        inFlight.push_back(done);
+        size_t myChunkNum = chunkNum++;
+        std::shared_ptr<std::vector<NamedRowValue> > rows = std::move(chunk);
+        chunk = std::make_shared<std::vector<NamedRowValue> >();
+        chunk->reserve(ROWS_PER_CHUNK);
+
+        tp.add([&, myChunkNum, rows, done] ()
+            {
+                CancellationScope cancellationScope(token);
+                try {
+                    if (!hasExc) {
+                        std::ostringstream text;
+                        CsvWriter csv(text, delimiter, quoteChar);
+                        std::vector<const CellValue *> line;
+                        for (auto & row: *rows)
+                            formatRow(row, csv, line);
+                        writer.write(myChunkNum, text.str());
+                    }
+                } catch (...) {
+                    std::unique_lock<std::mutex> guard(excMutex);
+                    if (!hasExc) {
+                        exc = std::current_exception();
+                        hasExc = true;
+                    }
+                }
+                {
+                    std::unique_lock<std::mutex> guard(doneMutex);
+                    *done = true;
+                }
+                doneCond.notify_all();
+            });
+    };
+
+    auto addRow = [&] (NamedRowValue & row,
+                       const vector<ExpressionValue> & calc)
+    {
+        chunk->emplace_back(std::move(row));
+        if (chunk->size() == ROWS_PER_CHUNK)
+            submitChunk();
+        return true;
+    };
+
+    try {
+        bsq.execute({addRow, false/*processInParallel*/},
+                    runProcConf.exportData.stm->offset,
+                    runProcConf.exportData.stm->limit,
+                    onProgress);
+        if (!chunk->empty())
+            submitChunk();
+    } catch (...) {
+        tp.waitForAll();
+        throw;
+    }
+
+    tp.waitForAll();
+    rethrowIfFailed();
+    writer.close();
+
     RunOutput output;
     return output;
 }
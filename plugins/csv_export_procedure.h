@@ -16,7 +16,7 @@ namespace MLDB {
 struct CsvExportProcedureConfig : ProcedureConfig {
     CsvExportProcedureConfig()
         : headers(true), skipDuplicateCells(false),
-          delimiter(","), quoteChar("\"")
+          delimiter(","), quoteChar("\""), numFiles(1)
     {
     }
 
@@ -28,6 +28,7 @@ struct CsvExportProcedureConfig : ProcedureConfig {
     bool skipDuplicateCells;
     std::string delimiter;
     std::string quoteChar;
+    int numFiles;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(CsvExportProcedureConfig);
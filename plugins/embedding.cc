@@ -9,6 +9,8 @@
 
 #include "embedding.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
+#include "mldb/ml/hnsw_index.h"
+#include "mldb/ml/quantized_vectors.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -68,6 +70,40 @@ operator >> (ML::DB::Store_Reader & store, Path & coords)
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(NeighborsIndex);
+
+NeighborsIndexDescription::
+NeighborsIndexDescription()
+{
+    addValue("vptree", NEIGHBORS_INDEX_VP_TREE,
+             "Exact index in a vantage point tree, which is rebuilt from "
+             "scratch on each commit.  This works well for embeddings with "
+             "few dimensions, like the t-SNE.");
+    addValue("hnsw", NEIGHBORS_INDEX_HNSW,
+             "Approximate index in a hierarchical navigable small world "
+             "graph, to which the rows recorded since the last commit are "
+             "added on each commit.  This is much faster to build and query "
+             "for embeddings with many dimensions or rows, but may miss "
+             "some of the nearest neighbors.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingStorage);
+
+EmbeddingStorageDescription::
+EmbeddingStorageDescription()
+{
+    addValue("float32", EMBEDDING_STORAGE_FLOAT32,
+             "Store each value as a 32 bit float, exactly as recorded.");
+    addValue("int8", EMBEDDING_STORAGE_INT8,
+             "Store each value of a row as a signed byte, scaled so that "
+             "the largest magnitude value of the row is 127.  This takes "
+             "about 8 times less memory than float32 storage, and "
+             "distances are calculated directly on the bytes.  Values read "
+             "back from the dataset and the distances to neighbors are "
+             "approximate, to within 1/254th of the largest magnitude value "
+             "of the row.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -81,6 +117,26 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("storage", &EmbeddingDatasetConfig::storage,
+             "How the coordinates of each row are stored in memory.",
+             EMBEDDING_STORAGE_FLOAT32);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used for nearest neighbors calculations.",
+             NEIGHBORS_INDEX_VP_TREE);
+    addField("hnswM", &EmbeddingDatasetConfig::hnswM,
+             "Number of neighbors each row is linked to in the HNSW index. "
+             "Higher values give more accurate results for embeddings with "
+             "many dimensions, at the expense of memory and indexing time.",
+             16);
+    addField("hnswEfConstruction", &EmbeddingDatasetConfig::hnswEfConstruction,
+             "Number of candidate neighbors considered when adding a row to "
+             "the HNSW index.  Higher values give a better index, at the "
+             "expense of indexing time.", 200);
+    addField("hnswEfSearch", &EmbeddingDatasetConfig::hnswEfSearch,
+             "Number of candidate neighbors considered when querying the "
+             "HNSW index.  Higher values give more accurate results, at the "
+             "expense of query time.  At least as many candidates as the "
+             "number of neighbors asked for are always considered.", 50);
 }
 
 
@@ -89,31 +145,66 @@ EmbeddingDatasetConfigDescription()
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : config(config),
+          vpTree(new ML::VantagePointTreeT<int>()),
+          distance(DistanceMetric::create(config.metric))
     {
+        initIndex();
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnName> columnNames,
-                         MetricSpace metric)
-        : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
+                         const EmbeddingDatasetConfig & config)
+        : config(config),
+          columnNames(std::move(columnNames)), columns(this->columnNames.size()),
           vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          distance(DistanceMetric::create(config.metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
+        if (config.storage == EMBEDDING_STORAGE_INT8)
+            quantized.reset(new QuantizedVectors(this->columnNames.size()));
+        initIndex();
     }
 
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
-        : columnNames(other.columnNames),
+        : config(other.config),
+          columnNames(other.columnNames),
           columns(other.columns),
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          distance(DistanceMetric::create(config.metric))
     {
+        // The metric caches information about each row, which needs to be
+        // there for rows to be added after this copy
+        if (other.quantized)
+            quantized.reset(new QuantizedVectors(*other.quantized));
+        else {
+            for (unsigned i = 0;  i < rows.size();  ++i)
+                distance->addRow(i, rows[i].coords);
+        }
+        if (other.hnsw)
+            hnsw.reset(new HnswIndex(*other.hnsw));
+    }
+
+    void initIndex()
+    {
+        if (config.index != NEIGHBORS_INDEX_HNSW)
+            return;
+
+        HnswIndexParams params;
+        params.m = config.hnswM;
+        params.efConstruction = config.hnswEfConstruction;
+        params.efSearch = config.hnswEfSearch;
+        if (params.m < 2 || params.efConstruction < 1 || params.efSearch < 1)
+            throw HttpReturnException(400, "Invalid parameters for HNSW index",
+                                      "hnswM", params.m,
+                                      "hnswEfConstruction", params.efConstruction,
+                                      "hnswEfSearch", params.efSearch);
+        hnsw.reset(new HnswIndex(params));
     }
 
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
@@ -161,6 +252,40 @@ struct EmbeddingDatasetRepr {
         }
     };
 
+    /** Index the coordinates of the row that was just added to rows.
+        With int8 storage, they are quantized and the floats are freed.
+    */
+    void addCoords(unsigned row)
+    {
+        ML::distribution<float> & coords = rows.at(row).coords;
+        if (quantized) {
+            ExcAssertEqual(row, quantized->size());
+            quantized->add(coords.data());
+            ML::distribution<float>().swap(coords);
+        }
+        else distance->addRow(row, coords);
+    }
+
+    /// Value of the given column of the given row
+    float value(unsigned row, unsigned col) const
+    {
+        if (quantized)
+            return quantized->value(row, col);
+        return rows[row].coords[col];
+    }
+
+    /// Values of the given column, for each row
+    std::vector<float> getColumnValues(unsigned col) const
+    {
+        if (!quantized)
+            return columns.at(col);
+
+        std::vector<float> result(rows.size());
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            result[i] = quantized->value(i, col);
+        return result;
+    }
+
     float dist(unsigned row1, unsigned row2) const
     {
         ExcAssertLess(row1, rows.size());
@@ -169,9 +294,17 @@ struct EmbeddingDatasetRepr {
         if (row1 == row2)
             return 0.0f;
         
-        float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+        float result;
+        if (quantized) {
+            result = distance->distFromDotProduct
+                (quantized->dotprod(row1, row2),
+                 quantized->sqNorm(row1), quantized->sqNorm(row2));
+        }
+        else {
+            result = distance->dist(row1, row2,
+                                    rows[row1].coords,
+                                    rows[row2].coords);
+        }
         
         ExcAssert(isfinite(result));
         return result;
@@ -179,14 +312,42 @@ struct EmbeddingDatasetRepr {
 
     float dist(unsigned row1, const ML::distribution<float> & row2) const
     {
-        ExcAssertLess(row1, rows.size());
-        ExcAssertEqual(row2.size(), columns.size());
-        
-        float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
-                                      row2);
-        ExcAssert(isfinite(result));
-        return result;
+        return queryDistance(row2)(row1);
+    }
+
+    /** Return a function giving the distance between the given query and
+        a row.  The query must outlive the function.  With int8 storage,
+        the query stays in floats and is multiplied directly with each
+        row's bytes.
+    */
+    std::function<float (int)>
+    queryDistance(const ML::distribution<float> & query) const
+    {
+        ExcAssertEqual(query.size(), columns.size());
+
+        if (!quantized) {
+            return [this, &query] (int row) -> float
+                {
+                    ExcAssertLess(row, rows.size());
+                    float result = distance->dist(row, -1,
+                                                  rows[row].coords,
+                                                  query);
+                    ExcAssert(isfinite(result));
+                    return result;
+                };
+        }
+
+        double querySqNorm = query.dotprod(query);
+
+        return [this, &query, querySqNorm] (int row) -> float
+            {
+                ExcAssertLess(row, rows.size());
+                float result = distance->distFromDotProduct
+                    (quantized->dotprod(row, query.data()),
+                     quantized->sqNorm(row), querySqNorm);
+                ExcAssert(isfinite(result));
+                return result;
+            };
     }
     
     std::pair<Date, Date> getTimestampRange() const
@@ -210,6 +371,7 @@ struct EmbeddingDatasetRepr {
         return { earliest, latest };
     }
     
+    EmbeddingDatasetConfig config;
     std::vector<ColumnName> columnNames;
     std::vector<std::vector<float> > columns;
     ML::Lightweight_Hash<ColumnHash, int> columnIndex;
@@ -220,6 +382,26 @@ struct EmbeddingDatasetRepr {
     std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
     std::unique_ptr<DistanceMetric> distance;
 
+    /// If the HNSW index is used, it's here and vpTree is empty
+    std::unique_ptr<HnswIndex> hnsw;
+
+    /// With int8 storage, the coordinates of each row are here instead of
+    /// in rows, and columns is empty
+    std::unique_ptr<QuantizedVectors> quantized;
+
+    /** Return the at most numNeighbors rows closest to a query, from
+        whichever index is used.  dist gives the distance between the
+        query and a row.
+    */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist, int numNeighbors,
+           double maxDistance) const
+    {
+        if (hnsw)
+            return hnsw->search(dist, numNeighbors, maxDistance);
+        return vpTree->search(dist, numNeighbors, maxDistance);
+    }
+
     void save(const std::string & filename)
     {
         filter_ostream stream(filename);
@@ -247,21 +429,27 @@ EmbeddingDatasetRepr::
 serialize(ML::DB::Store_Writer & store) const
 {
     store << string("EMBEDDING_DATASET")
-          << ML::DB::compact_size_t(1);  // version
+          << ML::DB::compact_size_t(3);  // version
     store << columnNames << columns << rows;
     vpTree->serialize(store);
+    store << ML::DB::compact_size_t(hnsw ? 1 : 0);
+    if (hnsw)
+        hnsw->serialize(store);
+    store << ML::DB::compact_size_t(quantized ? 1 : 0);
+    if (quantized)
+        quantized->serialize(store);
 }
 
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr)
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr)
     {
     }
 
     // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address)
+    Itl(const std::string & address, const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr), address(address)
     {
     }
 
@@ -270,7 +458,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -393,10 +581,11 @@ struct EmbeddingDataset::Itl
 
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(repr->columnNames.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < repr->columnNames.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i],
+                                        repr->value(it->second, i),
                                         row.timestamp);
         }
         return result;
@@ -417,10 +606,11 @@ struct EmbeddingDataset::Itl
         MatrixRow result;
         result.rowHash = rowHash;
         result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(repr->columnNames.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < repr->columnNames.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i],
+                                        repr->value(it->second, i),
                                         row.timestamp);
         }
         return result;
@@ -521,7 +711,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -546,7 +736,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        vector<float> columnVals = repr->getColumnValues(it->second);
 
         MatrixColumn result;
 
@@ -641,7 +831,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -696,8 +886,7 @@ struct EmbeddingDataset::Itl
                 // Update the row
                 (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
                                                  ts);
-                (*uncommitted).distance->addRow(numRowsBefore,
-                                                (*uncommitted).rows.back().coords);
+                (*uncommitted).addCoords(numRowsBefore);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
                 (*uncommitted).rowIndex[rowHash] = -1;
@@ -749,7 +938,7 @@ struct EmbeddingDataset::Itl
                 
                 //cerr << "columnNames = " << columnNames << endl;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -812,8 +1001,7 @@ struct EmbeddingDataset::Itl
             // Update the row
             (*uncommitted).rows.emplace_back(rowName, std::move(embedding),
                                              latestDate);
-            (*uncommitted).distance->addRow(numRowsBefore,
-                                            (*uncommitted).rows.back().coords);
+            (*uncommitted).addCoords(numRowsBefore);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
             (*uncommitted).rowIndex[rowHash] = -1;
@@ -832,18 +1020,54 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+        // With int8 storage, columns are decoded when asked for instead
+        if (!(*uncommitted).quantized) {
+            for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                (*uncommitted).columns[j].resize((*uncommitted).rows.size());
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
-            {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
-            };
+            // Create the column index; this is a standard matrix inversion
+            auto indexRow = [&] (size_t i)
+                {
+                    for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                        (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
+                };
+
+            parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        }
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        if ((*uncommitted).hnsw) {
+            // Only the rows recorded since the last commit need to be
+            // added to the index
+            HnswIndex & hnsw = *(*uncommitted).hnsw;
+            cerr << "adding " << (*uncommitted).rows.size() - hnsw.size()
+                 << " rows to HNSW index" << endl;
+            ML::Timer timer;
 
+            auto dist = [&] (int item1, int item2) -> float
+                {
+                    return (*uncommitted).dist(item1, item2);
+                };
+
+            hnsw.insert((*uncommitted).rows.size(), dist);
+
+            cerr << "HNSW index done in " << timer.elapsed() << endl;
+        }
+        else {
+            buildVpTree();
+        }
+
+        committed.replace(uncommitted);
+        uncommitted = nullptr;
+
+        if (!address.empty()) {
+            cerr << "saving embedding" << endl;
+            committed()->save(address);
+        }
+    }
+
+    /// Rebuild the vantage point tree of the uncommitted representation
+    void buildVpTree()
+    {
         // Create the vantage point tree
         cerr << "creating vantage point tree" << endl;
         ML::Timer timer;
@@ -891,14 +1115,6 @@ struct EmbeddingDataset::Itl
         (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
 
         cerr << "VP tree done in " << timer.elapsed() << endl;
-        
-        committed.replace(uncommitted);
-        uncommitted = nullptr;
-
-        if (!address.empty()) {
-            cerr << "saving embedding" << endl;
-            committed()->save(address);
-        }
     }
 
     vector<tuple<RowName, RowHash, float> >
@@ -910,16 +1126,11 @@ struct EmbeddingDataset::Itl
         if (!repr->initialized())
             return {};
 
-        auto dist = [&] (int item) -> float
-        {
-            float result = repr->dist(item, coord);
-            ExcAssert(isfinite(result));
-            return result;
-        };
+        auto dist = repr->queryDistance(coord);
 
         //ML::Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance);
 
         //cerr << "neighbors took " << timer.elapsed() << endl;
 
@@ -959,7 +1170,7 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(dist, numNeighbors, maxDistance);
 
         vector<tuple<RowName, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -994,7 +1205,7 @@ EmbeddingDataset(MldbServer * owner,
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
 #if 1
-    itl.reset(new Itl(datasetConfig.metric));
+    itl.reset(new Itl(datasetConfig));
 #else // once persistence is done
 
     if (!config.address.empty()) {
@@ -22,13 +22,34 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+enum NeighborsIndex {
+    NEIGHBORS_INDEX_VP_TREE,   ///< Exact, rebuilt on each commit
+    NEIGHBORS_INDEX_HNSW       ///< Approximate, added to on each commit
+};
+
+DECLARE_ENUM_DESCRIPTION(NeighborsIndex);
+
+enum EmbeddingStorage {
+    EMBEDDING_STORAGE_FLOAT32,   ///< Exact, 4 bytes per value
+    EMBEDDING_STORAGE_INT8       ///< Quantized, 1 byte per value
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingStorage);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), storage(EMBEDDING_STORAGE_FLOAT32),
+          index(NEIGHBORS_INDEX_VP_TREE),
+          hnswM(16), hnswEfConstruction(200), hnswEfSearch(50)
     {
     }
 
     MetricSpace metric;
+    EmbeddingStorage storage;
+    NeighborsIndex index;
+    int hnswM;
+    int hnswEfConstruction;
+    int hnswEfSearch;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
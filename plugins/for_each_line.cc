@@ -8,8 +8,10 @@
 
 #include <atomic>
 #include <exception>
+#include <future>
 #include <mutex>
 #include "for_each_line.h"
+#include "text_scan.h"
 #include "mldb/arch/threads.h"
 #include <chrono>
 #include <thread>
@@ -17,6 +19,7 @@
 #include "mldb/jml/utils/ring_buffer.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/thread_pool.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/types/date.h"
 
@@ -251,11 +254,16 @@ void forEachLineBlock(std::istream & stream,
 {
     //static constexpr int64_t BLOCK_SIZE = 100000000;  // 100MB blocks
     static constexpr int64_t BLOCK_SIZE = 20000000;  // 20MB blocks
-    static constexpr int64_t READ_SIZE = 200000;  // read&scan 200kb to fit in cache
 
-    std::atomic<int64_t> doneLines(0); //number of lines processed but not yet returned
-    std::atomic<int64_t> returnedLines(0); //number of lines returned
-    std::atomic<int64_t> byteOffset(0);
+    // Blocks are read one after the other, each being cut just after its
+    // last newline.  Splitting a block into lines is done by the worker
+    // that processes it, so the reader only needs to copy (or, for a
+    // mapped stream, simply point to) the data.  Since a block doesn't
+    // know its first line number until the blocks before it have counted
+    // their lines, each block passes the number of its successor's first
+    // line on via a future.
+
+    std::atomic<int64_t> knownLines(0); // lines in the blocks counted so far
     std::atomic<int> chunkNumber(0);
 
     ThreadPool tp(maxParallelism);
@@ -263,6 +271,7 @@ void forEachLineBlock(std::istream & stream,
     // Memory map if possible
     const char * mapped = nullptr;
     size_t mappedSize = 0;
+    size_t mappedOffset = 0;
 
     filter_istream * fistream = dynamic_cast<filter_istream *>(&stream);
 
@@ -271,188 +280,161 @@ void forEachLineBlock(std::istream & stream,
         // saves us having to copy data.  mapped will be set to
         // nullptr if it's not possible to memory map this stream.
         std::tie(mapped, mappedSize) = fistream->mapped();
+
+        // We start where the stream is, eg after a header line
+        if (mapped) {
+            std::streamoff pos = stream.tellg();
+            if (pos < 0 || (size_t)pos > mappedSize)
+                mapped = nullptr;
+            else mappedOffset = pos;
+        }
+    }
+
+    // State of the reader.  This is only touched by one block at a time,
+    // as each block schedules the next only once it's finished reading.
+    std::string leftover;  // partial last line of the previous block
+    std::shared_future<int64_t> nextStartLine;
+
+    {
+        std::promise<int64_t> firstLine;
+        firstLine.set_value(0);
+        nextStartLine = firstLine.get_future().share();
     }
 
     std::atomic<int> hasExc(false);
     std::exception_ptr exc;
 
+    // Blocks are processed on behalf of the caller, and are cancelled
+    // along with it
+    CancellationToken * token = currentCancellationToken();
+
     std::function<void ()> doBlock = [&] ()
         {
-            //cerr << "block starting at line " << doneLines << endl;
-
-            std::shared_ptr<const char> blockOut;
+            CancellationScope cancellationScope(token);
+            std::shared_future<int64_t> startLineFuture = nextStartLine;
+            std::promise<int64_t> endLinePromise;
+            bool published = false;
 
-            int64_t startOffset = byteOffset;
-            int64_t startLine = doneLines;
-            vector<size_t> lineOffsets = {0};
-            bool lastBlock = false;
-            size_t myChunkNumber = 0;
-            
             try {
-                //MLDB-1426
-                if (mapped && false) {
-                    const char * start = mapped + stream.tellg();
-                    const char * current = start;
-                    const char * end = mapped + mappedSize;
-
-                    while (current && current < end && (current - start) < BLOCK_SIZE
-                           && (maxLines == -1 || doneLines < maxLines)) { //stop processing new line when we have enough)
-                        current = (const char *)memchr(current, '\n', end - current);
-                        if (current && current < end) {
-                            ExcAssertEqual(*current, '\n');
-                            lineOffsets.push_back(current - start);
-                            ++doneLines;
-                            ++current;
-                        }
-                    }
-                
-                    if (current)
-                        stream.seekg(current - start, ios::cur);
-                    else {
-                        // Last line has no newline
-                        lineOffsets.push_back(end - start);
-                        ++doneLines;
+                if (token)
+                    token->check();
+
+                const char * data;
+                size_t length;
+                std::shared_ptr<std::string> blockStorage;
+                bool lastBlock = false;
+
+                nextStartLine = endLinePromise.get_future().share();
+                size_t myChunkNumber = chunkNumber++;
+
+                if (mapped) {
+                    data = mapped + mappedOffset;
+                    length = std::min<size_t>(BLOCK_SIZE,
+                                              mappedSize - mappedOffset);
+                    if (mappedOffset + length < mappedSize) {
+                        // Extend to the end of the current line
+                        const char * nl
+                            = (const char *)memchr(data + length, '\n',
+                                                   mappedSize - mappedOffset
+                                                   - length);
+                        length = nl ? nl - data + 1 : mappedSize - mappedOffset;
                     }
-                    
-                    myChunkNumber = chunkNumber++;
-
-                    if (current && current < end &&
-                        (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
-                        {
-                            // Ready for another chunk
-                            tp.add(doBlock);
-                        } else if (current == end) {
-                        lastBlock = true;
-                    }
-
-                    blockOut = std::shared_ptr<const char>(start,
-                                                           [] (const char *) {});
+                    mappedOffset += length;
+                    lastBlock = mappedOffset == mappedSize;
+                    if (lastBlock)
+                        stream.seekg(0, ios::end);
                 }
                 else {
-                    // How far through our block are we?
-                    size_t offset = 0;
-
-                    // How much extra space to allocate for the last line?
-                    static constexpr size_t EXTRA_SIZE = 10000;
-
-                    std::shared_ptr<char> block(new char[BLOCK_SIZE + EXTRA_SIZE],
-                                                [] (char * c) { delete[] c; });
-                    blockOut = block;
-
-                    // First line starts at offset 0
-
-                    while (stream && !stream.eof()
-                           && (maxLines == -1 || doneLines < maxLines)  //stop processing new line when we have enough
-                           && (byteOffset - startOffset < BLOCK_SIZE)) {
-                        
-                        stream.read((char *)block.get() + offset,
-                                    std::min<size_t>(READ_SIZE, BLOCK_SIZE - offset));
-
-                        // Check how many bytes we actually read
-                        size_t bytesRead = stream.gcount();
-                        
-                        offset += bytesRead;
-
-                        // Scan for end of line characters
-                        const char * current = block.get() + lineOffsets.back();
-                        const char * end = block.get() + offset;
-
-                        while (current && current < end) {
-                            current = (const char *)memchr(current, '\n', end - current);
-                            if (current && current < end) {
-                                ExcAssertEqual(*current, '\n');
-                                if (lineOffsets.back() != current - block.get()) {
-                                    lineOffsets.push_back(current - block.get());
-                                    //cerr << "got line at offset " << lineOffsets.back() << endl;
-                                    ++doneLines;
-                                }
-                                ++current;
-                            }
+                    blockStorage = std::make_shared<std::string>();
+                    std::string & block = *blockStorage;
+                    block.swap(leftover);
+                    size_t offset = block.size();
+                    size_t target = offset + BLOCK_SIZE;
+
+                    for (;;) {
+                        if (stream && !stream.eof()) {
+                            block.resize(target);
+                            stream.read(&block[offset], target - offset);
+                            offset += stream.gcount();
+                            block.resize(offset);
                         }
 
-                        byteOffset += bytesRead;
-                    }
+                        if (!stream || stream.eof()) {
+                            lastBlock = true;
+                            break;
+                        }
 
-                
-                    if (stream.eof()) {
-                        // If we are at the end of the stream
-                        // make sure we include the last line 
-                        // if there was no newline
-                        if (lineOffsets.back() != offset - 1) {
-                            lineOffsets.push_back(offset);
-                            ++doneLines;
+                        // Keep the partial last line for the next block
+                        size_t lastNewline = block.rfind('\n');
+                        if (lastNewline != string::npos) {
+                            leftover.assign(block, lastNewline + 1,
+                                            string::npos);
+                            block.resize(lastNewline + 1);
+                            break;
                         }
-                    }
-                    else {
-                        // If we are not at the end of the stream
-                        // get the last line, as we probably got just a partial
-                        // line in the last one
-                        std::string lastLine;
-                        getline(stream, lastLine);
-                
-                        size_t cnt = stream.gcount();
-
-                        if (cnt != 0) {
-                            // Check for overflow on the buffer size
-                            if (offset + lastLine.size() + 1 > BLOCK_SIZE + EXTRA_SIZE) {
-                                // reallocate and copy
-                                std::shared_ptr<char> newBlock(new char[offset + lastLine.size() + 1],
-                                                               [] (char * c) { delete[] c; });
-                                std::copy(block.get(), block.get() + offset,
-                                          newBlock.get());
-                                block = newBlock;
-                                blockOut = block;
-                            }
-
-                            std::copy(lastLine.data(), lastLine.data() + lastLine.length(),
-                                      block.get() + offset);
-                    
-                            lineOffsets.emplace_back(offset + lastLine.length());
-                            ++doneLines;
-                            offset += cnt;
-                        }                
+
+                        // A single line longer than the block; read more
+                        target = offset + BLOCK_SIZE;
                     }
 
-                    myChunkNumber = chunkNumber++;
+                    data = block.data();
+                    length = block.size();
+                }
 
-                    if (stream && !stream.eof() &&
-                        (maxLines == -1 || doneLines < maxLines)) // don't schedule a new block if we have enough lines
-                        {
-                            // Ready for another chunk
-                            tp.add(doBlock);
-                        } else if (stream.eof()) {
-                        lastBlock = true;
-                    }
+                if (!lastBlock
+                    && !hasExc.load(std::memory_order_relaxed)
+                    && (maxLines == -1 || knownLines < maxLines)) {
+                    // Ready for another chunk
+                    tp.add(doBlock);
                 }
-                    
-                //cerr << "processing block of " << lineOffsets.size() - 1
-                //     << " lines starting at " << startLine << endl;
 
+                // Find where our lines end.  This is where most of the
+                // scanning work is, and it happens in parallel.
+                std::vector<size_t> lineEnds;
+                lineEnds.reserve(length / 64);
+                findAllChars(data, data + length, '\n', data, lineEnds);
+
+                // A last line with no newline
+                if (length > 0 && (lineEnds.empty()
+                                   || lineEnds.back() != length - 1))
+                    lineEnds.push_back(length);
+
+                // Find out our first line number, and tell the next block
+                int64_t startLine = startLineFuture.get();
+                int64_t endLine = startLine + lineEnds.size();
+                knownLines = endLine;
+                endLinePromise.set_value(endLine);
+                published = true;
+
+                if (maxLines != -1 && startLine >= maxLines)
+                    return;
+
+                //cerr << "processing block of " << lineEnds.size()
+                //     << " lines starting at " << startLine << endl;
 
                 int64_t chunkLineNumber = startLine;
-                size_t lastLineOffset = lineOffsets[0];
+                size_t lineStart = 0;
 
                 if (startBlock)
                     if (!startBlock(myChunkNumber, chunkLineNumber))
                         return;
 
-                for (unsigned i = 1;  i < lineOffsets.size() && (maxLines == -1 || returnedLines++ < maxLines);  ++i) {
+                for (size_t lineEnd: lineEnds) {
+                    if (maxLines != -1 && chunkLineNumber >= maxLines)
+                        break;
                     if (hasExc.load(std::memory_order_relaxed))
                         return;
-                    const char * line = blockOut.get() + lastLineOffset;
-                    size_t len = lineOffsets[i] - lastLineOffset;
+                    const char * line = data + lineStart;
+                    size_t len = lineEnd - lineStart;
 
                     // Skip \r for DOS line endings
                     if (len > 0 && line[len - 1] == '\r')
                         --len;
 
-                    // if we are not at the last line
-                    if (!lastBlock || len != 0 || i != lineOffsets.size() - 1)
-                        if (!onLine(line, len, chunkNumber, chunkLineNumber++))
-                            return;
-                
-                    lastLineOffset = lineOffsets[i] + 1;
+                    if (!onLine(line, len, myChunkNumber, chunkLineNumber++))
+                        return;
 
+                    lineStart = lineEnd + 1;
                 }
 
                 if (endBlock)
@@ -460,6 +442,9 @@ void forEachLineBlock(std::istream & stream,
                         return;
 
             } JML_CATCH_ALL {
+                // Don't leave the next block waiting for our line count
+                if (!published)
+                    endLinePromise.set_exception(std::current_exception());
                 if (hasExc.fetch_add(1) == 0) {
                     exc = std::current_exception();
                 }
@@ -496,9 +481,15 @@ void forEachChunk(std::istream & stream,
     std::atomic<int> hasExc(false);
     std::exception_ptr exc;
 
+    CancellationToken * token = currentCancellationToken();
+
     std::function<void ()> doBlock = [&] ()
         {
+            CancellationScope cancellationScope(token);
             try {
+                if (token)
+                    token->check();
+
                 std::shared_ptr<char> block(new char[chunkLength],
                                             [] (char * c) { delete[] c; });
 
@@ -12,6 +12,10 @@
 #include "mldb/utils/compact_vector.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/sql/path.h"
 #include <mutex>
 
 using namespace std;
@@ -19,6 +23,16 @@ using namespace std;
 namespace Datacratic {
 namespace MLDB {
 
+/// Tags used to identify the type of a serialized frozen column
+enum FrozenColumnFormat {
+    FROZEN_TABLE = 1,
+    FROZEN_SPARSE_TABLE = 2,
+    FROZEN_INTEGER = 3
+};
+
+/// Serialization format version for frozen columns
+static constexpr int FROZEN_COLUMN_VERSION = 1;
+
 /// Frozen column that finds each value in a lookup table
 struct TableFrozenColumn: public FrozenColumn {
     TableFrozenColumn(TabularDatasetColumn & column)
@@ -52,6 +66,21 @@ struct TableFrozenColumn: public FrozenColumn {
         }
     }
 
+    TableFrozenColumn(ML::DB::Store_Reader & store,
+                      const std::shared_ptr<const void> & mapping)
+    {
+        ML::DB::compact_size_t tableSize;
+        store >> indexBits >> numEntries >> firstEntry >> hasNulls
+              >> columnTypes >> tableSize;
+        table.resize(tableSize);
+        for (auto & v: table)
+            store >> v;
+        size_t numWords = ((size_t)indexBits * numEntries + 31) / 32;
+        auto data = reinterpret_cast<const uint32_t *>
+            (reconstituteAligned(store, numWords * 4));
+        storage = std::shared_ptr<const uint32_t>(mapping, data);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -120,6 +149,17 @@ struct TableFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << (unsigned char)FROZEN_TABLE
+              << indexBits << numEntries << firstEntry << hasNulls
+              << columnTypes << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            store << v;
+        size_t numWords = ((size_t)indexBits * numEntries + 31) / 32;
+        serializeAligned(store, storage.get(), numWords * 4);
+    }
+
     static size_t bytesRequired(const TabularDatasetColumn & column)
     {
         size_t numEntries = column.maxRowNumber - column.minRowNumber + 1;
@@ -176,6 +216,22 @@ struct SparseTableFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    SparseTableFrozenColumn(ML::DB::Store_Reader & store,
+                            const std::shared_ptr<const void> & mapping)
+    {
+        ML::DB::compact_size_t tableSize;
+        store >> rowNumBits >> indexBits >> numEntries >> firstEntry
+              >> columnTypes >> tableSize;
+        table.resize(tableSize);
+        for (auto & v: table)
+            store >> v;
+        size_t numWords
+            = ((size_t)(indexBits + rowNumBits) * numEntries + 31) / 32;
+        auto data = reinterpret_cast<const uint32_t *>
+            (reconstituteAligned(store, numWords * 4));
+        storage = std::shared_ptr<const uint32_t>(mapping, data);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -276,6 +332,18 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         return result;
     }
 
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << (unsigned char)FROZEN_SPARSE_TABLE
+              << rowNumBits << indexBits << numEntries << firstEntry
+              << columnTypes << ML::DB::compact_size_t(table.size());
+        for (auto & v: table)
+            store << v;
+        size_t numWords
+            = ((size_t)(indexBits + rowNumBits) * numEntries + 31) / 32;
+        serializeAligned(store, storage.get(), numWords * 4);
+    }
+
     std::shared_ptr<const uint32_t> storage;
     compact_vector<CellValue, 0> table;
     uint8_t rowNumBits;
@@ -437,6 +505,17 @@ struct IntegerFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    IntegerFrozenColumn(ML::DB::Store_Reader & store,
+                        const std::shared_ptr<const void> & mapping)
+    {
+        store >> entryBits >> numEntries >> firstEntry >> offset
+              >> hasNulls >> columnTypes;
+        size_t numWords = ((size_t)entryBits * numEntries + 63) / 64;
+        auto data = reinterpret_cast<const uint64_t *>
+            (reconstituteAligned(store, numWords * 8));
+        storage = std::shared_ptr<const uint64_t>(mapping, data);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -519,6 +598,15 @@ struct IntegerFrozenColumn: public FrozenColumn {
         return columnTypes;
     }
 
+    virtual void serialize(ML::DB::Store_Writer & store) const
+    {
+        store << (unsigned char)FROZEN_INTEGER
+              << entryBits << numEntries << firstEntry << offset
+              << hasNulls << columnTypes;
+        size_t numWords = ((size_t)entryBits * numEntries + 63) / 64;
+        serializeAligned(store, storage.get(), numWords * 8);
+    }
+
     static ssize_t bytesRequired(const TabularDatasetColumn & column)
     {
         return SizingInfo(column);
@@ -544,6 +632,50 @@ freeze(TabularDatasetColumn & column)
     else return std::make_shared<SparseTableFrozenColumn>(column);
 }
 
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping)
+{
+    unsigned char format;
+    store >> format;
+
+    switch (format) {
+    case FROZEN_TABLE:
+        return std::make_shared<TableFrozenColumn>(store, mapping);
+    case FROZEN_SPARSE_TABLE:
+        return std::make_shared<SparseTableFrozenColumn>(store, mapping);
+    case FROZEN_INTEGER:
+        return std::make_shared<IntegerFrozenColumn>(store, mapping);
+    default:
+        throw HttpReturnException(500, "Unknown frozen column format",
+                                  "format", (int)format,
+                                  "version", FROZEN_COLUMN_VERSION);
+    }
+}
+
+
+/*****************************************************************************/
+/* SERIALIZATION                                                             */
+/*****************************************************************************/
+
+void serializeAligned(ML::DB::Store_Writer & store,
+                      const void * data, size_t bytes)
+{
+    static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    store.save_binary(padding, (8 - store.offset() % 8) % 8);
+    store.save_binary(data, bytes);
+}
+
+const void * reconstituteAligned(ML::DB::Store_Reader & store, size_t bytes)
+{
+    store.skip((8 - store.offset() % 8) % 8);
+    store.must_have(bytes);
+    const void * result = store.pos();
+    store.skip(bytes);
+    return result;
+}
+
 } // namespace MLDB
 } // namespace Datacratic
 
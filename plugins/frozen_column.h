@@ -10,6 +10,7 @@
 
 #include "column_types.h"
 #include "mldb/sql/cell_value.h"
+#include "mldb/jml/db/persistent_fwd.h"
 
 namespace Datacratic {
 namespace MLDB {
@@ -57,8 +58,36 @@ struct FrozenColumn {
 
     static std::shared_ptr<FrozenColumn>
     freeze(TabularDatasetColumn & column);
+
+    /** Serialize the column into the given store.  The bulk (bit-packed)
+        storage is written 8 byte aligned relative to the start of the
+        store, so that it can be used in place once the file is mapped.
+    */
+    virtual void serialize(ML::DB::Store_Writer & store) const = 0;
+
+    /** Reconstitute a column written by serialize().  The store must be
+        reading directly from an in-memory region (which is normally a
+        memory mapped file) that starts on an aligned address; the bulk
+        storage will point directly into that region rather than being
+        copied.  The mapping argument keeps the region alive for as long
+        as the column exists.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping);
 };
 
+/** Write the given block of memory so that it starts 8 byte aligned
+    relative to the start of the store, padding with zeros as necessary.
+*/
+void serializeAligned(ML::DB::Store_Writer & store,
+                      const void * data, size_t bytes);
+
+/** Read a block written by serializeAligned(), returning a pointer
+    directly into the store's memory region and skipping over it.
+*/
+const void * reconstituteAligned(ML::DB::Store_Reader & store, size_t bytes);
+
 
 } // namespace MLDB
 } // namespace Datacratic
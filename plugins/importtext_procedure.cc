@@ -10,7 +10,9 @@
 #include "mldb/jml/utils/csv.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/plugins/text_scan.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/sql/sql_expression.h"
@@ -533,32 +535,49 @@ parseFixedWidthCsvRow(const char * & line,
                     s[len++] = c;
                 };
 
-            for (; line < lineEnd;  ++line) {
-                c = *line;
-                //cerr << "c = " << c << endl;
-                if (c == quote) {
-                    ++line;
-                    if (line >= lineEnd) {
-                        ok = true;
-                        break;
-                    }
-                    else if (*line == separator) {
-                        ok = true;
-                        ++line;
-                        break;
-                    }
-                    else if (*line == quote) {
-                        // doubled quote; take a literal value
-                        pushChar(quote);
-                    }
-                    else {
-                        // Error
-                        errorMsg = "Garbage after closing quote";
-                        break;
+            auto pushChars = [&] (const char * chars, size_t n)
+                {
+                    if (len + n > buflen) {
+                        while (len + n > buflen)
+                            buflen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[buflen]);
+                        std::copy(s, s + len, newBuf.get());
+                        sdynamic.swap(newBuf);
+                        s = sdynamic.get();
                     }
+                    std::copy(chars, chars + n, s + len);
+                    len += n;
+                };
+
+            while (line < lineEnd) {
+                // Copy everything up to the next quote in one go
+                const char * next
+                    = scanForChars(line, lineEnd, quote, quote, eightBit);
+                pushChars(line, next - line);
+                line = next;
+                if (line == lineEnd)
+                    break;
+
+                // We're on a quote
+                ++line;
+                if (line >= lineEnd) {
+                    ok = true;
+                    break;
+                }
+                else if (*line == separator) {
+                    ok = true;
+                    ++line;
+                    break;
+                }
+                else if (*line == quote) {
+                    // doubled quote; take a literal value
+                    pushChar(quote);
+                    ++line;
                 }
                 else {
-                    pushChar(c);
+                    // Error
+                    errorMsg = "Garbage after closing quote";
+                    break;
                 }
             }
 
@@ -619,18 +638,20 @@ parseFixedWidthCsvRow(const char * & line,
             // likely a non-quoted string
 
             bool eightBit = !isascii(c);
-            size_t len = 1;
+            const char * fieldEnd;
 
-            for (; line < lineEnd;  ++line, ++len) {
-                c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
+            if (isTextLine) {
+                fieldEnd = lineEnd;
+                eightBit = eightBit || hasEightBitChars(line, lineEnd);
+            }
+            else {
+                fieldEnd = scanForChars(line, lineEnd, separator, separator,
+                                        eightBit);
             }
 
+            size_t len = fieldEnd - start;
+            line = fieldEnd < lineEnd ? fieldEnd + 1 : lineEnd;
+
             values[colNum++] = finishString(start, len, eightBit);
         }
 
@@ -704,8 +725,12 @@ struct ImportTextProcedureWorkInstance
     {
         string filename = config.dataFileUrl.toDecodedString();
 
-        // Ask for a memory mappable stream if possible
-        filter_istream stream(config.dataFileUrl, { { "mapped", "true" } });
+        // Ask for a memory mappable stream if possible, and for compressed
+        // input to be decompressed on all cores
+        filter_istream stream(config.dataFileUrl,
+                              { { "mapped", "true" },
+                                { "decompressionThreads",
+                                  std::to_string(numCpus()) } });
 
         // Get the file timestamp out
         ts = stream.info().lastModified;
@@ -13,12 +13,14 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/plugins/json_projection.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/sql/builtin_functions.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/arch/timers.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/server/dataset_context.h"
@@ -238,7 +240,9 @@ struct JSONImporter: public Procedure {
         std::string line;
         std::string filename = runProcConf.dataFileUrl.toDecodedString();
 
-        filter_istream stream(filename);
+        filter_istream stream(filename,
+                              { { "decompressionThreads",
+                                  std::to_string(numCpus()) } });
 
         Date timestamp = stream.info().lastModified;
 
@@ -298,11 +302,22 @@ struct JSONImporter: public Procedure {
         bool useNamed = config.named != SqlExpression::TRUE;
 
         JsonScope jsonScope(server);
-        ExpressionValue storage;
         const auto whereBound = config.where->bind(jsonScope);
         const auto selectBound = config.select.bind(jsonScope);
         const auto namedBound = config.named->bind(jsonScope);
 
+        // If the expressions only use some of the members of each object,
+        // we only need to parse those ones.
+        std::shared_ptr<const JsonProjection> projection;
+        if (useSelect) {
+            UnboundEntities unbound = config.select.getUnbound();
+            if (useWhere)
+                unbound.merge(config.where->getUnbound());
+            if (useNamed)
+                unbound.merge(config.named->getUnbound());
+            projection = JsonProjection::fromUnbound(unbound);
+        }
+
         auto onLine = [&] (const char * line,
                            size_t lineLength,
                            int64_t blockNumber,
@@ -316,31 +331,48 @@ struct JSONImporter: public Procedure {
             if(lineLength == 0)
                 return handleError("empty line", actualLineNum, "");
 
-            StreamingJsonParsingContext parser(filename, line, lineLength,
-                                               actualLineNum);
-
-            skipJsonWhitespace(*parser.context);
-            if (parser.context->eof()) {
-                return handleError("empty line", actualLineNum, "");
-            }
-
             // TODO: in the configuration
             JsonArrayHandling arrays = ENCODE_ARRAYS;
 
             ExpressionValue expr;
-            try {
-                expr = ExpressionValue::parseJson(parser, timestamp, arrays);
-            } catch (const std::exception & exc) {
-                return handleError(exc.what(), actualLineNum, string(line, lineLength));
+            bool parsed = false;
+
+            if (projection) {
+                try {
+                    parsed = projection->parse(line, lineLength, filename,
+                                               actualLineNum, timestamp,
+                                               arrays, expr);
+                } catch (const std::exception &) {
+                    // Parsed again in full below, to get the usual error
+                }
             }
 
-            skipJsonWhitespace(*parser.context);
-            if (!parser.context->eof()) {
-                return handleError("extra characters at end of line", actualLineNum, "");
+            if (!parsed) {
+                StreamingJsonParsingContext parser(filename, line, lineLength,
+                                                   actualLineNum);
+
+                skipJsonWhitespace(*parser.context);
+                if (parser.context->eof()) {
+                    return handleError("empty line", actualLineNum, "");
+                }
+
+                try {
+                    expr = ExpressionValue::parseJson(parser, timestamp, arrays);
+                } catch (const std::exception & exc) {
+                    return handleError(exc.what(), actualLineNum, string(line, lineLength));
+                }
+
+                skipJsonWhitespace(*parser.context);
+                if (!parser.context->eof()) {
+                    return handleError("extra characters at end of line", actualLineNum, "");
+                }
             }
 
             RowName rowName(actualLineNum);
             if (useWhere || useSelect || useNamed) {
+                // Lines are processed on many threads at once, so each
+                // needs its own storage.
+                ExpressionValue storage;
                 JsonRowScope row(expr, actualLineNum);
                 if (useWhere) {
                     if (!whereBound(row, storage, GET_ALL).isTrue()) {
@@ -355,7 +387,6 @@ struct JSONImporter: public Procedure {
 
                 if (useSelect) {
                     expr = selectBound(row, storage, GET_ALL);
-                    storage = expr;
                 }
 
             }
@@ -0,0 +1,260 @@
+/** json_projection.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Parsing of JSON objects that only keeps the members a query needs.
+*/
+
+#include "json_projection.h"
+#include "text_scan.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/types/json_parsing.h"
+#include "mldb/base/parse_context.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+inline bool isJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline const char * skipWhitespace(const char * p, const char * end)
+{
+    while (p < end && isJsonWhitespace(*p))
+        ++p;
+    return p;
+}
+
+/** Return a pointer just past the closing quote of the string whose
+    contents start at p, or null if it isn't terminated.
+*/
+const char * skipString(const char * p, const char * end)
+{
+    bool eightBit = false;
+    for (;;) {
+        p = scanForChars(p, end, '"', '\\', eightBit);
+        if (p == end)
+            return nullptr;
+        if (*p == '"')
+            return p + 1;
+        // Backslash; skip it and the character it escapes
+        p += 2;
+        if (p > end)
+            return nullptr;
+    }
+}
+
+/** Return a pointer just past the object or array whose opening bracket is
+    at p, or null if it isn't complete.
+*/
+const char * skipContainer(const char * p, const char * end)
+{
+    // One bit per level of nesting, set for objects and clear for arrays
+    uint64_t isObject = 0;
+    int depth = 0;
+
+    while (p < end) {
+        p = scanForJsonStructure(p, end);
+        if (p == end)
+            return nullptr;
+
+        char c = *p++;
+        if (c == '"') {
+            p = skipString(p, end);
+            if (!p)
+                return nullptr;
+        }
+        else if (c == '{' || c == '[') {
+            // Very deep nesting is left to the full parser
+            if (depth == 64)
+                return nullptr;
+            isObject = (isObject << 1) | (c == '{');
+            ++depth;
+        }
+        else {
+            if (depth == 0 || (isObject & 1) != (c == '}'))
+                return nullptr;
+            isObject >>= 1;
+            if (--depth == 0)
+                return p;
+        }
+    }
+
+    return nullptr;
+}
+
+/** Return a pointer just past the number or literal that starts at p, or
+    null if it isn't one.
+*/
+const char * skipAtom(const char * p, const char * end)
+{
+    const char * start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']'
+           && !isJsonWhitespace(*p))
+        ++p;
+
+    size_t length = p - start;
+    if (length == 0)
+        return nullptr;
+
+    if ((length == 4 && (!strncmp(start, "true", 4)
+                         || !strncmp(start, "null", 4)))
+        || (length == 5 && !strncmp(start, "false", 5)))
+        return p;
+
+    for (const char * q = start;  q < p;  ++q) {
+        if (!isdigit(*q) && *q != '-' && *q != '+' && *q != '.'
+            && *q != 'e' && *q != 'E')
+            return nullptr;
+    }
+
+    return p;
+}
+
+} // file scope
+
+const char * skipJsonValue(const char * p, const char * end)
+{
+    if (p == end)
+        return nullptr;
+    if (*p == '"')
+        return skipString(p + 1, end);
+    if (*p == '{' || *p == '[')
+        return skipContainer(p, end);
+    return skipAtom(p, end);
+}
+
+
+/*****************************************************************************/
+/* JSON PROJECTION                                                           */
+/*****************************************************************************/
+
+JsonProjection::
+JsonProjection(std::vector<Utf8String> keys)
+{
+    for (auto & k: keys)
+        this->keys.emplace_back(k.rawString());
+    std::sort(this->keys.begin(), this->keys.end());
+    this->keys.erase(std::unique(this->keys.begin(), this->keys.end()),
+                     this->keys.end());
+}
+
+std::shared_ptr<const JsonProjection>
+JsonProjection::
+fromUnbound(const UnboundEntities & unbound)
+{
+    // Wildcards and functions like columnCount() need all of the members,
+    // and we don't know what a table name would refer to.
+    if (!unbound.wildcards.empty() || !unbound.tables.empty()
+        || unbound.hasRowFunctions())
+        return nullptr;
+
+    std::vector<Utf8String> keys;
+    for (auto & v: unbound.vars) {
+        if (v.first.empty())
+            return nullptr;
+        // A nested variable like x.y needs all of member x
+        keys.emplace_back(v.first.front().toUtf8String());
+    }
+
+    return std::make_shared<JsonProjection>(std::move(keys));
+}
+
+bool
+JsonProjection::
+isWanted(const char * name, size_t length) const
+{
+    // There are only ever a few keys, so a linear scan is fastest
+    for (auto & k: keys) {
+        if (k.length() == length && !memcmp(k.data(), name, length))
+            return true;
+    }
+    return false;
+}
+
+bool
+JsonProjection::
+parse(const char * str, size_t length,
+      const std::string & filename, int64_t lineNumber,
+      Date timestamp, JsonArrayHandling arrays,
+      ExpressionValue & result) const
+{
+    const char * p = str;
+    const char * end = str + length;
+
+    p = skipWhitespace(p, end);
+    if (p == end || *p != '{')
+        return false;
+    p = skipWhitespace(p + 1, end);
+
+    StructValue out;
+
+    if (p < end && *p == '}') {
+        ++p;
+    }
+    else {
+        for (;;) {
+            if (p == end || *p != '"')
+                return false;
+
+            const char * keyStart = p + 1;
+            bool eightBit = false;
+            const char * keyEnd = scanForChars(keyStart, end, '"', '\\',
+                                               eightBit);
+            // Names with escapes are left to the full parser
+            if (keyEnd == end || *keyEnd == '\\')
+                return false;
+
+            p = skipWhitespace(keyEnd + 1, end);
+            if (p == end || *p != ':')
+                return false;
+            p = skipWhitespace(p + 1, end);
+
+            const char * valueStart = p;
+            const char * valueEnd = skipJsonValue(valueStart, end);
+            if (!valueEnd)
+                return false;
+
+            if (isWanted(keyStart, keyEnd - keyStart)) {
+                StreamingJsonParsingContext parser(filename, valueStart,
+                                                   valueEnd - valueStart,
+                                                   lineNumber);
+                out.emplace_back(PathElement(keyStart, keyEnd - keyStart),
+                                 ExpressionValue::parseJson(parser, timestamp,
+                                                            arrays));
+                skipJsonWhitespace(*parser.context);
+                if (!parser.context->eof())
+                    return false;
+            }
+
+            p = skipWhitespace(valueEnd, end);
+            if (p == end)
+                return false;
+            if (*p == '}') {
+                ++p;
+                break;
+            }
+            if (*p != ',')
+                return false;
+            p = skipWhitespace(p + 1, end);
+        }
+    }
+
+    if (skipWhitespace(p, end) != end)
+        return false;
+
+    result = ExpressionValue(std::move(out));
+    return true;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,76 @@
+/** json_projection.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Parsing of JSON objects that only keeps the members a query needs.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Datacratic {
+namespace MLDB {
+
+struct UnboundEntities;
+
+
+/*****************************************************************************/
+/* JSON PROJECTION                                                           */
+/*****************************************************************************/
+
+/** Parses text holding a JSON object into an ExpressionValue, keeping only
+    the top-level members whose names are in a fixed set.
+
+    It works in two stages.  The first finds the extent of each member's
+    value by looking only at quotes, backslashes and brackets, using SIMD
+    instructions to skip over everything else, and without allocating any
+    memory.  The second parses the values of the wanted members in the same
+    way as ExpressionValue::parseJson().  Values that aren't wanted are
+    only checked to have matching brackets and terminated strings.
+*/
+
+struct JsonProjection {
+
+    /** Create a projection that keeps the members with the given names. */
+    JsonProjection(std::vector<Utf8String> keys);
+
+    /** Return the projection that keeps the top-level members that the
+        given expressions refer to, or null if they need the whole object
+        (for example because they use a wildcard).
+    */
+    static std::shared_ptr<const JsonProjection>
+    fromUnbound(const UnboundEntities & unbound);
+
+    /** Parse the JSON object in [str, str + length) into result, which is
+        the same as what ExpressionValue::parseJson() would return with the
+        members that aren't wanted removed.
+
+        Returns false, leaving result untouched, if the text isn't an
+        object that this can handle (for example if it's malformed or has
+        a member name with an escape in it).  The caller should then parse
+        it in full, which will also give a proper error message.
+    */
+    bool parse(const char * str, size_t length,
+               const std::string & filename, int64_t lineNumber,
+               Date timestamp, JsonArrayHandling arrays,
+               ExpressionValue & result) const;
+
+    /// Is the member with the given (unescaped) name wanted?
+    bool isWanted(const char * name, size_t length) const;
+
+private:
+    std::vector<std::string> keys;
+};
+
+/** Return a pointer just past the JSON value that starts at p, which must
+    not point to whitespace, or null if there is no complete value in
+    [p, end).  Objects and arrays are checked only for matching brackets
+    and terminated strings.
+*/
+const char * skipJsonValue(const char * p, const char * end);
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -384,6 +384,14 @@ call(KmeansFunctionArgs input) const
              ts)};
 }
 
+std::vector<ExpressionValue>
+KmeansFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & contexts) const
+{
+    return applyBatchParallel(applier, contexts);
+}
+
 namespace {
 
 RegisterProcedureType<KmeansProcedure, KmeansConfig>
@@ -103,6 +103,11 @@ struct KmeansFunction: public ValueFunctionT<KmeansFunctionArgs, KmeansExpressio
                    const std::function<bool (const Json::Value &)> & onProgress);
     
     virtual KmeansExpressionValue call(KmeansFunctionArgs input) const override; 
+
+    /** Assign a batch of embeddings to their clusters, in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const override;
     
     KmeansFunctionConfig functionConfig;
 
@@ -0,0 +1,315 @@
+/** python_columnar.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Access to query results from Python as NumPy arrays.
+*/
+
+#include <Python.h>
+
+#include "python_columnar.h"
+#include "python_plugin_context.h"
+#include "mldb/server/analytics.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/sql/statement_cache.h"
+#include "mldb/http/http_exception.h"
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+
+using namespace std;
+namespace bp = boost::python;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/** Make the NumPy C API available.  Must be called with the interpreter
+    lock held; only the first call does anything.
+*/
+void initNumpy()
+{
+    static bool initialized = false;
+    if (initialized)
+        return;
+    if (_import_array() < 0)
+        bp::throw_error_already_set();
+    initialized = true;
+}
+
+/** Result of a query, accumulated column by column.  Building it doesn't
+    touch any Python objects, and so happens without the interpreter lock.
+*/
+struct ColumnarResult {
+
+    struct Column {
+        Column(ColumnName name)
+            : name(std::move(name)), numeric(true)
+        {
+        }
+
+        ColumnName name;
+
+        /// True until we've seen a value that isn't a number or null
+        bool numeric;
+
+        /// Values while the column is numeric, with NaN for nulls
+        std::vector<double> numbers;
+
+        /// Values once the column has been found not to be numeric
+        std::vector<CellValue> cells;
+
+        void add(size_t rowNum, const CellValue & val)
+        {
+            if (numeric && !val.empty() && !val.isNumeric()) {
+                // Switch to holding cells.  Nulls come back as nulls.
+                cells.reserve(numbers.capacity());
+                for (double d: numbers)
+                    cells.emplace_back(std::isnan(d) ? CellValue() : CellValue(d));
+                numbers = std::vector<double>();
+                numeric = false;
+            }
+
+            // When a cell has many values, the last one wins
+            if (numeric) {
+                numbers.resize(rowNum, std::numeric_limits<double>::quiet_NaN());
+                numbers.push_back(val.empty()
+                                  ? std::numeric_limits<double>::quiet_NaN()
+                                  : val.toDouble());
+                numbers.resize(rowNum + 1);
+            }
+            else {
+                cells.resize(rowNum);
+                cells.push_back(val);
+                cells.resize(rowNum + 1);
+            }
+        }
+
+        void finish(size_t numRows)
+        {
+            if (numeric)
+                numbers.resize(numRows, std::numeric_limits<double>::quiet_NaN());
+            else cells.resize(numRows);
+        }
+    };
+
+    std::vector<RowName> rowNames;
+    std::vector<Column> columns;
+    std::unordered_map<ColumnName, size_t, PathNewHasher> columnIndex;
+
+    void addRow(MatrixNamedRow & row)
+    {
+        size_t rowNum = rowNames.size();
+        rowNames.emplace_back(std::move(row.rowName));
+
+        for (auto & c: row.columns) {
+            const ColumnName & name = std::get<0>(c);
+            auto it = columnIndex.find(name);
+            if (it == columnIndex.end()) {
+                it = columnIndex.emplace(name, columns.size()).first;
+                columns.emplace_back(name);
+            }
+            columns[it->second].add(rowNum, std::get<1>(c));
+        }
+    }
+
+    void finish()
+    {
+        for (auto & c: columns)
+            c.finish(rowNames.size());
+    }
+};
+
+/** Run the query, without the interpreter lock. */
+ColumnarResult runColumnarQuery(MldbPythonContext * mldbCon,
+                                const Utf8String & query)
+{
+    ColumnarResult result;
+
+    ReleasePythonLock unlocked;
+
+    auto stm = getCachedSelectStatement(query);
+    SqlExpressionMldbScope context(mldbCon->getPyContext()->server);
+
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            result.addRow(row);
+            return true;
+        };
+
+    queryFromStatementStreaming(onRow, *stm, context);
+    result.finish();
+
+    return result;
+}
+
+/** Return a float64 NumPy array of the given shape that takes over the
+    memory of values, rather than copying it.  The vector is freed when the
+    array is garbage collected.
+*/
+bp::object toNumpyArray(std::vector<double> values,
+                        int numDims, npy_intp * dims)
+{
+    auto storage = new std::vector<double>(std::move(values));
+
+    auto destroy = [] (PyObject * capsule)
+        {
+            delete static_cast<std::vector<double> *>
+                (PyCapsule_GetPointer(capsule, nullptr));
+        };
+
+    PyObject * owner = PyCapsule_New(storage, nullptr, destroy);
+    if (!owner) {
+        delete storage;
+        bp::throw_error_already_set();
+    }
+
+    PyObject * array = PyArray_SimpleNewFromData(numDims, dims, NPY_FLOAT64,
+                                                 storage->data());
+    if (!array) {
+        Py_DECREF(owner);
+        bp::throw_error_already_set();
+    }
+
+    // Steals the reference to owner
+    if (PyArray_SetBaseObject((PyArrayObject *)array, owner) < 0) {
+        Py_DECREF(array);
+        bp::throw_error_already_set();
+    }
+
+    return bp::object(bp::handle<>(array));
+}
+
+/** Convert a cell into the corresponding Python object.  Types with no
+    Python equivalent are converted to their string form.
+*/
+PyObject * cellToPython(const CellValue & cell)
+{
+    switch (cell.cellType()) {
+    case CellValue::EMPTY:
+        Py_RETURN_NONE;
+    case CellValue::INTEGER:
+        if (cell.isInt64())
+            return PyLong_FromLongLong(cell.toInt());
+        return PyLong_FromUnsignedLongLong(cell.toUInt());
+    case CellValue::FLOAT:
+        return PyFloat_FromDouble(cell.toDouble());
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        return PyUnicode_DecodeUTF8(cell.stringChars(), cell.toStringLength(),
+                                    "strict");
+    default: {
+        Utf8String str = cell.toUtf8String();
+        return PyUnicode_DecodeUTF8(str.rawData(), str.rawLength(), "strict");
+    }
+    }
+}
+
+/** Return a NumPy array of Python objects with the given cells. */
+bp::object toNumpyObjectArray(const std::vector<CellValue> & cells)
+{
+    npy_intp dims[1] = { (npy_intp)cells.size() };
+    PyObject * array = PyArray_SimpleNew(1, dims, NPY_OBJECT);
+    if (!array)
+        bp::throw_error_already_set();
+    bp::object result((bp::handle<>(array)));
+
+    // Object arrays start out full of null pointers
+    PyObject ** data = (PyObject **)PyArray_DATA((PyArrayObject *)array);
+    for (size_t i = 0;  i < cells.size();  ++i) {
+        PyObject * obj = cellToPython(cells[i]);
+        if (!obj)
+            bp::throw_error_already_set();
+        Py_XDECREF(data[i]);
+        data[i] = obj;
+    }
+
+    return result;
+}
+
+bp::list toPythonList(const std::vector<Path> & paths)
+{
+    bp::list result;
+    for (auto & p: paths)
+        result.append(p.toUtf8String());
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR QUERIES                                                          */
+/*****************************************************************************/
+
+bp::object
+queryColumnar(MldbPythonContext * mldbCon, const Utf8String & query)
+{
+    ColumnarResult result = runColumnarQuery(mldbCon, query);
+
+    initNumpy();
+
+    bp::dict output;
+    output["_rowName"] = toPythonList(result.rowNames);
+
+    for (auto & c: result.columns) {
+        if (c.numeric) {
+            npy_intp dims[1] = { (npy_intp)c.numbers.size() };
+            output[c.name.toUtf8String()]
+                = toNumpyArray(std::move(c.numbers), 1, dims);
+        }
+        else {
+            output[c.name.toUtf8String()] = toNumpyObjectArray(c.cells);
+        }
+    }
+
+    return std::move(output);
+}
+
+bp::object
+getEmbeddingArray(MldbPythonContext * mldbCon, const Utf8String & query)
+{
+    ColumnarResult result = runColumnarQuery(mldbCon, query);
+
+    size_t numRows = result.rowNames.size();
+    size_t numColumns = result.columns.size();
+    std::vector<double> values;
+    std::vector<Path> columnNames;
+
+    {
+        ReleasePythonLock unlocked;
+
+        for (auto & c: result.columns) {
+            if (!c.numeric)
+                throw HttpReturnException
+                    (400, "get_embedding_array() requires all values to be "
+                     "numeric, but column '" + c.name.toUtf8String()
+                     + "' is not");
+            columnNames.push_back(c.name);
+        }
+
+        // Lay the columns out as the rows of a matrix
+        values.resize(numRows * numColumns);
+        for (size_t j = 0;  j < numColumns;  ++j) {
+            const std::vector<double> & column = result.columns[j].numbers;
+            for (size_t i = 0;  i < numRows;  ++i)
+                values[i * numColumns + j] = column[i];
+        }
+    }
+
+    initNumpy();
+
+    npy_intp dims[2] = { (npy_intp)numRows, (npy_intp)numColumns };
+    return bp::make_tuple(toNumpyArray(std::move(values), 2, dims),
+                          toPythonList(result.rowNames),
+                          toPythonList(columnNames));
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,49 @@
+/** python_columnar.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Access to query results from Python as NumPy arrays, without converting
+    each numeric cell into a Python object.
+*/
+
+#pragma once
+
+#include "pointer_fix.h" // must come before boost/python
+#include <boost/python.hpp>
+#include "mldb/types/string.h"
+
+
+namespace Datacratic {
+namespace MLDB {
+
+struct MldbPythonContext;
+
+
+/*****************************************************************************/
+/* COLUMNAR QUERIES                                                          */
+/*****************************************************************************/
+
+/** Run the given query, and return its output as a dict with one entry
+    per column.  Columns with only numeric (or null) values are returned as
+    float64 NumPy arrays which share the memory that MLDB filled in, with
+    NaN for nulls; other columns are NumPy arrays of Python objects.  The
+    row names are under the "_rowName" key, as a list.
+
+    The query is run without holding the Python interpreter lock.
+*/
+boost::python::object
+queryColumnar(MldbPythonContext * mldbCon, const Utf8String & query);
+
+/** Run the given query, whose values must all be numeric (or null), and
+    return a tuple (array, rowNames, columnNames) where array is a 2
+    dimensional float64 NumPy array with one row per output row and one
+    column per output column.  This is the natural way to get at an
+    embedding.
+
+    The query is run and the array is filled without holding the Python
+    interpreter lock.
+*/
+boost::python::object
+getEmbeddingArray(MldbPythonContext * mldbCon, const Utf8String & query);
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -29,12 +29,14 @@ namespace MLDB {
 
 void DatasetPy::
 recordRow(const RowName & rowName, const std::vector<RowCellTuple> & columns) {
+    ReleasePythonLock unlocked;
     dataset->recordRow(rowName, columns);
 }
 
 void DatasetPy::
 recordRows(const std::vector<std::pair<RowName, std::vector<RowCellTuple> > > & rows)
 {
+    ReleasePythonLock unlocked;
     dataset->recordRows(rows);
 }
     
@@ -42,17 +44,20 @@ void  DatasetPy::
 recordColumn(const ColumnName & columnName,
              const std::vector<ColumnCellTuple> & columns)
 {
+    ReleasePythonLock unlocked;
     dataset->recordColumn(columnName, columns);
 }
 
 void  DatasetPy::
 recordColumns(const std::vector<std::pair<ColumnName, std::vector<ColumnCellTuple> > > & columns)
 {
+    ReleasePythonLock unlocked;
     dataset->recordColumns(columns);
 }
     
 void DatasetPy::
 commit() {
+    ReleasePythonLock unlocked;
     dataset->commit();
 }
 
@@ -29,6 +29,7 @@
 
 #include "python_plugin_context.h"
 #include "python_entities.h"
+#include "python_columnar.h"
 #include "mldb/http/http_exception.h"
 
 #include "mldb/rest/rest_request_binding.h"
@@ -707,6 +708,8 @@ class mldb_wrapper(object):
             self.put_async = functools.partial(self._post_put, 'PUT',
                                                async=True)
             self.create_dataset = self._mldb.create_dataset
+            self.query_columnar = self._mldb.query_columnar
+            self.get_embedding_array = self._mldb.get_embedding_array
 
         def _follow_redirect(self, url, counter):
             # somewhat copy pasted from _perform, but gives a nicer stacktrace
@@ -1080,6 +1083,8 @@ struct AtInit {
         mldb.def("read_lines", readLines);
         mldb.def("read_lines", readLines1);
         mldb.def("ls", ls);
+        mldb.def("query_columnar", queryColumnar);
+        mldb.def("get_embedding_array", getEmbeddingArray);
         mldb.def("get_http_bound_address", getHttpBoundAddress);
         mldb.def("create_dataset",
                    &DatasetPy::createDataset,
@@ -368,16 +368,10 @@ perform(MldbPythonContext * mldbCon,
     }
 
 
-    // save current thread state and release lock
-    PyThreadState* threadState = PyThreadState_Get();
-    PyThreadState_Swap(NULL);
-    PyEval_ReleaseLock();
-
-    mldbCon->getPyContext()->server->handleRequest(connection, request);
-
-    // relock and restore thread state
-    PyEval_AcquireLock();
-    PyThreadState_Swap(threadState);
+    {
+        ReleasePythonLock unlocked;
+        mldbCon->getPyContext()->server->handleRequest(connection, request);
+    }
 
     Json::Value result;
     result["statusCode"] = connection.responseCode;
@@ -411,6 +405,7 @@ Json::Value
 readLines(MldbPythonContext * mldbCon,
           const std::string & path, int maxLines)
 {
+    ReleasePythonLock unlocked;
     filter_istream stream(path);
 
     Json::Value lines(Json::arrayValue);
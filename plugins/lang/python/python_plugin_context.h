@@ -61,6 +61,30 @@ struct PythonSubinterpreter {
     std::unique_ptr<std::lock_guard<std::mutex>> lock;
 };
 
+/** RAII object that releases the Python interpreter lock for the duration
+    of its scope, so that other interpreters can run while this thread does
+    C++ work.  Nothing in its scope may touch a Python object.
+*/
+struct ReleasePythonLock {
+    ReleasePythonLock()
+        : threadState(PyThreadState_Get())
+    {
+        PyThreadState_Swap(NULL);
+        PyEval_ReleaseLock();
+    }
+
+    ~ReleasePythonLock()
+    {
+        PyEval_AcquireLock();
+        PyThreadState_Swap(threadState);
+    }
+
+    PyThreadState * threadState;
+
+    ReleasePythonLock(const ReleasePythonLock &) = delete;
+    void operator = (const ReleasePythonLock &) = delete;
+};
+
 ScriptException
 convertException(PythonSubinterpreter & pyControl,
         const boost::python::error_already_set & exc2,
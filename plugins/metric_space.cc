@@ -131,6 +131,14 @@ dist(int rowNum1, int rowNum2,
     return sqrtf(distSquared);
 }
 
+float
+EuclideanDistanceMetric::
+distFromDotProduct(double dotprod, double sqNorm1, double sqNorm2) const
+{
+    double distSquared = sqNorm1 + sqNorm2 - 2.0 * dotprod;
+    return sqrt(std::max(distSquared, 0.0));
+}
+
 
 /*****************************************************************************/
 /* COSINE DISTANCE METRIC                                                    */
@@ -246,6 +254,19 @@ dist(int rowNum1, int rowNum2,
     return result;
 }
 
+float
+CosineDistanceMetric::
+distFromDotProduct(double dotprod, double sqNorm1, double sqNorm2) const
+{
+    // Same conventions for zero length vectors as calc()
+    if (sqNorm1 == 0.0 && sqNorm2 == 0.0)
+        return 0.0;
+    if (sqNorm1 == 0.0 || sqNorm2 == 0.0)
+        return 1.0;
+
+    return std::max(1.0 - dotprod / sqrt(sqNorm1 * sqNorm2), 0.0);
+}
+
 
 } // namespace Datacratic
 } // namespace MLDB
@@ -44,6 +44,13 @@ struct DistanceMetric {
                        const ML::distribution<float> & coords1,
                        const ML::distribution<float> & coords2) const = 0;
 
+    /** Calculate the distance between two vectors from their dot product
+        and their squared two norms, for when the vectors themselves
+        aren't stored as floats.
+    */
+    virtual float distFromDotProduct(double dotprod, double sqNorm1,
+                                     double sqNorm2) const = 0;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -61,6 +68,9 @@ struct EuclideanDistanceMetric: public DistanceMetric {
                const ML::distribution<float> & coords1,
                const ML::distribution<float> & coords2) const;
 
+    float distFromDotProduct(double dotprod, double sqNorm1,
+                             double sqNorm2) const;
+
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
@@ -83,6 +93,9 @@ struct CosineDistanceMetric: public DistanceMetric {
                const ML::distribution<float> & coords1,
                const ML::distribution<float> & coords2) const;
 
+    float distFromDotProduct(double dotprod, double sqNorm1,
+                             double sqNorm2) const;
+
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
@@ -23,6 +23,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	csv_export_procedure.cc \
 	xlsx_importer.cc \
 	json_importer.cc \
+	json_projection.cc \
 	melt_procedure.cc \
 	ranking_procedure.cc \
 	fetcher.cc \
@@ -31,7 +32,11 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	frozen_column.cc \
 	column_types.cc \
 	tabular_dataset_column.cc \
+	tabular_dataset_chunk.cc \
+	tabular_dataset_row_index.cc \
+	column_zone_map.cc \
 	randomforest_procedure.cc \
+	boosted_trees_procedure.cc \
 	classifier.cc \
 	sql_functions.cc \
 	embedding.cc \
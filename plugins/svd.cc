@@ -1107,6 +1107,14 @@ call(SvdInput input) const
     return result;
 }
 
+std::vector<ExpressionValue>
+SvdEmbedRow::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & contexts) const
+{
+    return applyBatchParallel(applier, contexts);
+}
+
 namespace {
 
 RegisterProcedureType<SvdProcedure, SvdConfig>
@@ -185,6 +185,11 @@ struct SvdEmbedRow: public ValueFunctionT<SvdInput, SvdOutput> {
                 const std::function<bool (const Json::Value &)> & onProgress);
     
     virtual SvdOutput call(SvdInput input) const;
+
+    /** Embed a batch of rows, in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const override;
     
     SvdBasis svd;
     SvdEmbedConfig functionConfig;
@@ -10,6 +10,7 @@
 #include "frozen_column.h"
 #include "tabular_dataset_column.h"
 #include "tabular_dataset_chunk.h"
+#include "tabular_dataset_row_index.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/ml/jml/training_index_entry.h"
@@ -18,11 +19,19 @@
 #include "mldb/base/thread_pool.h"
 #include "mldb/base/scope.h"
 #include "mldb/server/bucket.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include "mldb/sql/expression_batch.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/atomic_shared_ptr.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
 #include <mutex>
+#include <cstring>
 
 using namespace std;
 
@@ -32,6 +41,28 @@ namespace MLDB {
 static constexpr size_t TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK=65536;
 static constexpr size_t NUM_PARALLEL_CHUNKS=16;
 
+/// Version of the on-disk format written by TabularDataStore::save()
+/// Version 2 added zone maps to each chunk
+/// Version 3 added the row index
+static constexpr int TABULAR_DATASET_FILE_VERSION=3;
+
+/// Maximum number of rows in each batch passed by forEachColumnBatch()
+static constexpr size_t TABULAR_DATASET_COLUMN_BATCH_SIZE=1024;
+
+namespace {
+
+/// Same order as Dataset::generateRowsWhere() gives a parallel scan
+struct SortByRowHash {
+    bool operator () (const RowName & row1, const RowName & row2)
+    {
+        RowHash h1(row1), h2(row2);
+
+        return h1 < h2 || (h1 == h2 && row1 < row2);
+    }
+};
+
+} // file scope
+
 
 /*****************************************************************************/
 /* TABULAR DATA STORE                                                        */
@@ -45,7 +76,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     TabularDataStore(TabularDatasetConfig config)
         : rowCount(0), config(std::move(config)),
-          backgroundJobsActive(0)
+          loadedFromFile(false), backgroundJobsActive(0)
     {
     }
 
@@ -335,15 +366,11 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     // Everything below here is protected by the dataset lock
     std::vector<TabularDatasetChunk> frozenChunks;
 
-    static int getRowShard(RowHash rowHash)
-    {
-        return (rowHash.hash() >> 23) % ROW_INDEX_SHARDS;
-    }
+    /// Index from rowHash to the number of the row within the dataset
+    TabularDatasetRowIndex rowIndex;
 
-    /// Index from rowHash to (chunk, indexInChunk) when line number not used for rowName
-    static constexpr size_t ROW_INDEX_SHARDS=32;
-    ML::Lightweight_Hash<RowHash, std::pair<int, int> > rowIndex
-        [ROW_INDEX_SHARDS];
+    /// Number of the first row of each chunk, plus the total row count
+    std::vector<size_t> chunkStarts;
     std::string filename;
     Date earliestTs, latestTs;
 
@@ -351,6 +378,14 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     TabularDatasetConfig config;
 
+    /// Set when the data was loaded from dataFileUrl; no more rows can be
+    /// recorded in that case.
+    bool loadedFromFile;
+
+    /// Keeps the mapped (or read) contents of the data file alive for as
+    /// long as the frozen columns point into it.
+    std::shared_ptr<const void> mapping;
+
     // Return the value of the column for all rows
     virtual MatrixColumn getColumn(const ColumnName & column) const override
     {
@@ -552,13 +587,22 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return getRowNamesT<RowHash>(start, limit);
     }
 
-    std::pair<int, int> tryLookupRow(const RowName & rowName) const
+    /// Return the (chunk, indexInChunk) of the given row number
+    std::pair<int, int> tryLookupRowNum(size_t rowNum) const
     {
-        int shard = getRowShard(rowName);
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end())
+        int chunk = std::upper_bound(chunkStarts.begin(), chunkStarts.end(),
+                                     rowNum)
+            - chunkStarts.begin() - 1;
+        return { chunk, rowNum - chunkStarts[chunk] };
+    }
+
+    /// Return the (chunk, indexInChunk) of the given row, or (-1, -1)
+    std::pair<int, int> tryLookupRow(const RowHash & rowHash) const
+    {
+        uint32_t rowNum = rowIndex.lookup(rowHash);
+        if (rowNum == TabularDatasetRowIndex::NOT_FOUND)
             return { -1, -1 };
-        return it->second;
+        return tryLookupRowNum(rowNum);
     }
     
     std::pair<int, int> lookupRow(const RowName & rowName) const
@@ -587,47 +631,169 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         result.rowHash = rowName;
         result.rowName = rowName;
 
-        int shard = getRowShard(result.rowHash);
+        auto row = lookupRow(rowName);
+        result.columns = chunks.at(row.first).getRow(row.second, fixedColumns);
+        return result;
+    }
 
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
+    virtual ExpressionValue getRowExpr(const RowName & rowName) const
+    {
+        auto row = lookupRow(rowName);
+        return chunks.at(row.first).getRowExpr(row.second, fixedColumns);
+    }
+
+    ExpressionValue
+    getRowColumnsExpr(const RowName & rowName,
+                      const std::vector<ColumnName> & columnNames) const
+    {
+        auto row = lookupRow(rowName);
+        const TabularDatasetChunk & chunk = chunks.at(row.first);
+        std::vector<int> columnIndexes = getColumnIndexes(columnNames);
+
+        std::vector<std::tuple<ColumnName, CellValue, Date> > result;
+        result.reserve(columnNames.size());
+        Date ts = chunk.timestamps->get(row.second).mustCoerceToTimestamp();
+        for (size_t i = 0;  i < columnNames.size();  ++i) {
+            const FrozenColumn * column
+                = chunk.maybeGetColumn(columnIndexes[i], columnNames[i]);
+            if (!column)
+                continue;
+            CellValue val = column->get(row.second);
+            if (val.empty())
+                continue;
+            result.emplace_back(columnNames[i], std::move(val), ts);
         }
+        return std::move(result);
+    }
 
-        result.columns
-            = chunks.at(it->second.first)
-            .getRow(it->second.second, fixedColumns);
-        return result;
+    /// A range of rows within a single chunk
+    struct ChunkRange {
+        size_t chunk;     ///< Index of the chunk
+        size_t begin;     ///< First row within the chunk
+        size_t end;       ///< One past the last row within the chunk
+        size_t rowIndex;  ///< Index of the first row within the dataset
+    };
+
+    /** Split rows [start, start + limit) of the dataset up into ranges of
+        at most batchSize rows, none of which span more than one chunk.  If
+        keepChunk is set, then chunks for which it returns false are
+        skipped.
+    */
+    std::vector<ChunkRange>
+    getChunkRanges(ssize_t start, ssize_t limit, size_t batchSize,
+                   const std::function<bool (const TabularDatasetChunk &)>
+                       & keepChunk = nullptr) const
+    {
+        std::vector<ChunkRange> ranges;
+        size_t first = start;
+        size_t end = limit == -1 ? rowCount : first + limit;
+        size_t n = 0;
+        for (size_t chunk = 0;  chunk < chunks.size() && n < end;
+             n += chunks[chunk++].rowCount()) {
+            size_t chunkRows = chunks[chunk].rowCount();
+            if (n + chunkRows <= first)
+                continue;
+            if (keepChunk && !keepChunk(chunks[chunk]))
+                continue;
+            size_t chunkStart = n < first ? first - n : 0;
+            size_t chunkEnd = std::min(chunkRows, end - n);
+            for (size_t i = chunkStart;  i < chunkEnd;  i += batchSize) {
+                size_t batchEnd = std::min(i + batchSize, chunkEnd);
+                ranges.push_back({ chunk, i, batchEnd, n + i });
+            }
+        }
+        return ranges;
     }
 
-    virtual ExpressionValue getRowExpr(const RowName & rowName) const
+    /// Index each of the columns, as for getting a row.  Unknown columns
+    /// are given an index of -1.
+    std::vector<int>
+    getColumnIndexes(const std::vector<ColumnName> & columnNames) const
     {
-        RowHash rowHash(rowName);
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
+        std::vector<int> columnIndexes;
+        columnIndexes.reserve(columnNames.size());
+        for (auto & c: columnNames) {
+            auto it = columnIndex.find(c.newHash());
+            if (it == columnIndex.end())
+                columnIndexes.emplace_back(-1);
+            else columnIndexes.emplace_back(it->second);
+        }
+        return columnIndexes;
+    }
+
+    /// Extract the values of the given columns over a range of rows
+    void getColumnBatch(const ChunkRange & range,
+                        const std::vector<ColumnName> & columnNames,
+                        const std::vector<int> & columnIndexes,
+                        ColumnBatch & batch) const
+    {
+        const TabularDatasetChunk & chunk = chunks[range.chunk];
+        size_t numRows = range.end - range.begin;
+
+        batch.rowIndex = range.rowIndex;
+        batch.rowNames.clear();
+        batch.rowNames.reserve(numRows);
+
+        // Timestamps are per row, and shared by each column
+        std::vector<Date> timestamps;
+        timestamps.reserve(numRows);
+        for (size_t i = range.begin;  i < range.end;  ++i) {
+            batch.rowNames.emplace_back(chunk.getRowName(i));
+            timestamps.emplace_back
+                (chunk.timestamps->get(i).mustCoerceToTimestamp());
+        }
+
+        batch.columns.clear();
+        batch.columns.resize(columnNames.size());
+        for (size_t j = 0;  j < columnNames.size();  ++j) {
+            ColumnBatch::Column & column = batch.columns[j];
+            const FrozenColumn * frozen
+                = chunk.maybeGetColumn(columnIndexes[j], columnNames[j]);
+            if (!frozen) {
+                column.values.resize(numRows);
+                column.timestamps.resize(numRows, Date::negativeInfinity());
+                continue;
+            }
+
+            column.values.reserve(numRows);
+            column.timestamps = timestamps;
+            for (size_t i = range.begin;  i < range.end;  ++i) {
+                column.values.emplace_back(frozen->get(i));
+                // Nulls aren't recorded in a row, so have no timestamp
+                if (column.values.back().empty())
+                    column.timestamps[i - range.begin]
+                        = Date::negativeInfinity();
+            }
         }
+    }
+
+    bool forEachColumnBatch(const std::vector<ColumnName> & columnNames,
+                            ssize_t start,
+                            ssize_t limit,
+                            const OnColumnBatch & onBatch) const
+    {
+        std::vector<int> columnIndexes = getColumnIndexes(columnNames);
+        std::vector<ChunkRange> ranges
+            = getChunkRanges(start, limit, TABULAR_DATASET_COLUMN_BATCH_SIZE);
 
-        return chunks.at(it->second.first)
-            .getRowExpr(it->second.second, fixedColumns);
+        auto doBatch = [&] (size_t b) -> bool
+            {
+                ColumnBatch batch;
+                getColumnBatch(ranges[b], columnNames, columnIndexes, batch);
+                return onBatch(batch);
+            };
+
+        return parallelMapHaltable(0, ranges.size(), doBatch);
     }
 
     virtual RowName getRowName(const RowHash & rowHash) const override
     {
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
+        auto row = tryLookupRow(rowHash);
+        if (row.first == -1) {
             throw HttpReturnException(400, "Row not found in tabular dataset");
         }
 
-        return chunks.at(it->second.first).getRowName(it->second.second);
+        return chunks.at(row.first).getRowName(row.second);
     }
 
     virtual ColumnName getColumnName(ColumnHash column) const override
@@ -701,8 +867,13 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return result;
     }
 
+    /** Take ownership of the given chunks, and index their columns and
+        rows.  If loadedRowIndex is passed, it's used instead of indexing
+        the rows again.
+    */
     void finalize(std::vector<TabularDatasetChunk> & inputChunks,
-                  uint64_t totalRows)
+                  uint64_t totalRows,
+                  const TabularDatasetRowIndex * loadedRowIndex = nullptr)
     {
         // NOTE: must be called with the lock held
 
@@ -749,66 +920,49 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         ExcAssertEqual(columns.size(), columnIndex.size());
         ExcAssertEqual(columns.size(), columnHashIndex.size());
 
-        // We create the row index in multiple chunks
+        chunkStarts.clear();
+        chunkStarts.reserve(chunks.size() + 1);
+        chunkStarts.push_back(0);
+        for (auto & c: chunks)
+            chunkStarts.push_back(chunkStarts.back() + c.rowCount());
+        ExcAssertEqual(chunkStarts.back(), totalRows);
 
-        std::mutex rowIndexLock[ROW_INDEX_SHARDS];
+        if (loadedRowIndex) {
+            ExcAssertEqual(loadedRowIndex->size(), totalRows);
+            rowIndex = *loadedRowIndex;
+            return;
+        }
 
         ML::Timer rowIndexTimer;
 
-        auto indexChunk = [&] (int chunkNum)
+        // Hash the row names of each chunk in parallel
+        auto getRowHashes = [&] (size_t begin, size_t end, RowHash * out)
             {
-                std::vector<std::pair<RowHash, uint32_t> >
-                    toInsert[ROW_INDEX_SHARDS];
-                
-                // First, extract and sort them
-                for (unsigned j = 0;  j < chunks[chunkNum].rowCount();  ++j) {
+                int chunkNum = tryLookupRowNum(begin).first;
+                size_t chunkStart = chunkStarts[chunkNum];
+                for (size_t i = begin;  i < end;  ++i, ++out) {
+                    // Skip to the next (non-empty) chunk
+                    while (i == chunkStarts[chunkNum + 1])
+                        chunkStart = chunkStarts[++chunkNum];
                     RowName rowNameStorage;
-                    const RowName & rowName
-                        = chunks[chunkNum].getRowName(j, rowNameStorage);
-                    RowHash rowHash = rowName;
-                    
-                    int shard = getRowShard(rowHash);
-                    toInsert[shard].emplace_back(rowHash, j);
+                    *out = chunks[chunkNum].getRowName(i - chunkStart,
+                                                       rowNameStorage);
                 }
+            };
 
-                // Secondly, add them to the row index
-                for (size_t i = 0;  i < ROW_INDEX_SHARDS;  ++i) {
-                    size_t shard = (i + chunkNum) % ROW_INDEX_SHARDS;
-                    std::unique_lock<std::mutex> guard(rowIndexLock[shard]);
-                    
-                    for (auto & e: toInsert[shard]) {
-                        RowHash rowHash = e.first;
-                        int32_t indexInChunk = e.second;
-                        
-                        if (!rowIndex[shard].insert({rowHash,
-                                        { chunkNum, indexInChunk }}).second) {
-                            throw HttpReturnException
-                                (400, "Duplicate row name in tabular dataset",
-                                 "rowName",
-                                 chunks[chunkNum].getRowName(indexInChunk));
-                        }
-                    }
-                }
+        auto onDuplicate = [&] (uint32_t rowNum)
+            {
+                auto row = tryLookupRowNum(rowNum);
+                throw HttpReturnException
+                    (400, "Duplicate row name in tabular dataset",
+                     "rowName",
+                     chunks[row.first].getRowName(row.second));
             };
-        
-        parallelMap(0, chunks.size(), indexChunk);
-        
-#if 0
-        //cerr << "creating row index" << endl;
-        rowIndex.reserve(4 * totalRows / 3);
-        //cerr << "rowIndex capacity is " << rowIndex.capacity() << endl;
-        for (unsigned i = 0;  i < chunks.size();  ++i) {
-            for (unsigned j = 0;  j < chunks[i].rowCount();  ++j) {
-                RowName rowNameStorage;
-                if (!rowIndex.insert({ chunks[i].getRowName(j, rowNameStorage),
-                                { i, j } }).second)
-                    throw HttpReturnException
-                        (400, "Duplicate row name in tabular dataset",
-                         "rowName", chunks[i].getRowName(j));
-            }
-        }
-#endif
-        //cerr << "done creating row index" << endl;
+
+        rowIndex = TabularDatasetRowIndex::build
+            (totalRows, TABULAR_DATASET_DEFAULT_ROWS_PER_CHUNK,
+             getRowHashes, onDuplicate);
+
         cerr << "row index took " << rowIndexTimer.elapsed() << endl;
 
     }
@@ -827,6 +981,163 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         }
     }
 
+    /** Save the committed chunks to the given file.  The file contains a
+        header with the column names, then each chunk starting on an
+        8 byte boundary, then the row index, and finally a footer with
+        the offset of each chunk (so that they can be loaded in parallel)
+        and of the row index.  The bulk storage
+        of the frozen columns is aligned so that it can be used in place
+        when the file is memory mapped.
+    */
+    void save(const Url & dataFileUrl) const
+    {
+        ML::Timer timer;
+
+        filter_ostream stream(dataFileUrl);
+        ML::DB::Store_Writer store(stream);
+
+        store << string("MLDB_TABULAR_DATASET")
+              << ML::DB::compact_size_t(TABULAR_DATASET_FILE_VERSION)
+              << ML::DB::compact_size_t(rowCount)
+              << ML::DB::compact_size_t(fixedColumns.size());
+        for (auto & c: fixedColumns)
+            store << c.toUtf8String();
+
+        std::vector<uint64_t> chunkOffsets;
+        chunkOffsets.reserve(chunks.size());
+
+        for (auto & c: chunks) {
+            serializeAligned(store, nullptr, 0);
+            chunkOffsets.push_back(store.offset());
+            c.serialize(store);
+        }
+
+        serializeAligned(store, nullptr, 0);
+        uint64_t rowIndexOffset = store.offset();
+        rowIndex.serialize(store);
+
+        serializeAligned(store, chunkOffsets.data(),
+                         chunkOffsets.size() * sizeof(uint64_t));
+        uint64_t footer[3] = { chunkOffsets.size(),
+                               store.offset() - chunkOffsets.size() * sizeof(uint64_t),
+                               rowIndexOffset };
+        serializeAligned(store, footer, sizeof(footer));
+
+        stream.close();
+
+        cerr << "saving tabular dataset to " << dataFileUrl
+             << " took " << timer.elapsed() << endl;
+    }
+
+    /** Load the dataset from a file written by save().  The file is
+        memory mapped if possible, in which case the column data is
+        paged in lazily and shared with any other process that maps the
+        same file; otherwise (compressed or remote files) it is read into
+        memory first.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        ML::Timer timer;
+
+        auto stream = std::make_shared<filter_istream>
+            (dataFileUrl, std::map<std::string, std::string>{ { "mapped", "true" } });
+
+        const char * data;
+        size_t size;
+        std::tie(data, size) = stream->mapped();
+        std::shared_ptr<const void> fileMapping = stream;
+
+        if (!data) {
+            auto contents = std::make_shared<std::string>(stream->readAll());
+            data = contents->data();
+            size = contents->size();
+            fileMapping = contents;
+        }
+
+        ML::DB::Store_Reader store(data, size);
+
+        std::string magic;
+        store >> magic;
+        if (magic != "MLDB_TABULAR_DATASET")
+            throw HttpReturnException(400, "File is not a tabular dataset",
+                                      "dataFileUrl", dataFileUrl);
+
+        ML::DB::compact_size_t version(store);
+        if (version < 1 || version > TABULAR_DATASET_FILE_VERSION)
+            throw HttpReturnException(400, "Unsupported tabular dataset file version",
+                                      "dataFileUrl", dataFileUrl,
+                                      "version", (size_t)version,
+                                      "supportedVersion", TABULAR_DATASET_FILE_VERSION);
+
+        ML::DB::compact_size_t totalRows(store);
+        ML::DB::compact_size_t numColumns(store);
+
+        std::vector<ColumnName> columnNames;
+        columnNames.reserve(numColumns);
+        for (size_t i = 0;  i < numColumns;  ++i) {
+            Utf8String name;
+            store >> name;
+            columnNames.emplace_back(ColumnName::parse(name));
+        }
+
+        // Before version 3, there is no row index in the footer
+        uint64_t footer[3] = { 0, 0, 0 };
+        size_t footerSize = (version < 3 ? 2 : 3) * sizeof(uint64_t);
+        if (size < store.offset() + footerSize)
+            throw HttpReturnException(400, "Tabular dataset file is truncated",
+                                      "dataFileUrl", dataFileUrl);
+        std::memcpy(footer, data + size - footerSize, footerSize);
+
+        uint64_t numChunks = footer[0];
+        uint64_t offsetsStart = footer[1];
+        uint64_t rowIndexStart = footer[2];
+        if (offsetsStart + numChunks * sizeof(uint64_t) > size - footerSize
+            || offsetsStart % 8 != 0
+            || rowIndexStart > offsetsStart
+            || rowIndexStart % 8 != 0)
+            throw HttpReturnException(400, "Tabular dataset file is corrupt",
+                                      "dataFileUrl", dataFileUrl);
+
+        const uint64_t * chunkOffsets
+            = reinterpret_cast<const uint64_t *>(data + offsetsStart);
+
+        std::vector<TabularDatasetChunk> loadedChunks(numChunks);
+
+        auto loadChunk = [&] (size_t i)
+            {
+                uint64_t start = chunkOffsets[i];
+                ExcAssertLess(start, offsetsStart);
+                ExcAssertEqual(start % 8, 0);
+                ML::DB::Store_Reader chunkStore(data + start,
+                                                offsetsStart - start);
+                loadedChunks[i].reconstitute(chunkStore, fileMapping,
+                                             version);
+            };
+
+        parallelMap(0, numChunks, loadChunk);
+
+        // The row index is used in place, rather than being rebuilt
+        std::unique_ptr<TabularDatasetRowIndex> loadedRowIndex;
+        if (version >= 3) {
+            ML::DB::Store_Reader rowIndexStore(data + rowIndexStart,
+                                               offsetsStart - rowIndexStart);
+            loadedRowIndex.reset(new TabularDatasetRowIndex
+                                 (TabularDatasetRowIndex::reconstitute
+                                  (rowIndexStore, fileMapping)));
+        }
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        initialize(std::move(columnNames));
+        finalize(loadedChunks, totalRows, loadedRowIndex.get());
+
+        this->mapping = std::move(fileMapping);
+        loadedFromFile = true;
+
+        cerr << "loading tabular dataset from " << dataFileUrl
+             << " took " << timer.elapsed() << endl;
+    }
+
     /** This is a recorder that allows parallel records from multiple
         threads. */
     struct BasicRecorder: public Recorder {
@@ -1149,7 +1460,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
              << totalRows << " rows and " << columns.size() << " columns for "
              << 1.0 * mem / rowCount << " bytes/row" << endl;
         cerr << "column memory is " << columnMem << endl;
+        cerr << "row index memory is " << rowIndex.memusage() << endl;
 
+        if (!config.dataFileUrl.empty())
+            save(config.dataFileUrl);
     }
 
     /// The number of background jobs that we're currently waiting for
@@ -1202,6 +1516,12 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void createFirstChunks(const std::vector<std::tuple<ColumnName, CellValue, Date> > & vals)
     {
         // Must be done with the dataset lock held
+        if (loadedFromFile)
+            throw HttpReturnException
+                (400, "Cannot record into a tabular dataset that was loaded "
+                 "from a file",
+                 "dataFileUrl", config.dataFileUrl);
+
         if (!mutableChunks.load()) {
             //need to create the mutable chunk
             vector<ColumnName> columnNames;
@@ -1341,7 +1661,12 @@ TabularDataset(MldbServer * owner,
                const std::function<bool (const Json::Value &)> & onProgress)
     : Dataset(owner)
 {
-    itl = make_shared<TabularDataStore>(config.params.convert<TabularDatasetConfig>());
+    auto tabularConfig = config.params.convert<TabularDatasetConfig>();
+    itl = make_shared<TabularDataStore>(tabularConfig);
+
+    if (!tabularConfig.dataFileUrl.empty()
+        && tryGetUriObjectInfo(tabularConfig.dataFileUrl.toString()))
+        itl->load(tabularConfig.dataFileUrl);
 }
 
 TabularDataset::
@@ -1395,6 +1720,24 @@ getRowExpr(const RowName & row) const
     return itl->getRowExpr(row);
 }
 
+ExpressionValue
+TabularDataset::
+getRowColumnsExpr(const RowName & row,
+                  const std::vector<ColumnName> & columnNames) const
+{
+    return itl->getRowColumnsExpr(row, columnNames);
+}
+
+bool
+TabularDataset::
+forEachColumnBatch(const std::vector<ColumnName> & columnNames,
+                   ssize_t start,
+                   ssize_t limit,
+                   const OnColumnBatch & onBatch) const
+{
+    return itl->forEachColumnBatch(columnNames, start, limit, onBatch);
+}
+
 GenerateRowsWhereFunction
 TabularDataset::
 generateRowsWhere(const SqlBindingScope & context,
@@ -1407,7 +1750,132 @@ generateRowsWhere(const SqlBindingScope & context,
         = itl->generateRowsWhere(context, where, offset, limit);
     if (!fn)
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
-    return fn;
+    if (fn.complexity != GenerateRowsWhereFunction::TABLESCAN)
+        return fn;
+
+    // The where clause requires a scan of the whole table.  If part of it
+    // can be tested against the zone maps of each chunk, then we scan only
+    // the chunks that may contain matching rows.
+    SqlExpressionDatasetScope dsScope(*this, alias);
+    auto resolveColumn = [&] (const ColumnName & columnName)
+        {
+            return dsScope.resolveColumnName("", columnName);
+        };
+
+    std::shared_ptr<ZoneMapPredicate> predicate
+        = ZoneMapPredicate::fromExpression(where, resolveColumn);
+    if (!predicate)
+        return fn;
+
+    auto whereBound = where.bind(dsScope);
+    UnboundEntities unbound = where.getUnbound();
+
+    bool useColumnBatches = whereBound.execBatch
+        && unbound.tables.empty() && unbound.wildcards.empty();
+    std::vector<ColumnName> batchColumns;
+    if (useColumnBatches) {
+        for (auto & v: unbound.vars)
+            batchColumns.push_back(resolveColumn(v.first));
+    }
+
+    std::shared_ptr<TabularDataStore> store = itl;
+
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params)
+            {
+                ssize_t start = 0;
+                if (!token.empty())
+                    start = token.convert<size_t>();
+
+                auto keepChunk = [&] (const TabularDatasetChunk & chunk)
+                    {
+                        auto getZoneMap = [&] (const ColumnName & columnName)
+                            {
+                                auto it = store->columnIndex
+                                    .find(columnName.newHash());
+                                size_t index = it == store->columnIndex.end()
+                                    ? -1 : it->second;
+                                return chunk.maybeGetZoneMap(index, columnName);
+                            };
+
+                        return predicate->mayMatch(getZoneMap);
+                    };
+
+                std::vector<TabularDataStore::ChunkRange> ranges
+                    = store->getChunkRanges(start, numToGenerate,
+                                            TABULAR_DATASET_COLUMN_BATCH_SIZE,
+                                            keepChunk);
+                std::vector<int> columnIndexes
+                    = store->getColumnIndexes(batchColumns);
+
+                // Rows kept from each range, which are in dataset order
+                std::vector<std::vector<RowName> > kept(ranges.size());
+
+                auto doRange = [&] (size_t r)
+                    {
+                        const TabularDataStore::ChunkRange & range = ranges[r];
+                        std::vector<RowName> & output = kept[r];
+
+                        if (useColumnBatches) {
+                            ColumnBatch columns;
+                            store->getColumnBatch(range, batchColumns,
+                                                  columnIndexes, columns);
+                            SqlExpressionDatasetScope::RowBatch
+                                batch(columns, batchColumns, &params);
+                            BatchColumn keep;
+                            whereBound.execRowBatch(batch, keep);
+
+                            for (size_t i = 0;  i < columns.size();  ++i) {
+                                if (keep.isTrue(i))
+                                    output.emplace_back
+                                        (std::move(columns.rowNames[i]));
+                            }
+                            return;
+                        }
+
+                        const TabularDatasetChunk & chunk
+                            = store->chunks[range.chunk];
+                        for (size_t i = range.begin;  i < range.end;  ++i) {
+                            MatrixNamedRow row;
+                            row.rowName = chunk.getRowName(i);
+                            row.rowHash = row.rowName;
+                            row.columns = chunk.getRow(i, store->fixedColumns);
+
+                            auto rowScope = dsScope.getRowScope(row, &params);
+                            if (whereBound(rowScope, GET_LATEST).isTrue())
+                                output.emplace_back(std::move(row.rowName));
+                        }
+                    };
+
+                parallelMap(0, ranges.size(), doRange);
+
+                std::vector<RowName> rowsToKeep;
+                for (auto & k: kept) {
+                    rowsToKeep.insert(rowsToKeep.end(),
+                                      std::make_move_iterator(k.begin()),
+                                      std::make_move_iterator(k.end()));
+                }
+
+                // Rows covered by this call, including those in the chunks
+                // that were skipped
+                size_t end = numToGenerate == -1
+                    ? store->rowCount
+                    : std::min<size_t>(store->rowCount, start + numToGenerate);
+                size_t numScanned = end > (size_t)start ? end - start : 0;
+
+                // Order the same way as the scan in Dataset
+                if (numScanned >= 1000)
+                    parallelQuickSortRecursive<RowName, SortByRowHash>
+                        (rowsToKeep.begin(), rowsToKeep.end());
+
+                Any newToken;
+                if (end < store->rowCount)
+                    newToken = end;
+
+                return std::move(make_pair(std::move(rowsToKeep),
+                                           std::move(newToken)));
+            },
+            "scan tabular dataset chunks, skipping those excluded by zone maps"};
 }
 
 KnownColumn
@@ -1488,6 +1956,12 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file in which the dataset is persisted.  If the "
+             "file exists, the dataset is loaded from it (memory mapping "
+             "it when possible) and no more rows may be recorded.  "
+             "Otherwise, the dataset is written to the file when it is "
+             "committed.");
 }
 
 namespace {
@@ -13,6 +13,7 @@
 
 #include "mldb/core/dataset.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/types/url.h"
 
 namespace Datacratic {
 namespace MLDB {
@@ -33,6 +34,7 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -54,6 +56,10 @@ struct TabularDataset : public Dataset {
     virtual std::shared_ptr<RowStream> getRowStream() const;
 
     virtual ExpressionValue getRowExpr(const RowName & row) const;
+
+    virtual ExpressionValue
+    getRowColumnsExpr(const RowName & row,
+                      const std::vector<ColumnName> & columnNames) const;
     
     virtual std::pair<Date, Date> getTimestampRange() const;
 
@@ -64,6 +70,12 @@ struct TabularDataset : public Dataset {
                       ssize_t offset,
                       ssize_t limit) const;
 
+    virtual bool
+    forEachColumnBatch(const std::vector<ColumnName> & columnNames,
+                       ssize_t start,
+                       ssize_t limit,
+                       const OnColumnBatch & onBatch) const;
+
     virtual KnownColumn getKnownColumnInfo(const ColumnName & columnName) const;
 
     /** Commit changes to the database. */
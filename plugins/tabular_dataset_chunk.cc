@@ -0,0 +1,125 @@
+/** tabular_dataset_chunk.cc                                       -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Serialization of frozen tabular dataset chunks.
+*/
+
+#include "tabular_dataset_chunk.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/any_impl.h"
+
+using namespace std;
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR DATASET CHUNK                                                     */
+/*****************************************************************************/
+
+void
+TabularDatasetChunk::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << ML::DB::compact_size_t(rowCount());
+
+    // Row names.  Integer row names are written in bulk; others one by one.
+    bool integerNames = rowNames.empty();
+    store << integerNames;
+    if (integerNames) {
+        serializeAligned(store, integerRowNames.data(),
+                         integerRowNames.size() * sizeof(uint64_t));
+    }
+    else {
+        for (auto & n: rowNames)
+            store << n.toUtf8String();
+    }
+
+    timestamps->serialize(store);
+
+    store << ML::DB::compact_size_t(columns.size());
+    for (unsigned i = 0;  i < columns.size();  ++i) {
+        columns[i]->serialize(store);
+        zoneMaps.at(i).serialize(store);
+    }
+
+    store << ML::DB::compact_size_t(sparseColumns.size());
+    for (auto & c: sparseColumns) {
+        store << c.first.toUtf8String();
+        c.second->serialize(store);
+        sparseZoneMaps.at(c.first).serialize(store);
+    }
+}
+
+void
+TabularDatasetChunk::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping,
+             int version)
+{
+    ML::DB::compact_size_t numRows(store);
+
+    bool integerNames;
+    store >> integerNames;
+    rowNames.clear();
+    integerRowNames.clear();
+
+    if (integerNames) {
+        auto names = reinterpret_cast<const uint64_t *>
+            (reconstituteAligned(store, numRows * sizeof(uint64_t)));
+        integerRowNames.assign(names, names + numRows);
+    }
+    else {
+        rowNames.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            Utf8String name;
+            store >> name;
+            rowNames.emplace_back(RowName::parse(name));
+        }
+    }
+
+    timestamps = FrozenColumn::reconstitute(store, mapping);
+
+    ML::DB::compact_size_t numColumns(store);
+    columns.clear();
+    columns.reserve(numColumns);
+    zoneMaps.clear();
+    zoneMaps.reserve(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        columns.emplace_back(FrozenColumn::reconstitute(store, mapping));
+        zoneMaps.emplace_back();
+        if (version >= 2)
+            zoneMaps.back().reconstitute(store);
+        else zoneMaps.back()
+                 = ColumnZoneMap::fromFrozen(*columns.back(), numRows);
+    }
+
+    ML::DB::compact_size_t numSparseColumns(store);
+    sparseColumns.clear();
+    sparseColumns.reserve(numSparseColumns);
+    sparseZoneMaps.clear();
+    sparseZoneMaps.reserve(numSparseColumns);
+    for (size_t i = 0;  i < numSparseColumns;  ++i) {
+        Utf8String name;
+        store >> name;
+        ColumnName columnName = ColumnName::parse(name);
+        auto column = FrozenColumn::reconstitute(store, mapping);
+        ColumnZoneMap zoneMap;
+        if (version >= 2)
+            zoneMap.reconstitute(store);
+        else zoneMap = ColumnZoneMap::fromFrozen(*column, numRows);
+        sparseColumns.emplace(columnName, std::move(column));
+        sparseZoneMaps.emplace(std::move(columnName), std::move(zoneMap));
+    }
+
+    if (rowCount() != numRows)
+        throw HttpReturnException(500, "Tabular dataset chunk has wrong number of rows",
+                                  "expected", (size_t)numRows,
+                                  "actual", rowCount());
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -9,6 +9,10 @@
 
 #include <unordered_map>
 #include "frozen_column.h"
+#include "tabular_dataset_column.h"
+#include "column_zone_map.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/jml/db/persistent_fwd.h"
 #include <mutex>
 
 namespace Datacratic {
@@ -45,6 +49,8 @@ struct TabularDatasetChunk {
     {
         columns.swap(other.columns);
         sparseColumns.swap(other.sparseColumns);
+        zoneMaps.swap(other.zoneMaps);
+        sparseZoneMaps.swap(other.sparseZoneMaps);
         rowNames.swap(other.rowNames);
         integerRowNames.swap(other.integerRowNames);
         std::swap(timestamps, other.timestamps);
@@ -136,8 +142,29 @@ struct TabularDatasetChunk {
         }
     }
 
+    /** Return the zone map of the given column, or null if the chunk has
+        no such column (in which case all of its values are null).
+    */
+    const ColumnZoneMap *
+    maybeGetZoneMap(size_t columnIndex, const ColumnName & columnName) const
+    {
+        if (columnIndex < zoneMaps.size()) {
+            return &zoneMaps[columnIndex];
+        }
+        else {
+            auto it = sparseZoneMaps.find(columnName);
+            if (it == sparseZoneMaps.end())
+                return nullptr;
+            return &it->second;
+        }
+    }
+
     std::vector<std::shared_ptr<FrozenColumn> > columns;
     std::unordered_map<ColumnName, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
+
+    /// Summary of the values of each column, for skipping the chunk
+    std::vector<ColumnZoneMap> zoneMaps;
+    std::unordered_map<ColumnName, ColumnZoneMap, PathNewHasher> sparseZoneMaps;
 private:
     std::vector<RowName> rowNames;
     std::vector<uint64_t> integerRowNames;
@@ -228,6 +255,20 @@ public:
         }
     }
 
+    /** Serialize the chunk into the given store, in a form that can be
+        reconstituted in place from a memory mapped file.
+    */
+    void serialize(ML::DB::Store_Writer & store) const;
+
+    /** Reconstitute a chunk written by serialize().  The store must be
+        reading from the in-memory region held by mapping; see
+        FrozenColumn::reconstitute().  Files before version 2 have no
+        zone maps, so they are calculated by scanning the columns.
+    */
+    void reconstitute(ML::DB::Store_Reader & store,
+                      const std::shared_ptr<const void> & mapping,
+                      int version);
+
     friend class MutableTabularDatasetChunk;
 };
 
@@ -257,10 +298,19 @@ struct MutableTabularDatasetChunk {
         result.columns.resize(columns.size());
         result.sparseColumns.reserve(sparseColumns.size());
 
-        for (unsigned i = 0;  i < columns.size();  ++i)
+        result.zoneMaps.reserve(columns.size());
+        result.sparseZoneMaps.reserve(sparseColumns.size());
+
+        for (unsigned i = 0;  i < columns.size();  ++i) {
+            result.zoneMaps.emplace_back
+                (ColumnZoneMap::fromColumn(columns[i], rowCount_));
             result.columns[i] = columns[i].freeze();
-        for (auto & c: sparseColumns)
+        }
+        for (auto & c: sparseColumns) {
+            result.sparseZoneMaps.emplace
+                (c.first, ColumnZoneMap::fromColumn(c.second, rowCount_));
             result.sparseColumns.emplace(c.first, c.second.freeze());
+        }
 
         result.timestamps = timestamps.freeze();
 
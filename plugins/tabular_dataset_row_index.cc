@@ -0,0 +1,164 @@
+/** tabular_dataset_row_index.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Frozen index from row name to row number for a tabular dataset.
+*/
+
+#include "tabular_dataset_row_index.h"
+#include "frozen_column.h"
+#include "mldb/base/parallel.h"
+#include "mldb/server/parallel_merge_sort.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/jml/db/persistent.h"
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Memory for an index that was built rather than loaded
+struct RowIndexStorage {
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> rowNums;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* TABULAR DATASET ROW INDEX                                                 */
+/*****************************************************************************/
+
+constexpr uint32_t TabularDatasetRowIndex::NOT_FOUND;
+
+TabularDatasetRowIndex::
+TabularDatasetRowIndex()
+    : numRows(0), numSlots(0), shift(63),
+      hashes(nullptr), rowNums(nullptr)
+{
+}
+
+TabularDatasetRowIndex
+TabularDatasetRowIndex::
+build(size_t numRows,
+      size_t rowsPerBlock,
+      const std::function<void (size_t begin, size_t end, RowHash * out)>
+          & getRowHashes,
+      const std::function<void (uint32_t rowNum)> & onDuplicate)
+{
+    if (numRows >= NOT_FOUND)
+        throw HttpReturnException(400, "Too many rows to index in tabular dataset",
+                                  "numRows", numRows);
+
+    // Get the hash of every row, paired with its number
+    std::vector<std::pair<uint64_t, uint32_t> > entries(numRows);
+    size_t numBlocks = (numRows + rowsPerBlock - 1) / rowsPerBlock;
+
+    auto doBlock = [&] (size_t block)
+        {
+            size_t begin = block * rowsPerBlock;
+            size_t end = std::min(begin + rowsPerBlock, numRows);
+            std::vector<RowHash> blockHashes(end - begin);
+            getRowHashes(begin, end, blockHashes.data());
+            for (size_t i = begin;  i < end;  ++i)
+                entries[i] = std::make_pair(blockHashes[i - begin].hash(),
+                                            uint32_t(i));
+        };
+
+    parallelMap(0, numBlocks, doBlock);
+
+    // Sorting by hash also sorts by home slot, as that's the top bits of
+    // the hash.  It also brings duplicates together.
+    parallelQuickSortRecursive(entries);
+
+    for (size_t i = 1;  i < numRows;  ++i) {
+        if (entries[i].first == entries[i - 1].first)
+            onDuplicate(entries[i].second);
+    }
+
+    // Table with a power of two number of slots, at most 3/4 full
+    int numBits = 1;
+    while ((size_t(1) << numBits) * 3 < numRows * 4)
+        ++numBits;
+
+    TabularDatasetRowIndex result;
+    result.numRows = numRows;
+    result.shift = 64 - numBits;
+
+    // Place each row in its home slot, or the first empty slot after it.
+    // As the rows are in order, that's just after the previous one.  Rather
+    // than wrapping around, rows that overflow the end go in extra slots.
+    auto storage = std::make_shared<RowIndexStorage>();
+    storage->hashes.resize(size_t(1) << numBits, -1);
+    storage->rowNums.resize(size_t(1) << numBits, NOT_FOUND);
+
+    size_t next = 0;
+    for (auto & e: entries) {
+        size_t slot = std::max<size_t>(e.first >> result.shift, next);
+        if (slot >= storage->hashes.size()) {
+            storage->hashes.resize(slot + 1, -1);
+            storage->rowNums.resize(slot + 1, NOT_FOUND);
+        }
+        storage->hashes[slot] = e.first;
+        storage->rowNums[slot] = e.second;
+        next = slot + 1;
+    }
+
+    result.numSlots = storage->hashes.size();
+    result.hashes = storage->hashes.data();
+    result.rowNums = storage->rowNums.data();
+    result.storage = std::move(storage);
+
+    return result;
+}
+
+size_t
+TabularDatasetRowIndex::
+memusage() const
+{
+    return sizeof(*this) + numSlots * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+void
+TabularDatasetRowIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << ML::DB::compact_size_t(numRows)
+          << ML::DB::compact_size_t(numSlots)
+          << ML::DB::compact_size_t(shift);
+    serializeAligned(store, hashes, numSlots * sizeof(uint64_t));
+    serializeAligned(store, rowNums, numSlots * sizeof(uint32_t));
+}
+
+TabularDatasetRowIndex
+TabularDatasetRowIndex::
+reconstitute(ML::DB::Store_Reader & store,
+             const std::shared_ptr<const void> & mapping)
+{
+    TabularDatasetRowIndex result;
+
+    ML::DB::compact_size_t numRows(store), numSlots(store), shift(store);
+    if (shift < 1 || shift > 63 || numSlots < numRows
+        || (numSlots >> (64 - shift)) == 0)
+        throw HttpReturnException(400, "Tabular dataset row index is corrupt");
+
+    result.numRows = numRows;
+    result.numSlots = numSlots;
+    result.shift = shift;
+    result.hashes = reinterpret_cast<const uint64_t *>
+        (reconstituteAligned(store, numSlots * sizeof(uint64_t)));
+    result.rowNums = reinterpret_cast<const uint32_t *>
+        (reconstituteAligned(store, numSlots * sizeof(uint32_t)));
+    result.storage = mapping;
+
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
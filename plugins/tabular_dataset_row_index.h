@@ -0,0 +1,102 @@
+/** tabular_dataset_row_index.h                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Frozen index from row name to row number for a tabular dataset.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_fwd.h"
+#include "mldb/types/hash_wrapper.h"
+#include "mldb/jml/db/persistent_fwd.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* TABULAR DATASET ROW INDEX                                                 */
+/*****************************************************************************/
+
+/** Index from the hash of a row name to the number of the row within the
+    dataset, built once when the dataset is committed and never modified
+    afterwards.
+
+    It's a flat open addressing table with linear probing.  Each row's
+    home slot is given by the top bits of its hash, and rows are laid out
+    in hash order, so that a lookup can stop as soon as it sees a larger
+    hash.  The table is two arrays (hashes and row numbers) with no
+    pointers, which takes 12 bytes per slot at a load factor of at most
+    3/4, and which can be saved with the dataset and used in place from a
+    memory mapped file.
+*/
+
+struct TabularDatasetRowIndex {
+    TabularDatasetRowIndex();
+
+    /// Returned by lookup() for rows that aren't in the index
+    static constexpr uint32_t NOT_FOUND = -1;
+
+    /** Build the index over numRows rows.  getRowHashes(begin, end, out)
+        must fill in the row hash of each row in [begin, end), and will be
+        called in parallel over disjoint ranges of at most rowsPerBlock
+        rows.  If two rows have the same hash, onDuplicate is called with
+        the number of one of them, and must throw.
+    */
+    static TabularDatasetRowIndex
+    build(size_t numRows,
+          size_t rowsPerBlock,
+          const std::function<void (size_t begin, size_t end, RowHash * out)>
+              & getRowHashes,
+          const std::function<void (uint32_t rowNum)> & onDuplicate);
+
+    /// Return the number of the row with the given hash, or NOT_FOUND
+    uint32_t lookup(RowHash rowHash) const
+    {
+        uint64_t hash = rowHash.hash();
+        for (size_t i = hash >> shift;  i < numSlots;  ++i) {
+            // Empty slots have the largest possible hash, so this also
+            // stops at the end of the run of slots that hold rows.
+            if (hashes[i] > hash)
+                return NOT_FOUND;
+            if (hashes[i] == hash)
+                return rowNums[i];
+        }
+        return NOT_FOUND;
+    }
+
+    /// Number of rows in the index
+    size_t size() const
+    {
+        return numRows;
+    }
+
+    size_t memusage() const;
+
+    /// Write the index in a form that reconstitute() can use in place
+    void serialize(ML::DB::Store_Writer & store) const;
+
+    /** Reconstitute an index written by serialize().  As for a frozen
+        column, the table points directly into the store's memory, which
+        mapping keeps alive.
+    */
+    static TabularDatasetRowIndex
+    reconstitute(ML::DB::Store_Reader & store,
+                 const std::shared_ptr<const void> & mapping);
+
+private:
+    size_t numRows;
+    size_t numSlots;
+    int shift;                  ///< Right shift of a hash for its home slot
+    const uint64_t * hashes;    ///< Hash of each slot; empty slots are ~0
+    const uint32_t * rowNums;   ///< Row of each slot; empty is NOT_FOUND
+
+    /// Keeps hashes and rowNums alive
+    std::shared_ptr<const void> storage;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,139 @@
+/** text_scan.h                                                    -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Vectorized scanning of text for structural characters (newlines,
+    separators, quotes and JSON brackets), used when splitting and parsing
+    text files.
+*/
+
+#pragma once
+
+#include "mldb/arch/arch.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#if JML_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
+namespace Datacratic {
+
+/** Return a pointer to the first character in [p, end) that is equal to
+    c1 or c2, or end if there is none.  If any character before the one
+    returned has its high bit set, eightBit is set to true; otherwise it
+    is left untouched.
+*/
+inline const char *
+scanForChars(const char * p, const char * end, char c1, char c2,
+             bool & eightBit)
+{
+#if JML_INTEL_ISA
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+
+    for (; end - p >= 16;  p += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        unsigned found
+            = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1),
+                                             _mm_cmpeq_epi8(chunk, v2)));
+        unsigned high = _mm_movemask_epi8(chunk);
+        if (found) {
+            int pos = __builtin_ctz(found);
+            if (high & ((1U << pos) - 1))
+                eightBit = true;
+            return p + pos;
+        }
+        if (high)
+            eightBit = true;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if (*p == c1 || *p == c2)
+            return p;
+        if ((unsigned char)*p >= 128)
+            eightBit = true;
+    }
+    return end;
+}
+
+/** Return true if any character in [p, end) has its high bit set. */
+inline bool
+hasEightBitChars(const char * p, const char * end)
+{
+#if JML_INTEL_ISA
+    for (; end - p >= 16;  p += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p)))
+            return true;
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if ((unsigned char)*p >= 128)
+            return true;
+    }
+    return false;
+}
+
+/** Return a pointer to the first character in [p, end) that is a double
+    quote or a bracket that opens or closes a JSON object or array, or end
+    if there is none.
+*/
+inline const char *
+scanForJsonStructure(const char * p, const char * end)
+{
+#if JML_INTEL_ISA
+    // '[' and ']' are '{' and '}' with bit 5 cleared, so setting that bit
+    // lets us find all four brackets with two comparisons.
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bit5 = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+
+    for (; end - p >= 16;  p += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        __m128i folded = _mm_or_si128(chunk, bit5);
+        unsigned found
+            = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                             _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                                                          _mm_cmpeq_epi8(folded, close))));
+        if (found)
+            return p + __builtin_ctz(found);
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        char c = *p | 0x20;
+        if (*p == '"' || c == '{' || c == '}')
+            return p;
+    }
+    return end;
+}
+
+/** Append to offsets the position, relative to base, of every occurrence
+    of c in [p, end).
+*/
+inline void
+findAllChars(const char * p, const char * end, char c,
+             const char * base, std::vector<size_t> & offsets)
+{
+#if JML_INTEL_ISA
+    const __m128i v = _mm_set1_epi8(c);
+
+    for (; end - p >= 16;  p += 16) {
+        unsigned found = _mm_movemask_epi8
+            (_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), v));
+        while (found) {
+            offsets.push_back(p - base + __builtin_ctz(found));
+            found &= found - 1;
+        }
+    }
+#endif
+
+    for (; p < end;  ++p) {
+        if (*p == c)
+            offsets.push_back(p - base);
+    }
+}
+
+} // namespace Datacratic
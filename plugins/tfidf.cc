@@ -445,6 +445,14 @@ apply(const FunctionApplier & applier,
     return std::move(outputRow);
 }
 
+std::vector<ExpressionValue>
+TfidfFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & contexts) const
+{
+    return applyBatchParallel(applier, contexts);
+}
+
 FunctionInfo
 TfidfFunction::
 getFunctionInfo() const
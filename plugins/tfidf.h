@@ -98,6 +98,11 @@ struct TfidfFunction: public Function {
     
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
+
+    /** Score a batch of documents, in parallel. */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & contexts) const;
     
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
@@ -14,6 +14,7 @@
 #include "http_rest_endpoint.h"
 #include "mldb/utils/log.h"
 #include <iomanip>
+#include <cstdio>
 
 using namespace std;
 
@@ -146,6 +147,11 @@ handleHttpPayload(const HttpHeader & header, const std::string & payload)
     this->httpHeader = header;
     clock_gettime(CLOCK_REALTIME, &timer);
 
+    // A new request means that the previous response is complete, so
+    // whatever captured the connection for it doesn't need to know if it
+    // goes away
+    onDisconnect = nullptr;
+
     try {
         auto ptr = acceptor().findHandlerPtr(this);
         endpoint->onRequest(static_pointer_cast<HttpRestEndpoint::RestConnectionHandler>(ptr),
@@ -170,6 +176,18 @@ handleHttpPayload(const HttpHeader & header, const std::string & payload)
     }
 }
 
+void
+HttpRestEndpoint::RestConnectionHandler::
+onReceiveError(const boost::system::error_code & ec, size_t bufferSize)
+{
+    if (onDisconnect) {
+        auto fn = std::move(onDisconnect);
+        onDisconnect = nullptr;
+        fn();
+    }
+    HttpLegacySocketHandler::onReceiveError(ec, bufferSize);
+}
+
 void
 HttpRestEndpoint::RestConnectionHandler::
 sendErrorResponse(int code, std::string error)
@@ -222,11 +240,14 @@ sendResponse(int code,
 
 void
 HttpRestEndpoint::RestConnectionHandler::
-sendResponseHeader(int code, std::string contentType, RestParams headers)
+sendResponseHeader(int code, std::string contentType, RestParams headers,
+                   OnWriteFinished onWriteFinished)
 {
+    // Once we've finished sending the header, the connection is left open
+    // for the rest of the response
     auto onSendFinished = [=] {
-        // Do nothing once we've finished sending the response, so that
-        // the connection isn't closed
+        if (onWriteFinished)
+            onWriteFinished();
     };
     
     for (auto & h: endpoint->extraHeaders)
@@ -246,7 +267,18 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Frame the chunk for chunked transfer encoding; an empty chunk
+    // terminates the response
+    char header[32];
+    int headerLen = snprintf(header, sizeof(header), "%zx\r\n",
+                             chunk.size());
+    std::string framed;
+    framed.reserve(headerLen + chunk.size() + 2);
+    framed.append(header, headerLen);
+    framed.append(chunk);
+    framed.append("\r\n");
+
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
 }
 
 inline void
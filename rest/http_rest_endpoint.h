@@ -94,7 +94,9 @@ struct HttpRestEndpoint {
 
         void sendResponseHeader(int code,
                                 std::string contentType,
-                                RestParams headers = RestParams());
+                                RestParams headers = RestParams(),
+                                OnWriteFinished onWriteFinished
+                                    = OnWriteFinished());
 
         /** Send an HTTP chunk with the appropriate headers back down the
             wire. */
@@ -103,6 +105,13 @@ struct HttpRestEndpoint {
                            OnWriteFinished onWriteFinished = OnWriteFinished());
 
     private:
+        /** Called when the client closes the connection or it fails.  A
+            response that is still being produced elsewhere is told through
+            onDisconnect.
+        */
+        virtual void onReceiveError(const boost::system::error_code & ec,
+                                    size_t bufferSize);
+
         void logRequest(int code) const;
         HttpHeader httpHeader;
         std::shared_ptr<spdlog::logger> logger;
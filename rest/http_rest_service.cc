@@ -142,7 +142,18 @@ void
 HttpRestConnection::
 sendHttpResponseHeader(int responseCode,
                        std::string contentType, ssize_t contentLength,
-                       RestParams headers_)
+                       RestParams headers)
+{
+    sendHttpResponseHeader(responseCode, std::move(contentType),
+                           contentLength, std::move(headers), nullptr);
+}
+
+void
+HttpRestConnection::
+sendHttpResponseHeader(int responseCode,
+                       std::string contentType, ssize_t contentLength,
+                       RestParams headers_,
+                       std::function<void ()> onWritten)
 {
     if (responseSent_)
         throw ML::Exception("response already sent");
@@ -166,7 +177,8 @@ sendHttpResponseHeader(int responseCode,
     }
 
     http->sendResponseHeader(responseCode,
-                             std::move(contentType), std::move(headers));
+                             std::move(contentType), std::move(headers),
+                             std::move(onWritten));
 }
 
 bool
@@ -180,14 +192,30 @@ isConnected()
 void
 HttpRestConnection::
 sendPayload(std::string payload)
+{
+    sendPayload(std::move(payload), nullptr);
+}
+
+void
+HttpRestConnection::
+sendPayload(std::string payload, std::function<void ()> onWritten)
 {
     if (chunkedEncoding) {
         if (payload.empty()) {
             throw ML::Exception("Can't send empty chunk over a chunked connection");
         }
-        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
+        http->sendHttpChunk(std::move(payload),
+                            HttpLegacySocketHandler::NEXT_CONTINUE,
+                            std::move(onWritten));
     }
-    else http->send(std::move(payload));
+    else if (payload.empty()) {
+        // Nothing will be written, so there is no write to wait for
+        if (onWritten)
+            onWritten();
+    }
+    else http->send(std::move(payload),
+                    HttpLegacySocketHandler::NEXT_CONTINUE,
+                    std::move(onWritten));
 }
 
 void
@@ -206,6 +234,23 @@ finishResponse()
     responseSent_ = true;
 }
 
+void
+HttpRestConnection::
+abortResponse()
+{
+    // Close without the terminating chunk, so the client sees a truncated
+    // response rather than a complete one.
+    http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+    responseSent_ = true;
+}
+
+void
+HttpRestConnection::
+runOnConnectionThread(std::function<void ()> fn)
+{
+    endpoint->eventLoop->post(std::move(fn));
+}
+
 std::shared_ptr<RestConnection>
 HttpRestConnection::
 capture(std::function<void ()> onDisconnect)
@@ -99,13 +99,24 @@ struct HttpRestConnection: public RestConnection {
                                         std::string contentType,
                                         ssize_t contentLength,
                                         RestParams headers = RestParams());
+
+    virtual void sendHttpResponseHeader(int responseCode,
+                                        std::string contentType,
+                                        ssize_t contentLength,
+                                        RestParams headers,
+                                        std::function<void ()> onWritten);
     
     /** Send a payload (or a chunk of a payload) for an HTTP connection. */
     virtual void sendPayload(std::string payload);
 
+    virtual void sendPayload(std::string payload,
+                             std::function<void ()> onWritten);
+
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse();
 
+    virtual void abortResponse();
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -122,6 +133,13 @@ struct HttpRestConnection: public RestConnection {
 
     virtual bool isConnected() const;
 
+    virtual bool canCapture() const
+    {
+        return true;
+    }
+
+    virtual void runOnConnectionThread(std::function<void ()> fn);
+
     virtual std::shared_ptr<RestConnection>
     capture(std::function<void ()> onDisconnect);
 
@@ -87,11 +87,25 @@ sendPayload(std::string payload)
     this->response += std::move(payload);
 }
 
+void InProcessRestConnection::
+sendPayload(std::string payload, std::function<void ()> onWritten)
+{
+    this->response += std::move(payload);
+    if (onWritten)
+        onWritten();
+}
+
 void InProcessRestConnection::
 finishResponse()
 {
 }
 
+void InProcessRestConnection::
+abortResponse()
+{
+    this->responseCode = 500;
+}
+
 /** Send the given error string back on the connection. */
 void InProcessRestConnection::
 sendErrorResponse(int responseCode,
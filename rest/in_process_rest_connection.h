@@ -50,10 +50,20 @@ struct InProcessRestConnection: public HttpRestConnection {
                            std::string contentType, ssize_t contentLength,
                            RestParams headers = RestParams());
 
+    using HttpRestConnection::sendHttpResponseHeader;
+
     virtual void sendPayload(std::string payload);
 
+    virtual void sendPayload(std::string payload,
+                             std::function<void ()> onWritten);
+
     virtual void finishResponse();
 
+    /** There is no connection to close, so an aborted response is
+        turned into a 500 error.
+    */
+    virtual void abortResponse();
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -70,6 +80,11 @@ struct InProcessRestConnection: public HttpRestConnection {
     RestParams headers;
     std::string response;
 
+    virtual bool canCapture() const
+    {
+        return false;
+    }
+
     virtual std::shared_ptr<RestConnection>
     capture(std::function<void ()> onDisconnect);
 
@@ -672,6 +672,7 @@ cancel()
 {
     bool wasCancelled = this->cancelled.exchange(true);
     if (!wasCancelled) {
+        cancellation.cancel("Background task was cancelled", 400);
         cancelledWatches.trigger(true);
         state = State::_cancelled;
     }
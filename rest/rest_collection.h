@@ -13,6 +13,7 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/rest/rest_request_params.h"
 #include "mldb/watch/watch.h"
+#include "mldb/base/cancellation.h"
 #include "link.h"
 #include <map>
 #include <atomic>
@@ -145,6 +146,10 @@ struct BackgroundTaskBase {
     std::atomic<bool> cancelled, error, finished;
     std::atomic<State> state;
     WatchesT<bool> cancelledWatches;
+
+    /// Current while the task runs, so that cancel() stops any queries
+    /// and parallel work it is doing
+    CancellationToken cancellation;
     
     /// Everything below here is protected by this mutex
     mutable std::mutex mutex;
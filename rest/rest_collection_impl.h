@@ -570,6 +570,7 @@ addBackgroundJobInThread(Key key,
         auto toRun = [=] ()
             {
                 JML_TRACE_EXCEPTIONS(false);
+                CancellationScope cancellationScope(&task->cancellation);
                 try {
                     WatchT<bool> cancelled = std::move(*cancelledPtr);
                     task->value = fn(onProgressFn, std::move(cancelled));
@@ -77,13 +77,54 @@ struct RestConnection {
     sendHttpResponseHeader(int responseCode,
                            std::string contentType, ssize_t contentLength,
                            RestParams headers = RestParams()) = 0;
+
+    /** Send an HTTP-only response header, calling onWritten once it has
+        been written out.  The default calls onWritten as soon as the
+        header has been sent.
+    */
+    virtual void
+    sendHttpResponseHeader(int responseCode,
+                           std::string contentType, ssize_t contentLength,
+                           RestParams headers,
+                           std::function<void ()> onWritten)
+    {
+        sendHttpResponseHeader(responseCode, std::move(contentType),
+                               contentLength, std::move(headers));
+        if (onWritten)
+            onWritten();
+    }
     
     /** Send a payload (or a chunk of a payload) for an HTTP connection. */
     virtual void sendPayload(std::string payload) = 0;
 
+    /** Send a payload (or a chunk of a payload) for an HTTP connection,
+        calling onWritten once it has been written out.  This allows
+        something producing a long response to wait for the client rather
+        than queueing the whole response up in memory.  The default calls
+        onWritten as soon as the payload has been sent.
+    */
+    virtual void sendPayload(std::string payload,
+                             std::function<void ()> onWritten)
+    {
+        sendPayload(std::move(payload));
+        if (onWritten)
+            onWritten();
+    }
+
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse() = 0;
 
+    /** Abandon a response whose header and part of whose payload has
+        already been sent, for example because producing the rest of it
+        failed.  The connection is closed without finishing the response,
+        so that the client can tell that it's incomplete.  The default
+        simply finishes the response.
+    */
+    virtual void abortResponse()
+    {
+        finishResponse();
+    }
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -102,6 +143,25 @@ struct RestConnection {
 
     virtual bool isConnected() const = 0;
 
+    /** Return true if capture() is supported, in other words if the
+        response can be finished from another thread once the handler has
+        returned.
+    */
+    virtual bool canCapture() const
+    {
+        return false;
+    }
+
+    /** Run the given function on the event loop that services the
+        connection.  A captured connection isn't thread safe, so anything
+        that writes to it from another thread must go through here.  The
+        default runs the function straight away.
+    */
+    virtual void runOnConnectionThread(std::function<void ()> fn)
+    {
+        fn();
+    }
+
     /** Construct an object that captures this connection so that it can be
         written to asynchronously later.  It is obligatory to pass in an
         onDisconnect handler, which must have the direct result of destroying
@@ -16,6 +16,7 @@
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/jml/utils/less.h"
 #include "mldb/types/value_description.h"
+#include "mldb/base/cancellation.h"
 
 
 using namespace std;
@@ -1010,6 +1011,8 @@ Json::Value extractException(const std::exception & exc, int defaultCode)
         = dynamic_cast<const HttpReturnException *>(&exc);
     const std::bad_alloc * balloc
         = dynamic_cast<const std::bad_alloc *>(&exc);
+    const CancellationException * cancelled
+        = dynamic_cast<const CancellationException *>(&exc);
 
     Json::Value val;
     val["error"] = exc.what();
@@ -1018,6 +1021,8 @@ Json::Value extractException(const std::exception & exc, int defaultCode)
         val["httpCode"] = http->httpCode;
         if (!http->details.empty())
             val["details"] = jsonEncode(http->details);
+    } else if (cancelled) {
+        val["httpCode"] = cancelled->httpCode;
     } else if (balloc) {
         val["error"] = "Out of memory.  A memory allocation failed when performing "
             "the operation.  Consider retrying with a smaller amount of data "
@@ -138,9 +138,13 @@ struct RestServiceEndpoint {
                                     ssize_t contentLength,
                                     RestParams headers = RestParams());
 
+        using RestConnection::sendHttpResponseHeader;
+
         /** Send a payload (or a chunk of a payload) for an HTTP connection. */
         void sendPayload(std::string payload);
 
+        using RestConnection::sendPayload;
+
         /** Finish the response, recycling or closing the connection. */
         void finishResponse();
 
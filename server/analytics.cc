@@ -314,6 +314,46 @@ getEmbedding(const SelectStatement & stm,
                         stm.offset, stm.limit, onProgress);
 }
 
+namespace {
+
+/** Pass the outputs of the pipeline between offset and offset + limit to
+    onOutput.  They are taken from the pipeline a batch at a time, which
+    allows its elements to process each batch in parallel, but never more
+    than the limit requires.
+*/
+bool forEachPipelineOutput(ElementExecutor & executor,
+                           ssize_t offset, ssize_t limit,
+                           const std::function<bool (PipelineResults &)> & onOutput)
+{
+    size_t n = 0;
+    while (limit == -1 || n < limit + offset) {
+        size_t maxElements = ElementExecutor::DEFAULT_BATCH_SIZE;
+        if (limit != -1)
+            maxElements = std::min<size_t>(maxElements, limit + offset - n);
+
+        auto outputs = executor.takeBatch(maxElements);
+        if (outputs.empty())
+            break;
+
+        for (auto & output: outputs) {
+            // MLDB-1329 band-aid fix.  This appears to break a circlar
+            // reference chain that stops the elements from being
+            // released.
+            output->group.clear();
+
+            if (n++ < offset)
+                continue;
+
+            if (!onOutput(*output))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // file scope
+
 std::vector<MatrixNamedRow>
 queryWithoutDataset(const SelectStatement& stm, SqlBindingScope& scope)
 {
@@ -340,17 +380,37 @@ std::vector<MatrixNamedRow>
 queryFromStatement(const SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params)
+{
+    std::vector<MatrixNamedRow> rows;
+
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            rows.emplace_back(std::move(row));
+            return true;
+        };
+
+    queryFromStatementStreaming(onRow, stm, scope, params);
+
+    return rows;
+}
+
+bool
+queryFromStatementStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                            const SelectStatement & stm,
+                            SqlBindingScope & scope,
+                            BoundParameters params)
 {
     BoundTableExpression table = stm.from->bind(scope);
     
     if (table.dataset) {
-        return table.dataset->queryStructured(stm.select, stm.when,
-                                              *stm.where,
-                                              stm.orderBy, stm.groupBy,
-                                              stm.having,
-                                              stm.rowName,
-                                              stm.offset, stm.limit, 
-                                              table.asName);
+        return table.dataset->queryStructuredStreaming
+            (onRow, stm.select, stm.when,
+             *stm.where,
+             stm.orderBy, stm.groupBy,
+             stm.having,
+             stm.rowName,
+             stm.offset, stm.limit, 
+             table.asName);
     }
     else if (table.table.runQuery && stm.from) {
 
@@ -368,41 +428,29 @@ queryFromStatement(const SelectStatement & stm,
         auto boundPipeline = pipeline->bind();
 
         auto executor = boundPipeline->start(params);
-        
-        std::vector<MatrixNamedRow> rows;
 
-        ssize_t limit = stm.limit;
-        ssize_t offset = stm.offset;
-
-        auto output = executor->take();
-
-        for (size_t n = 0;
-             output && (limit == -1 || n < limit + offset);
-             output = executor->take(), ++n) {
-
-            // MLDB-1329 band-aid fix.  This appears to break a circlar
-            // reference chain that stops the elements from being
-            // released.
-            output->group.clear();
-
-            if (n < offset) {
-                continue;
-            }
+        auto onOutput = [&] (PipelineResults & output)
+            {
+                MatrixNamedRow row;
+                // Second last element is the row name
+                row.rowName = output.values.at(output.values.size() - 2)
+                    .coerceToPath(); 
+                row.rowHash = row.rowName;
+                output.values.back().mergeToRowDestructive(row.columns);
+                return onRow(row);
+            };
 
-            MatrixNamedRow row;
-            // Second last element is the row name
-            row.rowName = output->values.at(output->values.size() - 2)
-                .coerceToPath(); 
-            row.rowHash = row.rowName;
-            output->values.back().mergeToRowDestructive(row.columns);
-            rows.emplace_back(std::move(row));
-        }
-            
-        return rows;
+        return forEachPipelineOutput(*executor, stm.offset, stm.limit,
+                                     onOutput);
     }
     else {
         // No from at all
-        return queryWithoutDataset(stm, scope);
+        auto rows = queryWithoutDataset(stm, scope);
+        for (auto & r: rows) {
+            if (!onRow(r))
+                return false;
+        }
+        return true;
     }
 }
 
@@ -454,35 +502,17 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
         auto boundPipeline = pipeline->bind();
 
         auto executor = boundPipeline->start(params);
-        
-        std::vector<MatrixNamedRow> rows;
-
-        ssize_t limit = stm.limit;
-        ssize_t offset = stm.offset;
-
-        auto output = executor->take();
-
-        for (size_t n = 0;
-             output && (limit == -1 || n < limit + offset);
-             output = executor->take(), ++n) {
-
-            // MLDB-1329 band-aid fix.  This appears to break a circlar
-            // reference chain that stops the elements from being
-            // released.
-            output->group.clear();
 
-            if (n < offset) {
-                continue;
-            }
+        auto onOutput = [&] (PipelineResults & output)
+            {
+                Path path = output.values.at(output.values.size() - 2)
+                    .coerceToPath(); 
+                ExpressionValue val(std::move(output.values.back()));
+                return onRow(path, val);
+            };
 
-            Path path = output->values.at(output->values.size() - 2)
-                .coerceToPath(); 
-            ExpressionValue val(std::move(output->values.back()));
-            if (!onRow(path, val))
-                return false;
-        }
-            
-        return true;
+        return forEachPipelineOutput(*executor, stm.offset, stm.limit,
+                                     onOutput);
     }
     else {
         // No from at all
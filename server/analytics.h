@@ -177,6 +177,17 @@ queryFromStatement(const SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params = nullptr);
 
+/** Same as queryFromStatement(), but passes the rows one by one to onRow
+    in the order that queryFromStatement() would return them, instead of
+    accumulating them.  Stops and returns false as soon as onRow returns
+    false.
+*/
+bool
+queryFromStatementStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                            const SelectStatement & stm,
+                            SqlBindingScope & scope,
+                            BoundParameters params = nullptr);
+
 /** Select from the given statement.  This will choose the most
     appropriate execution method based upon what is in the query.
 
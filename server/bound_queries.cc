@@ -10,14 +10,20 @@
 #include "mldb/core/dataset.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/parallel_merge_sort.h"
+#include "mldb/sql/spill.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/http/http_exception.h"
+#include "mldb/jml/utils/hash_specializations.h"
+#include "mldb/jml/db/persistent.h"
 #include <boost/algorithm/string.hpp>
+#include <unordered_map>
+#include <set>
 
 #include "mldb/jml/utils/profile.h"
 
@@ -36,6 +42,9 @@ namespace MLDB {
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
 
+/// Number of rows over which an unordered select is evaluated at once
+const size_t SELECT_BATCH_SIZE = 1024;
+
 __thread int QueryThreadTracker::depth = 0;
 
 
@@ -88,21 +97,41 @@ struct BoundSelectQuery::Executor {
     }
 
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const = 0;
+
+    /// Columns of the dataset that the query reads from each row, sorted,
+    /// or null if it may read any of them
+    std::shared_ptr<const std::vector<ColumnName> > rowColumns;
+
+    /// Read the given row with just the columns that the query reads
+    ExpressionValue getRow(const Dataset & dataset,
+                           const RowName & rowName) const
+    {
+        if (rowColumns)
+            return dataset.getRowColumnsExpr(rowName, *rowColumns);
+        return dataset.getRowExpr(rowName);
+    }
 };
 
 struct UnorderedExecutor: public BoundSelectQuery::Executor {
     const Dataset & dataset;
     GenerateRowsWhereFunction whereGenerator;
     SqlExpressionDatasetScope & context;
-    BoundSqlExpression whereBound;
     BoundWhenExpression whenBound;
     BoundSqlExpression boundSelect;
     std::vector<BoundSqlExpression> boundCalc;
     int numBuckets;
+
+    /// Alias and bound expression of each clause of the select, when it
+    /// can be evaluated over a batch of rows at once.  Empty otherwise.
+    std::vector<std::pair<ColumnName, BoundSqlExpression> > batchClauses;
+
     typedef std::function<bool (NamedRowValue & output,
                                              std::vector<ExpressionValue> & calcd,
                                              int rowNum)> ExecutorAggregator;
 
+    typedef std::tuple<RowName, ExpressionValue, std::vector<ExpressionValue> >
+        OutputRow;
+
     UnorderedExecutor(const Dataset & dataset,
                       GenerateRowsWhereFunction whereGenerator,
                       SqlExpressionDatasetScope & context,
@@ -119,6 +148,45 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
           boundCalc(std::move(boundCalc)),
           numBuckets(numBuckets)
     {
+        bindBatchClauses();
+    }
+
+    /** Bind each clause of the select on its own, so that they can be
+        evaluated with the batch kernel.  This is only done if every clause
+        is a named expression (like "x + 1 AS y") and at least one of them
+        has a batch implementation; otherwise the select is evaluated a row
+        at a time.
+    */
+    void bindBatchClauses()
+    {
+        auto select = dynamic_cast<const SelectExpression *>
+            (boundSelect.expr.get());
+        if (!select || select->clauses.empty())
+            return;
+
+        std::vector<std::pair<ColumnName, BoundSqlExpression> > clauses;
+        bool anyBatch = false;
+        for (auto & c: select->clauses) {
+            auto named = dynamic_cast<const NamedColumnExpression *>(c.get());
+            if (!named || named->alias.empty())
+                return;
+            clauses.emplace_back(named->alias,
+                                 named->expression->bind(context));
+            if (clauses.back().second.execBatch)
+                anyBatch = true;
+        }
+
+        if (anyBatch)
+            batchClauses = std::move(clauses);
+    }
+
+    /** Can we evaluate the select over a batch of rows?  This is only done
+        when rows are read with just the columns that the query uses, which
+        keeps processBlock()'s check for repeated columns cheap.
+    */
+    bool canBatchSelect(bool selectStar) const
+    {
+        return !selectStar && rowColumns && !batchClauses.empty();
     }
 
     virtual bool executeExpr(std::function<bool (Path & rowName,
@@ -166,31 +234,14 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         // Do we select *?  In that case we can avoid a lot of copying
         bool selectStar = boundSelect.expr->isIdentitySelect(context);
 
+        // Rows are processed in blocks, so that the select can be run over
+        // many rows at once
+        size_t blockSize = canBatchSelect(selectStar) ? SELECT_BATCH_SIZE : 1;
+
         size_t numRows = rows.size();
         size_t numPerBucket = std::max((size_t)std::floor((float)numRows / numBuckets), (size_t)1);
         size_t effectiveNumBucket = std::min((size_t)numBuckets, numRows);
 
-        auto doRow = [&] (size_t rowNum) -> bool
-            {
-                //if (rowNum % 1000 == 0)
-                //    cerr << "applying row " << rowNum << " of " << rows.size() << endl;
-
-                //RowName rowName = rows[rowNum];
-
-                ExpressionValue row = dataset.getRowExpr(rows[rowNum]);
-                auto output = processRow(rows[rowNum], row, rowNum, numPerBucket,
-                                         selectStar);
-
-                int bucketNumber
-                    = numBuckets > 0
-                    ? std::min((size_t)(rowNum/numPerBucket), (size_t)(numBuckets-1))
-                    : -1;
-
-                /* Finally, pass to the terminator to continue. */
-                return processor(std::get<0>(output), std::get<1>(output),
-                                 std::get<2>(output), bucketNumber);
-            };
-
         if (numBuckets > 0) {
             ExcAssert(processInParallel);
             ExcAssertEqual(limit, -1);
@@ -200,10 +251,24 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 {
                     size_t it = bucketNumber * numPerBucket;
                     int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
-                    for (; it < stopIt; ++it)
-                    {
-                        if (!doRow(it))
-                            return false;
+                    std::vector<OutputRow> output;
+                    for (; it < stopIt;  it += output.size()) {
+                        output.resize(std::min(blockSize, stopIt - it));
+                        processBlock(&rows[it], output.size(), it,
+                                     numPerBucket, selectStar, output.data());
+
+                        for (size_t i = 0;  i < output.size();  ++i) {
+                            int rowBucket
+                                = std::min((size_t)((it + i)/numPerBucket),
+                                           (size_t)(numBuckets-1));
+
+                            /* Finally, pass to the terminator to continue. */
+                            if (!processor(std::get<0>(output[i]),
+                                           std::get<1>(output[i]),
+                                           std::get<2>(output[i]),
+                                           rowBucket))
+                                return false;
+                        }
                     }
 
                     if (onProgress) {
@@ -222,8 +287,28 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 upper = std::min((size_t)(offset+limit), upper);
 
             if (offset <= upper) {
+                size_t numBlocks = (upper - offset + blockSize - 1) / blockSize;
+
                 if (processInParallel) {
-                    return parallelMapHaltable(offset, upper, doRow);
+                    auto doBlock = [&] (size_t block) -> bool
+                        {
+                            size_t begin = offset + block * blockSize;
+                            size_t end = std::min(begin + blockSize, upper);
+                            std::vector<OutputRow> output(end - begin);
+                            processBlock(&rows[begin], end - begin, begin,
+                                         numPerBucket, selectStar,
+                                         output.data());
+
+                            for (auto & outputRow: output) {
+                                if (!processor(std::get<0>(outputRow),
+                                               std::get<1>(outputRow),
+                                               std::get<2>(outputRow), -1))
+                                    return false;
+                            }
+                            return true;
+                        };
+
+                    return parallelMapHaltable(0, numBlocks, doBlock);
                 }
                 else {
                     // TODO: to reduce memory usage, we should fill blocks of
@@ -231,19 +316,18 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     // in order as much as possible
                     // while calling the aggregator on the caller thread.
                     ExcAssert(offset >= 0 && offset <= upper);
-                    std::vector<std::tuple<Path, ExpressionValue, std::vector<ExpressionValue> > >
-                        output(upper-offset);
+                    std::vector<OutputRow> output(upper-offset);
                 
-                    auto copyRow = [&] (int rowNum)
+                    auto copyBlock = [&] (size_t block)
                         {
-                            auto row = dataset.getRowExpr(rows[rowNum]);
-                            auto outputRow = processRow(rows[rowNum], row, rowNum,
-                                                        numPerBucket, selectStar);
-                            output[rowNum-offset] = std::move(outputRow);
+                            size_t begin = offset + block * blockSize;
+                            size_t end = std::min(begin + blockSize, upper);
+                            processBlock(&rows[begin], end - begin, begin,
+                                         numPerBucket, selectStar,
+                                         &output[begin - offset]);
                         };
 
-
-                    parallelMap(offset, upper, copyRow);
+                    parallelMap(0, numBlocks, copyBlock);
 
                     for (size_t i = offset; i < upper; ++i) {
                         auto& outputRow = output[i-offset];
@@ -281,6 +365,8 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         // Do we select *?  In that case we can avoid a lot of copying
         bool selectStar = boundSelect.expr->isIdentitySelect(context);
 
+        size_t blockSize = canBatchSelect(selectStar) ? SELECT_BATCH_SIZE : 1;
+
         int64_t numRows = whereGenerator.rowStreamTotalRows;
         
         size_t numPerBucket = std::max((size_t)std::floor((float)numRows / numBuckets), (size_t)1);
@@ -299,19 +385,30 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
                 auto stream = whereGenerator.rowStream->clone();
                 stream->initAt(it);
-                for (;  it < stopIt; ++it) {
-                    RowName rowName = stream->next();
-                    auto row = dataset.getRowExpr(rowName);
-
-                    auto output = processRow(rowName, row, it, numPerBucket, selectStar);
-                    int bucketNumber
-                        = numBuckets > 0 ? std::min((size_t)(it/numPerBucket),
-                                                    (size_t)(numBuckets-1)) : -1;
-
-                    /* Finally, pass to the terminator to continue. */
-                    if (!processor(std::get<0>(output), std::get<1>(output),
-                                   std::get<2>(output), bucketNumber))
-                        return false;
+
+                std::vector<RowName> rowNames;
+                std::vector<OutputRow> output;
+                for (;  it < stopIt;  it += rowNames.size()) {
+                    rowNames.clear();
+                    size_t n = std::min(blockSize, stopIt - it);
+                    for (size_t i = 0;  i < n;  ++i)
+                        rowNames.emplace_back(stream->next());
+
+                    output.resize(n);
+                    processBlock(rowNames.data(), n, it, numPerBucket,
+                                 selectStar, output.data());
+
+                    for (size_t i = 0;  i < n;  ++i) {
+                        int rowBucket
+                            = numBuckets > 0 ? std::min((size_t)((it + i)/numPerBucket),
+                                                        (size_t)(numBuckets-1)) : -1;
+
+                        /* Finally, pass to the terminator to continue. */
+                        if (!processor(std::get<0>(output[i]),
+                                       std::get<1>(output[i]),
+                                       std::get<2>(output[i]), rowBucket))
+                            return false;
+                    }
                 }
                 if (onProgress) {
                     Json::Value progress;
@@ -324,18 +421,99 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         return parallelMapHaltable(0, effectiveNumBucket, doBucket);
     }
 
-    std::tuple<RowName, ExpressionValue, std::vector<ExpressionValue> >
+    /** Read the given rows, numbered from firstRowNum, and process them into
+        output.  If the select can be evaluated over a batch then the whole
+        block is run through the batch kernel; otherwise (or if a row has
+        more than one value for a column) each row is run through
+        processRow().
+    */
+    void processBlock(const RowName * rowNames,
+                      size_t numRows,
+                      size_t firstRowNum,
+                      int numPerBucket,
+                      bool selectStar,
+                      OutputRow * output)
+    {
+        std::vector<ExpressionValue> rows;
+        rows.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i)
+            rows.emplace_back(getRow(dataset, rowNames[i]));
+
+        // The batch kernel reads the latest value of each column, whereas
+        // the select returns all of them
+        bool useBatch = canBatchSelect(selectStar);
+        for (size_t i = 0;  useBatch && i < numRows;  ++i) {
+            if (rows[i].getUniqueAtomCount() != rows[i].getAtomCount())
+                useBatch = false;
+        }
+
+        if (!useBatch) {
+            for (size_t i = 0;  i < numRows;  ++i) {
+                output[i] = processRow(rowNames[i], rows[i], firstRowNum + i,
+                                       numPerBucket, selectStar);
+            }
+            return;
+        }
+
+        checkCancellation();
+
+        for (size_t i = 0;  i < numRows;  ++i) {
+            auto rowContext = context.getRowScope(rowNames[i], rows[i]);
+            whenBound.filterInPlace(rows[i], rowContext);
+        }
+
+        SqlExpressionDatasetScope::RowBatch batch(rowNames, rows.data(),
+                                                  numRows);
+
+        std::vector<BatchColumn> calcd(boundCalc.size());
+        for (unsigned i = 0;  i < boundCalc.size();  ++i)
+            boundCalc[i].execRowBatch(batch, calcd[i]);
+
+        std::vector<BatchColumn> selected(batchClauses.size());
+        for (unsigned i = 0;  i < batchClauses.size();  ++i)
+            batchClauses[i].second.execRowBatch(batch, selected[i]);
+
+        for (size_t i = 0;  i < numRows;  ++i) {
+            OutputRow & outputRow = output[i];
+            std::get<0>(outputRow) = rowNames[i];
+
+            std::get<2>(outputRow).clear();
+            for (auto & c: calcd)
+                std::get<2>(outputRow).emplace_back(c.getValue(i));
+
+            // Put together the row in the same way as the select would,
+            // with each value nested under its alias
+            StructValue result;
+            result.reserve(batchClauses.size());
+            for (unsigned j = 0;  j < batchClauses.size();  ++j) {
+                const ColumnName & alias = batchClauses[j].first;
+                ExpressionValue val = selected[j].getValue(i);
+                for (size_t k = alias.size();  k > 0;  --k) {
+                    StructValue nested;
+                    nested.emplace_back(alias[k - 1], std::move(val));
+                    val = std::move(nested);
+                }
+                val.mergeToRowDestructive(result);
+            }
+
+            std::get<1>(outputRow) = std::move(result);
+        }
+    }
+
+    OutputRow
     processRow(const RowName & rowName,
                ExpressionValue & row,
                int rowNum,
                int numPerBucket,
                bool selectStar)
     {
+        checkCancellation();
+
         auto rowContext = context.getRowScope(rowName, row);
 
         whenBound.filterInPlace(row, rowContext);
 
-        std::tuple<RowName, ExpressionValue, std::vector<ExpressionValue> > output;
+        OutputRow output;
 
         std::get<0>(output) = rowName;
 
@@ -368,6 +546,60 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
     }
 };
 
+namespace {
+
+/** Rows accumulated by a single thread of a blocking operator, along with
+    an estimate of the memory that they use.
+*/
+template<typename Row>
+struct RowBuffer {
+    RowBuffer()
+        : bytes(0)
+    {
+    }
+
+    std::vector<Row> rows;
+    size_t bytes;
+};
+
+/// Row held by an ORDER BY: sort fields, output row and calculated values
+typedef std::tuple<std::vector<ExpressionValue>,
+                   NamedRowValue,
+                   std::vector<ExpressionValue> >
+    SpillableSortedRow;
+
+size_t memusage(const std::vector<ExpressionValue> & values)
+{
+    size_t result = sizeof(values);
+    for (auto & v: values)
+        result += v.memusage();
+    return result;
+}
+
+size_t memusage(const SpillableSortedRow & row)
+{
+    return memusage(std::get<0>(row)) + std::get<1>(row).memusage()
+        + memusage(std::get<2>(row));
+}
+
+void serializeSortedRow(ML::DB::Store_Writer & store,
+                        const SpillableSortedRow & row)
+{
+    store << std::get<0>(row);
+    std::get<1>(row).serialize(store);
+    store << std::get<2>(row);
+}
+
+void reconstituteSortedRow(ML::DB::Store_Reader & store,
+                           SpillableSortedRow & row)
+{
+    store >> std::get<0>(row);
+    std::get<1>(row).reconstitute(store);
+    store >> std::get<2>(row);
+}
+
+} // file scope
+
 struct OrderedExecutor: public BoundSelectQuery::Executor {
 
     const Dataset & dataset;
@@ -431,15 +663,48 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         typedef std::tuple<std::vector<ExpressionValue>, NamedRowValue, std::vector<ExpressionValue> > SortedRow;
         typedef std::vector<SortedRow> SortedRows;
         
-        PerThreadAccumulator<SortedRows> accum;
+        PerThreadAccumulator<RowBuffer<SortedRow> > accum;
 
         std::atomic<int64_t> rowsAdded(0);
 
+        // Compare two rows according to the sort criteria
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
+            {
+                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+            };
+
+        // Once we're over our memory budget, each thread sorts what it has
+        // accumulated and writes it to disk as a sorted run.
+        MemoryTracker memory;
+        std::mutex spilledMutex;
+        std::vector<std::shared_ptr<SpillFile> > spilled;
+
+        auto spillRows = [&] (RowBuffer<SortedRow> & buffer)
+            {
+                std::sort(buffer.rows.begin(), buffer.rows.end(), compareRows);
+                auto file = std::make_shared<SpillFile>();
+                for (auto & r: buffer.rows) {
+                    serializeSortedRow(file->writer(), r);
+                    file->recordWritten();
+                }
+                file->finishWriting();
+
+                memory.release(buffer.bytes);
+                buffer.rows.clear();
+                buffer.bytes = 0;
+
+                std::unique_lock<std::mutex> guard(spilledMutex);
+                spilled.emplace_back(std::move(file));
+            };
+
         auto doWhere = [&] (int rowNum) -> bool
             {
                 QueryThreadTracker childTracker = parentTracker.child();
 
-                auto row = dataset.getRowExpr(rows[rowNum]);
+                checkCancellation();
+
+                auto row = getRow(dataset, rows[rowNum]);
 
                 if (onProgress && rowsAdded % 1000 == 0) {
                     Json::Value progress;
@@ -481,11 +746,16 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                 std::vector<ExpressionValue> sortFields
                     = boundOrderBy.apply(orderByRowScope);
 
-                SortedRows * sortedRows = &accum.get();
-                sortedRows->emplace_back(std::move(sortFields),
+                RowBuffer<SortedRow> & buffer = accum.get();
+                buffer.rows.emplace_back(std::move(sortFields),
                                          std::move(outputRow),
                                          std::move(calcd));
 
+                size_t bytes = memusage(buffer.rows.back());
+                buffer.bytes += bytes;
+                if (memory.allocate(bytes))
+                    spillRows(buffer);
+
                 ++rowsAdded;
                 return true;
             };
@@ -497,33 +767,63 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
         
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
+        // Return the rows one by one in sorted order.  If nothing was
+        // spilled, everything is sorted in memory; otherwise the runs on
+        // disk are merged with what's left in memory.
+        std::vector<std::shared_ptr<SortedRows> > threads;
+        for (auto & t: accum.threads)
+            threads.emplace_back(t, &t->rows);
+
+        SortedRows rowsSorted;
+        std::vector<SortedRows> inMemory;
+        std::unique_ptr<SortedRunMerger<SortedRow> > merger;
+        size_t rowsReturned = 0;
+
+        if (spilled.empty()) {
+            rowsSorted = parallelMergeSort(threads, compareRows);
+        }
+        else {
+            inMemory.resize(threads.size());
+            auto sortThread = [&] (size_t i)
+                {
+                    inMemory[i] = std::move(*threads[i]);
+                    std::sort(inMemory[i].begin(), inMemory[i].end(),
+                              compareRows);
+                };
+            parallelMap(0, threads.size(), sortThread);
+
+            merger.reset(new SortedRunMerger<SortedRow>
+                         (spilled, inMemory, compareRows,
+                          reconstituteSortedRow));
+        }
+
+        auto nextRow = [&] (SortedRow & row) -> bool
             {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+                if (merger)
+                    return merger->next(row);
+                if (rowsReturned == rowsSorted.size())
+                    return false;
+                row = std::move(rowsSorted[rowsReturned++]);
+                return true;
             };
-            
-        auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
         timer.restart(); 
 
         // Now select only the required subset of sorted rows
-        if (limit == -1)
-            limit = rowsSorted.size();
-
         ExcAssertGreaterEqual(offset, 0);
 
+        SortedRow current;
+        ssize_t count = 0;
+
         if (numDistinctOnClauses_ > 0) {
 
             std::vector<ExpressionValue> reference;
             reference.resize(numDistinctOnClauses_);
-            ssize_t count = 0;
 
-            for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
+            for (unsigned i = 0;  nextRow(current);  ++i) {
 
-                std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+                std::vector<ExpressionValue> & mark = std::get<0>(current);
 
                 if (i == 0) {
                     std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
@@ -549,8 +849,8 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                 if (count <= offset)
                     continue;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+                auto & row = std::get<1>(current);
+                auto & calcd = std::get<2>(current);
 
                 /* Finally, pass to the terminator to continue. */
                 if (!processor(row, calcd, i))
@@ -562,12 +862,15 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
         }
         else {
-            ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-            ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
-            for (unsigned i = begin;  i < end;  ++i) {
+            for (unsigned i = 0;  nextRow(current);  ++i) {
+
+                if (++count <= offset)
+                    continue;
+                if (limit != -1 && count - offset > limit)
+                    break;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+                auto & row = std::get<1>(current);
+                auto & calcd = std::get<2>(current);
 
                 /* Finally, pass to the terminator to continue. */
                 if (!processor(row, calcd, i))
@@ -702,6 +1005,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                 QueryThreadTracker childTracker
                     = std::move(parentTracker.child());
 
+                checkCancellation();
+
                 ExpressionValue row;
                 try {
                     // If we've gotten all past the maxRowNumNeeded, then we can stop
@@ -729,7 +1034,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
                     //RowName rowName = rows[rowNum];
 
-                    row = dataset.getRowExpr(rows[rowNum]);
+                    row = getRow(dataset, rows[rowNum]);
 
                     // Check it matches the where expression.  If not, we don't process
                     // it.
@@ -942,6 +1247,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
           while (index < stopIndex)
           {
+              checkCancellation();
+
               RowName rowName = stream->next();
 
               if (rowName == RowName())
@@ -1003,7 +1310,7 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         int count = 0;
         for (auto & r : rowsMerged) {
 
-            ExpressionValue row = dataset.getRowExpr(r);
+            ExpressionValue row = getRow(dataset, r);
             auto rowContext = context.getRowScope(r, row);
 
             whenBound.filterInPlace(row, rowContext);
@@ -1043,6 +1350,50 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
     }
 };
 
+namespace {
+
+/** Return the columns of the dataset that a query with the given unbound
+    entities reads from each row, sorted, or null if it may read the whole
+    row.  A variable can refer to a structure, so the columns nested under
+    a variable are read as well as the column it names.
+*/
+std::shared_ptr<const std::vector<ColumnName> >
+getRowColumns(const Dataset & from,
+              const SqlExpressionDatasetScope & context,
+              const UnboundEntities & unbound)
+{
+    // Wildcards and columnCount() read the whole row.  Variables scoped
+    // by a table name are resolved against the whole row, too.
+    if (!unbound.tables.empty() || !unbound.wildcards.empty()
+        || unbound.funcs.count("columnCount"))
+        return nullptr;
+
+    std::vector<ColumnName> vars;
+    for (auto & v: unbound.vars)
+        vars.push_back(context.resolveColumnName("", v.first));
+
+    std::vector<ColumnName> columns = from.getColumnNames();
+
+    auto result = std::make_shared<std::vector<ColumnName> >();
+    for (auto & c: columns) {
+        for (auto & v: vars) {
+            if (c.startsWith(v)) {
+                result->push_back(c);
+                break;
+            }
+        }
+    }
+
+    // Nothing is saved by reading every column one by one
+    if (result->size() == columns.size())
+        return nullptr;
+
+    std::sort(result->begin(), result->end());
+    return result;
+}
+
+} // file scope
+
 BoundSelectQuery::
 BoundSelectQuery(const SelectExpression & select,
                  const Dataset & from,
@@ -1136,6 +1487,16 @@ BoundSelectQuery(const SelectExpression & select,
                                                  numBuckets));
         }
 
+        // Rows only need to be read with the columns that the query uses
+        UnboundEntities unbound = select.getUnbound();
+        for (auto & d: select.distinctExpr)
+            unbound.merge(d->getUnbound());
+        unbound.merge(when.getUnbound());
+        unbound.merge(orderBy.getUnbound());
+        for (auto & c: calc)
+            unbound.merge(c->getUnbound());
+        executor->rowColumns = getRowColumns(from, *context, unbound);
+
     } JML_CATCH_ALL {
         rethrowHttpException(KEEP_HTTP_CODE, "Binding error: "
                              + ML::getExceptionString(),
@@ -1270,7 +1631,8 @@ struct GroupContext: public SqlExpressionDatasetScope {
         SqlExpressionDatasetScope(dataset, alias), 
         groupByExpression(groupByExpression),
         argCounter(0), argOffset(0),
-        evaluateEmptyGroups(false)
+        evaluateEmptyGroups(false),
+        orderDependent(false)
     {
     }
 
@@ -1278,13 +1640,19 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     struct RowScope: public SqlRowScope {
         RowScope(NamedRowValue & output,
-                   const std::vector<ExpressionValue> & currentGroupKey)
-            : output(output), currentGroupKey(currentGroupKey)
+                 const std::vector<ExpressionValue> & currentGroupKey,
+                 const GroupMapValue & aggData)
+            : output(output), currentGroupKey(currentGroupKey),
+              aggData(aggData)
         {
         }
 
         NamedRowValue & output;
         const std::vector<ExpressionValue> & currentGroupKey;
+
+        /// Aggregator state for the group.  This lives in the row scope
+        /// (and not the context) so that groups can be output in parallel.
+        const GroupMapValue & aggData;
     };
 
     virtual BoundFunction doGetFunction(const Utf8String & tableName,
@@ -1365,6 +1733,15 @@ struct GroupContext: public SqlExpressionDatasetScope {
                     evaluateEmptyGroups = true;
                 }
 
+            // These give a different result if the rows are aggregated
+            // in a different order
+            static const std::set<Utf8String> orderDependentAggregators = {
+                "earliest", "vertical_earliest", "latest", "vertical_latest",
+                "string_agg", "vertical_string_agg", "pivot"
+            };
+            if (orderDependentAggregators.count(functionName))
+                orderDependent = true;
+
             int aggIndex = outputAgg.size();
             OutputAggregator boundagg(argCounter,
                                       args.size(),
@@ -1376,8 +1753,9 @@ struct GroupContext: public SqlExpressionDatasetScope {
             return {[&,aggIndex] (const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & context)
                     {
+                        auto & row = context.as<RowScope>();
                         return outputAgg[aggIndex]
-                            .aggregate.extract(aggData[aggIndex].get());
+                            .aggregate.extract(row.aggData[aggIndex].get());
                     },
                     // TODO: get it from the value info for the group keys...
                     std::make_shared<AnyValueInfo>()};
@@ -1467,9 +1845,10 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     RowScope
     getRowScope(NamedRowValue & output,
-                  const std::vector<ExpressionValue> & currentGroupKey) const
+                const std::vector<ExpressionValue> & currentGroupKey,
+                const GroupMapValue & aggData) const
     {
-        return RowScope(output, currentGroupKey);
+        return RowScope(output, currentGroupKey, aggData);
     }
 
     // Represents a clause that is output by the program TODO: Rename this
@@ -1519,10 +1898,10 @@ struct GroupContext: public SqlExpressionDatasetScope {
              
 
     std::vector<OutputAggregator> outputAgg;    
-    std::vector<std::shared_ptr<void> > aggData;  //working buffers for the above
     int argCounter;
     int argOffset;
     bool evaluateEmptyGroups;
+    bool orderDependent;  ///< Does an aggregator depend on row order?
 };
 
 
@@ -1583,6 +1962,60 @@ BoundGroupByQuery(const SelectExpression & select,
 
 }
 
+namespace {
+
+/** Key under which rows are aggregated by the GROUP BY.  The hash is
+    calculated once when the key is created, and is used both to choose
+    the partition of the group and to look it up within that partition.
+*/
+struct GroupKey {
+    GroupKey(std::vector<ExpressionValue> values_)
+        : values(std::move(values_)), hash(0)
+    {
+        for (auto & v: values)
+            hash = ML::chain_hash(v.equalityHash(), hash);
+    }
+
+    std::vector<ExpressionValue> values;
+    uint64_t hash;
+
+    bool operator == (const GroupKey & other) const
+    {
+        return hash == other.hash && values == other.values;
+    }
+};
+
+struct GroupKeyHash {
+    size_t operator () (const GroupKey & key) const
+    {
+        return key.hash;
+    }
+};
+
+typedef std::unordered_map<GroupKey, GroupMapValue, GroupKeyHash>
+    GroupByMapType;
+
+/// A group whose output was evaluated early to free its aggregator state
+struct FinishedGroup {
+    std::vector<ExpressionValue> key;
+    NamedRowValue outputRow;
+    std::vector<ExpressionValue> sortFields;
+};
+
+/// A group that's been fully aggregated and is ready to be output
+struct GroupEntry {
+    const std::vector<ExpressionValue> * key;
+    const GroupMapValue * aggData;
+    FinishedGroup * finished;  ///< Already evaluated, if not null
+
+    bool operator < (const GroupEntry & other) const
+    {
+        return *key < *other.key;
+    }
+};
+
+} // file scope
+
 bool
 BoundGroupByQuery::
 execute(RowProcessor processor,
@@ -1598,11 +2031,13 @@ execute(RowProcessor processor,
         SortedRow;
 
     std::vector<SortedRow> rowsSorted;
-    std::atomic<ssize_t> groupsDone(0);
 
-    typedef std::vector<ExpressionValue> RowKey;
-    typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+    // Each bucket of the subselect hashes its groups into a fixed number
+    // of partitions.  Partition p of every bucket holds the same subset of
+    // the keys, which allows the partitions to be merged independently.
+    size_t numPartitions = numBuckets > 1 ? numCpus() : 1;
+    std::vector<std::vector<GroupByMapType> >
+        accum(numBuckets, std::vector<GroupByMapType>(numPartitions));
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1626,18 +2061,58 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    // Once we're over our memory budget, rows for groups that aren't
+    // already in memory are written to a spill file for their partition,
+    // and aggregated a bounded number of groups at a time when the
+    // partition is merged.  This stops each group from being held
+    // separately by every bucket.  Spilled rows are aggregated out of
+    // their original order, so we never spill if one of the aggregators
+    // depends on that order.
+    MemoryTracker memory(groupContext->orderDependent
+                         ? 0 : getQueryMemoryBudget());
+    std::vector<std::shared_ptr<SpillFile> > spilled(numPartitions);
+    std::vector<std::mutex> spilledMutexes(numPartitions);
+
+    auto spillRow = [&] (size_t partition,
+                         const std::vector<ExpressionValue> & calc)
+        {
+            std::unique_lock<std::mutex> guard(spilledMutexes[partition]);
+            if (!spilled[partition])
+                spilled[partition] = std::make_shared<SpillFile>();
+            spilled[partition]->writer() << calc;
+            spilled[partition]->recordWritten();
+        };
+
+    // Estimate of the memory used by a new group; the aggregator state is
+    // opaque, so we use a fixed overhead for it.
+    static constexpr size_t GROUP_OVERHEAD_BYTES = 64;
+    auto groupBytes = [&] (const GroupKey & key)
+        {
+            return memusage(key.values)
+                + GROUP_OVERHEAD_BYTES * (1 + groupContext->outputAgg.size());
+        };
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
-       RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
+       GroupKey rowKey({calc.begin(), calc.begin() + groupBy.clauses.size()});
+       // The low bits of the hash are used by the partition's hash table
+       size_t partition = (rowKey.hash >> 32) % numPartitions;
+       GroupByMapType & map = accum[groupNum][partition];
 
-       auto pair = map.insert({rowKey, GroupMapValue()});
-       auto & iter = pair.first;
-       if (pair.second)
+       auto iter = map.find(rowKey);
+       if (iter == map.end())
        {
+          if (memory.overBudget()) {
+              spillRow(partition, calc);
+              return true;
+          }
+
+          memory.allocate(groupBytes(rowKey));
+          iter = map.emplace(std::move(rowKey), GroupMapValue()).first;
+
           //initialize aggregator data
           groupContext->initializePerThreadAggregators(iter->second);
        }
@@ -1649,85 +2124,215 @@ execute(RowProcessor processor,
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
   
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
-    {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
+    // Evaluate the HAVING, row name, select and order by clauses for a
+    // group.  Returns false if the group is filtered out by the HAVING.
+    auto evaluateGroup = [&] (const GroupEntry & group,
+                              NamedRowValue & outputRow,
+                              std::vector<ExpressionValue> & sortFields)
         {
-            for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
-            {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
-                auto destiter = pair.first;
-                if (pair.second)
-                {
-                    //initialize aggregator data
-                    groupContext->initializePerThreadAggregators(destiter->second);
+            if (group.finished) {
+                outputRow = std::move(group.finished->outputRow);
+                sortFields = std::move(group.finished->sortFields);
+                return true;
+            }
+
+            const std::vector<ExpressionValue> & rowKey = *group.key;
+
+            // Create the context to evaluate the row name and order by
+            auto rowContext
+                = groupContext->getRowScope(outputRow, rowKey, *group.aggData);
+
+            //Evaluate the HAVING expression
+            ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
+
+            if (!havingResult.isTrue())
+                return false;
+
+            outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
+            outputRow.rowHash = outputRow.rowName;        
+
+            //Evaluating the whole bound select expression
+            ExpressionValue result = boundSelect(rowContext, GET_ALL);
+            result.mergeToRowDestructive(outputRow.columns);
+
+            if (!boundOrderBy.empty())
+                sortFields = boundOrderBy.apply(rowContext);
+
+            return true;
+        };
+
+    // Merge each partition in parallel.  Within a partition, buckets are
+    // merged in a fixed order so that the result is deterministic.
+    std::vector<GroupByMapType> merged(numPartitions);
+    std::vector<std::vector<FinishedGroup> > finished(numPartitions);
+    std::vector<std::vector<GroupEntry> > groups(numPartitions);
+
+    // Memory that each partition may use for its groups while it
+    // aggregates its spilled rows
+    size_t partitionBudget = memory.budget / numPartitions;
+
+    auto mergePartition = [&] (size_t p)
+        {
+            GroupByMapType & destMap = merged[p];
+            size_t bytes = 0;  // accounted to the groups in destMap
+            for (auto & bucket: accum) {
+                GroupByMapType & srcMap = bucket[p];
+                for (auto & entry: srcMap)
+                    bytes += groupBytes(entry.first);
+                if (destMap.empty()) {
+                    destMap.swap(srcMap);
+                    continue;
+                }
+                for (auto & entry: srcMap) {
+                    auto it = destMap.find(entry.first);
+                    if (it == destMap.end())
+                        destMap.emplace(entry.first, std::move(entry.second));
+                    else groupContext->mergeThreadMap(it->second,
+                                                      entry.second);
+                }
+                GroupByMapType().swap(srcMap);
+            }
+
+            // Aggregate the rows that were spilled for this partition.
+            // Rows for groups that don't fit in the partition's share of
+            // the memory budget are put aside in a new spill file.  Once
+            // all the rows have been read, the groups in memory are
+            // evaluated and their aggregators freed, and the rows that
+            // were put aside are aggregated in the same way.  Each pass
+            // takes at least one new group, so this terminates.
+            std::shared_ptr<SpillFile> toAggregate = std::move(spilled[p]);
+            while (toAggregate) {
+                std::shared_ptr<SpillFile> putAside;
+
+                auto reader = toAggregate->openReader();
+                std::vector<ExpressionValue> calc;
+                for (;  reader->remaining > 0;  --reader->remaining) {
+                    reader->store() >> calc;
+                    GroupKey rowKey({calc.begin(),
+                                     calc.begin() + groupBy.clauses.size()});
+                    auto it = destMap.find(rowKey);
+                    if (it == destMap.end()) {
+                        if (bytes >= partitionBudget && !destMap.empty()) {
+                            if (!putAside)
+                                putAside = std::make_shared<SpillFile>();
+                            putAside->writer() << calc;
+                            putAside->recordWritten();
+                            continue;
+                        }
+
+                        size_t newBytes = groupBytes(rowKey);
+                        memory.allocate(newBytes);
+                        bytes += newBytes;
+                        it = destMap.emplace(std::move(rowKey),
+                                             GroupMapValue()).first;
+                        groupContext->initializePerThreadAggregators
+                            (it->second);
+                    }
+                    groupContext->aggregateRow(it->second, calc);
                 }
+                reader.reset();
 
-                groupContext->mergeThreadMap(destiter->second, it->second);
+                toAggregate = std::move(putAside);
+                if (!toAggregate)
+                    break;
+
+                // Everything for the groups in memory has been seen, so
+                // we can finish them and make room for the next ones
+                for (auto & entry: destMap) {
+                    FinishedGroup group;
+                    if (!evaluateGroup({ &entry.first.values, &entry.second },
+                                       group.outputRow, group.sortFields))
+                        continue;
+                    group.key = entry.first.values;
+                    finished[p].emplace_back(std::move(group));
+                }
+                GroupByMapType().swap(destMap);
+                memory.release(bytes);
+                bytes = 0;
             }
-        }
-    }
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
-        && groupBy.clauses.empty())
-    {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
-    }
+            groups[p].reserve(finished[p].size() + destMap.size());
+            for (auto & group: finished[p])
+                groups[p].push_back({ &group.key, nullptr, &group });
+            for (auto & entry: destMap)
+                groups[p].push_back({ &entry.first.values, &entry.second });
+        };
 
-    //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
-    {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+    parallelMap(0, numPartitions, mergePartition);
 
-         // Create the context to evaluate the row name and order by
-        NamedRowValue outputRow;
+    std::vector<ExpressionValue> emptyKey;
+    GroupMapValue emptyGroup;
 
-        auto rowContext = groupContext->getRowScope(outputRow, rowKey);
+    if (groupBy.clauses.empty() && groupContext->evaluateEmptyGroups
+        && std::all_of(groups.begin(), groups.end(),
+                       [] (const std::vector<GroupEntry> & g)
+                       { return g.empty(); })) {
+        groupContext->initializePerThreadAggregators(emptyGroup);
+        groups[0].push_back({ &emptyKey, &emptyGroup });
+    }
 
-        //Evaluate the HAVING expression
-        ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
+    if (boundOrderBy.empty()) {
+        // In case of no output ordering, groups come out in the order of
+        // their keys.
+        std::vector<GroupEntry> sortedGroups = parallelMergeSort(groups);
 
-        if (!havingResult.isTrue())
-            continue;
+        if (limit != -1) {
+            // We can early exit once we have enough groups, so there is
+            // no point in evaluating them up front
+            ssize_t groupsDone = 0;
+            for (auto & group: sortedGroups) {
+                NamedRowValue outputRow;
+                std::vector<ExpressionValue> sortFields;
+                if (!evaluateGroup(group, outputRow, sortFields))
+                    continue;
+                if (groupsDone++ >= limit)
+                    break;
+                if (!processor(outputRow))
+                    return false;
+            }
+            return true;
+        }
 
-        outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
-        outputRow.rowHash = outputRow.rowName;        
+        std::vector<NamedRowValue> outputRows(sortedGroups.size());
+        std::vector<char> keep(sortedGroups.size());
 
-        //Evaluating the whole bound select expression
-        ExpressionValue result = boundSelect(rowContext, GET_ALL);
-        result.mergeToRowDestructive(outputRow.columns);
+        auto doGroup = [&] (size_t i)
+            {
+                std::vector<ExpressionValue> sortFields;
+                keep[i] = evaluateGroup(sortedGroups[i], outputRows[i],
+                                        sortFields);
+            };
 
-        //In case of no output ordering, we can early exit
-        if (boundOrderBy.empty()) {
-            ssize_t n = groupsDone.fetch_add(1);
-            if (limit != -1 && n >= limit)
-               break;
+        parallelMap(0, sortedGroups.size(), doGroup);
 
-            processor(outputRow);
+        for (size_t i = 0;  i < outputRows.size();  ++i) {
+            if (keep[i] && !processor(outputRows[i]))
+                return false;
         }
-        else
-        {
-             //Else we add the result to the output rows
-            std::vector<ExpressionValue> sortFields
-            = boundOrderBy.apply(rowContext);
 
-            std::vector<ExpressionValue> calcd;
-                
-            rowsSorted.emplace_back(std::move(sortFields),
-                                    std::move(outputRow),
-                                    std::move(calcd));
-        }           
+        return true;
     }
 
-    if (boundOrderBy.empty())
-        return true;
+    // Evaluate each partition's groups in parallel; the order in which
+    // they are evaluated doesn't matter since they are sorted afterwards.
+    std::vector<std::vector<SortedRow> > partitionRows(numPartitions);
+
+    auto doPartition = [&] (size_t p)
+        {
+            for (auto & group: groups[p]) {
+                NamedRowValue outputRow;
+                std::vector<ExpressionValue> sortFields;
+                if (!evaluateGroup(group, outputRow, sortFields))
+                    continue;
+
+                std::vector<ExpressionValue> calcd;
+                partitionRows[p].emplace_back(std::move(sortFields),
+                                              std::move(outputRow),
+                                              std::move(calcd));
+            }
+        };
+
+    parallelMap(0, numPartitions, doPartition);
 
     // Compare two rows according to the sort criteria
     auto compareRows = [&] (const SortedRow & row1,
@@ -1738,7 +2343,7 @@ execute(RowProcessor processor,
         };
 
     // Sort our output rows
-    std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    rowsSorted = parallelMergeSort(partitionRows, compareRows);
 
     // Now select only the required subset of sorted rows
     if (limit == -1)
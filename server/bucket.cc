@@ -137,6 +137,7 @@ getBucket(const CellValue & val) const
 
 BucketDescriptions::
 BucketDescriptions()
+    : hasNulls(false)
 {
 }
 
@@ -154,10 +155,9 @@ initialize(std::vector<CellValue> values, int numBuckets)
 
     // Bucketize each type.  Strings can't be bucketized.
     size_t n = 0;
-    if (!typeValues[CellValue::EMPTY].empty()) {
-        this->hasNulls = true;
+    this->hasNulls = !typeValues[CellValue::EMPTY].empty();
+    if (this->hasNulls)
         ++n;  // value zero is for nulls
-    }
 
     this->numeric.offset = n;
     this->numeric.active = false;
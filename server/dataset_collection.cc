@@ -18,6 +18,13 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pointer_description.h"
 #include "mldb/types/tuple_description.h"
+#include "mldb/soa/utils/csv_writer.h"
+#include "mldb/utils/log.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/cancellation.h"
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
 
 using namespace std;
 
@@ -66,53 +73,384 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
-void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
-                  RestConnection & connection,
-                  const std::string & format,
-                  bool createHeaders,
-                  bool rowNames,
-                  bool rowHashes,
-                  bool sortColumns)
+namespace {
+
+/** Thread pool on which queries whose output is sent over HTTP are run.
+    These spend much of their time waiting for their clients to read, so
+    they have threads of their own rather than tying up those of the
+    global pool.  Beyond this many, queries wait for their turn.
+*/
+ThreadPool & streamingQueryPool()
 {
-    std::vector<MatrixNamedRow> sparseOutput = runQuery();
+    static ThreadPool pool(std::max(64, 4 * numCpus()));
+    return pool;
+}
 
-    if (sortColumns) {
-        for (auto & r: sparseOutput) {
-            std::sort(r.columns.begin(), r.columns.end());
+/// Size of the pieces in which a streamed query response is sent
+static constexpr size_t QUERY_RESPONSE_CHUNK_SIZE = 65536;
+
+/** Run fn on the event loop that services the connection.  Anything that
+    writes to the connection from the thread that runs a query must go
+    through here.  The connection is kept alive until fn has run.
+*/
+void onConnectionThread(std::shared_ptr<RestConnection> connection,
+                        std::function<void (RestConnection &)> fn)
+{
+    RestConnection * conn = connection.get();
+    conn->runOnConnectionThread([=] ()
+        {
+            try {
+                fn(*connection);
+            } catch (const std::exception & exc) {
+                getQueryLog()->error()
+                    << "error writing query response: " << exc.what();
+            }
+        });
+}
+
+/** A response whose length isn't known in advance, which is sent in pieces
+    of around QUERY_RESPONSE_CHUNK_SIZE bytes with chunked transfer encoding
+    as it's produced.
+
+    Only one write (of the header or of a piece) is outstanding on the
+    connection at any time, and each is started on the connection's event
+    loop.  If the next piece fills up before the previous write has
+    finished, write() waits, which throttles whatever is producing the
+    response down to the speed at which the client is reading it.  The
+    writes complete on the event loop, so the response must be produced on
+    another thread (see runHttpQuery()).
+
+    The header isn't sent until the first piece is, so that an error before
+    then can still be returned as an ordinary error response, and a short
+    response is sent all at once with a content length as before.
+*/
+struct StreamingResponse {
+    StreamingResponse(std::shared_ptr<RestConnection> connection,
+                      std::string contentType)
+        : connection(std::move(connection)),
+          contentType(std::move(contentType)),
+          started(false),
+          writes(std::make_shared<PendingWrite>())
+    {
+    }
+
+    /** Add to the response, sending a piece if enough has accumulated.
+        Returns false if the client has gone away, in which case the rest
+        of the response doesn't need to be produced.
+    */
+    bool write(const std::string & data)
+    {
+        buffer += data;
+        if (buffer.size() >= QUERY_RESPONSE_CHUNK_SIZE)
+            return flush();
+        return connection->isConnected();
+    }
+
+    /// Send whatever remains, and finish the response
+    void finish()
+    {
+        if (!started) {
+            auto body = std::make_shared<std::string>(std::move(buffer));
+            std::string type = contentType;
+            onConnectionThread(connection, [=] (RestConnection & conn)
+                {
+                    conn.sendResponse(200, std::move(*body), type);
+                });
+            return;
+        }
+        flush();
+        writes->wait();
+        onConnectionThread(connection, [] (RestConnection & conn)
+            {
+                conn.finishResponse();
+            });
+    }
+
+    /// Give up on the response once it has been started
+    void abort()
+    {
+        writes->wait();
+        onConnectionThread(connection, [] (RestConnection & conn)
+            {
+                conn.abortResponse();
+            });
+    }
+
+    std::shared_ptr<RestConnection> connection;
+    std::string contentType;
+    std::string buffer;
+    bool started;
+
+private:
+    bool flush()
+    {
+        if (!started) {
+            std::string type = contentType;
+            startWrite([=] (RestConnection & conn,
+                            std::function<void ()> onWritten)
+                {
+                    conn.sendHttpResponseHeader
+                        (200, type, RestConnection::CHUNKED_ENCODING,
+                         RestParams(), std::move(onWritten));
+                });
+            started = true;
+        }
+
+        writes->wait();
+        if (!connection->isConnected())
+            return false;
+
+        if (!buffer.empty()) {
+            auto payload = std::make_shared<std::string>(std::move(buffer));
+            buffer.clear();
+            startWrite([=] (RestConnection & conn,
+                            std::function<void ()> onWritten)
+                {
+                    conn.sendPayload(std::move(*payload),
+                                     std::move(onWritten));
+                });
         }
+        return true;
     }
 
+    /** Start a write on the connection's event loop, once the previous one
+        has finished.  The write is given the function to call once it's
+        done.
+    */
+    void startWrite(std::function<void (RestConnection &,
+                                        std::function<void ()>)> write)
+    {
+        writes->wait();
+        writes->start();
+        std::shared_ptr<PendingWrite> pending = writes;
+        onConnectionThread(connection, [=] (RestConnection & conn)
+            {
+                try {
+                    write(conn, [=] () { pending->finish(); });
+                } catch (...) {
+                    pending->finish();
+                    throw;
+                }
+            });
+    }
+
+    /** Tracks the write in progress.  This is shared with the callback
+        that is called once the write is done, which may outlive us.
+    */
+    struct PendingWrite {
+        PendingWrite()
+            : writing(false)
+        {
+        }
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool writing;
+
+        void start()
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            writing = true;
+        }
+
+        void finish()
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            writing = false;
+            cond.notify_all();
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            cond.wait(guard, [&] () { return !writing; });
+        }
+    };
+
+    std::shared_ptr<PendingWrite> writes;
+};
+
+/// Convert a value for output in the table and csv formats
+CellValue getTableCell(CellValue cellValue)
+{
+    if (cellValue.isTimestamp()) {
+        //in table format print dates as epoch
+        return cellValue.coerceToString();
+    }
+    else if (cellValue.isTimeinterval()) {
+        //in table format print time intervals as string
+        return cellValue.coerceToString();
+    }
+    else if (cellValue.isDouble()) {
+        //in table format print 'special' floats as string
+        double value = cellValue.toDouble();
+        if (std::isnan(value)) {
+            std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
+            return CellValue(stringVal);
+        }
+        else if (std::isinf(value)) {
+            std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
+            return CellValue(stringVal);
+        }
+    }
+    else if (cellValue.isPath()) {
+        return CellValue(cellValue.coerceToPath().toUtf8String());
+    }
+    return cellValue;
+}
+
+/// Encode a row of the table format as a line of CSV
+std::string encodeCsvLine(const std::vector<CellValue> & row)
+{
+    std::ostringstream stream;
+    CsvWriter csv(stream);
+    for (auto & v: row) {
+        if (v.empty())
+            csv << "";
+        else csv << v.toUtf8String();
+    }
+    csv.endl();
+    return stream.str();
+}
+
+/** Run the query and send its output on the connection.  This blocks
+    while the client catches up, so it must not be called from one of the
+    threads of the event loop that writes to the connection.
+*/
+void streamHttpQuery(const RunHttpQuery & runQuery,
+                     std::shared_ptr<RestConnection> connection,
+                     const std::string & format,
+                     bool createHeaders,
+                     bool rowNames,
+                     bool rowHashes,
+                     bool sortColumns)
+{
+    // Formats with one element per row are encoded and sent a row at a
+    // time, as the query produces them.  The others need to see all of the
+    // rows first.
+    std::function<std::string (MatrixNamedRow &)> encodeRow;
+    std::string contentType = "application/json";
+    bool lineDelimited = false;
+
     if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
+        encodeRow = [] (MatrixNamedRow & row)
+            {
+                return jsonEncodeStr(row);
+            };
     }
     else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnName, CellValue> > > output;
-        output.reserve(sparseOutput.size());
+        encodeRow = [=] (MatrixNamedRow & row)
+            {
+                std::vector<std::pair<ColumnName, CellValue> > rowOut;
+                rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+                if (rowNames)
+                    rowOut.emplace_back(ColumnName("_rowName"), row.rowName.toUtf8String());
+                if (rowHashes)
+                    rowOut.emplace_back(ColumnName("_rowHash"), row.rowHash.toString());
+
+                for (auto & c: row.columns) {
+                    rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
+                }
 
-        for (auto & row: sparseOutput) {
+                std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
 
-            std::vector<std::pair<ColumnName, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+                return jsonEncodeStr(rowOut);
+            };
+    }
+    else if (format == "aos" || format == "ndjson") {
+        // Array of structures; one structure per row.  ndjson is the same,
+        // but with one structure per line rather than in an array.
+        encodeRow = [=] (MatrixNamedRow & row)
+            {
+                std::map<ColumnName, CellValue> rowOut;
+
+                if (rowNames)
+                    rowOut[ColumnName("_rowName")] = row.rowName.toUtf8String();
+                if (rowHashes)
+                    rowOut[ColumnName("_rowHash")] = row.rowHash.toString();
+
+                for (auto & c: row.columns) {
+                    const ColumnName & col = std::get<0>(c);
+                    const CellValue & val = std::get<1>(c);
+                    rowOut[col] = val;
+                }
 
-            if (rowNames)
-                rowOut.emplace_back(ColumnName("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnName("_rowHash"), row.rowHash.toString());
+                return jsonEncodeStr(rowOut);
+            };
 
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
+        if (format == "ndjson") {
+            contentType = "application/x-ndjson";
+            lineDelimited = true;
+        }
+    }
+    else if (format != "soa" && format != "table" && format != "csv") {
+        std::string error = "Unknown output format '" + format + "'";
+        onConnectionThread(connection, [=] (RestConnection & conn)
+            {
+                conn.sendErrorResponse(400, error);
+            });
+        return;
+    }
+
+    if (encodeRow) {
+        StreamingResponse response(connection, contentType);
+        bool first = true;
 
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+        auto onRow = [&] (MatrixNamedRow & row)
+            {
+                if (sortColumns)
+                    std::sort(row.columns.begin(), row.columns.end());
 
-            output.emplace_back(std::move(rowOut));
+                std::string encoded;
+                if (lineDelimited) {
+                    encoded = encodeRow(row);
+                    encoded += '\n';
+                }
+                else {
+                    encoded = first ? "[" : ",";
+                    encoded += encodeRow(row);
+                }
+                first = false;
+
+                return response.write(encoded);
+            };
+
+        try {
+            if (!runQuery(onRow) && !connection->isConnected()) {
+                // The client went away; there is nobody to respond to
+                response.abort();
+                return;
+            }
+            if (!lineDelimited)
+                response.write(first ? "[]" : "]");
+            response.finish();
+        } catch (const std::exception & exc) {
+            if (!response.started)
+                throw;
+            getQueryLog()->error()
+                << "error streaming query response: " << exc.what();
+            response.abort();
         }
+        return;
+    }
+
+    std::vector<MatrixNamedRow> sparseOutput;
+    auto onRow = [&] (MatrixNamedRow & row)
+        {
+            sparseOutput.emplace_back(std::move(row));
+            return true;
+        };
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+    runQuery(onRow);
+
+    if (sortColumns) {
+        for (auto & r: sparseOutput) {
+            std::sort(r.columns.begin(), r.columns.end());
+        }
     }
-    else if (format == "soa") {
+
+    if (format == "soa") {
         // Structure of arrays; one array per column
         std::map<ColumnName, std::vector<CellValue> > output;
         for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
@@ -133,61 +471,55 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                 vals[i] = val;
             }
         }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        auto body = std::make_shared<std::string>(jsonEncodeStr(output));
+        onConnectionThread(connection, [=] (RestConnection & conn)
+            {
+                conn.sendResponse(200, std::move(*body), "application/json");
+            });
+        return;
     }
-    else if (format == "aos") {
-        // Array of structures; one structure per row
-        std::vector<std::map<ColumnName, CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnName, CellValue> row;
-
-            if (rowNames)
-                row[ColumnName("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnName("_rowHash")] = sparseOutput[i].rowHash.toString();
 
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnName & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
+    // table or csv
+    // TODO: the SQL knows what columns could be created... this could
+    // be greatly optimized.
+
+    // First, find all columns
+    std::vector<ColumnName> columns;
+    ML::Lightweight_Hash<ColumnHash, int> columnIndex;
+    for (auto & o: sparseOutput) {
+        for (auto & c: o.columns) {
+            auto & columnName = std::get<0>(c);
+            if (columnIndex.insert({columnName, columns.size()}).second) {
+                columns.push_back(columnName);
             }
-
-            output.emplace_back(std::move(row));
         }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
     }
-    else if (format == "table") {
-        // TODO: the SQL knows what columns could be created... this could
-        // be greatly optimized.
-
-        // First, find all columns
-        std::vector<ColumnName> columns;
-        ML::Lightweight_Hash<ColumnHash, int> columnIndex;
-        for (auto & o: sparseOutput) {
-            for (auto & c: o.columns) {
-                auto & columnName = std::get<0>(c);
-                if (columnIndex.insert({columnName, columns.size()}).second) {
-                    columns.push_back(columnName);
-                }
-            }
-        }
 
-        if (sortColumns) {
-            std::sort(columns.begin(), columns.end());
-            for (size_t i = 0;  i < columns.size();  ++i) {
-                columnIndex[columns[i]] = i;
-            }
+    if (sortColumns) {
+        std::sort(columns.begin(), columns.end());
+        for (size_t i = 0;  i < columns.size();  ++i) {
+            columnIndex[columns[i]] = i;
         }
+    }
 
-        // Now, send them back
-        std::vector<std::vector<CellValue> > output;
-        output.reserve(sparseOutput.size() + createHeaders);
+    // Now, send them back a row at a time
+    bool csv = format == "csv";
+    StreamingResponse response(connection,
+                               csv ? "text/csv" : "application/json");
+    bool first = true;
 
-        if (createHeaders) {
+    auto writeRow = [&] (const std::vector<CellValue> & rowOut)
+        {
+            if (csv)
+                return response.write(encodeCsvLine(rowOut));
+            std::string encoded = first ? "[" : ",";
+            encoded += jsonEncodeStr(rowOut);
+            first = false;
+            return response.write(encoded);
+        };
 
+    try {
+        if (createHeaders) {
             std::vector<CellValue> headers;
             if (rowNames)
                 headers.push_back("_rowName");
@@ -197,7 +529,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
             for (auto & c: columns) {
                 headers.push_back(c.toUtf8String());
             }
-            output.push_back(headers);
+            writeRow(headers);
         }
 
         for (auto & row: sparseOutput) {
@@ -209,49 +541,93 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 
             for (auto & c: row.columns) {
                 const ColumnName & columnName = std::get<0>(c);
-                CellValue cellValue = std::get<1>(c);
+                rowOut[columnIndex[columnName] + rowHashes + rowNames]
+                    = getTableCell(std::move(std::get<1>(c)));
+            }
 
-                //Special output options for table format
-                if (cellValue.isTimestamp())
-                {
-                    //in table format print dates as epoch
-                    cellValue = cellValue.coerceToString();
-                }
-                else if (cellValue.isTimeinterval())
-                {
-                    //in table format print time intervals as string
-                    cellValue = cellValue.coerceToString();
-                }
-                else if (cellValue.isDouble())
-                {
-                    //in table format print 'special' floats as string
-                    double value = cellValue.toDouble();
-                    if (std::isnan(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
-                        cellValue = CellValue(stringVal);
-                    }
-                    else if (std::isinf(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
-                        cellValue = CellValue(stringVal);
-                    }
-                }
-                else if (cellValue.isPath()) {
-                    cellValue = CellValue(cellValue.coerceToPath().toUtf8String());
-                }
+            // Free the row as soon as it's been encoded
+            row = MatrixNamedRow();
 
-                rowOut[columnIndex[columnName] + rowHashes + rowNames] = std::move(cellValue);
+            if (!writeRow(rowOut)) {
+                response.abort();
+                return;
             }
-
-            output.push_back(rowOut);
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        if (!csv)
+            response.write(first ? "[]" : "]");
+        response.finish();
+    } catch (const std::exception & exc) {
+        if (!response.started)
+            throw;
+        getQueryLog()->error()
+            << "error streaming query response: " << exc.what();
+        response.abort();
     }
-    else {
-        connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
+}
+
+} // file scope
+
+void runHttpQuery(RunHttpQuery runQuery,
+                  std::shared_ptr<CancellationToken> token,
+                  RestConnection & connection,
+                  const std::string & format,
+                  bool createHeaders,
+                  bool rowNames,
+                  bool rowHashes,
+                  bool sortColumns)
+{
+    // An in-process connection takes each piece as soon as it's sent, so
+    // there is never anything to wait for
+    if (!connection.canCapture()) {
+        CancellationScope cancellationScope(token.get());
+        std::shared_ptr<RestConnection> notOwned
+            (&connection, [] (RestConnection *) {});
+        streamHttpQuery(runQuery, notOwned, format, createHeaders,
+                        rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    // Otherwise we are on a thread of the event loop, which is also where
+    // the writes to the client complete.  Waiting for them here would tie
+    // up the thread for as long as the client takes to read the response,
+    // and with as many slow clients as there are threads nothing could be
+    // written at all.  So the query runs on the streaming query pool, and
+    // the event loop is left to get its pieces to the client.  If the
+    // client goes away, the query is cancelled.
+    std::shared_ptr<RestConnection> captured
+        = connection.capture([=] ()
+                             {
+                                 token->cancel("Client disconnected");
+                             });
+
+    auto run = [=] ()
+        {
+            CancellationScope cancellationScope(token.get());
+            try {
+                streamHttpQuery(runQuery, captured, format, createHeaders,
+                                rowNames, rowHashes, sortColumns);
+            } catch (...) {
+                // Nothing has been sent yet, as otherwise streamHttpQuery()
+                // would have dealt with it
+                std::exception_ptr exc = std::current_exception();
+                onConnectionThread(captured, [=] (RestConnection & conn)
+                    {
+                        try {
+                            std::rethrow_exception(exc);
+                        } catch (const std::exception & exc) {
+                            sendExceptionResponse(conn, exc);
+                        } catch (...) {
+                            conn.sendErrorResponse(400, "unknown exception");
+                        }
+                    });
+            }
+        };
+
+    try {
+        streamingQueryPool().add(run);
+    } catch (const std::exception & exc) {
+        sendExceptionResponse(*captured, exc);
     }
 }
 
@@ -527,7 +903,7 @@ getColumnValueCounts(const Dataset * dataset,
 
 void
 DatasetCollection::
-queryStructured(const Dataset * dataset,
+queryStructured(std::shared_ptr<const Dataset> dataset,
                 RestConnection & connection,
                 const std::string & format,
                 const Utf8String & select,
@@ -566,14 +942,15 @@ queryStructured(const Dataset * dataset,
     //cerr << "limit = " << limit << endl;
     //cerr << "offset = " << offset << endl;
 
-    auto runQuery = [&] ()
+    auto runQuery = [=] (const std::function<bool (MatrixNamedRow &)> & onRow)
         {
-            return dataset->queryStructured
-                (selectParsed, whenParsed, *whereParsed, orderByParsed,
+            return dataset->queryStructuredStreaming
+                (onRow, selectParsed, whenParsed, *whereParsed, orderByParsed,
                  groupByParsed,havingParsed, rowNameParsed, offset, limit);
         };
 
-    runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
+    runHttpQuery(runQuery, std::make_shared<CancellationToken>(), connection,
+                 format, createHeaders,rowNames, rowHashes, sortColumns);
 }
 
 } // namespace MLDB
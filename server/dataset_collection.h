@@ -15,19 +15,39 @@
 namespace Datacratic {
 
 struct RestConnection;
+struct CancellationToken;
 
 namespace MLDB {
 
 
+/** Function that runs a query, passing each row of output in order to its
+    argument and stopping if that returns false.
+*/
+typedef std::function<bool (const std::function<bool (MatrixNamedRow &)> &)>
+RunHttpQuery;
+
 /** Run a query (by calling the given function) and format and return the
     results in HTTP based upon the given flag.
 
+    The full, sparse, aos and ndjson formats are sent as the rows are
+    produced, using chunked transfer encoding for long results, with the
+    query held back if the client doesn't keep up.  The soa, table and csv
+    formats need to see all of the columns first.
+
+    Over HTTP the query runs on a thread pool for streamed queries, so that
+    the event loop is free to write to slow clients, and this returns
+    before it's done.  runQuery therefore mustn't refer to anything on the
+    caller's stack, and must set up anything else that the query needs in
+    its thread.  The query runs within the cancellation scope of token,
+    which is cancelled if the client disconnects.
+
     - format: output format of results
     - createHeaders: table result formats will include a header row
     - rowNames: add a '_rowName' column
     - rowHashes: add a '_rowHash' column
 */
-void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
+void runHttpQuery(RunHttpQuery runQuery,
+                  std::shared_ptr<CancellationToken> token,
                   RestConnection & connection,
                   const std::string & format,
                   bool createHeaders,
@@ -55,7 +75,7 @@ struct DatasetCollection: public PolyCollection<Dataset> {
 
     /** Select from the database in a given format */
     virtual void
-    queryStructured(const Dataset * dataset,
+    queryStructured(std::shared_ptr<const Dataset> dataset,
                     RestConnection & connection,
                     const std::string & format,
                     const Utf8String & select,
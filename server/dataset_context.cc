@@ -272,6 +272,91 @@ getReshaped(const std::unordered_map<ColumnHash, ColumnName> & index,
     return  val.getFilteredDestructive(filter);
 }
 
+SqlExpressionDatasetScope::RowBatch::
+RowBatch(std::vector<MatrixNamedRow> rows_,
+         const BoundParameters * params)
+    : params(params), columnBatch(nullptr), rows(std::move(rows_))
+{
+    scopes.reserve(rows.size());
+    for (auto & r: rows)
+        scopes.emplace_back(r, params);
+}
+
+SqlExpressionDatasetScope::RowBatch::
+RowBatch(const ColumnBatch & columnBatch,
+         std::vector<ColumnName> columnNames,
+         const BoundParameters * params)
+    : params(params), columnBatch(&columnBatch),
+      columnNames(std::move(columnNames))
+{
+    ExcAssertEqual(this->columnNames.size(), columnBatch.columns.size());
+}
+
+SqlExpressionDatasetScope::RowBatch::
+RowBatch(const RowName * rowNames,
+         const ExpressionValue * rowValues,
+         size_t numRows,
+         const BoundParameters * params)
+    : params(params), columnBatch(nullptr)
+{
+    scopes.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        scopes.emplace_back(rowNames[i], rowValues[i], params);
+}
+
+size_t
+SqlExpressionDatasetScope::RowBatch::
+size() const
+{
+    return columnBatch ? columnBatch->size() : scopes.size();
+}
+
+const SqlRowScope &
+SqlExpressionDatasetScope::RowBatch::
+getRowScope(size_t n) const
+{
+    if (columnBatch && scopes.empty())
+        materializeRows();
+    return scopes.at(n);
+}
+
+const ColumnBatch::Column *
+SqlExpressionDatasetScope::RowBatch::
+tryGetColumn(const ColumnName & columnName) const
+{
+    if (!columnBatch)
+        return nullptr;
+    for (size_t i = 0;  i < columnNames.size();  ++i) {
+        if (columnNames[i] == columnName)
+            return &columnBatch->columns[i];
+    }
+    return nullptr;
+}
+
+void
+SqlExpressionDatasetScope::RowBatch::
+materializeRows() const
+{
+    size_t n = columnBatch->size();
+    rows.resize(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        MatrixNamedRow & row = rows[i];
+        row.rowName = columnBatch->rowNames[i];
+        row.rowHash = row.rowName;
+        for (size_t j = 0;  j < columnNames.size();  ++j) {
+            const ColumnBatch::Column & column = columnBatch->columns[j];
+            if (column.values[i].empty())
+                continue;
+            row.columns.emplace_back(columnNames[j], column.values[i],
+                                     column.timestamps[i]);
+        }
+    }
+
+    scopes.reserve(n);
+    for (auto & r: rows)
+        scopes.emplace_back(r, params);
+}
+
 SqlExpressionDatasetScope::
 SqlExpressionDatasetScope(std::shared_ptr<Dataset> dataset, const Utf8String& alias)
     : SqlExpressionMldbScope(dataset->server), dataset(*dataset), alias(alias)
@@ -295,19 +380,25 @@ SqlExpressionDatasetScope(const BoundTableExpression& boundDataset)
     boundDataset.dataset->getChildAliases(childaliases);
 }
 
-ColumnGetter
+ColumnName
 SqlExpressionDatasetScope::
-doGetColumn(const Utf8String & tableName,
-            const ColumnName & columnName)
-{   
-    ColumnName simplified;
+resolveColumnName(const Utf8String & tableName,
+                  const ColumnName & columnName) const
+{
     if (tableName.empty() && columnName.size() > 1) {
         if (!alias.empty() && columnName.startsWith(alias)) {
-            simplified = columnName.removePrefix();
+            return columnName.removePrefix();
         }
     }
-    if (simplified.empty())
-        simplified = columnName;
+    return columnName;
+}
+
+ColumnGetter
+SqlExpressionDatasetScope::
+doGetColumn(const Utf8String & tableName,
+            const ColumnName & columnName)
+{   
+    ColumnName simplified = resolveColumnName(tableName, columnName);
 
     //cerr << "doGetColumn: " << tableName << " " << columnName << endl;
     //cerr << columnName.size() << endl;
@@ -316,14 +407,42 @@ doGetColumn(const Utf8String & tableName,
     //    cerr << "  child " << c << endl;
     //cerr << "simplified = " << simplified << endl;
 
-    return {[=] (const SqlRowScope & context,
-                 ExpressionValue & storage,
-                 const VariableFilter & filter) -> const ExpressionValue &
-            {
-                auto & row = context.as<RowScope>();
-                return row.getColumn(simplified, filter, storage);
-            },
-            std::make_shared<AtomValueInfo>()};
+    ColumnGetter result
+        {[=] (const SqlRowScope & context,
+              ExpressionValue & storage,
+              const VariableFilter & filter) -> const ExpressionValue &
+         {
+             auto & row = context.as<RowScope>();
+             return row.getColumn(simplified, filter, storage);
+         },
+         std::make_shared<AtomValueInfo>()};
+
+    // Read straight from column-oriented batches where we can
+    result.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+        {
+            auto rows = dynamic_cast<const RowBatch *>(&batch);
+            const ColumnBatch::Column * column
+                = rows ? rows->tryGetColumn(simplified) : nullptr;
+            if (column) {
+                output.setCells(column->values, column->timestamps);
+                return;
+            }
+
+            std::vector<ExpressionValue> values;
+            values.reserve(batch.size());
+            for (size_t i = 0;  i < batch.size();  ++i) {
+                ExpressionValue storage;
+                auto & row = batch.getRowScope(i).as<RowScope>();
+                const ExpressionValue & val
+                    = row.getColumn(simplified, GET_LATEST, storage);
+                if (&val == &storage)
+                    values.emplace_back(std::move(storage));
+                else values.emplace_back(val);
+            }
+            output.setValues(std::move(values));
+        };
+
+    return result;
 }
 
 
@@ -11,6 +11,8 @@
 
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/binding_contexts.h"
+#include "mldb/sql/expression_batch.h"
+#include "mldb/core/dataset.h"
 #include <unordered_map>
 
 namespace Datacratic {
@@ -164,6 +166,61 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
         const BoundParameters * params;
     };
 
+    /** A batch of rows of the dataset, used to evaluate expressions bound
+        in this scope over many rows at once with
+        BoundSqlExpression::execRowBatch().
+    */
+    struct RowBatch: public SqlRowBatch {
+        RowBatch(std::vector<MatrixNamedRow> rows,
+                 const BoundParameters * params = nullptr);
+
+        /** Construct from a column-oriented batch holding the values of
+            the given columns, which is not copied and must outlive this
+            object.  Columns are read directly from the batch.  Rows are
+            only reconstructed (from these columns alone) if part of the
+            expression needs to be evaluated a row at a time, so the
+            expression must not refer to any other column.
+        */
+        RowBatch(const ColumnBatch & columnBatch,
+                 std::vector<ColumnName> columnNames,
+                 const BoundParameters * params = nullptr);
+
+        /** Construct from rows that have already been read, whose names
+            and values are not copied and must outlive this object.
+        */
+        RowBatch(const RowName * rowNames,
+                 const ExpressionValue * rowValues,
+                 size_t numRows,
+                 const BoundParameters * params = nullptr);
+
+        // The scopes point into rows, so this can't be copied
+        RowBatch(const RowBatch &) = delete;
+        void operator = (const RowBatch &) = delete;
+
+        virtual size_t size() const;
+
+        virtual const SqlRowScope & getRowScope(size_t n) const;
+
+        /** Return the values of the given column if this batch is column
+            oriented and contains it, or null otherwise.
+        */
+        const ColumnBatch::Column *
+        tryGetColumn(const ColumnName & columnName) const;
+
+    private:
+        /// Reconstruct the rows from columnBatch
+        void materializeRows() const;
+
+        const BoundParameters * params;
+        const ColumnBatch * columnBatch;
+        std::vector<ColumnName> columnNames;
+
+        // These are created on demand for a column-oriented batch; like
+        // row scopes, a batch is only used by one thread at a time.
+        mutable std::vector<MatrixNamedRow> rows;
+        mutable std::vector<RowScope> scopes;
+    };
+
     SqlExpressionDatasetScope(std::shared_ptr<Dataset> dataset, const Utf8String& alias);
     SqlExpressionDatasetScope(const Dataset & dataset, const Utf8String& alias);
     SqlExpressionDatasetScope(const BoundTableExpression& boundDataset);
@@ -172,6 +229,13 @@ struct SqlExpressionDatasetScope: public SqlExpressionMldbScope {
     Utf8String alias;
     std::vector<Utf8String> childaliases;
 
+    /** Return the name of the column in the dataset that a reference to
+        the given column within the given table refers to, removing the
+        dataset's alias if present.
+    */
+    ColumnName resolveColumnName(const Utf8String & tableName,
+                                 const ColumnName & columnName) const;
+
     virtual ColumnGetter doGetColumn(const Utf8String & tableName,
                                        const ColumnName & columnName);
 
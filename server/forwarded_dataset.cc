@@ -139,6 +139,26 @@ queryStructured(const SelectExpression & select,
             groupBy, having, rowName, offset, limit, alias);
 }
 
+bool
+ForwardedDataset::
+queryStructuredStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                         const SelectExpression & select,
+                         const WhenExpression & when,
+                         const SqlExpression & where,
+                         const OrderByExpression & orderBy,
+                         const TupleExpression & groupBy,
+                         const std::shared_ptr<SqlExpression> having,
+                         const std::shared_ptr<SqlExpression> rowName,
+                         ssize_t offset,
+                         ssize_t limit,
+                         Utf8String alias) const
+{
+    ExcAssert(underlying);
+    return underlying->queryStructuredStreaming(onRow, select, when, where,
+                                                orderBy, groupBy, having,
+                                                rowName, offset, limit, alias);
+}
+
 std::vector<MatrixNamedRow>
 ForwardedDataset::
 queryString(const Utf8String & query) const
@@ -69,6 +69,19 @@ struct ForwardedDataset: public Dataset {
                     ssize_t limit,
                     Utf8String alias = "") const;
 
+    virtual bool
+    queryStructuredStreaming(const std::function<bool (MatrixNamedRow &)> & onRow,
+                             const SelectExpression & select,
+                             const WhenExpression & when,
+                             const SqlExpression & where,
+                             const OrderByExpression & orderBy,
+                             const TupleExpression & groupBy,
+                             const std::shared_ptr<SqlExpression> having,
+                             const std::shared_ptr<SqlExpression> rowName,
+                             ssize_t offset,
+                             ssize_t limit,
+                             Utf8String alias = "") const;
+
     virtual std::vector<MatrixNamedRow>
     queryString(const Utf8String & query) const;
     
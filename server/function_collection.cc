@@ -15,6 +15,7 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/map_description.h"
+#include "mldb/types/vector_description.h"
 
 
 
@@ -132,6 +133,18 @@ call(const ExpressionValue & input) const
     return applier->apply(input);
 }
 
+std::vector<ExpressionValue>
+Function::
+callBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
+    
+    auto info = this->getFunctionInfo();
+    auto applier = this->bind(outerContext, info.input);
+
+    return applier->applyBatch(inputs);
+}
+
 /*****************************************************************************/
 /* FUNCTION COLLECTION                                                       */
 /*****************************************************************************/
@@ -142,58 +155,98 @@ FunctionCollection(MldbServer * server)
 {
 }
 
-void
-FunctionCollection::
-applyFunction(const Function * function,
-              const std::map<Utf8String, ExpressionValue> & input,
-              const std::vector<Utf8String> & keepValues,
-              RestConnection & connection
-              ) const
+namespace {
+
+ExpressionValue
+toFunctionInput(const std::map<Utf8String, ExpressionValue> & input)
 {
     StructValue inputExpr;
     inputExpr.reserve(input.size());
     for (auto & i: input) {
         inputExpr.emplace_back(i.first, i.second);
     }
+    return std::move(inputExpr);
+}
 
-    ExpressionValue output = function->call(std::move(inputExpr));
+/** Print the output of a function as a JSON object, keeping only the
+    given values if there are any.
+*/
+void printFunctionOutput(JsonPrintingContext & context,
+                         const ExpressionValue & output,
+                         const std::vector<Utf8String> & keepValues)
+{
+    static auto valDesc = getExpressionValueDescriptionNoTimestamp();
 
-    //cerr << "output = " << jsonEncode(output) << endl;
+    context.startObject();
 
-    ExpressionValue result;
+    auto printColumn = [&] (const PathElement & columnName,
+                            const ExpressionValue & val)
+        {
+            context.startMember(columnName.toUtf8String());
+            valDesc->printJsonTyped(&val, context);
+            return true;
+        };
 
     if (!keepValues.empty()) {
-        StructValue outputStruct;
-        outputStruct.reserve(keepValues.size());
-        for (auto & p: keepValues) {
-            outputStruct.emplace_back(p, output.getColumn(p));
-        }
-        result = std::move(outputStruct);
+        for (auto & p: keepValues)
+            printColumn(p, output.getColumn(p));
     }
     else {
-        result = std::move(output);
+        output.forEachColumn(printColumn);
     }
 
-    static auto valDesc = getExpressionValueDescriptionNoTimestamp();
+    context.endObject();
+}
+
+} // file scope
+
+void
+FunctionCollection::
+applyFunction(const Function * function,
+              const std::map<Utf8String, ExpressionValue> & input,
+              const std::vector<Utf8String> & keepValues,
+              RestConnection & connection
+              ) const
+{
+    ExpressionValue output = function->call(toFunctionInput(input));
 
     std::ostringstream stream;
     StreamJsonPrintingContext context(stream);
 
     context.startObject();
     context.startMember("output");
-    context.startObject();
+    printFunctionOutput(context, output, keepValues);
+    context.endObject();
+    connection.sendResponse(200, stream.str(), "application/json");
+}
 
-    auto onColumn = [&] (const PathElement & columnName,
-                         const ExpressionValue & val)
-        {
-            context.startMember(columnName.toUtf8String());
-            valDesc->printJsonTyped(&val, context);
-            return true;
-        };
+void
+FunctionCollection::
+applyFunctionBatch(const Function * function,
+                   const std::vector<std::map<Utf8String, ExpressionValue> > & inputs,
+                   const std::vector<Utf8String> & keepValues,
+                   RestConnection & connection
+                   ) const
+{
+    std::vector<ExpressionValue> inputExprs;
+    inputExprs.reserve(inputs.size());
+    for (auto & i: inputs)
+        inputExprs.emplace_back(toFunctionInput(i));
 
-    result.forEachColumn(onColumn);
-    
-    context.endObject();
+    std::vector<ExpressionValue> outputs = function->callBatch(inputExprs);
+    ExcAssertEqual(outputs.size(), inputs.size());
+
+    std::ostringstream stream;
+    StreamJsonPrintingContext context(stream);
+
+    context.startObject();
+    context.startMember("outputs");
+    context.startArray(outputs.size());
+    for (auto & output: outputs) {
+        context.newArrayElement();
+        printFunctionOutput(context, output, keepValues);
+    }
+    context.endArray();
     context.endObject();
     connection.sendResponse(200, stream.str(), "application/json");
 }
@@ -236,6 +289,29 @@ initRoutes(RouteManager & manager)
                   PassConnectionId()
                   );
 
+    typedef std::vector<MapType> BatchType;
+
+    auto batchDesc = std::make_shared<VectorDescription<MapType> >(mapDesc);
+
+    const auto inputsDefStr = "Array of objects with input values, one per "
+                              "application of the function. "
+                              "Must be defined either as a query string "
+                              "parameter or the json body.";
+
+    addRouteAsync(*manager.valueNode, "/batch", { "GET" },
+                  "Apply a function to each of an array of sets of input "
+                  "values and return an array with the output of each",
+                  &FunctionCollection::applyFunctionBatch,
+                  manager.getCollection,
+                  getFunction,
+                  HybridParamJsonDefault<BatchType>(
+                      "inputs", inputsDefStr, {}, "",
+                      JsonStrCodec<BatchType>(batchDesc)),
+                  HybridParamJsonDefault<std::vector<Utf8String>>(
+                      "keepValues", keepValuesDefStr, {}),
+                  PassConnectionId()
+                  );
+
 
 
 
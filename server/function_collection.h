@@ -38,6 +38,15 @@ struct FunctionCollection: public PolyCollection<Function> {
                        const std::vector<Utf8String> & qsKeepPins,
                        RestConnection & connection
                        ) const;
+
+    /** Apply the function to each of the given inputs, binding it only
+        once, and return an array with one output per input.
+    */
+    void applyFunctionBatch(const Function * function,
+                            const std::vector<std::map<Utf8String, ExpressionValue> > & inputs,
+                            const std::vector<Utf8String> & keepValues,
+                            RestConnection & connection
+                            ) const;
     
     static ExpressionValue call(MldbServer * server,
                                const Function * function,
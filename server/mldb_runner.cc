@@ -14,6 +14,9 @@
 #include "mldb/server/credential_collection.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/utils/config.h"
+#include "mldb/sql/spill.h"
+#include "mldb/sql/statement_cache.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/soa/credentials/credential_provider.h"
 #include "mldb/soa/credentials/credentials.h"
 #include <boost/filesystem.hpp>
@@ -93,6 +96,20 @@ int main(int argc, char ** argv)
     string cacheDir;
     string httpBaseUrl = "";
 
+    // Memory each blocking query operator may use before spilling to disk
+    size_t queryMemoryBudgetMb = 0;
+    string spillDir;
+
+    // Memory a single query may hold before it is aborted
+    size_t queryMemoryLimitMb = 0;
+
+    // Number of parsed query statements to keep
+    size_t queryCacheSize = getStatementCacheSize();
+
+    // Share of the thread pool for procedure runs, and how many may run
+    int batchThreads = getWorkloadThreadLimit(WORKLOAD_BATCH);
+    int maxConcurrentProcedures = 0;
+
 #if 0
     string peerListenPort = "18000-19000";
     string peerListenHost = "0.0.0.0";
@@ -142,6 +159,30 @@ int main(int argc, char ** argv)
          "directory to serve documentation from")
         ("cache-dir", value(&cacheDir),
          "Cache directory to memory map large files and store downloads")
+        ("query-memory-budget",
+         value(&queryMemoryBudgetMb)->default_value(queryMemoryBudgetMb),
+         "Megabytes a single ORDER BY or GROUP BY may hold in memory before "
+         "spilling to disk (0 means no limit)")
+        ("spill-dir", value(&spillDir),
+         "Directory for temporary files of queries over their memory budget "
+         "(default is the system temporary directory)")
+        ("query-memory-limit",
+         value(&queryMemoryLimitMb)->default_value(queryMemoryLimitMb),
+         "Megabytes a single query may hold in memory before it is aborted "
+         "(0 means no limit)")
+        ("query-cache-size",
+         value(&queryCacheSize)->default_value(queryCacheSize),
+         "Number of parsed query statements to keep for reuse (0 disables "
+         "the cache)")
+        ("batch-threads",
+         value(&batchThreads)->default_value(batchThreads),
+         "Number of the thread pool's threads that procedure runs may occupy "
+         "at once; the rest are kept for interactive calls (-1 means all)")
+        ("max-concurrent-procedures",
+         value(&maxConcurrentProcedures)
+         ->default_value(maxConcurrentProcedures),
+         "Number of procedure runs that may execute at once; others wait "
+         "their turn (0 means no limit)")
 
 #if 0
         ("peer-listen-port,l",
@@ -307,6 +348,13 @@ int main(int argc, char ** argv)
         }
     }
 
+    setQueryMemoryBudget(queryMemoryBudgetMb * 1024 * 1024);
+    setSpillDirectory(spillDir);
+    setQueryMemoryLimit(queryMemoryLimitMb * 1024 * 1024);
+    setStatementCacheSize(queryCacheSize);
+    setWorkloadThreadLimit(WORKLOAD_BATCH, batchThreads);
+    setWorkloadAdmissionLimit(WORKLOAD_BATCH, maxConcurrentProcedures);
+
     bool enableAccessLog = vm.count("enable-access-log");
     bool hideInternalEntities = vm.count("hide-internal-entities");
 
@@ -19,6 +19,10 @@
 #include "mldb/server/static_content_handler.h"
 #include "mldb/server/plugin_manifest.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/spill.h"
+#include "mldb/sql/statement_cache.h"
+#include "mldb/base/cancellation.h"
+#include "mldb/base/thread_pool.h"
 #include <signal.h>
 
 #include "mldb/server/dataset_collection.h"
@@ -184,6 +188,19 @@ initRoutes()
                            this,
                            RestParam<std::string>("type", "The type to look up"));
 
+    addRouteSyncJsonReturn(versionNode, "/queryCache", {"GET"},
+                           "Get statistics of the cache of parsed queries",
+                           "Hit, miss and eviction counts and size of the "
+                           "cache",
+                           &MldbServer::getQueryCacheStats,
+                           this);
+
+    addRouteSyncJsonReturn(versionNode, "/workloads", {"GET"},
+                           "Get thread pool statistics per workload class",
+                           "Statistics and limits of each workload class",
+                           &MldbServer::getWorkloadStats,
+                           this);
+
     versionNode.addRoute("/shutdown", "POST", "Shutdown the service",
                          handleShutdown,
                          Json::Value());
@@ -213,7 +230,17 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
-                                     false));
+                                     false),
+            HybridParamDefault<double>("timeout",
+                                       "Number of seconds after which the "
+                                       "query is aborted (0 means never)",
+                                       0.0),
+            HybridParamDefault<ssize_t>("memoryLimit",
+                                        "Number of bytes the query may hold "
+                                        "in memory before it is aborted "
+                                        "(-1 means the server default; 0 "
+                                        "means no limit)",
+                                        -1));
 
         this->versionNode = &versionNode;
         return true;
@@ -246,17 +273,26 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             double timeout,
+             ssize_t memoryLimit) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
-    SqlExpressionMldbScope mldbContext(this);
+    // Work done for the query checks this token, which aborts it once it's
+    // past its deadline or memory limit
+    auto token = std::make_shared<CancellationToken>();
+    token->setTimeout(timeout);
+    token->setMemoryLimit(memoryLimit < 0 ? getQueryMemoryLimit() : memoryLimit);
+
+    auto stm = getCachedSelectStatement(query);
 
-    auto runQuery = [&] ()
+    // This may run on another thread after we return
+    auto runQuery = [=] (const std::function<bool (MatrixNamedRow &)> & onRow)
         {
-            return queryFromStatement(stm, mldbContext);
+            SqlExpressionMldbScope mldbContext(this);
+            return queryFromStatementStreaming(onRow, *stm, mldbContext);
         };
 
-    MLDB::runHttpQuery(runQuery,
+    MLDB::runHttpQuery(runQuery, token,
                        connection, format, createHeaders,
                        rowNames, rowHashes, sortColumns);
 }
@@ -265,10 +301,10 @@ std::vector<MatrixNamedRow>
 MldbServer::
 query(const Utf8String& query) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto stm = getCachedSelectStatement(query);
     SqlExpressionMldbScope mldbContext(this);
 
-    return queryFromStatement(stm, mldbContext);
+    return queryFromStatement(*stm, mldbContext);
 }
 
 Json::Value
@@ -287,6 +323,45 @@ getTypeInfo(const std::string & typeName)
     return result;
 }
 
+Json::Value
+MldbServer::
+getQueryCacheStats() const
+{
+    StatementCacheStats stats = getStatementCacheStats();
+
+    Json::Value result;
+    result["hits"] = stats.hits;
+    result["misses"] = stats.misses;
+    result["evictions"] = stats.evictions;
+    result["size"] = stats.size;
+    result["capacity"] = stats.capacity;
+    return result;
+}
+
+Json::Value
+MldbServer::
+getWorkloadStats() const
+{
+    Json::Value result;
+    for (int i = 0;  i < NUM_WORKLOAD_CLASSES;  ++i) {
+        WorkloadClass cls = (WorkloadClass)i;
+        WorkloadStats stats = Datacratic::getWorkloadStats(cls);
+        Json::Value & entry = result[workloadClassName(cls)];
+        entry["jobsSubmitted"] = stats.jobsSubmitted;
+        entry["jobsFinished"] = stats.jobsFinished;
+        entry["jobsStolen"] = stats.jobsStolen;
+        entry["jobsWithFullQueue"] = stats.jobsWithFullQueue;
+        entry["jobsRunLocally"] = stats.jobsRunLocally;
+        entry["threadLimit"] = stats.threadLimit;
+        entry["threadsActive"] = stats.threadsActive;
+        entry["threadsWaiting"] = stats.threadsWaiting;
+        entry["admissionLimit"] = stats.admissionLimit;
+        entry["operationsRunning"] = stats.operationsRunning;
+        entry["operationsWaiting"] = stats.operationsWaiting;
+    }
+    return result;
+}
+
 void
 MldbServer::
 initCollections(std::string credentialsPath,
@@ -113,7 +113,10 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
     /** Parse and perform an SQL query, returning the results
-        on the given HTTP connection.
+        on the given HTTP connection.  The query is aborted if it runs for
+        longer than timeout seconds (if positive), or holds more than
+        memoryLimit bytes (-1 means the server's default limit; 0 means
+        no limit).
     */
     void runHttpQuery(const Utf8String& query,
                       RestConnection & connection,
@@ -121,12 +124,22 @@ struct MldbServer: public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      double timeout,
+                      ssize_t memoryLimit) const;
 
     /** Get a type info structure for the given type. */
     Json::Value
     getTypeInfo(const std::string & typeName);
 
+    /** Get the counters of the cache of parsed query statements. */
+    Json::Value
+    getQueryCacheStats() const;
+
+    /** Get the thread pool statistics and limits of each workload class. */
+    Json::Value
+    getWorkloadStats() const;
+
     /** Get the documentation path for the given package.  This will look
         at the working directory of the package that loaded it.
     */
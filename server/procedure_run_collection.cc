@@ -12,6 +12,7 @@
 #include "mldb/rest/service_peer.h"
 #include "mldb/utils/json_utils.h"
 #include "mldb/rest/rest_request_binding.h"
+#include "mldb/base/thread_pool.h"
 
 
 using namespace std;
@@ -180,6 +181,9 @@ std::shared_ptr<ProcedureRun>
 ProcedureRunCollection::
 construct(ProcedureRunConfig config, const OnProgress & onProgress) const
 {
+    // Procedure runs are batch work: they wait their turn if too many are
+    // in flight and leave a slice of the cores to interactive calls.
+    WorkloadAdmission admission(WORKLOAD_BATCH);
     return std::make_shared<ProcedureRun>(procedure, config, onProgress);
 }
 
@@ -12,6 +12,7 @@
 #include "mldb/jml/utils/csv.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/sql/sketches.h"
 #include <array>
 #include <unordered_set>
 
@@ -1083,6 +1084,189 @@ struct StdDevAccum : public VarAccum {
 static RegisterAggregatorT<VarAccum> registerVarAgg("variance", "vertical_variance");
 static RegisterAggregatorT<StdDevAccum> registerStdDevAgg("stddev", "vertical_stddev");
 
+struct ApproxCountDistinctAccum {
+    static constexpr int nargs = 1;
+    ApproxCountDistinctAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        sketch.add(val.getAtom());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        return ExpressionValue(sketch.estimate(), ts);
+    }
+
+    void merge(ApproxCountDistinctAccum* src)
+    {
+        sketch.merge(src->sketch);
+        ts.setMax(src->ts);
+    }
+
+    HyperLogLog sketch;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxCountDistinctAccum>
+registerApproxCountDistinct("approx_count_distinct",
+                            "vertical_approx_count_distinct");
+
+/** Accumulator for approx_quantile(x, q) and approx_median(x).  The
+    quantile is taken from the first row, and must be constant.
+*/
+template<int NArgs>
+struct ApproxQuantileAccum {
+    static constexpr int nargs = NArgs;
+    ApproxQuantileAccum()
+        : q(NArgs == 1 ? 0.5 : -1.0), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, NArgs);
+        const ExpressionValue & val = args[0];
+
+        if (q < 0.0) {
+            double quantile = args[1].empty()
+                ? std::nan("") : args[1].toDouble();
+            if (!(quantile >= 0.0 && quantile <= 1.0))
+                throw HttpReturnException
+                    (400, "approx_quantile requires a quantile between "
+                     "0 and 1 as its second argument",
+                     "quantile", args[1]);
+            q = quantile;
+        }
+
+        if (val.empty())
+            return;
+
+        digest.add(val.toDouble());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        return ExpressionValue(digest.quantile(q), ts);
+    }
+
+    void merge(ApproxQuantileAccum* src)
+    {
+        if (q < 0.0)
+            q = src->q;
+        digest.merge(src->digest);
+        ts.setMax(src->ts);
+    }
+
+    double q;  ///< Quantile to extract; negative until known
+    TDigest digest;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxQuantileAccum<2> >
+registerApproxQuantile("approx_quantile", "vertical_approx_quantile");
+static RegisterAggregatorT<ApproxQuantileAccum<1> >
+registerApproxMedian("approx_median", "vertical_approx_median");
+
+/** Accumulator for approx_top_k(x, k), which returns a row with the
+    (approximately) k most frequent values of x, most frequent first.
+    Column i of the row holds {value, count} for the i-th value; values
+    aren't used as column names, as that would confuse 1 with '1'.  k is
+    taken from the first row.
+*/
+struct ApproxTopKAccum {
+    static constexpr int nargs = 2;
+    ApproxTopKAccum()
+        : k(0), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<RowValueInfo>
+            (std::vector<KnownColumn>(), SCHEMA_OPEN);
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 2);
+        const ExpressionValue & val = args[0];
+
+        if (k == 0) {
+            int64_t numValues = args[1].empty() ? 0 : args[1].toInt();
+            if (numValues <= 0)
+                throw HttpReturnException
+                    (400, "approx_top_k requires a positive number of "
+                     "values as its second argument",
+                     "k", args[1]);
+            k = numValues;
+            // Keep more counters than values returned, so that the counts
+            // for the values returned are accurate
+            summary.setCapacity(std::max<size_t>(100, 10 * k));
+        }
+
+        if (val.empty())
+            return;
+
+        summary.add(val.getAtom());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    ExpressionValue extract()
+    {
+        StructValue result;
+        for (auto & entry: summary.top(k)) {
+            StructValue valueCount;
+            valueCount.emplace_back(PathElement("value"),
+                                    ExpressionValue(entry.value, ts));
+            valueCount.emplace_back(PathElement("count"),
+                                    ExpressionValue(entry.count, ts));
+            result.emplace_back(PathElement(result.size()),
+                                std::move(valueCount));
+        }
+        return ExpressionValue(std::move(result));
+    }
+
+    void merge(ApproxTopKAccum* src)
+    {
+        if (k == 0)
+            k = src->k;
+        summary.merge(src->summary);
+        ts.setMax(src->ts);
+    }
+
+    size_t k;
+    SpaceSaving summary;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxTopKAccum>
+registerApproxTopK("approx_top_k", "vertical_approx_top_k");
+
+
 
 } // namespace Builtins
 } // namespace MLDB
@@ -25,6 +25,7 @@
 #include "mldb/types/structure_description.h"
 
 #include <boost/regex/icu.hpp>
+#include "re2/re2.h"
 #include <iterator>
 #include <thread>
 #include <mutex>
@@ -938,6 +939,291 @@ BoundFunction implicit_cast(const std::vector<BoundSqlExpression> & args)
 
 static RegisterBuiltin registerImplicitCast(implicit_cast, "implicit_cast");
 
+/** A compiled regular expression for the regex_* functions.
+
+    Patterns are matched by RE2, which works directly on the UTF-8 bytes
+    of the string and runs in time linear in its length.  The few Perl
+    constructs that RE2 doesn't support (backreferences and lookaround
+    assertions) are compiled by boost::u32regex instead, which needs the
+    string to be converted to UTF-32 first.  So are the word boundaries
+    \b and \B, which are ASCII only in RE2 (see unicodeClassesForRe2()).
+*/
+struct CompiledRegex {
+    /// The RE2 version, or null if RE2 can't handle the pattern
+    std::shared_ptr<const RE2> re2;
+
+    /// The boost version, used only when re2 is null
+    boost::u32regex fallback;
+};
+
+/** Return the UTF-8 text of the given value.  Strings are returned in
+    place; other values are converted into storage first.
+*/
+re2::StringPiece getUtf8Text(const ExpressionValue & val, Utf8String & storage)
+{
+    if (val.isString()) {
+        const CellValue & atom = val.getAtom();
+        return re2::StringPiece(atom.stringChars(), atom.toStringLength());
+    }
+    storage = val.toUtf8String();
+    return re2::StringPiece(storage.rawData(), storage.rawLength());
+}
+
+/** Append the replacement text for a match to result.  This follows the
+    same Perl-style format as boost::regex_replace: $& (or $0) is the whole
+    match, $n or ${n} is the nth group, $` and $' are the text before and
+    after the match, $$ is a dollar sign, \n (for n > 0) is also the nth
+    group, and \a, \e, \f, \n, \r, \t, \v and \xhh are the usual escapes.
+*/
+void appendReplacement(std::string & result,
+                       const std::string & format,
+                       const re2::StringPiece & input,
+                       const std::vector<re2::StringPiece> & groups)
+{
+    auto appendGroup = [&] (size_t n)
+        {
+            if (n < groups.size() && groups[n].data())
+                result.append(groups[n].data(), groups[n].size());
+        };
+
+    auto readNumber = [&] (size_t & i) -> size_t
+        {
+            size_t n = 0;
+            while (i < format.size() && isdigit(format[i]))
+                n = n * 10 + (format[i++] - '0');
+            return n;
+        };
+
+    for (size_t i = 0;  i < format.size();) {
+        char c = format[i++];
+        if (c == '$' && i < format.size()) {
+            char n = format[i];
+            if (n == '$') {
+                result += '$';  ++i;
+            }
+            else if (n == '&') {
+                appendGroup(0);  ++i;
+            }
+            else if (n == '`') {
+                result.append(input.data(), groups[0].data() - input.data());
+                ++i;
+            }
+            else if (n == '\'') {
+                const char * end = groups[0].data() + groups[0].size();
+                result.append(end, input.data() + input.size() - end);
+                ++i;
+            }
+            else if (isdigit(n)) {
+                appendGroup(readNumber(i));
+            }
+            else if (n == '{' && i + 1 < format.size()
+                     && isdigit(format[i + 1])) {
+                size_t j = i + 1;
+                size_t num = readNumber(j);
+                if (j < format.size() && format[j] == '}') {
+                    appendGroup(num);
+                    i = j + 1;
+                }
+                else result += c;
+            }
+            else result += c;
+        }
+        else if (c == '\\' && i < format.size()) {
+            char n = format[i++];
+            switch (n) {
+            case 'a': result += '\a';  break;
+            case 'e': result += '\x1b';  break;
+            case 'f': result += '\f';  break;
+            case 'n': result += '\n';  break;
+            case 'r': result += '\r';  break;
+            case 't': result += '\t';  break;
+            case 'v': result += '\v';  break;
+            case 'x': {
+                uint32_t cp = 0;
+                int digits = 0;
+                while (digits < 2 && i < format.size()
+                       && isxdigit(format[i])) {
+                    cp = cp * 16 + (isdigit(format[i])
+                                    ? format[i] - '0'
+                                    : (tolower(format[i]) - 'a' + 10));
+                    ++i;  ++digits;
+                }
+                utf8::append(cp, std::back_inserter(result));
+                break;
+            }
+            default:
+                if (n >= '1' && n <= '9') {
+                    --i;
+                    appendGroup(readNumber(i));
+                }
+                else result += n;
+            }
+        }
+        else result += c;
+    }
+}
+
+/** Replace all matches of regex in input, as boost::u32regex_replace
+    does.  An empty match is replaced and then the next character is
+    copied over, so that the search always advances.
+*/
+std::string re2Replace(const RE2 & regex,
+                       const re2::StringPiece & input,
+                       const std::string & format)
+{
+    std::vector<re2::StringPiece> groups
+        (regex.NumberOfCapturingGroups() + 1);
+
+    std::string result;
+    result.reserve(input.size());
+
+    size_t pos = 0;     // where to start searching for the next match
+    size_t copied = 0;  // input before here is already in the result
+
+    while (pos <= input.size()
+           && regex.Match(input, pos, input.size(), RE2::UNANCHORED,
+                          groups.data(), groups.size())) {
+        size_t start = groups[0].data() - input.data();
+        size_t end = start + groups[0].size();
+
+        result.append(input.data() + copied, start - copied);
+        appendReplacement(result, format, input, groups);
+        copied = pos = end;
+
+        if (start == end) {
+            if (end == input.size())
+                break;
+            // Copy over the whole of the next UTF-8 character
+            unsigned char lead = input[end];
+            size_t len = lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+            len = std::min(len, input.size() - end);
+            result.append(input.data() + end, len);
+            copied = pos = end + len;
+        }
+    }
+
+    result.append(input.data() + copied, input.size() - copied);
+    return result;
+}
+
+/** Rewrite the character classes of a regex pattern, which
+    boost::u32regex matches against all of Unicode, into the Unicode
+    classes of RE2, whose own \w, \d, \s and [[:alpha:]] only match ASCII.
+    For example \w becomes [\pL\pM\pN\p{Pc}].
+
+    Returns false if the pattern uses something that can't be rewritten
+    that way: the word boundaries \b and \B, \W or \S within brackets,
+    and the POSIX classes that have no Unicode equivalent in RE2.  Such
+    patterns need boost to match as they always have.
+*/
+bool unicodeClassesForRe2(const std::string & pattern, std::string & result)
+{
+    // Each class in the form to use outside and within brackets; an empty
+    // form within brackets means that it can't be used there
+    static const struct {
+        char escape;
+        const char * outside;
+        const char * within;
+    } escapes[] = {
+        { 'w', "[\\pL\\pM\\pN\\p{Pc}]", "\\pL\\pM\\pN\\p{Pc}" },
+        { 'W', "[^\\pL\\pM\\pN\\p{Pc}]", "" },
+        { 'd', "\\p{Nd}", "\\p{Nd}" },
+        { 'D', "\\P{Nd}", "\\P{Nd}" },
+        { 's', "[\\t\\n\\v\\f\\r\\p{Z}\\x{85}]", "\\t\\n\\v\\f\\r\\p{Z}\\x{85}" },
+        { 'S', "[^\\t\\n\\v\\f\\r\\p{Z}\\x{85}]", "" }
+    };
+
+    static const std::pair<const char *, const char *> posixClasses[] = {
+        { "[:alpha:]", "\\pL" },
+        { "[:alnum:]", "\\pL\\p{Nd}" },
+        { "[:digit:]", "\\p{Nd}" },
+        { "[:upper:]", "\\p{Lu}" },
+        { "[:lower:]", "\\p{Ll}" },
+        { "[:punct:]", "\\pP" },
+        { "[:space:]", "\\t\\n\\v\\f\\r\\p{Z}\\x{85}" },
+        { "[:word:]", "\\pL\\pM\\pN\\p{Pc}" },
+        { "[:xdigit:]", "[:xdigit:]" },  // ASCII in both
+        { "[:ascii:]", "[:ascii:]" }
+    };
+
+    result.clear();
+    result.reserve(pattern.size() * 2);
+
+    bool inBrackets = false;
+    for (size_t i = 0;  i < pattern.size();  /* no inc */) {
+        char c = pattern[i];
+
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char e = pattern[i + 1];
+            if (e == 'b' || e == 'B')
+                return false;
+
+            if (e == 'Q') {
+                // Quoted text is copied up to and including the \E
+                size_t end = pattern.find("\\E", i + 2);
+                end = end == std::string::npos ? pattern.size() : end + 2;
+                result.append(pattern, i, end - i);
+                i = end;
+                continue;
+            }
+
+            bool found = false;
+            for (auto & cls: escapes) {
+                if (cls.escape != e)
+                    continue;
+                if (inBrackets && !*cls.within)
+                    return false;
+                result += inBrackets ? cls.within : cls.outside;
+                found = true;
+                break;
+            }
+            if (!found)
+                result.append(pattern, i, 2);
+            i += 2;
+        }
+        else if (!inBrackets && c == '[') {
+            inBrackets = true;
+            result += c;
+            ++i;
+            // A ] straight after the opening bracket is a literal
+            if (i < pattern.size() && pattern[i] == '^')
+                result += pattern[i++];
+            if (i < pattern.size() && pattern[i] == ']')
+                result += pattern[i++];
+        }
+        else if (inBrackets && c == '[' && i + 1 < pattern.size()
+                 && pattern[i + 1] == ':') {
+            size_t end = pattern.find(":]", i + 2);
+            if (end == std::string::npos) {
+                result += c;
+                ++i;
+                continue;
+            }
+            end += 2;
+
+            bool found = false;
+            for (auto & cls: posixClasses) {
+                if (pattern.compare(i, end - i, cls.first) != 0)
+                    continue;
+                result += cls.second;
+                found = true;
+                break;
+            }
+            if (!found)
+                return false;
+            i = end;
+        }
+        else {
+            if (c == ']')
+                inBrackets = false;
+            result += c;
+            ++i;
+        }
+    }
+
+    return true;
+}
+
 /** Helper class that takes care of regular expression application whether
     it's a constant value or not.
 */
@@ -952,7 +1238,7 @@ struct RegexHelper {
         else isPrecompiled = false;
     }
 
-    boost::u32regex compile(const ExpressionValue & val) const
+    CompiledRegex compile(const ExpressionValue & val) const
     {
         Utf8String regexStr;
         try {
@@ -965,8 +1251,27 @@ struct RegexHelper {
                  "expr", expr,
                  "value", val);
         }
+
+        CompiledRegex result;
+
+        // Like boost's Perl syntax, '.' matches a newline and '^' and '$'
+        // match at the beginning and end of each line
+        RE2::Options options;
+        options.set_dot_nl(true);
+        options.set_log_errors(false);
+
+        std::string re2Pattern;
+        if (unicodeClassesForRe2(regexStr.rawString(), re2Pattern)) {
+            auto compiled = std::make_shared<RE2>("(?m)" + re2Pattern,
+                                                  options);
+            if (compiled->ok()) {
+                result.re2 = std::move(compiled);
+                return result;
+            }
+        }
+
         try {
-            return boost::make_u32regex(regexStr.rawData());
+            result.fallback = boost::make_u32regex(regexStr.rawData());
         } JML_CATCH_ALL {
             rethrowHttpException
                 (400, "Error when compiling regex '"
@@ -977,20 +1282,21 @@ struct RegexHelper {
                  "expr", expr,
                  "value", val);
         }
+        return result;
     }
 
     /// The expression that the regex came from, to help with error messages
     BoundSqlExpression expr;
 
     /// The pre-compiled version of that expression, when it's constant
-    boost::u32regex precompiled;
+    CompiledRegex precompiled;
 
     /// Is it actually constant (and precompiled), or computed on the fly?
     bool isPrecompiled;
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const = 0;
+                                  const CompiledRegex & regex) const = 0;
 
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & scope)
@@ -1012,13 +1318,25 @@ struct ApplyRegexReplace: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const CompiledRegex & regex) const
     {
         checkArgsSize(args.size(), 3);
 
         if (args[0].empty() || args[1].empty() || args[2].empty())
             return ExpressionValue::null(calcTs(args[0], args[1], args[2]));
 
+        if (regex.re2) {
+            Utf8String storage;
+            re2::StringPiece matchStr = getUtf8Text(args[0], storage);
+            Utf8String replacementStr = args[2].toUtf8String();
+
+            std::string result = re2Replace(*regex.re2, matchStr,
+                                            replacementStr.rawString());
+            return ExpressionValue(Utf8String(std::move(result),
+                                              false /* check */),
+                                   calcTs(args[0], args[1], args[2]));
+        }
+
         std::basic_string<char32_t> matchStr = args[0].toWideString();
         std::basic_string<char32_t> replacementStr = args[2].toWideString();
 
@@ -1027,7 +1345,8 @@ struct ApplyRegexReplace: public RegexHelper {
         std::basic_string<int32_t>
             replacementStr2(replacementStr.begin(), replacementStr.end());
 
-        auto result = boost::u32regex_replace(matchStr2, regex, replacementStr2);
+        auto result = boost::u32regex_replace(matchStr2, regex.fallback,
+                                              replacementStr2);
         std::basic_string<char32_t> result2(result.begin(), result.end());
 
         return ExpressionValue(result2, calcTs(args[0], args[1], args[2]));
@@ -1053,19 +1372,23 @@ struct ApplyRegexMatch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const CompiledRegex & regex) const
     {
-        // TODO: should be able to pass utf-8 string directly in
-
         checkArgsSize(args.size(), 2);
 
         if (args[0].empty() || args[1].empty())
             return ExpressionValue::null(calcTs(args[0], args[1]));
 
-        std::basic_string<char32_t> matchStr = args[0].toWideString();
-        
-        auto result = boost::u32regex_match(matchStr.begin(), matchStr.end(),
-                                            regex);
+        bool result;
+        if (regex.re2) {
+            Utf8String storage;
+            result = RE2::FullMatch(getUtf8Text(args[0], storage), *regex.re2);
+        }
+        else {
+            std::basic_string<char32_t> matchStr = args[0].toWideString();
+            result = boost::u32regex_match(matchStr.begin(), matchStr.end(),
+                                           regex.fallback);
+        }
         return ExpressionValue(result, calcTs(args[0], args[1]));
     }
 };
@@ -1089,19 +1412,24 @@ struct ApplyRegexSearch: public RegexHelper {
 
     virtual ExpressionValue apply(const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & scope,
-                                  const boost::u32regex & regex) const
+                                  const CompiledRegex & regex) const
     {
-        // TODO: should be able to pass utf-8 string directly in
-
         checkArgsSize(args.size(), 2);
 
         if (args[0].empty() || args[1].empty())
             return ExpressionValue::null(calcTs(args[0], args[1]));
 
-        std::basic_string<char32_t> searchStr = args[0].toWideString();
-        
-        auto result = boost::u32regex_search(searchStr.begin(), searchStr.end(),
-                                            regex);
+        bool result;
+        if (regex.re2) {
+            Utf8String storage;
+            result = RE2::PartialMatch(getUtf8Text(args[0], storage),
+                                       *regex.re2);
+        }
+        else {
+            std::basic_string<char32_t> searchStr = args[0].toWideString();
+            result = boost::u32regex_search(searchStr.begin(), searchStr.end(),
+                                            regex.fallback);
+        }
         return ExpressionValue(result, calcTs(args[0], args[1]));
     }
 };
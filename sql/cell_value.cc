@@ -20,6 +20,8 @@
 #include "interval.h"
 #include "path.h"
 #include "mldb/ext/s2/s2.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/types/jml_serialization.h"
 
 using namespace std;
 
@@ -1310,6 +1312,120 @@ extractStructuredJson(JsonPrintingContext & context) const
     }
 }
 
+void
+CellValue::
+serialize(ML::DB::Store_Writer & store) const
+{
+    CellType type = cellType();
+    store << (unsigned char)type;
+
+    switch (type) {
+    case EMPTY:
+        break;
+    case INTEGER:
+        if (isInt64())
+            store << (unsigned char)0 << (int64_t)toInt();
+        else store << (unsigned char)1 << (uint64_t)toUInt();
+        break;
+    case FLOAT:
+        store << toDouble();
+        break;
+    case ASCII_STRING:
+    case UTF8_STRING:
+        store << toUtf8String();
+        break;
+    case TIMESTAMP:
+        store << toTimestamp();
+        break;
+    case TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = toMonthDaySecond();
+        store << months << days << seconds;
+        break;
+    }
+    case BLOB:
+        store << std::string((const char *)blobData(), blobLength());
+        break;
+    case PATH:
+        store << coerceToPath().toUtf8String();
+        break;
+    default:
+        throw HttpReturnException(500, "Can't serialize CellValue of type",
+                                  "type", (int)type);
+    }
+}
+
+void
+CellValue::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    store >> type;
+
+    switch (type) {
+    case EMPTY:
+        *this = CellValue();
+        break;
+    case INTEGER: {
+        unsigned char isUnsigned;
+        store >> isUnsigned;
+        if (isUnsigned) {
+            uint64_t i;
+            store >> i;
+            *this = i;
+        }
+        else {
+            int64_t i;
+            store >> i;
+            *this = i;
+        }
+        break;
+    }
+    case FLOAT: {
+        double d;
+        store >> d;
+        *this = d;
+        break;
+    }
+    case ASCII_STRING:
+    case UTF8_STRING: {
+        Utf8String str;
+        store >> str;
+        *this = str;
+        break;
+    }
+    case TIMESTAMP: {
+        Date ts;
+        store >> ts;
+        *this = ts;
+        break;
+    }
+    case TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        store >> months >> days >> seconds;
+        *this = fromMonthDaySecond(months, days, seconds);
+        break;
+    }
+    case BLOB: {
+        std::string blob;
+        store >> blob;
+        *this = CellValue::blob(std::move(blob));
+        break;
+    }
+    case PATH: {
+        Utf8String path;
+        store >> path;
+        *this = Path::parse(path);
+        break;
+    }
+    default:
+        throw HttpReturnException(500, "Can't reconstitute CellValue of type",
+                                  "type", (int)type);
+    }
+}
+
 size_t
 CellValue::
 memusage() const
@@ -10,6 +10,7 @@
 #include "mldb/types/hash_wrapper.h"
 #include "mldb/types/date.h"
 #include "mldb/types/value_description_fwd.h"
+#include "mldb/jml/db/persistent_fwd.h"
 
 
 namespace Datacratic {
@@ -386,6 +387,10 @@ struct CellValue {
 
     size_t memusage() const;
 
+    /** Binary serialization.  All cell types round-trip exactly. */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
 private:
     double toDoubleImpl() const;
     
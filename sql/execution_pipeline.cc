@@ -382,15 +382,34 @@ tableNames() const
 /* ELEMENT EXECUTOR                                                          */
 /*****************************************************************************/
 
+constexpr size_t ElementExecutor::DEFAULT_BATCH_SIZE;
+
 bool
 ElementExecutor::
 takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
 {
-    std::shared_ptr<PipelineResults> res;
-    while ((res = take()))
-        if (!onResult(res))
-            return false;
-    return true;
+    while (true) {
+        auto batch = takeBatch(DEFAULT_BATCH_SIZE);
+        if (batch.empty())
+            return true;
+        for (auto & res: batch)
+            if (!onResult(res))
+                return false;
+    }
+}
+
+std::vector<std::shared_ptr<PipelineResults> >
+ElementExecutor::
+takeBatch(size_t maxElements)
+{
+    std::vector<std::shared_ptr<PipelineResults> > result;
+    while (result.size() < maxElements) {
+        auto res = take();
+        if (!res)
+            break;
+        result.emplace_back(std::move(res));
+    }
+    return result;
 }
 
 /*****************************************************************************/
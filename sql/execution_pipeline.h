@@ -226,11 +226,26 @@ struct ElementExecutor {
     /** Take one element from the pipeline. */
     virtual std::shared_ptr<PipelineResults> take() = 0;
 
+    /** Take up to maxElements elements from the pipeline at once, in the
+        same order as take() would return them.  An empty result means
+        that the pipeline has nothing more to give; otherwise fewer than
+        maxElements may be returned even if more will follow.
+
+        The default implementation calls take() repeatedly.  Elements
+        that process each row independently override it to work on the
+        whole batch at once, spreading it over the thread pool.
+    */
+    virtual std::vector<std::shared_ptr<PipelineResults> >
+    takeBatch(size_t maxElements);
+
     /** Take all elements from the pipeline.  inParallel describes whether
         the function can be called from multiple threads at once.
     */
     virtual bool takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult);
 
+    /// Number of elements taken at once by takeAll() and similar consumers
+    static constexpr size_t DEFAULT_BATCH_SIZE = 1024;
+
     /** Restart the executor from the start. */
     virtual void restart() = 0;
 };
@@ -393,5 +408,6 @@ struct PipelineElement: public std::enable_shared_from_this<PipelineElement> {
     statement(const SelectStatement& statement, GetParamInfo getParamInfo);
 };
 
+
 } // namespace MLDB
 } // namespace Datacratic
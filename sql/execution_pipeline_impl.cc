@@ -14,8 +14,13 @@
 #include "mldb/types/tuple_description.h"
 #include "table_expression_operations.h"
 #include <algorithm>
+#include <atomic>
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
+#include "expression_batch.h"
 
 using namespace std;
 
@@ -266,6 +271,10 @@ std::shared_ptr<PipelineResults>
 GenerateRowsExecutor::
 take()
 {
+    // Every row of a pipeline comes through here, so this is where a
+    // cancelled query notices
+    checkCancellation();
+
     // Return the row itself as the value, and the row's name as
     // metadata.
     auto result = source->take();
@@ -799,6 +808,28 @@ outputAdded() const
 /* JOIN ELEMENT                                                              */
 /*****************************************************************************/
 
+namespace {
+
+/// Minimum number of rows on the larger side of an equijoin before a hash
+/// join is considered; below this sorting both sides is cheap enough.
+static constexpr ssize_t HASH_JOIN_MIN_PROBE_ROWS = 10000;
+
+/// The larger side must have at least this many times the rows of the
+/// smaller side for a hash join to be chosen.
+static constexpr ssize_t HASH_JOIN_MIN_SIZE_RATIO = 4;
+
+/// Maximum number of rows that will be held in a hash join's hash table
+static constexpr ssize_t HASH_JOIN_MAX_BUILD_ROWS = 10000000;
+
+ssize_t estimateRowCount(const BoundTableExpression & table)
+{
+    if (!table.table.getRowCountEstimate)
+        return -1;
+    return table.table.getRowCountEstimate();
+}
+
+} // file scope
+
 JoinElement::
 JoinElement(std::shared_ptr<PipelineElement> root,
             std::shared_ptr<TableExpression> left,
@@ -843,6 +874,33 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     auto leftCondition = condition.left.where;
     auto rightCondition = condition.right.where;
 
+    // Choose how to execute an equijoin.  When one side is known to be
+    // much smaller than the other, we hash it and stream the larger side
+    // past it, which avoids having to sort the larger side.
+    strategy = MERGE_JOIN;
+    if (condition.style == AnnotatedJoinCondition::EQUIJOIN) {
+        ssize_t leftRows = estimateRowCount(boundLeft);
+        ssize_t rightRows = estimateRowCount(boundRight);
+
+        if (leftRows >= 0 && rightRows >= 0) {
+            ssize_t smaller = std::min(leftRows, rightRows);
+            ssize_t larger = std::max(leftRows, rightRows);
+            if (larger >= HASH_JOIN_MIN_PROBE_ROWS
+                && smaller * HASH_JOIN_MIN_SIZE_RATIO <= larger
+                && smaller <= HASH_JOIN_MAX_BUILD_ROWS) {
+                strategy = leftRows <= rightRows
+                    ? HASH_JOIN_BUILD_LEFT : HASH_JOIN_BUILD_RIGHT;
+            }
+        }
+    }
+
+    // A hash join doesn't need its inputs to be ordered by the join key
+    OrderByExpression leftOrderBy, rightOrderBy;
+    if (strategy == MERGE_JOIN) {
+        leftOrderBy = condition.left.orderBy;
+        rightOrderBy = condition.right.orderBy;
+    }
+
     // if outer join, we need to grab all rows on one or both sides  
     auto fixOuterSide = [&] (std::shared_ptr<SqlExpression>& condition,
                              AnnotatedJoinCondition::Side& side,
@@ -878,13 +936,13 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     leftImpl= root
         ->where(constantWhere)
         ->from(left, boundLeft, when, selectAll, leftCondition,
-               condition.left.orderBy)
+               leftOrderBy)
         ->select(leftEmbedding);
 
     rightImpl = root
         ->where(constantWhere)
         ->from(right, boundRight, when, selectAll, rightCondition,
-               condition.right.orderBy)
+               rightOrderBy)
         ->select(rightEmbedding);
 }
 
@@ -896,7 +954,8 @@ bind() const
                                    leftImpl->bind(),
                                    rightImpl->bind(),
                                    condition,
-                                   joinQualification);
+                                   joinQualification,
+                                   strategy);
 }
 
 
@@ -1274,6 +1333,266 @@ restart()
 }
 
 
+/*****************************************************************************/
+/* HASH JOIN EXECUTOR                                                        */
+/*****************************************************************************/
+
+namespace {
+
+/// Number of probe rows that are matched against the hash table at once
+static constexpr size_t HASH_JOIN_PROBE_BATCH_SIZE = 8192;
+
+/// Number of probe rows processed by a single thread within a batch
+static constexpr size_t HASH_JOIN_PROBE_CHUNK_SIZE = 512;
+
+/** Return whether a row with the given join embedding can match a row of
+    the other side.  A null key never matches anything.  For an outer side,
+    the rest of the condition on the side's own rows is in the second
+    column of the embedding, since its rows are all kept.
+*/
+bool canMatch(const ExpressionValue & embedding, bool outer)
+{
+    if (embedding.getColumn(0, GET_ALL).empty())
+        return false;
+    return !outer || embedding.getColumn(1, GET_ALL).isTrue();
+}
+
+} // file scope
+
+JoinElement::HashJoinExecutor::
+HashJoinExecutor(const Bound * parent,
+                 std::shared_ptr<ElementExecutor> root,
+                 std::shared_ptr<ElementExecutor> left,
+                 std::shared_ptr<ElementExecutor> right,
+                 bool buildLeft)
+    : parent(parent),
+      root(std::move(root)),
+      left(std::move(left)),
+      right(std::move(right)),
+      buildLeft(buildLeft),
+      build(buildLeft ? this->left : this->right),
+      probe(buildLeft ? this->right : this->left),
+      built(false),
+      probeDone(false),
+      unmatchedDone(false),
+      outputDone(0)
+{
+}
+
+void
+JoinElement::HashJoinExecutor::
+buildTable()
+{
+    bool outerBuild = buildLeft
+        ? (parent->joinQualification_ == JOIN_LEFT
+           || parent->joinQualification_ == JOIN_FULL)
+        : (parent->joinQualification_ == JOIN_RIGHT
+           || parent->joinQualification_ == JOIN_FULL);
+
+    while (true) {
+        auto rows = build->takeBatch(DEFAULT_BATCH_SIZE);
+        if (rows.empty())
+            break;
+        for (auto & row: rows) {
+            buildKeys.emplace_back(row->values.back().getColumn(0, GET_ALL));
+            buildRows.emplace_back(std::move(row));
+        }
+    }
+
+    // Rows that can't match anything are only kept to be output as
+    // unmatched rows
+    buildIndex.reserve(buildRows.size());
+    for (size_t i = 0;  i < buildRows.size();  ++i) {
+        if (canMatch(buildRows[i]->values.back(), outerBuild))
+            buildIndex.emplace(buildKeys[i].equalityHash(), i);
+    }
+
+    buildMatched.reset(new std::atomic<bool>[buildRows.size()]);
+    for (size_t i = 0;  i < buildRows.size();  ++i)
+        buildMatched[i] = false;
+
+    built = true;
+}
+
+void
+JoinElement::HashJoinExecutor::
+probeBatch()
+{
+    bool outerLeft = parent->joinQualification_ == JOIN_LEFT
+        || parent->joinQualification_ == JOIN_FULL;
+    bool outerRight = parent->joinQualification_ == JOIN_RIGHT
+        || parent->joinQualification_ == JOIN_FULL;
+    bool outerProbe = buildLeft ? outerRight : outerLeft;
+
+    std::vector<std::shared_ptr<PipelineResults> > probeRows
+        = probe->takeBatch(HASH_JOIN_PROBE_BATCH_SIZE);
+    if (probeRows.empty())
+        probeDone = true;
+
+    // Join a single probe row against the hash table, appending the
+    // results to output in build order so that the join is deterministic.
+    // A pair of rows whose keys are equal but which fail the rest of the
+    // condition doesn't match; a row of an outer side that matches
+    // nothing is output once, with nulls for the other side.
+    auto joinRow = [&] (const std::shared_ptr<PipelineResults> & p,
+                        std::vector<std::shared_ptr<PipelineResults> > & output)
+        {
+            const ExpressionValue & pEmbedding = p->values.back();
+
+            std::vector<size_t> matches;
+            if (canMatch(pEmbedding, outerProbe)) {
+                ExpressionValue pField = pEmbedding.getColumn(0, GET_ALL);
+                auto range = buildIndex.equal_range(pField.equalityHash());
+                for (auto it = range.first;  it != range.second;  ++it) {
+                    if (buildKeys[it->second] == pField)
+                        matches.push_back(it->second);
+                }
+                std::sort(matches.begin(), matches.end());
+            }
+
+            bool anyMatch = false;
+
+            for (size_t b: matches) {
+                const PipelineResults & l = buildLeft ? *buildRows[b] : *p;
+                const PipelineResults & r = buildLeft ? *p : *buildRows[b];
+
+                auto result = std::make_shared<PipelineResults>(l);
+                // Pop the selected join conditions from left
+                result->values.pop_back();
+
+                auto numR = r.values.size() - 1;
+                for (auto i = 0;  i < numR;  ++i)
+                    result->values.push_back(r.values[i]);
+
+                ExpressionValue storage;
+                if (!parent->crossWhere_(*result, storage, GET_LATEST).isTrue())
+                    continue;
+
+                buildMatched[b] = true;
+                anyMatch = true;
+                output.emplace_back(std::move(result));
+            }
+
+            if (!anyMatch && outerProbe) {
+                auto result = std::make_shared<PipelineResults>(*p);
+                result->values.pop_back();
+                if (buildLeft) {
+                    result->values.insert(result->values.begin(),
+                                          ExpressionValue::null(Date::notADate()));
+                    result->values.insert(result->values.begin(),
+                                          ExpressionValue::null(Date::notADate()));
+                }
+                else {
+                    result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+                    result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+                }
+                output.emplace_back(std::move(result));
+            }
+        };
+
+    // Each chunk of probe rows is joined on its own thread, and the chunks
+    // are concatenated so that the output follows the probe order.
+    size_t numChunks = (probeRows.size() + HASH_JOIN_PROBE_CHUNK_SIZE - 1)
+        / HASH_JOIN_PROBE_CHUNK_SIZE;
+    std::vector<std::vector<std::shared_ptr<PipelineResults> > >
+        chunkOutput(numChunks);
+
+    auto doChunk = [&] (size_t chunk)
+        {
+            size_t begin = chunk * HASH_JOIN_PROBE_CHUNK_SIZE;
+            size_t end = std::min(begin + HASH_JOIN_PROBE_CHUNK_SIZE,
+                                  probeRows.size());
+            for (size_t i = begin;  i < end;  ++i)
+                joinRow(probeRows[i], chunkOutput[chunk]);
+        };
+
+    if (numChunks > 1)
+        parallelMap(0, numChunks, doChunk);
+    else if (numChunks == 1)
+        doChunk(0);
+
+    output.clear();
+    outputDone = 0;
+    for (auto & c: chunkOutput) {
+        for (auto & r: c)
+            output.emplace_back(std::move(r));
+    }
+}
+
+void
+JoinElement::HashJoinExecutor::
+outputUnmatchedBuildRows()
+{
+    bool outerLeft = parent->joinQualification_ == JOIN_LEFT
+        || parent->joinQualification_ == JOIN_FULL;
+    bool outerRight = parent->joinQualification_ == JOIN_RIGHT
+        || parent->joinQualification_ == JOIN_FULL;
+    bool outerBuild = buildLeft ? outerLeft : outerRight;
+
+    output.clear();
+    outputDone = 0;
+
+    if (!outerBuild)
+        return;
+
+    for (size_t i = 0;  i < buildRows.size();  ++i) {
+        if (buildMatched[i])
+            continue;
+        auto result = std::make_shared<PipelineResults>(*buildRows[i]);
+        result->values.pop_back();
+        if (buildLeft) {
+            result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+            result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+        }
+        else {
+            result->values.insert(result->values.begin(),
+                                  ExpressionValue::null(Date::notADate()));
+            result->values.insert(result->values.begin(),
+                                  ExpressionValue::null(Date::notADate()));
+        }
+        output.emplace_back(std::move(result));
+    }
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+take()
+{
+    if (!built)
+        buildTable();
+
+    while (outputDone == output.size()) {
+        if (!probeDone)
+            probeBatch();
+        else if (!unmatchedDone) {
+            // Unmatched build side rows go last, for outer joins
+            outputUnmatchedBuildRows();
+            unmatchedDone = true;
+        }
+        else return nullptr;
+    }
+
+    return std::move(output[outputDone++]);
+}
+
+void
+JoinElement::HashJoinExecutor::
+restart()
+{
+    left->restart();
+    right->restart();
+    buildRows.clear();
+    buildKeys.clear();
+    buildIndex.clear();
+    buildMatched.reset();
+    built = false;
+    probeDone = false;
+    unmatchedDone = false;
+    output.clear();
+    outputDone = 0;
+}
+
+
 /*****************************************************************************/
 /* BOUND JOIN EXECUTOR                                                       */
 /*****************************************************************************/
@@ -1283,14 +1602,16 @@ Bound(std::shared_ptr<BoundPipelineElement> root,
       std::shared_ptr<BoundPipelineElement> left,
       std::shared_ptr<BoundPipelineElement> right,
       AnnotatedJoinCondition condition,
-      JoinQualification joinQualification)
+      JoinQualification joinQualification,
+      EquiJoinStrategy strategy)
     : root_(std::move(root)),
       left_(std::move(left)),
       right_(std::move(right)),
       outputScope_(createOutputScope()),
       crossWhere_(condition.crossWhere->bind(*outputScope_)),
       condition_(std::move(condition)),
-      joinQualification_(joinQualification)
+      joinQualification_(joinQualification),
+      strategy_(strategy)
 {
 }
 
@@ -1340,6 +1661,14 @@ start(const BoundParameters & getParam) const
              right_->start(getParam));
 
     case AnnotatedJoinCondition::EQUIJOIN:
+        if (strategy_ != MERGE_JOIN) {
+            return std::make_shared<HashJoinExecutor>
+                (this,
+                 root_->start(getParam),
+                 left_->start(getParam),
+                 right_->start(getParam),
+                 strategy_ == HASH_JOIN_BUILD_LEFT);
+        }
         return std::make_shared<EquiJoinExecutor>
             (this,
              root_->start(getParam),
@@ -1623,10 +1952,142 @@ bind() const
 /* FILTER WHERE EXECUTOR                                                     */
 /*****************************************************************************/
 
+namespace {
+
+/// Number of rows that the where clause is evaluated over at once, when
+/// it's not constant
+static constexpr size_t FILTER_WHERE_BATCH_SIZE = 1024;
+
+/// Number of rows read ahead and selected at once by SelectElement::take()
+static constexpr size_t SELECT_BATCH_SIZE = 256;
+
+/// Number of rows of a batch processed by a single job on the thread pool
+static constexpr size_t PIPELINE_CHUNK_SIZE = 128;
+
+/// A range of rows flowing through the pipeline
+struct PipelineRowBatch: public SqlRowBatch {
+    PipelineRowBatch(const std::shared_ptr<PipelineResults> * rows,
+                     size_t numRows)
+        : rows(rows), numRows(numRows)
+    {
+    }
+
+    const std::shared_ptr<PipelineResults> * rows;
+    size_t numRows;
+
+    virtual size_t size() const
+    {
+        return numRows;
+    }
+
+    virtual const SqlRowScope & getRowScope(size_t n) const
+    {
+        return *rows[n];
+    }
+};
+
+/** Call doRange(begin, end) over consecutive ranges covering [0, numRows).
+    Batches bigger than a single chunk are spread over the thread pool.
+*/
+void forEachChunk(size_t numRows,
+                  const std::function<void (size_t begin, size_t end)> & doRange)
+{
+    size_t numChunks = (numRows + PIPELINE_CHUNK_SIZE - 1) / PIPELINE_CHUNK_SIZE;
+
+    auto doChunk = [&] (size_t chunk)
+        {
+            size_t begin = chunk * PIPELINE_CHUNK_SIZE;
+            doRange(begin, std::min(begin + PIPELINE_CHUNK_SIZE, numRows));
+        };
+
+    if (numChunks > 1)
+        parallelMap(0, numChunks, doChunk);
+    else if (numChunks == 1)
+        doChunk(0);
+}
+
+} // file scope
+
+void
+FilterWhereElement::Executor::
+filterRows(std::vector<std::shared_ptr<PipelineResults> > & input,
+           std::vector<std::shared_ptr<PipelineResults> > & output)
+{
+    const BoundSqlExpression & where = parent_->where_;
+
+    // Whether or not each row passes
+    std::vector<char> pass(input.size());
+
+    auto doRange = [&] (size_t begin, size_t end)
+        {
+            if (where.execBatch) {
+                PipelineRowBatch batch(input.data() + begin, end - begin);
+                BatchColumn result;
+                where.execRowBatch(batch, result);
+                for (size_t i = begin;  i < end;  ++i)
+                    pass[i] = result.isTrue(i - begin);
+            }
+            else {
+                for (size_t i = begin;  i < end;  ++i) {
+                    ExpressionValue storage;
+                    pass[i] = where(*input[i], storage, GET_LATEST).isTrue();
+                }
+            }
+        };
+
+    // Constant where clauses are too cheap to be worth spreading out
+    if (where.metadata.isConstant)
+        doRange(0, input.size());
+    else forEachChunk(input.size(), doRange);
+
+    for (size_t i = 0;  i < input.size();  ++i) {
+        if (pass[i])
+            output.emplace_back(std::move(input[i]));
+    }
+}
+
+std::vector<std::shared_ptr<PipelineResults> >
+FilterWhereElement::Executor::
+takeBatch(size_t maxElements)
+{
+    std::vector<std::shared_ptr<PipelineResults> > result;
+
+    // Rows that were read ahead by take() come first
+    if (passedDone < passed.size()) {
+        size_t n = std::min(maxElements, passed.size() - passedDone);
+        result.reserve(n);
+        for (size_t i = 0;  i < n;  ++i)
+            result.emplace_back(std::move(passed[passedDone++]));
+        return result;
+    }
+
+    while (result.empty() && !sourceDone) {
+        auto input = source_->takeBatch(maxElements);
+        if (input.empty())
+            sourceDone = true;
+        else filterRows(input, result);
+    }
+
+    return result;
+}
+
 std::shared_ptr<PipelineResults>
 FilterWhereElement::Executor::
 take()
 {
+    // Constant where clauses are cheap enough that there's nothing to gain
+    // by reading ahead of the consumer
+    if (!parent_->where_.metadata.isConstant) {
+        while (passedDone == passed.size()) {
+            if (sourceDone)
+                return nullptr;
+            passed.clear();
+            passedDone = 0;
+            passed = takeBatch(FILTER_WHERE_BATCH_SIZE);
+        }
+        return std::move(passed[passedDone++]);
+    }
+
     while (true) {
         std::shared_ptr<PipelineResults> input = source_->take();
 
@@ -1652,6 +2113,9 @@ FilterWhereElement::Executor::
 restart()
 {
     source_->restart();
+    passed.clear();
+    passedDone = 0;
+    sourceDone = false;
 }
 
 
@@ -1728,20 +2192,49 @@ std::shared_ptr<PipelineResults>
 SelectElement::Executor::
 take()
 {
-    while (true) {
-        std::shared_ptr<PipelineResults> input = source->take();
+    while (selectedDone == selected.size()) {
+        if (sourceDone)
+            return nullptr;
+        selected.clear();
+        selectedDone = 0;
+        selected = takeBatch(SELECT_BATCH_SIZE);
+        if (selected.empty())
+            sourceDone = true;
+    }
 
-        // If nothing left to give, then return an empty vector
-        if (!input)
-            return input;
+    return std::move(selected[selectedDone++]);
+}
 
-        // Run the select expression in this input's context
-        ExpressionValue selected = parent->select_(*input, GET_ALL);
+std::vector<std::shared_ptr<PipelineResults> >
+SelectElement::Executor::
+takeBatch(size_t maxElements)
+{
+    // Rows that were read ahead by take() come first
+    if (selectedDone < selected.size()) {
+        std::vector<std::shared_ptr<PipelineResults> > result;
+        size_t n = std::min(maxElements, selected.size() - selectedDone);
+        result.reserve(n);
+        for (size_t i = 0;  i < n;  ++i)
+            result.emplace_back(std::move(selected[selectedDone++]));
+        return result;
+    }
 
-        input->values.emplace_back(std::move(selected));
+    auto rows = source->takeBatch(maxElements);
 
-        return input;
-    }
+    // Each row is selected independently, so we can spread them over
+    // threads while keeping their order
+    auto doRange = [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin;  i < end;  ++i) {
+                // Run the select expression in this input's context
+                ExpressionValue selected = parent->select_(*rows[i], GET_ALL);
+                rows[i]->values.emplace_back(std::move(selected));
+            }
+        };
+
+    forEachChunk(rows.size(), doRange);
+
+    return rows;
 }
 
 void
@@ -1749,6 +2242,9 @@ SelectElement::Executor::
 restart()
 {
     source->restart();
+    selected.clear();
+    selectedDone = 0;
+    sourceDone = false;
 }
 
 
@@ -1814,6 +2310,36 @@ bind() const
 /* ORDER BY ELEMENT EXECUTOR                                                 */
 /*****************************************************************************/
 
+namespace {
+
+/** The parameters of a query, which are shared by all of the rows that go
+    through its ParamsElement rather than copied into each of them.  This
+    also allows the rows whose parameters are the same to be recognised.
+*/
+struct SharedParams {
+    std::shared_ptr<const BoundParameters> getParam;
+
+    ExpressionValue operator () (const Utf8String & paramName) const
+    {
+        return (*getParam)(paramName);
+    }
+};
+
+/** Return whether the two parameters are known to be the same.  Only
+    empty parameters and those of a SharedParams can be recognised, so
+    passing the same parameters twice tells whether they can be.
+*/
+bool sameParams(const BoundParameters & p1, const BoundParameters & p2)
+{
+    if (!p1 && !p2)
+        return true;
+    auto s1 = p1.target<SharedParams>();
+    auto s2 = p2.target<SharedParams>();
+    return s1 && s2 && s1->getParam == s2->getParam;
+}
+
+} // file scope
+
 OrderByElement::Executor::
 Executor(const Bound * parent,
          std::shared_ptr<ElementExecutor> source)
@@ -1830,14 +2356,6 @@ take()
     // from the input, sort it, and get it ready to serve up as results
     // of the query.
     if (numDone == -1) {
-        // Get and sort the input
-
-        while (true) {
-            std::shared_ptr<PipelineResults> input = source->take();
-            if (!input)
-                break;
-            sorted.emplace_back(std::move(input));
-        }
 
         // We assume that the fields to sort on are at the end of the
         // list of fields.
@@ -1853,11 +2371,95 @@ take()
                                              offset);
             };
 
-        std::sort(sorted.begin(), sorted.end(), compare);
-                
+        // Sort what we have so far and write it to disk as a sorted run.
+        // Only the values are written; results that carry a group or a
+        // reference to an inner scope are always kept in memory.
+        MemoryTracker memory;
+        auto spillSorted = [&] ()
+            {
+                std::sort(sorted.begin(), sorted.end(), compare);
+                auto file = std::make_shared<SpillFile>();
+                for (auto & r: sorted) {
+                    file->writer() << r->values;
+                    file->recordWritten();
+                }
+                file->finishWriting();
+                sorted.clear();
+                memory.release(memory.used);
+                spilled.emplace_back(std::move(file));
+            };
+
+        std::vector<std::shared_ptr<PipelineResults> > inputs;
+        size_t inputsDone = 0;
+
+        while (true) {
+            // Read the input a batch at a time, so that the elements
+            // before us can work on each batch in parallel
+            if (inputsDone == inputs.size()) {
+                inputs = source->takeBatch(DEFAULT_BATCH_SIZE);
+                inputsDone = 0;
+                if (inputs.empty())
+                    break;
+            }
+            std::shared_ptr<PipelineResults> input
+                = std::move(inputs[inputsDone++]);
+
+            if (memory.budget == 0) {
+                sorted.emplace_back(std::move(input));
+                continue;
+            }
+
+            // Whether we can spill is decided for each result, since
+            // only some of them may have a group or an inner scope.  The
+            // parameters aren't written to disk, so they must also be the
+            // same as those of the results that were spilled before.
+            bool first = sorted.empty() && spilled.empty();
+            if (!input->group.empty() || input->inner
+                || !sameParams(input->getParam,
+                               first ? input->getParam : spilledGetParam)) {
+                unspillable.emplace_back(std::move(input));
+                continue;
+            }
+
+            if (first)
+                spilledGetParam = input->getParam;
+
+            size_t bytes = sizeof(PipelineResults);
+            for (auto & v: input->values)
+                bytes += v.memusage();
+            sorted.emplace_back(std::move(input));
+            if (memory.allocate(bytes))
+                spillSorted();
+        }
+
+        if (!spilled.empty()) {
+            // Everything that can go to disk does, so that restart() can
+            // replay the merge.
+            if (!sorted.empty())
+                spillSorted();
+            std::sort(unspillable.begin(), unspillable.end(), compare);
+            startMerge();
+        }
+        else {
+            sorted.insert(sorted.end(),
+                          std::make_move_iterator(unspillable.begin()),
+                          std::make_move_iterator(unspillable.end()));
+            unspillable.clear();
+            std::sort(sorted.begin(), sorted.end(), compare);
+        }
+
         numDone = 0;
     }
 
+    if (merger) {
+        std::shared_ptr<PipelineResults> result;
+        if (!merger->next(result)) {
+            merger.reset();
+            return nullptr;
+        }
+        return result;
+    }
+
     // OK, sorting is done.  Do we have anything left?  If not, return null
     if (numDone == sorted.size()) {
         sorted.clear();
@@ -1868,12 +2470,49 @@ take()
     return sorted[numDone++];
 }
 
+void
+OrderByElement::Executor::
+startMerge()
+{
+    int offset
+        = parent->scope_->numOutputFields()
+        - parent->orderBy_.clauses.size();
+
+    auto compare = [=] (const std::shared_ptr<PipelineResults> & p1,
+                        const std::shared_ptr<PipelineResults> & p2)
+        -> bool
+        {
+            return parent->orderBy_.less(p1->values, p2->values, offset);
+        };
+
+    auto read = [=] (ML::DB::Store_Reader & store,
+                     std::shared_ptr<PipelineResults> & result)
+        {
+            result = std::make_shared<PipelineResults>();
+            result->getParam = spilledGetParam;
+            store >> result->values;
+        };
+
+    // The merger consumes its in-memory runs, so it gets a copy of the
+    // unspillable results to allow for a restart.
+    merger.reset();
+    inMemoryRuns.clear();
+    if (!unspillable.empty())
+        inMemoryRuns.push_back(unspillable);
+    merger.reset(new SortedRunMerger<std::shared_ptr<PipelineResults> >
+                 (spilled, inMemoryRuns, compare, read));
+}
+
 void
 OrderByElement::Executor::
 restart()
 {
     // Don't re-sort the elements...
     numDone = 0;
+
+    // ... but spilled runs need to be merged again
+    if (!spilled.empty())
+        startMerge();
 }
 
 
@@ -2217,10 +2856,11 @@ bind() const
 ParamsElement::Executor::
 Executor(std::shared_ptr<ElementExecutor> source,
          BoundParameters getParam)
-    : source_(std::move(source)),
-      getParam_(std::move(getParam))
+    : source_(std::move(source))
 {
-    ExcAssert(getParam_);
+    ExcAssert(getParam);
+    getParam_ = SharedParams{ std::make_shared<const BoundParameters>
+                              (std::move(getParam)) };
 }
 
 std::shared_ptr<PipelineResults>
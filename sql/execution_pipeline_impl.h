@@ -9,7 +9,10 @@
 
 #include "execution_pipeline.h"
 #include "join_utils.h"
+#include "spill.h"
 #include <list>
+#include <unordered_map>
+#include <atomic>
 
 namespace Datacratic {
 namespace MLDB {
@@ -328,6 +331,15 @@ struct JoinElement: public PipelineElement {
     std::shared_ptr<PipelineElement> leftImpl;
     std::shared_ptr<PipelineElement> rightImpl;
 
+    /// How an EQUIJOIN is executed
+    enum EquiJoinStrategy {
+        MERGE_JOIN,             ///< Sort both sides and merge them
+        HASH_JOIN_BUILD_LEFT,   ///< Hash the left side, probe with the right
+        HASH_JOIN_BUILD_RIGHT   ///< Hash the right side, probe with the left
+    };
+
+    EquiJoinStrategy strategy;
+
     struct Bound;
 
     /** Execution runs over all left rows for each right row.  The complexity is
@@ -383,6 +395,55 @@ struct JoinElement: public PipelineElement {
         virtual void restart();
     };
 
+    /** Execution builds a hash table over the join key of one side, and
+        then probes it with batches of rows from the other side in
+        parallel.  Neither side needs to be sorted, so the complexity is
+        O(left rows + right rows).  This is used instead of the
+        EquiJoinExecutor when one side is much smaller than the other, as
+        in `SELECT * FROM facts JOIN dimension ON facts.id = dimension.id`.
+        Rows are output in the order of the probe side, followed by the
+        unmatched rows of the build side for outer joins.
+    */
+    struct HashJoinExecutor: public ElementExecutor {
+        HashJoinExecutor(const Bound * parent,
+                         std::shared_ptr<ElementExecutor> root,
+                         std::shared_ptr<ElementExecutor> left,
+                         std::shared_ptr<ElementExecutor> right,
+                         bool buildLeft);
+
+        const Bound * parent;
+        std::shared_ptr<ElementExecutor> root, left, right;
+        bool buildLeft;
+        std::shared_ptr<ElementExecutor> build, probe;
+
+        /// Rows of the build side, with their join keys
+        std::vector<std::shared_ptr<PipelineResults> > buildRows;
+        std::vector<ExpressionValue> buildKeys;
+
+        /// Index from the hash of the join key to position in buildRows
+        std::unordered_multimap<uint64_t, size_t> buildIndex;
+
+        /// Which build rows have matched a probe row, for outer joins
+        std::unique_ptr<std::atomic<bool>[]> buildMatched;
+
+        bool built;
+        bool probeDone;
+        bool unmatchedDone;
+
+        /// Output produced by the last batch of probe rows
+        std::vector<std::shared_ptr<PipelineResults> > output;
+        size_t outputDone;
+
+        virtual std::shared_ptr<PipelineResults> take();
+
+        virtual void restart();
+
+    private:
+        void buildTable();
+        void probeBatch();
+        void outputUnmatchedBuildRows();
+    };
+
     struct Bound: public BoundPipelineElement {
 
         /** Bind this in.  The main difficulty is with the output scope, which
@@ -393,7 +454,8 @@ struct JoinElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> left,
               std::shared_ptr<BoundPipelineElement> right,
               AnnotatedJoinCondition condition,
-              JoinQualification joinQualification);
+              JoinQualification joinQualification,
+              EquiJoinStrategy strategy);
 
         std::shared_ptr<BoundPipelineElement> root_;
         std::shared_ptr<BoundPipelineElement> left_;
@@ -402,6 +464,7 @@ struct JoinElement: public PipelineElement {
         BoundSqlExpression crossWhere_;
         AnnotatedJoinCondition condition_;
         JoinQualification joinQualification_;
+        EquiJoinStrategy strategy_;
 
         /** Our output scope has:
             - The left and right tables
@@ -522,13 +585,34 @@ struct FilterWhereElement: public PipelineElement {
 
     struct Executor: public ElementExecutor {
 
+        Executor()
+            : passedDone(0), sourceDone(false)
+        {
+        }
+
         const Bound * parent_;
         std::shared_ptr<ElementExecutor> source_;
         PipelineExpressionScope * context_;
 
+        /** Unless the where clause is constant, rows are read from the
+            source and filtered a batch at a time, and those that pass
+            are buffered here for take().
+        */
+        std::vector<std::shared_ptr<PipelineResults> > passed;
+        size_t passedDone;
+        bool sourceDone;
+
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual std::vector<std::shared_ptr<PipelineResults> >
+        takeBatch(size_t maxElements);
+
         virtual void restart();
+
+    private:
+        /// Append the rows of input that pass the where clause to output
+        void filterRows(std::vector<std::shared_ptr<PipelineResults> > & input,
+                        std::vector<std::shared_ptr<PipelineResults> > & output);
     };
 
     struct Bound: public BoundPipelineElement {
@@ -577,11 +661,24 @@ struct SelectElement: public PipelineElement {
     struct Bound;
 
     struct Executor: public ElementExecutor {
+        Executor()
+            : selectedDone(0), sourceDone(false)
+        {
+        }
+
         const Bound * parent;
         std::shared_ptr<ElementExecutor> source;
 
+        /// Rows selected a batch at a time, waiting to be returned by take()
+        std::vector<std::shared_ptr<PipelineResults> > selected;
+        size_t selectedDone;
+        bool sourceDone;
+
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual std::vector<std::shared_ptr<PipelineResults> >
+        takeBatch(size_t maxElements);
+
         virtual void restart();
     };
 
@@ -635,6 +732,24 @@ struct OrderByElement: public PipelineElement {
         std::vector<std::shared_ptr<PipelineResults> > sorted;
         ssize_t numDone;
 
+        /// Sorted runs written to disk when the input is over the query
+        /// memory budget.  When non-empty, results come from the merger.
+        std::vector<std::shared_ptr<SpillFile> > spilled;
+        std::unique_ptr<SortedRunMerger<std::shared_ptr<PipelineResults> > >
+            merger;
+        /// Parameters of the spilled results, which are all the same
+        BoundParameters spilledGetParam;
+
+        /// Results that carry a group or a reference to an inner scope,
+        /// and so can't be spilled.  Once there are spilled runs, these
+        /// are sorted and merged with them as a single in-memory run.
+        std::vector<std::shared_ptr<PipelineResults> > unspillable;
+        std::vector<std::vector<std::shared_ptr<PipelineResults> > >
+            inMemoryRuns;
+
+        /// Start returning results by merging the spilled runs
+        void startMerge();
+
         // When we take elements, we take a group at a time
         virtual std::shared_ptr<PipelineResults> take();
 
@@ -0,0 +1,601 @@
+/** expression_batch.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Column-oriented evaluation of SQL operators.
+*/
+
+#include "expression_batch.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/http/http_exception.h"
+#include <cmath>
+#include <functional>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BATCH COLUMN                                                              */
+/*****************************************************************************/
+
+ExpressionValue
+BatchColumn::
+getValue(size_t i) const
+{
+    if (nulls[i])
+        return ExpressionValue::null(ts[i]);
+
+    switch (type) {
+    case NULLS:
+        return ExpressionValue::null(ts[i]);
+    case INTEGER:
+        return ExpressionValue(CellValue(ints[i]), ts[i]);
+    case NUMBER:
+        return ExpressionValue(CellValue(doubles[i]), ts[i]);
+    case STRING:
+        return ExpressionValue(cells[i], ts[i]);
+    case VALUES:
+        return values[i];
+    }
+
+    throw HttpReturnException(500, "Unknown batch column type");
+}
+
+bool
+BatchColumn::
+isTrue(size_t i) const
+{
+    if (nulls[i])
+        return false;
+
+    switch (type) {
+    case NULLS:    return false;
+    case INTEGER:  return ints[i] != 0;
+    case NUMBER:   return doubles[i] != 0;  // NaN is true, as for CellValue
+    case STRING:   return cells[i].isTrue();
+    case VALUES:   return values[i].isTrue();
+    }
+
+    throw HttpReturnException(500, "Unknown batch column type");
+}
+
+bool
+BatchColumn::
+isFalse(size_t i) const
+{
+    if (nulls[i])
+        return false;
+
+    switch (type) {
+    case NULLS:    return false;
+    case INTEGER:  return ints[i] == 0;
+    case NUMBER:   return doubles[i] == 0;
+    case STRING:   return cells[i].isFalse();
+    case VALUES:   return values[i].isFalse();
+    }
+
+    throw HttpReturnException(500, "Unknown batch column type");
+}
+
+void
+BatchColumn::
+reset(Type type, size_t n)
+{
+    this->type = type;
+    ts.resize(n);
+    nulls.clear();
+    nulls.resize(n, type == NULLS);
+    ints.clear();
+    doubles.clear();
+    cells.clear();
+    values.clear();
+
+    switch (type) {
+    case NULLS:    break;
+    case INTEGER:  ints.resize(n);  break;
+    case NUMBER:   doubles.resize(n);  break;
+    case STRING:   cells.resize(n);  break;
+    case VALUES:   values.resize(n);  break;
+    }
+}
+
+// Integers beyond this can't be held exactly in a double
+static constexpr double MAX_EXACT_DOUBLE_INT = 9007199254740992.0;  // 2^53
+
+/** Accumulates the types of a set of atoms, to work out the most specific
+    representation that holds all of them exactly.
+*/
+struct AtomTypes {
+    AtomTypes()
+        : anyValue(false), allInt(true), allNumber(true), allString(true)
+    {
+    }
+
+    bool anyValue, allInt, allNumber, allString;
+
+    /// Add the given atom.  Returns false once only VALUES can hold them.
+    bool add(const CellValue & c)
+    {
+        if (c.empty())
+            return true;
+        anyValue = true;
+        if (c.isInt64()) {
+            allString = false;
+            if (std::abs((double)c.toInt()) > MAX_EXACT_DOUBLE_INT)
+                allNumber = false;
+        }
+        else if (c.isDouble()) {
+            allInt = allString = false;
+        }
+        else if (c.isString()) {
+            allInt = allNumber = false;
+        }
+        else {
+            allInt = allNumber = allString = false;
+        }
+        return allInt || allNumber || allString;
+    }
+
+    BatchColumn::Type type() const
+    {
+        return !anyValue ? BatchColumn::NULLS
+            : allInt ? BatchColumn::INTEGER
+            : allNumber ? BatchColumn::NUMBER
+            : allString ? BatchColumn::STRING
+            : BatchColumn::VALUES;
+    }
+};
+
+void
+BatchColumn::
+setValues(std::vector<ExpressionValue> vals)
+{
+    size_t n = vals.size();
+
+    AtomTypes types;
+    for (auto & v: vals) {
+        if (v.empty())
+            continue;
+        if (!v.isAtom()) {
+            types.anyValue = true;
+            types.allInt = types.allNumber = types.allString = false;
+            break;
+        }
+        if (!types.add(v.getAtom()))
+            break;
+    }
+
+    Type newType = types.type();
+
+    if (newType == VALUES) {
+        reset(VALUES, 0);
+        ts.resize(n);
+        nulls.resize(n);
+        for (size_t i = 0;  i < n;  ++i) {
+            ts[i] = vals[i].getEffectiveTimestamp();
+            nulls[i] = vals[i].empty();
+        }
+        values = std::move(vals);
+        return;
+    }
+
+    reset(newType, n);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        const ExpressionValue & v = vals[i];
+        ts[i] = v.getEffectiveTimestamp();
+        if (v.empty()) {
+            nulls[i] = 1;
+            continue;
+        }
+        switch (newType) {
+        case INTEGER:  ints[i] = v.getAtom().toInt();  break;
+        case NUMBER:   doubles[i] = v.getAtom().toDouble();  break;
+        case STRING:   cells[i] = v.getAtom();  break;
+        default:
+            ExcAssert(false);
+        }
+    }
+}
+
+void
+BatchColumn::
+setCells(const std::vector<CellValue> & vals,
+         const std::vector<Date> & valTs)
+{
+    ExcAssertEqual(vals.size(), valTs.size());
+    size_t n = vals.size();
+
+    AtomTypes types;
+    for (auto & c: vals) {
+        if (!types.add(c))
+            break;
+    }
+
+    Type newType = types.type();
+    reset(newType, n);
+    ts = valTs;
+
+    for (size_t i = 0;  i < n;  ++i) {
+        const CellValue & c = vals[i];
+        if (c.empty()) {
+            nulls[i] = 1;
+            continue;
+        }
+        switch (newType) {
+        case INTEGER:  ints[i] = c.toInt();  break;
+        case NUMBER:   doubles[i] = c.toDouble();  break;
+        case STRING:   cells[i] = c;  break;
+        case VALUES:   values[i] = ExpressionValue(c, valTs[i]);  break;
+        default:
+            ExcAssert(false);
+        }
+    }
+}
+
+void
+BatchColumn::
+setConstant(const ExpressionValue & value, size_t n)
+{
+    std::vector<ExpressionValue> vals(1, value);
+    setValues(std::move(vals));
+
+    // Broadcast the single value over the whole batch
+    Date valueTs = ts[0];
+    bool valueNull = nulls[0];
+    ts.assign(n, valueTs);
+    nulls.assign(n, valueNull);
+
+    switch (type) {
+    case NULLS:    break;
+    case INTEGER:  ints.resize(n, ints[0]);  break;
+    case NUMBER:   doubles.resize(n, doubles[0]);  break;
+    case STRING:   cells.resize(n, cells[0]);  break;
+    case VALUES:   values.resize(n, values[0]);  break;
+    }
+}
+
+
+/*****************************************************************************/
+/* SQL ROW BATCH                                                             */
+/*****************************************************************************/
+
+SqlRowBatch::
+~SqlRowBatch()
+{
+}
+
+
+/*****************************************************************************/
+/* BATCH OPERATIONS                                                          */
+/*****************************************************************************/
+
+namespace {
+
+/// Set up the output of a binary operator, with timestamps and nulls
+/// propagated from the inputs.  Returns true if any row is non-null.
+bool setupBinary(const BatchColumn & lhs,
+                 const BatchColumn & rhs,
+                 BatchColumn::Type type,
+                 BatchColumn & output)
+{
+    size_t n = lhs.size();
+    ExcAssertEqual(rhs.size(), n);
+
+    if (lhs.type == BatchColumn::NULLS || rhs.type == BatchColumn::NULLS)
+        type = BatchColumn::NULLS;
+
+    output.reset(type, n);
+
+    bool anyValue = false;
+    for (size_t i = 0;  i < n;  ++i) {
+        output.ts[i] = std::max(lhs.ts[i], rhs.ts[i]);
+        output.nulls[i] = lhs.nulls[i] | rhs.nulls[i];
+        anyValue = anyValue || !output.nulls[i];
+    }
+
+    if (!anyValue && output.type != BatchColumn::NULLS) {
+        // Everything is null; the value array is unneeded
+        output.type = BatchColumn::NULLS;
+        output.ints.clear();
+        output.doubles.clear();
+        output.cells.clear();
+        output.values.clear();
+    }
+    return anyValue;
+}
+
+template<typename T, typename Compare>
+void compareLoop(const T * l, const T * r, int64_t * out, size_t n,
+                 Compare cmp)
+{
+    for (size_t i = 0;  i < n;  ++i)
+        out[i] = cmp(l[i], r[i]);
+}
+
+template<typename T>
+void compareArrays(const T * l, const T * r, int64_t * out, size_t n,
+                   BatchCompareOp op)
+{
+    switch (op) {
+    case BATCH_EQ:
+        compareLoop(l, r, out, n, [] (T a, T b) { return a == b; });  return;
+    case BATCH_NE:
+        compareLoop(l, r, out, n, [] (T a, T b) { return a != b; });  return;
+    case BATCH_LT:
+        compareLoop(l, r, out, n, [] (T a, T b) { return a < b; });  return;
+    case BATCH_GT:
+        compareLoop(l, r, out, n, [] (T a, T b) { return b < a; });  return;
+    case BATCH_LE:
+        compareLoop(l, r, out, n, [] (T a, T b) { return !(b < a); });  return;
+    case BATCH_GE:
+        compareLoop(l, r, out, n, [] (T a, T b) { return !(a < b); });  return;
+    }
+}
+
+template<typename T>
+bool compareValues(const T & a, const T & b, BatchCompareOp op)
+{
+    switch (op) {
+    case BATCH_EQ: return a == b;
+    case BATCH_NE: return a != b;
+    case BATCH_LT: return a < b;
+    case BATCH_GT: return a > b;
+    case BATCH_LE: return a <= b;
+    case BATCH_GE: return a >= b;
+    }
+    throw HttpReturnException(500, "Unknown batch comparison");
+}
+
+/// Can a comparison between these two doubles be done directly, giving
+/// the same answer as comparing the CellValues they came from?
+bool isExactlyComparable(double a, double b)
+{
+    return !std::isnan(a) && !std::isnan(b)
+        && std::abs(a) <= MAX_EXACT_DOUBLE_INT
+        && std::abs(b) <= MAX_EXACT_DOUBLE_INT;
+}
+
+template<typename Fn>
+void arithmeticLoop(const BatchColumn & lhs, const BatchColumn & rhs,
+                    double * out, size_t n, Fn fn)
+{
+    if (lhs.type == BatchColumn::NUMBER && rhs.type == BatchColumn::NUMBER) {
+        const double * l = lhs.doubles.data();
+        const double * r = rhs.doubles.data();
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = fn(l[i], r[i]);
+    }
+    else {
+        for (size_t i = 0;  i < n;  ++i)
+            out[i] = fn(lhs.getNumber(i), rhs.getNumber(i));
+    }
+}
+
+CellValue getCell(const BatchColumn & col, size_t i)
+{
+    switch (col.type) {
+    case BatchColumn::INTEGER: return col.ints[i];
+    case BatchColumn::NUMBER:  return col.doubles[i];
+    case BatchColumn::STRING:  return col.cells[i];
+    default:
+        return col.getValue(i).getAtom();
+    }
+}
+
+} // file scope
+
+void batchCompare(const BatchColumn & lhs,
+                  const BatchColumn & rhs,
+                  BatchCompareOp op,
+                  BatchColumn & output)
+{
+    if (!setupBinary(lhs, rhs, BatchColumn::INTEGER, output))
+        return;
+
+    size_t n = output.size();
+
+    if (lhs.type == BatchColumn::INTEGER && rhs.type == BatchColumn::INTEGER) {
+        // Values in null rows are zero, so no need to special case them
+        compareArrays(lhs.ints.data(), rhs.ints.data(), output.ints.data(),
+                      n, op);
+    }
+    else if (lhs.isNumeric() && rhs.isNumeric()) {
+        for (size_t i = 0;  i < n;  ++i) {
+            if (output.nulls[i])
+                continue;
+            double a = lhs.getNumber(i), b = rhs.getNumber(i);
+            if (JML_LIKELY(isExactlyComparable(a, b)))
+                output.ints[i] = compareValues(a, b, op);
+            else output.ints[i] = compareValues(getCell(lhs, i),
+                                                getCell(rhs, i), op);
+        }
+    }
+    else if (lhs.type == BatchColumn::STRING
+             && rhs.type == BatchColumn::STRING) {
+        for (size_t i = 0;  i < n;  ++i) {
+            if (output.nulls[i])
+                continue;
+            output.ints[i] = compareValues(lhs.cells[i], rhs.cells[i], op);
+        }
+    }
+    else {
+        for (size_t i = 0;  i < n;  ++i) {
+            if (output.nulls[i])
+                continue;
+            output.ints[i] = compareValues(lhs.getValue(i), rhs.getValue(i),
+                                           op);
+        }
+    }
+}
+
+void batchArithmetic(const BatchColumn & lhs,
+                     const BatchColumn & rhs,
+                     BatchArithmeticOp op,
+                     CellValue (*cellOp) (const CellValue &, const CellValue &),
+                     BatchColumn & output)
+{
+    if (lhs.isNumeric() && rhs.isNumeric()) {
+        // Numeric arithmetic is always done in double precision, as
+        // in binaryPlus() and friends
+        if (!setupBinary(lhs, rhs, BatchColumn::NUMBER, output))
+            return;
+
+        size_t n = output.size();
+        double * out = output.doubles.data();
+
+        switch (op) {
+        case BATCH_PLUS:
+            arithmeticLoop(lhs, rhs, out, n, std::plus<double>());  break;
+        case BATCH_MINUS:
+            arithmeticLoop(lhs, rhs, out, n, std::minus<double>());  break;
+        case BATCH_TIMES:
+            arithmeticLoop(lhs, rhs, out, n, std::multiplies<double>());  break;
+        case BATCH_DIVIDE:
+            arithmeticLoop(lhs, rhs, out, n, std::divides<double>());  break;
+        }
+
+        // Null rows hold garbage; keep the column canonical
+        for (size_t i = 0;  i < n;  ++i) {
+            if (output.nulls[i])
+                out[i] = 0;
+        }
+        return;
+    }
+
+    // General case: the scalar operator on each pair of values
+    size_t n = lhs.size();
+    ExcAssertEqual(rhs.size(), n);
+
+    std::vector<ExpressionValue> vals;
+    vals.reserve(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        ExpressionValue l = lhs.getValue(i), r = rhs.getValue(i);
+        vals.emplace_back(cellOp(l.getAtom(), r.getAtom()),
+                          std::max(lhs.ts[i], rhs.ts[i]));
+    }
+    output.setValues(std::move(vals));
+}
+
+void batchAnd(const BatchColumn & lhs,
+              const BatchColumn & rhs,
+              BatchColumn & output)
+{
+    size_t n = lhs.size();
+    ExcAssertEqual(rhs.size(), n);
+
+    output.reset(BatchColumn::INTEGER, n);
+
+    // Same logic as the row version in BooleanOperatorExpression::bind()
+    for (size_t i = 0;  i < n;  ++i) {
+        bool lFalse = lhs.isFalse(i), rFalse = rhs.isFalse(i);
+        Date lts = lhs.ts[i], rts = rhs.ts[i];
+
+        if (lFalse && rFalse)
+            output.ts[i] = std::min(lts, rts);
+        else if (lFalse)
+            output.ts[i] = lts;
+        else if (rFalse)
+            output.ts[i] = rts;
+        else if (lhs.nulls[i] && rhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = std::min(lts, rts);
+        }
+        else if (lhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = lts;
+        }
+        else if (rhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = rts;
+        }
+        else {
+            output.ints[i] = 1;
+            output.ts[i] = std::max(lts, rts);
+        }
+    }
+}
+
+void batchOr(const BatchColumn & lhs,
+             const BatchColumn & rhs,
+             BatchColumn & output)
+{
+    size_t n = lhs.size();
+    ExcAssertEqual(rhs.size(), n);
+
+    output.reset(BatchColumn::INTEGER, n);
+
+    // Same logic as the row version in BooleanOperatorExpression::bind()
+    for (size_t i = 0;  i < n;  ++i) {
+        bool lTrue = lhs.isTrue(i), rTrue = rhs.isTrue(i);
+        Date lts = lhs.ts[i], rts = rhs.ts[i];
+
+        if (lTrue && rTrue) {
+            output.ints[i] = 1;
+            output.ts[i] = std::max(lts, rts);
+        }
+        else if (lTrue) {
+            output.ints[i] = 1;
+            output.ts[i] = lts;
+        }
+        else if (rTrue) {
+            output.ints[i] = 1;
+            output.ts[i] = rts;
+        }
+        else if (lhs.nulls[i] && rhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = std::max(lts, rts);
+        }
+        else if (lhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = lts;
+        }
+        else if (rhs.nulls[i]) {
+            output.nulls[i] = 1;
+            output.ts[i] = rts;
+        }
+        else output.ts[i] = std::min(lts, rts);
+    }
+}
+
+void batchNot(const BatchColumn & input,
+              BatchColumn & output)
+{
+    size_t n = input.size();
+    output.reset(BatchColumn::INTEGER, n);
+    output.ts = input.ts;
+    output.nulls = input.nulls;
+    for (size_t i = 0;  i < n;  ++i) {
+        if (!input.nulls[i])
+            output.ints[i] = !input.isTrue(i);
+    }
+}
+
+void batchIsType(const BatchColumn & input,
+                 bool (ExpressionValue::* isType) () const,
+                 bool notType,
+                 BatchColumn & output)
+{
+    size_t n = input.size();
+    output.reset(BatchColumn::INTEGER, n);
+    output.ts = input.ts;
+
+    for (size_t i = 0;  i < n;  ++i) {
+        bool val;
+        if (isType == &ExpressionValue::empty)
+            val = input.nulls[i];
+        else if (isType == &ExpressionValue::isTrue)
+            val = input.isTrue(i);
+        else if (isType == &ExpressionValue::isFalse)
+            val = input.isFalse(i);
+        else val = (input.getValue(i) .* isType)();
+        output.ints[i] = notType ? !val : val;
+    }
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,186 @@
+/** expression_batch.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Column-oriented batches of values, used to evaluate bound SQL
+    expressions over many rows at once rather than one row at a time.
+*/
+
+#pragma once
+
+#include "sql_expression.h"
+#include "expression_value.h"
+#include <vector>
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BATCH COLUMN                                                              */
+/*****************************************************************************/
+
+/** The values of an expression over each row of a batch.  When all of the
+    non-null values have the same simple type, they are held in a typed
+    array which allows operators to be applied in tight loops without any
+    per-value dispatch.  Otherwise, they are held as ExpressionValues.
+
+    Booleans are stored as integers, which is how ExpressionValue stores
+    them too.
+*/
+
+struct BatchColumn {
+    enum Type {
+        NULLS,     ///< Every value is null
+        INTEGER,   ///< Signed integers (and booleans), in ints
+        NUMBER,    ///< Integers and floating point numbers, in doubles
+        STRING,    ///< Strings, in cells
+        VALUES     ///< Anything else, in values
+    };
+
+    BatchColumn()
+        : type(NULLS)
+    {
+    }
+
+    Type type;
+
+    /// Timestamp of each row's value
+    std::vector<Date> ts;
+
+    /// One byte per row, which is non-zero if the row's value is null
+    std::vector<uint8_t> nulls;
+
+    std::vector<int64_t> ints;           ///< Values for INTEGER
+    std::vector<double> doubles;         ///< Values for NUMBER
+    std::vector<CellValue> cells;        ///< Values for STRING
+    std::vector<ExpressionValue> values; ///< Values for VALUES
+
+    size_t size() const
+    {
+        return ts.size();
+    }
+
+    bool isNull(size_t i) const
+    {
+        return nulls[i];
+    }
+
+    /// Is the value of row i numeric, and if so what is it?
+    bool isNumeric() const
+    {
+        return type == INTEGER || type == NUMBER;
+    }
+
+    double getNumber(size_t i) const
+    {
+        return type == INTEGER ? ints[i] : doubles[i];
+    }
+
+    /// Return the value for row i as an ExpressionValue
+    ExpressionValue getValue(size_t i) const;
+
+    /// Same as ExpressionValue::isTrue() on row i's value
+    bool isTrue(size_t i) const;
+
+    /// Same as ExpressionValue::isFalse() on row i's value
+    bool isFalse(size_t i) const;
+
+    /** Clear the column and set it up to hold n values of the given type.
+        The ts and nulls arrays and the value array for the type are
+        resized; the caller is responsible for filling them in.
+    */
+    void reset(Type type, size_t n);
+
+    /** Set the column from a value for each row, choosing the most
+        specific representation that holds all of them exactly.
+    */
+    void setValues(std::vector<ExpressionValue> values);
+
+    /** Set the column from an atom and a timestamp for each row, where
+        empty atoms are null.  This avoids constructing an ExpressionValue
+        per row when the values come from columnar storage.
+    */
+    void setCells(const std::vector<CellValue> & cells,
+                  const std::vector<Date> & ts);
+
+    /// Set the column to n copies of the given value
+    void setConstant(const ExpressionValue & value, size_t n);
+};
+
+
+/*****************************************************************************/
+/* SQL ROW BATCH                                                             */
+/*****************************************************************************/
+
+/** A batch of rows over which a bound expression can be evaluated all at
+    once.  Implementations are provided by the binding scope in which the
+    expression was bound, in the same way as SqlRowScope.
+*/
+
+struct SqlRowBatch {
+    virtual ~SqlRowBatch();
+
+    /// Number of rows in the batch
+    virtual size_t size() const = 0;
+
+    /** Return the scope of the nth row in the batch, for expressions that
+        need to be evaluated a row at a time.
+    */
+    virtual const SqlRowScope & getRowScope(size_t n) const = 0;
+};
+
+
+/*****************************************************************************/
+/* BATCH OPERATIONS                                                          */
+/*****************************************************************************/
+
+/** These apply SQL operators elementwise over batch columns, with exactly
+    the same semantics (including null handling and timestamps) as the
+    row at a time versions in sql_expression_operations.cc.
+*/
+
+enum BatchCompareOp {
+    BATCH_EQ, BATCH_NE, BATCH_LT, BATCH_GT, BATCH_LE, BATCH_GE
+};
+
+void batchCompare(const BatchColumn & lhs,
+                  const BatchColumn & rhs,
+                  BatchCompareOp op,
+                  BatchColumn & output);
+
+enum BatchArithmeticOp {
+    BATCH_PLUS, BATCH_MINUS, BATCH_TIMES, BATCH_DIVIDE
+};
+
+/** Apply an arithmetic operator to two columns of scalars.  Numeric
+    columns are handled directly; anything else calls cellOp on each pair
+    of values, which must be the operator's scalar implementation.
+*/
+void batchArithmetic(const BatchColumn & lhs,
+                     const BatchColumn & rhs,
+                     BatchArithmeticOp op,
+                     CellValue (*cellOp) (const CellValue &, const CellValue &),
+                     BatchColumn & output);
+
+void batchAnd(const BatchColumn & lhs,
+              const BatchColumn & rhs,
+              BatchColumn & output);
+
+void batchOr(const BatchColumn & lhs,
+             const BatchColumn & rhs,
+             BatchColumn & output);
+
+void batchNot(const BatchColumn & input,
+              BatchColumn & output);
+
+/** Implements `input IS [NOT] type`, where isType is the ExpressionValue
+    predicate for the type.
+*/
+void batchIsType(const BatchColumn & input,
+                 bool (ExpressionValue::* isType) () const,
+                 bool notType,
+                 BatchColumn & output);
+
+} // namespace MLDB
+} // namespace Datacratic
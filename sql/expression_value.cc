@@ -25,6 +25,9 @@
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/jml/db/compact_size_types.h"
+#include "mldb/types/jml_serialization.h"
 
 using namespace std;
 
@@ -3656,6 +3659,186 @@ hash() const
                               "type", (int)type_);
 }
 
+uint64_t
+ExpressionValue::
+equalityHash() const
+{
+    switch (type_) {
+    case Type::NONE:
+        return CellValue().hash();
+    case Type::ATOM:
+        // 0.0 and -0.0 compare equal but have different bit patterns
+        if (cell_.isDouble() && cell_.toDouble() == 0.0)
+            return CellValue(0.0).hash();
+        return cell_.hash();
+    case Type::STRUCTURED:
+    case Type::EMBEDDING:
+    case Type::SUPERPOSITION: {
+        static const auto desc = getExpressionValueDescriptionNoTimestamp();
+        std::string str;
+        StringJsonPrintingContext context(str);
+        desc->printJsonTyped(this, context);
+        return std::hash<std::string>()(str);
+    }
+    }
+    throw HttpReturnException(500, "Unknown expression type",
+                              "type", (int)type_);
+}
+
+size_t
+ExpressionValue::
+memusage() const
+{
+    switch (type_) {
+    case Type::NONE:
+        return sizeof(*this);
+    case Type::ATOM:
+        return sizeof(*this) - sizeof(CellValue) + cell_.memusage();
+    case Type::STRUCTURED: {
+        size_t result = sizeof(*this) + sizeof(Structured);
+        for (auto & c: *structured_) {
+            result += std::get<0>(c).memusage() + std::get<1>(c).memusage();
+        }
+        return result;
+    }
+    case Type::EMBEDDING:
+        return sizeof(*this) + sizeof(Embedding)
+            + embedding_->length()
+            * getCellSizeInBytes(embedding_->storageType_);
+    case Type::SUPERPOSITION: {
+        size_t result = sizeof(*this) + sizeof(Superposition);
+        for (auto & v: superposition_->values)
+            result += v.memusage();
+        return result;
+    }
+    }
+    throw HttpReturnException(400, "unknown ExpressionValue type");
+}
+
+void
+ExpressionValue::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << (unsigned char)type_ << ts_;
+
+    switch (type_) {
+    case Type::NONE:
+        return;
+    case Type::ATOM:
+        store << cell_;
+        return;
+    case Type::STRUCTURED:
+        store << ML::DB::compact_size_t(structured_->size());
+        for (auto & c: *structured_) {
+            store << std::get<0>(c).toUtf8String();
+            std::get<1>(c).serialize(store);
+        }
+        return;
+    case Type::EMBEDDING: {
+        const Embedding & embedding = *embedding_;
+        size_t length = embedding.length();
+        store << (unsigned char)embedding.storageType_
+              << ML::DB::compact_size_t(embedding.dims_.size());
+        for (auto & d: embedding.dims_)
+            store << ML::DB::compact_size_t(d);
+
+        if (embedding.storageType_ <= ST_UINT64) {
+            // Plain numbers are written as their binary representation
+            store.save_binary(embedding.data_.get(),
+                              length
+                              * getCellSizeInBytes(embedding.storageType_));
+        }
+        else {
+            for (size_t i = 0;  i < length;  ++i)
+                store << embedding.getValue(i);
+        }
+        return;
+    }
+    case Type::SUPERPOSITION:
+        store << ML::DB::compact_size_t(superposition_->values.size());
+        for (auto & v: superposition_->values)
+            v.serialize(store);
+        return;
+    }
+    throw HttpReturnException(400, "unknown ExpressionValue type");
+}
+
+void
+ExpressionValue::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    unsigned char type;
+    Date ts;
+    store >> type >> ts;
+
+    switch ((Type)type) {
+    case Type::NONE:
+        *this = ExpressionValue();
+        ts_ = ts;
+        return;
+    case Type::ATOM: {
+        CellValue cell;
+        store >> cell;
+        *this = ExpressionValue(std::move(cell), ts);
+        return;
+    }
+    case Type::STRUCTURED: {
+        ML::DB::compact_size_t numColumns(store);
+        StructValue columns;
+        columns.reserve(numColumns);
+        for (size_t i = 0;  i < numColumns;  ++i) {
+            Utf8String name;
+            store >> name;
+            ExpressionValue value;
+            value.reconstitute(store);
+            columns.emplace_back(PathElement(std::move(name)),
+                                 std::move(value));
+        }
+        *this = ExpressionValue(std::move(columns));
+        ts_ = ts;
+        return;
+    }
+    case Type::EMBEDDING: {
+        unsigned char storageType;
+        store >> storageType;
+        ML::DB::compact_size_t numDims(store);
+        DimsVector dims;
+        size_t length = 1;
+        for (size_t i = 0;  i < numDims;  ++i) {
+            ML::DB::compact_size_t d(store);
+            dims.push_back(d);
+            length *= d;
+        }
+
+        if (storageType <= ST_UINT64) {
+            size_t bytes = length * getCellSizeInBytes((StorageType)storageType);
+            std::shared_ptr<char> data(new char[bytes],
+                                       [] (char * p) { delete[] p; });
+            store.load_binary(data.get(), bytes);
+            *this = embedding(ts, std::move(data), (StorageType)storageType,
+                              std::move(dims));
+        }
+        else {
+            std::vector<CellValue> values(length);
+            for (auto & v: values)
+                store >> v;
+            *this = ExpressionValue(std::move(values), ts, std::move(dims));
+        }
+        return;
+    }
+    case Type::SUPERPOSITION: {
+        ML::DB::compact_size_t numValues(store);
+        std::vector<ExpressionValue> values(numValues);
+        for (auto & v: values)
+            v.reconstitute(store);
+        *this = superpose(std::move(values));
+        return;
+    }
+    }
+    throw HttpReturnException(400, "unknown ExpressionValue type",
+                              "type", (int)type);
+}
+
 void
 ExpressionValue::
 initInt(int64_t intValue, Date ts)
@@ -4604,5 +4787,50 @@ NamedRowValue::flattenDestructive()
     return result;
 }
 
+size_t
+NamedRowValue::
+memusage() const
+{
+    size_t result = sizeof(*this) + rowName.memusage();
+    for (auto & c: columns)
+        result += std::get<0>(c).memusage() + std::get<1>(c).memusage();
+    return result;
+}
+
+void
+NamedRowValue::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << rowName.toUtf8String() << rowHash.hash()
+          << ML::DB::compact_size_t(columns.size());
+    for (auto & c: columns) {
+        store << std::get<0>(c).toUtf8String();
+        std::get<1>(c).serialize(store);
+    }
+}
+
+void
+NamedRowValue::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    Utf8String name;
+    uint64_t hash;
+    store >> name >> hash;
+    rowName = Path::parse(name);
+    rowHash = RowHash(hash);
+
+    ML::DB::compact_size_t numColumns(store);
+    columns.clear();
+    columns.reserve(numColumns);
+    for (size_t i = 0;  i < numColumns;  ++i) {
+        Utf8String columnName;
+        store >> columnName;
+        ExpressionValue value;
+        value.reconstitute(store);
+        columns.emplace_back(PathElement(std::move(columnName)),
+                             std::move(value));
+    }
+}
+
 } // namespace MLDB
 } // namespace Datacratic
@@ -1077,6 +1077,23 @@ struct ExpressionValue {
     */
     size_t hash() const;
 
+    /** Return a hash that is consistent with operator ==, for use in hash
+        tables (group by, hash join).  Unlike hash(), structured values
+        that differ only in their timestamps hash the same.
+    */
+    uint64_t equalityHash() const;
+
+    /** Return an estimate of the memory used by the value, including the
+        memory it refers to.  Shared storage is counted in full.
+    */
+    size_t memusage() const;
+
+    /** Binary serialization, used to spill values to disk.  Values
+        round-trip with their timestamps; embedding metadata is not kept.
+    */
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
+
 private:
     void extractImpl(void * obj, const ValueDescription & desc) const;
 
@@ -1540,6 +1557,13 @@ struct NamedRowValue {
 
     //operator MatrixNamedRow() const;
     MatrixNamedRow flattenDestructive();
+
+    /// Estimate of the memory used by the row, as ExpressionValue::memusage()
+    size_t memusage() const;
+
+    /// Binary serialization, used to spill rows to disk
+    void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
 
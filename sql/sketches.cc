@@ -0,0 +1,462 @@
+/** sketches.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Implementation of mergeable sketches.
+*/
+
+#include "mldb/sql/sketches.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+namespace {
+
+/// Finalizer from MurmurHash3, so that every bit of the hash is well
+/// mixed whatever the quality of the hash we're given
+inline uint64_t mixHash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Helper functions for Ertl's HyperLogLog estimator; see "New cardinality
+// estimation algorithms for HyperLogLog sketches", 2017.
+
+double hllSigma(double x)
+{
+    if (x == 1.0)
+        return std::numeric_limits<double>::infinity();
+    double y = 1.0, z = x, zPrev;
+    do {
+        x *= x;
+        zPrev = z;
+        z += x * y;
+        y += y;
+    } while (z != zPrev);
+    return z;
+}
+
+double hllTau(double x)
+{
+    if (x == 0.0 || x == 1.0)
+        return 0.0;
+    double y = 1.0, z = 1.0 - x, zPrev;
+    do {
+        x = std::sqrt(x);
+        zPrev = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != zPrev);
+    return z / 3.0;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HYPERLOGLOG                                                               */
+/*****************************************************************************/
+
+HyperLogLog::
+HyperLogLog()
+{
+}
+
+void
+HyperLogLog::
+addHash(uint64_t hash)
+{
+    hash = mixHash(hash);
+
+    if (!isSparse()) {
+        addToRegisters(hash);
+        return;
+    }
+
+    auto it = std::lower_bound(sparse.begin(), sparse.end(), hash);
+    if (it != sparse.end() && *it == hash)
+        return;
+    sparse.insert(it, hash);
+
+    if (sparse.size() > MAX_SPARSE)
+        makeDense();
+}
+
+void
+HyperLogLog::
+addToRegisters(uint64_t hash)
+{
+    size_t index = hash >> (64 - PRECISION);
+    uint64_t rest = hash << PRECISION;
+    uint8_t rank = rest
+        ? __builtin_clzll(rest) + 1
+        : 64 - PRECISION + 1;
+    registers[index] = std::max(registers[index], rank);
+}
+
+void
+HyperLogLog::
+makeDense()
+{
+    registers.resize(NUM_REGISTERS);
+    for (uint64_t hash: sparse)
+        addToRegisters(hash);
+    sparse.clear();
+    sparse.shrink_to_fit();
+}
+
+void
+HyperLogLog::
+merge(const HyperLogLog & other)
+{
+    if (other.isSparse()) {
+        // Hashes were already mixed when they were added to other
+        for (uint64_t hash: other.sparse) {
+            if (isSparse()) {
+                auto it = std::lower_bound(sparse.begin(), sparse.end(), hash);
+                if (it == sparse.end() || *it != hash)
+                    sparse.insert(it, hash);
+                if (sparse.size() > MAX_SPARSE)
+                    makeDense();
+            }
+            else addToRegisters(hash);
+        }
+        return;
+    }
+
+    if (isSparse())
+        makeDense();
+
+    for (size_t i = 0;  i < NUM_REGISTERS;  ++i)
+        registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+uint64_t
+HyperLogLog::
+estimate() const
+{
+    if (isSparse())
+        return sparse.size();
+
+    static constexpr int q = 64 - PRECISION;
+    int counts[q + 2] = { 0 };
+    for (uint8_t r: registers)
+        ++counts[r];
+
+    double m = NUM_REGISTERS;
+    double z = m * hllTau(1.0 - counts[q + 1] / m);
+    for (int k = q;  k >= 1;  --k) {
+        z += counts[k];
+        z *= 0.5;
+    }
+    z += m * hllSigma(counts[0] / m);
+
+    return std::llround(m / (2.0 * std::log(2.0)) * m / z);
+}
+
+
+/*****************************************************************************/
+/* T-DIGEST                                                                  */
+/*****************************************************************************/
+
+constexpr double TDigest::COMPRESSION;
+
+TDigest::
+TDigest()
+    : minValue(std::numeric_limits<double>::infinity()),
+      maxValue(-std::numeric_limits<double>::infinity())
+{
+}
+
+void
+TDigest::
+add(double value, double weight)
+{
+    if (std::isnan(value) || weight <= 0)
+        return;
+    buffer.push_back({ value, weight });
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+    if (buffer.size() >= BUFFER_SIZE)
+        compress();
+}
+
+void
+TDigest::
+merge(const TDigest & other)
+{
+    buffer.insert(buffer.end(),
+                  other.centroids.begin(), other.centroids.end());
+    buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+    if (buffer.size() >= BUFFER_SIZE)
+        compress();
+}
+
+double
+TDigest::
+totalWeight() const
+{
+    double result = 0.0;
+    for (auto & c: centroids)
+        result += c.weight;
+    for (auto & c: buffer)
+        result += c.weight;
+    return result;
+}
+
+void
+TDigest::
+compress()
+{
+    if (buffer.empty())
+        return;
+
+    buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+    std::sort(buffer.begin(), buffer.end(),
+              [] (const Centroid & c1, const Centroid & c2)
+              {
+                  return c1.mean < c2.mean;
+              });
+
+    double total = 0.0;
+    for (auto & c: buffer)
+        total += c.weight;
+
+    // The k1 scale function and its inverse.  Each centroid may span at
+    // most one unit of k.
+    auto k = [] (double q)
+        {
+            return COMPRESSION / (2.0 * M_PI) * std::asin(2.0 * q - 1.0);
+        };
+    auto kInverse = [] (double k)
+        {
+            k = std::min(k, COMPRESSION / 4.0);
+            return (std::sin(k * 2.0 * M_PI / COMPRESSION) + 1.0) / 2.0;
+        };
+
+    std::vector<Centroid> merged;
+    merged.reserve(2 * COMPRESSION);
+
+    Centroid current = buffer[0];
+    double weightSoFar = 0.0;
+    double weightLimit = total * kInverse(k(0.0) + 1.0);
+
+    for (size_t i = 1;  i < buffer.size();  ++i) {
+        const Centroid & c = buffer[i];
+        if (weightSoFar + current.weight + c.weight <= weightLimit) {
+            current.weight += c.weight;
+            current.mean += (c.mean - current.mean) * c.weight / current.weight;
+        }
+        else {
+            weightSoFar += current.weight;
+            weightLimit = total * kInverse(k(weightSoFar / total) + 1.0);
+            merged.push_back(current);
+            current = c;
+        }
+    }
+    merged.push_back(current);
+
+    centroids.swap(merged);
+    buffer.clear();
+}
+
+double
+TDigest::
+quantile(double q) const
+{
+    if (!buffer.empty()) {
+        TDigest compressed(*this);
+        compressed.compress();
+        return compressed.quantile(q);
+    }
+
+    if (centroids.empty())
+        return std::nan("");
+
+    double total = totalWeight();
+    double index = std::min(1.0, std::max(0.0, q)) * total;
+
+    if (index <= 0.0)
+        return minValue;
+    if (index >= total)
+        return maxValue;
+
+    // Interpolate between the centers of the centroids, and between the
+    // outermost centroids and the extreme values
+    const Centroid & first = centroids.front();
+    if (index < first.weight / 2)
+        return minValue
+            + (first.mean - minValue) * index / (first.weight / 2);
+
+    double position = first.weight / 2;
+    for (size_t i = 0;  i + 1 < centroids.size();  ++i) {
+        double gap = (centroids[i].weight + centroids[i + 1].weight) / 2;
+        if (index < position + gap) {
+            double t = (index - position) / gap;
+            return centroids[i].mean
+                + t * (centroids[i + 1].mean - centroids[i].mean);
+        }
+        position += gap;
+    }
+
+    const Centroid & last = centroids.back();
+    return last.mean
+        + (maxValue - last.mean) * (index - position) / (last.weight / 2);
+}
+
+
+/*****************************************************************************/
+/* SPACE SAVING                                                              */
+/*****************************************************************************/
+
+SpaceSaving::
+SpaceSaving(size_t capacity)
+    : capacity_(capacity)
+{
+}
+
+void
+SpaceSaving::
+setCapacity(size_t capacity)
+{
+    ExcAssert(counters.empty());
+    capacity_ = capacity;
+}
+
+void
+SpaceSaving::
+setCounter(const CellValue & value, const Counter & counter)
+{
+    auto it = counters.find(value);
+    if (it != counters.end()) {
+        byCount.erase({ it->second.count, value });
+        it->second = counter;
+    }
+    else counters.emplace(value, counter);
+    byCount.emplace(counter.count, value);
+}
+
+uint64_t
+SpaceSaving::
+minCount() const
+{
+    if (counters.size() < capacity_ || byCount.empty())
+        return 0;
+    return byCount.begin()->first;
+}
+
+void
+SpaceSaving::
+add(const CellValue & value)
+{
+    ExcAssert(capacity_ > 0);
+
+    auto it = counters.find(value);
+    if (it != counters.end()) {
+        Counter counter = it->second;
+        ++counter.count;
+        setCounter(value, counter);
+        return;
+    }
+
+    if (counters.size() < capacity_) {
+        setCounter(value, { 1, 0 });
+        return;
+    }
+
+    // Replace the value with the smallest count; the new value may have
+    // been seen up to that many times already
+    auto smallest = byCount.begin();
+    uint64_t count = smallest->first;
+    counters.erase(smallest->second);
+    byCount.erase(smallest);
+    setCounter(value, { count + 1, count });
+}
+
+void
+SpaceSaving::
+merge(const SpaceSaving & other)
+{
+    if (other.counters.empty())
+        return;
+    if (capacity_ == 0)
+        capacity_ = other.capacity_;
+
+    // A value missing from a full summary may have been seen up to its
+    // minimum count times
+    uint64_t myMin = minCount();
+    uint64_t otherMin = other.minCount();
+
+    std::vector<std::pair<CellValue, Counter> > combined;
+    combined.reserve(counters.size() + other.counters.size());
+
+    for (auto & c: counters) {
+        Counter counter = c.second;
+        auto it = other.counters.find(c.first);
+        if (it != other.counters.end()) {
+            counter.count += it->second.count;
+            counter.error += it->second.error;
+        }
+        else {
+            counter.count += otherMin;
+            counter.error += otherMin;
+        }
+        combined.emplace_back(c.first, counter);
+    }
+
+    for (auto & c: other.counters) {
+        if (counters.count(c.first))
+            continue;
+        Counter counter = c.second;
+        counter.count += myMin;
+        counter.error += myMin;
+        combined.emplace_back(c.first, counter);
+    }
+
+    // Keep only the largest counts
+    if (combined.size() > capacity_) {
+        std::nth_element(combined.begin(), combined.begin() + capacity_,
+                         combined.end(),
+                         [] (const std::pair<CellValue, Counter> & c1,
+                             const std::pair<CellValue, Counter> & c2)
+                         {
+                             return c1.second.count > c2.second.count;
+                         });
+        combined.resize(capacity_);
+    }
+
+    counters.clear();
+    byCount.clear();
+    for (auto & c: combined)
+        setCounter(c.first, c.second);
+}
+
+std::vector<SpaceSaving::Entry>
+SpaceSaving::
+top(size_t k) const
+{
+    std::vector<Entry> result;
+    for (auto it = byCount.rbegin();
+         it != byCount.rend() && result.size() < k;  ++it) {
+        const Counter & counter = counters.at(it->second);
+        result.push_back({ it->second, counter.count, counter.error });
+    }
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
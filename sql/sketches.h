@@ -0,0 +1,182 @@
+/** sketches.h                                                     -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Fixed-size, mergeable summaries of a stream of values, used to
+    implement the approximate aggregators (approx_count_distinct,
+    approx_quantile and approx_top_k).
+*/
+
+#pragma once
+
+#include "mldb/sql/cell_value.h"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HYPERLOGLOG                                                               */
+/*****************************************************************************/
+
+/** HyperLogLog sketch to estimate the number of distinct values in a
+    stream, in the style of HyperLogLog++:
+
+    - 64 bit hashes, so there is no need for a large range correction;
+    - a sparse representation that holds the exact hashes until there
+      are too many of them, so small cardinalities are exact and cost
+      little memory;
+    - 2^14 one byte registers once dense (a standard error of 0.8%),
+      with the cardinality estimated using Ertl's improved estimator,
+      which needs no empirical bias correction tables.
+*/
+
+struct HyperLogLog {
+    static constexpr int PRECISION = 14;
+    static constexpr size_t NUM_REGISTERS = 1 << PRECISION;
+
+    /// Number of distinct hashes kept before moving to dense registers
+    static constexpr size_t MAX_SPARSE = 1024;
+
+    HyperLogLog();
+
+    /// Add a value given its 64 bit hash
+    void addHash(uint64_t hash);
+
+    /// Add the given value
+    void add(const CellValue & value)
+    {
+        addHash(value.hash());
+    }
+
+    /// Merge in the values from another sketch
+    void merge(const HyperLogLog & other);
+
+    /// Estimate the number of distinct values added
+    uint64_t estimate() const;
+
+    bool isSparse() const
+    {
+        return registers.empty();
+    }
+
+private:
+    void addToRegisters(uint64_t hash);
+    void makeDense();
+
+    std::vector<uint64_t> sparse;     ///< Distinct hashes while sparse
+    std::vector<uint8_t> registers;   ///< Registers once dense
+};
+
+
+/*****************************************************************************/
+/* T-DIGEST                                                                  */
+/*****************************************************************************/
+
+/** Merging t-digest (Dunning and Ertl) used to estimate quantiles of a
+    stream of numbers.  Values are buffered and periodically merged into
+    a sorted list of centroids whose sizes are bounded by the k1 scale
+    function, which gives the most accuracy near the extreme quantiles.
+    The number of centroids is bounded by about the compression.
+*/
+
+struct TDigest {
+    static constexpr double COMPRESSION = 100;
+    static constexpr size_t BUFFER_SIZE = 500;
+
+    TDigest();
+
+    /// Add a value with the given weight
+    void add(double value, double weight = 1.0);
+
+    /// Merge in the values from another digest
+    void merge(const TDigest & other);
+
+    /** Estimate the value at quantile q (0 <= q <= 1).  Returns NaN if
+        nothing was added.
+    */
+    double quantile(double q) const;
+
+    /// Total weight of the values added
+    double totalWeight() const;
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    /// Merge the buffered values into the centroids
+    void compress();
+
+    std::vector<Centroid> centroids;  ///< Merged, sorted by mean
+    std::vector<Centroid> buffer;     ///< Not yet merged
+    double minValue;
+    double maxValue;
+};
+
+
+/*****************************************************************************/
+/* SPACE SAVING                                                              */
+/*****************************************************************************/
+
+/** Space-Saving summary (Metwally et al.) that tracks the most frequent
+    values in a stream using a fixed number of counters.  Each counter
+    records an overestimate of its value's count, along with the maximum
+    amount by which it may be overestimated.  Summaries are merged as
+    described by Agarwal et al. in "Mergeable Summaries".
+*/
+
+struct SpaceSaving {
+    SpaceSaving(size_t capacity = 0);
+
+    /** Set the number of counters.  This must be done before anything is
+        added.
+    */
+    void setCapacity(size_t capacity);
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /// Add one occurrence of the given value
+    void add(const CellValue & value);
+
+    /// Merge in the values from another summary
+    void merge(const SpaceSaving & other);
+
+    struct Entry {
+        CellValue value;
+        uint64_t count;   ///< Estimated count; never an underestimate
+        uint64_t error;   ///< Maximum overestimate of count
+    };
+
+    /// Return the k values with the highest counts, highest first
+    std::vector<Entry> top(size_t k) const;
+
+private:
+    struct Counter {
+        uint64_t count;
+        uint64_t error;
+    };
+
+    /// Set the count for a value, keeping the ordering up to date
+    void setCounter(const CellValue & value, const Counter & counter);
+
+    /// Smallest count held, or zero if not all counters are used
+    uint64_t minCount() const;
+
+    size_t capacity_;
+    std::unordered_map<CellValue, Counter> counters;
+    std::set<std::pair<uint64_t, CellValue> > byCount;
+};
+
+} // namespace MLDB
+} // namespace Datacratic
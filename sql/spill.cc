@@ -0,0 +1,151 @@
+/** spill.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Spilling of query operator state to temporary files.
+*/
+
+#include "spill.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/base/exc_assert.h"
+#include <boost/filesystem.hpp>
+#include <mutex>
+
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+namespace {
+
+std::atomic<size_t> queryMemoryBudget(0);
+std::atomic<size_t> queryMemoryLimit(0);
+std::mutex spillDirectoryMutex;
+std::string spillDirectory;
+std::atomic<size_t> spillFilesCreated(0);
+
+} // file scope
+
+void setQueryMemoryBudget(size_t bytes)
+{
+    queryMemoryBudget = bytes;
+}
+
+size_t getQueryMemoryBudget()
+{
+    return queryMemoryBudget;
+}
+
+void setQueryMemoryLimit(size_t bytes)
+{
+    queryMemoryLimit = bytes;
+}
+
+size_t getQueryMemoryLimit()
+{
+    return queryMemoryLimit;
+}
+
+void setSpillDirectory(const std::string & directory)
+{
+    std::unique_lock<std::mutex> guard(spillDirectoryMutex);
+    spillDirectory = directory;
+}
+
+std::string getSpillDirectory()
+{
+    std::unique_lock<std::mutex> guard(spillDirectoryMutex);
+    if (spillDirectory.empty())
+        return fs::temp_directory_path().string();
+    return spillDirectory;
+}
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+SpillFile::
+SpillFile()
+    : numRecords_(0), finished_(false)
+{
+    fs::path path = fs::path(getSpillDirectory())
+        / fs::unique_path("mldb-spill-%%%%-%%%%-%%%%-%%%%.lz4");
+    filename_ = "file://" + path.string();
+    ++spillFilesCreated;
+}
+
+SpillFile::
+~SpillFile()
+{
+    store_.reset();
+    stream_.reset();
+    tryEraseUriObject(filename_);
+}
+
+ML::DB::Store_Writer &
+SpillFile::
+writer()
+{
+    ExcAssert(!finished_);
+    if (!store_) {
+        stream_.reset(new filter_ostream(filename_));
+        store_.reset(new ML::DB::Store_Writer(*stream_));
+    }
+    return *store_;
+}
+
+void
+SpillFile::
+finishWriting()
+{
+    if (finished_)
+        return;
+    if (!stream_) {
+        // Nothing was written; create an empty file so it can be read
+        writer();
+    }
+    store_.reset();
+    stream_->close();
+    finished_ = true;
+}
+
+std::unique_ptr<SpillFile::Reader>
+SpillFile::
+openReader()
+{
+    finishWriting();
+    return std::unique_ptr<Reader>(new Reader(filename_, numRecords_));
+}
+
+size_t
+SpillFile::
+numSpillFilesCreated()
+{
+    return spillFilesCreated;
+}
+
+SpillFile::Reader::
+Reader(const std::string & filename, size_t numRecords)
+    : remaining(numRecords),
+      stream_(new filter_istream(filename)),
+      store_(new ML::DB::Store_Reader(*stream_))
+{
+}
+
+SpillFile::Reader::
+~Reader()
+{
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,308 @@
+/** spill.h                                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Support for query operators (sorts, group by) that need to hold more
+    data than fits in their memory budget.  Once over budget, data is
+    written out to lz4 compressed temporary files which are read back and
+    merged when the operator produces its output.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include "mldb/base/cancellation.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+
+
+namespace Datacratic {
+
+class filter_ostream;
+class filter_istream;
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+/** Set the number of bytes that a single blocking query operator may hold
+    in memory before it starts spilling to disk.  Zero (the default) means
+    that there is no limit and nothing is ever spilled.
+*/
+void setQueryMemoryBudget(size_t bytes);
+
+/** Return the current query memory budget in bytes, or zero if there is
+    no limit.
+*/
+size_t getQueryMemoryBudget();
+
+/** Set the number of bytes that all of the blocking operators of a single
+    query may hold in memory before the query is aborted.  Zero (the
+    default) means that there is no limit.  This should be larger than the
+    memory budget, as memory that was spilled isn't counted.
+*/
+void setQueryMemoryLimit(size_t bytes);
+
+/** Return the current query memory limit in bytes, or zero if there is
+    no limit.
+*/
+size_t getQueryMemoryLimit();
+
+/** Set the directory under which spill files are created.  An empty
+    string (the default) means the system temporary directory.
+*/
+void setSpillDirectory(const std::string & directory);
+
+std::string getSpillDirectory();
+
+
+/*****************************************************************************/
+/* MEMORY TRACKER                                                            */
+/*****************************************************************************/
+
+/** Tracks the approximate amount of memory held by a query operator
+    across all of the threads that contribute to it.
+
+    The memory is also accounted to the cancellation token that is current
+    when the tracker is created, which aborts the query with an exception
+    if that takes it over its memory limit.
+*/
+struct MemoryTracker {
+    MemoryTracker(size_t budget = getQueryMemoryBudget())
+        : budget(budget), used(0), token(currentCancellationToken())
+    {
+    }
+
+    ~MemoryTracker()
+    {
+        if (token)
+            token->release(used.load());
+    }
+
+    /// Record that the given number of bytes were allocated.  Returns true
+    /// if the operator is now over budget and should spill.
+    bool allocate(size_t bytes)
+    {
+        size_t total = used.fetch_add(bytes) + bytes;
+        if (token)
+            token->allocate(bytes);
+        return budget != 0 && total > budget;
+    }
+
+    /// Record that the given number of bytes were released (spilled)
+    void release(size_t bytes)
+    {
+        used.fetch_sub(bytes);
+        if (token)
+            token->release(bytes);
+    }
+
+    bool overBudget() const
+    {
+        return budget != 0 && used.load() > budget;
+    }
+
+    size_t budget;
+    std::atomic<size_t> used;
+    CancellationToken * token;  ///< Query to account memory to, if any
+};
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+/** A temporary file holding a sequence of records spilled from memory.
+    The file is written once, then read back any number of times, and is
+    deleted when the object is destroyed.  Records are written with
+    ML::DB serialization through the lz4 compressor.
+*/
+
+struct SpillFile {
+    SpillFile();
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    void operator = (const SpillFile &) = delete;
+
+    /** Return the store to which records are written.  The caller must
+        call recordWritten() after each record, and provide its own
+        locking if it's written from multiple threads.
+    */
+    ML::DB::Store_Writer & writer();
+
+    void recordWritten()
+    {
+        ++numRecords_;
+    }
+
+    /** Finish writing the file.  This is called automatically by the
+        first call to openReader().
+    */
+    void finishWriting();
+
+    /** Open a new reader positioned at the first record.  The reader
+        must not outlive the SpillFile.
+    */
+    struct Reader;
+    std::unique_ptr<Reader> openReader();
+
+    const std::string & filename() const
+    {
+        return filename_;
+    }
+
+    /// Number of records written to the file
+    size_t numRecords() const
+    {
+        return numRecords_;
+    }
+
+    /// Number of spill files created by this process, for monitoring
+    static size_t numSpillFilesCreated();
+
+private:
+    std::string filename_;
+    size_t numRecords_;
+    bool finished_;
+    std::unique_ptr<filter_ostream> stream_;
+    std::unique_ptr<ML::DB::Store_Writer> store_;
+};
+
+struct SpillFile::Reader {
+    Reader(const std::string & filename, size_t numRecords);
+    ~Reader();
+
+    ML::DB::Store_Reader & store()
+    {
+        return *store_;
+    }
+
+    /// Number of records that remain to be read
+    size_t remaining;
+
+private:
+    std::unique_ptr<filter_istream> stream_;
+    std::unique_ptr<ML::DB::Store_Reader> store_;
+};
+
+
+/*****************************************************************************/
+/* SORTED RUN MERGER                                                         */
+/*****************************************************************************/
+
+/** Performs a k-way merge of sorted runs of values, some of which have
+    been spilled to disk and some of which are held in memory, returning
+    them one at a time in sorted order.  Each spilled run is read back one
+    record at a time, so memory use is proportional to the number of runs,
+    not their size.  In-memory runs are consumed (moved from) as they are
+    merged.  Values that compare equal are returned in run order, with
+    spilled runs first, so the output is deterministic.
+*/
+template<typename T>
+struct SortedRunMerger {
+    typedef std::function<bool (const T &, const T &)> Compare;
+
+    /// Reconstitutes a single record written to a spill file
+    typedef std::function<void (ML::DB::Store_Reader &, T &)> Read;
+
+    SortedRunMerger(const std::vector<std::shared_ptr<SpillFile> > & spilled,
+                    std::vector<std::vector<T> > & inMemory,
+                    Compare less,
+                    Read read)
+        : less(std::move(less)), read(std::move(read))
+    {
+        cursors.reserve(spilled.size() + inMemory.size());
+
+        for (auto & s: spilled) {
+            cursors.emplace_back();
+            cursors.back().reader = s->openReader();
+        }
+        for (auto & m: inMemory) {
+            cursors.emplace_back();
+            cursors.back().values = &m;
+        }
+
+        for (size_t i = 0;  i < cursors.size();  ++i) {
+            if (advance(cursors[i]))
+                heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), heapCompare());
+    }
+
+    /** Move the next value in sorted order into value.  Returns false
+        once all runs are exhausted.
+    */
+    bool next(T & value)
+    {
+        if (heap.empty())
+            return false;
+
+        std::pop_heap(heap.begin(), heap.end(), heapCompare());
+        size_t c = heap.back();
+        value = std::move(cursors[c].current);
+
+        if (advance(cursors[c]))
+            std::push_heap(heap.begin(), heap.end(), heapCompare());
+        else heap.pop_back();
+
+        return true;
+    }
+
+private:
+    /// Cursor over a single run.  Spilled runs have a reader; in memory
+    /// runs point to their vector.
+    struct Cursor {
+        Cursor()
+            : values(nullptr), index(0)
+        {
+        }
+
+        std::unique_ptr<SpillFile::Reader> reader;
+        std::vector<T> * values;
+        size_t index;
+        T current;
+    };
+
+    std::vector<Cursor> cursors;
+    std::vector<size_t> heap;
+    Compare less;
+    Read read;
+
+    bool advance(Cursor & cursor)
+    {
+        if (cursor.reader) {
+            if (cursor.reader->remaining == 0)
+                return false;
+            read(cursor.reader->store(), cursor.current);
+            --cursor.reader->remaining;
+            return true;
+        }
+        if (cursor.index == cursor.values->size())
+            return false;
+        cursor.current = std::move((*cursor.values)[cursor.index++]);
+        return true;
+    }
+
+    /// Comparison for the heap, which is a max-heap so the sense is inverted
+    std::function<bool (size_t, size_t)> heapCompare() const
+    {
+        return [this] (size_t c1, size_t c2) -> bool
+            {
+                if (less(cursors[c2].current, cursors[c1].current))
+                    return true;
+                if (less(cursors[c1].current, cursors[c2].current))
+                    return false;
+                return c1 > c2;
+            };
+    }
+};
+
+} // namespace MLDB
+} // namespace Datacratic
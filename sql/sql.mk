@@ -21,14 +21,21 @@ SQL_EXPRESSION_SOURCES := \
 	dataset_types.cc \
 	sql_expression_operations.cc \
 	eval_sql.cc \
-	expression_value_conversions.cc
+	expression_value_conversions.cc \
+	spill.cc \
+	sketches.cc \
+	statement_cache.cc \
+	expression_batch.cc
 
 # Unfortunately the S2 library needs you to mess with the include path as its includes
 # aren't prefixed.
 $(eval $(call set_compile_option,cell_value.cc builtin_geo_functions.cc,$(S2_COMPILE_OPTIONS) $(S2_WARNING_OPTIONS)))
 
+# RE2's headers include each other without a prefix, too.
+$(eval $(call set_compile_option,builtin_functions.cc sql_utils.cc,-Imldb/ext/re2))
+
 # NOTE: the SQL library should NOT depend on MLDB.  See the comment in testing/testing.mk
-$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),types utils value_description any ml json_diff highwayhash hash s2 edlib))
+$(eval $(call library,sql_expression,$(SQL_EXPRESSION_SOURCES),types utils value_description any ml json_diff highwayhash hash s2 edlib re2 vfs db boost_filesystem base))
 
 $(eval $(call include_sub_make,sql_testing,testing,sql_testing.mk))
 
@@ -8,6 +8,7 @@
 */
 
 #include "sql_expression.h"
+#include "expression_batch.h"
 #include "mldb/base/parse_context.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/types/structure_description.h"
@@ -116,6 +117,22 @@ BoundSqlExpression(ExecFunction exec,
 {
 }
 
+void
+BoundSqlExpression::
+execRowBatch(const SqlRowBatch & batch, BatchColumn & output) const
+{
+    if (execBatch) {
+        execBatch(batch, output);
+        return;
+    }
+
+    std::vector<ExpressionValue> values;
+    values.reserve(batch.size());
+    for (size_t i = 0;  i < batch.size();  ++i)
+        values.emplace_back((*this)(batch.getRowScope(i), GET_LATEST));
+    output.setValues(std::move(values));
+}
+
 ExpressionValue
 BoundSqlExpression::
 constantValue() const
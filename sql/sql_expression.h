@@ -70,6 +70,8 @@ namespace MLDB {
 struct SqlExpression;
 struct KnownColumn;
 struct SqlRowScope;
+struct SqlRowBatch;
+struct BatchColumn;
 struct SqlRowExpression;
 struct OrderByExpression;
 struct TupleExpression;
@@ -169,6 +171,19 @@ struct BoundSqlExpression {
     ExecFunction exec;
     std::shared_ptr<const SqlExpression> expr;
 
+    /** Function type to execute the expression over every row of a batch
+        at once, putting the results in output.  The results must be the
+        same as calling exec with GET_LATEST on each row in turn.
+    */
+    typedef std::function<void (const SqlRowBatch & batch,
+                                BatchColumn & output)> BatchExecFunction;
+
+    /** Batch version of exec.  This is optional, and is only set by
+        expressions that can do better than calling exec on each row,
+        typically because they operate column-wise on typed arrays.
+    */
+    BatchExecFunction execBatch;
+
     /// What kind of value does this return?
     std::shared_ptr<ExpressionValueInfo> info;
 
@@ -199,6 +214,11 @@ struct BoundSqlExpression {
         return res;
     }
 
+    /** Evaluate the expression over every row of the batch.  This uses
+        execBatch if it's set, and otherwise calls exec on each row.
+    */
+    void execRowBatch(const SqlRowBatch & batch, BatchColumn & output) const;
+
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
@@ -237,6 +257,10 @@ struct TableOperations {
     /// Normally used in a join
     std::function<std::vector<Utf8String> () > getChildAliases;
 
+    /// Estimate of the number of rows in the table, used for query
+    /// planning.  May be empty if the table can't estimate it.
+    std::function<ssize_t ()> getRowCountEstimate;
+
     bool operator ! () const
     {
         return !getRowInfo && !getFunction && !runQuery
@@ -284,6 +308,10 @@ struct ColumnGetter {
     
     /// Function called to retrieve the value of the variable
     Exec exec;
+
+    /// Optional function to retrieve the latest value of the variable for
+    /// every row in a batch at once
+    BoundSqlExpression::BatchExecFunction execBatch;
     
     /// Function that describes the characteristics of the return type
     std::shared_ptr<ExpressionValueInfo> info;
@@ -6,6 +6,7 @@
 */
 
 #include "sql_expression_operations.h"
+#include "expression_batch.h"
 #include "mldb/http/http_exception.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/types/structure_description.h"
@@ -57,9 +58,11 @@ BoundSqlExpression
 doComparison(const SqlExpression * expr,
              const BoundSqlExpression & boundLhs,
              const BoundSqlExpression & boundRhs,
-             bool (ExpressionValue::* op)(const ExpressionValue &) const)
+             bool (ExpressionValue::* op)(const ExpressionValue &) const,
+             BatchCompareOp batchOp)
 {
-    return {[=] (const SqlRowScope & row, ExpressionValue & storage,
+    BoundSqlExpression result
+           {[=] (const SqlRowScope & row, ExpressionValue & storage,
                  const VariableFilter & filter)
             -> const ExpressionValue &
             {
@@ -75,6 +78,18 @@ doComparison(const SqlExpression * expr,
             },
             expr,
             std::make_shared<BooleanValueInfo>()};
+
+    if (boundLhs.execBatch && boundRhs.execBatch) {
+        result.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+            {
+                BatchColumn l, r;
+                boundLhs.execBatch(batch, l);
+                boundRhs.execBatch(batch, r);
+                batchCompare(l, r, batchOp, output);
+            };
+    }
+
+    return result;
 }
 
 BoundSqlExpression
@@ -86,27 +101,33 @@ bind(SqlBindingScope & scope) const
 
     if (op == "=" || op == "==") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+                            &ExpressionValue::operator ==,
+                            BATCH_EQ);
     }
     else if (op == "!=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+                            &ExpressionValue::operator !=,
+                            BATCH_NE);
     }
     else if (op == ">") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+                            &ExpressionValue::operator > ,
+                            BATCH_GT);
     }
     else if (op == "<") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+                            &ExpressionValue::operator < ,
+                            BATCH_LT);
     }
     else if (op == ">=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+                            &ExpressionValue::operator >=,
+                            BATCH_GE);
     }
     else if (op == "<=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+                            &ExpressionValue::operator <=,
+                            BATCH_LE);
     }
     else throw HttpReturnException(400, "Unknown comparison op " + op);
 }
@@ -1253,6 +1274,36 @@ struct BinaryModulusOp {
     }
 };
 
+/** Add a batch implementation to a bound binary arithmetic expression,
+    if both of its arguments are scalars that can be evaluated in batch.
+*/
+static BoundSqlExpression
+addArithmeticBatch(BoundSqlExpression bound,
+                   const BoundSqlExpression & boundLhs,
+                   const BoundSqlExpression & boundRhs,
+                   BatchArithmeticOp batchOp,
+                   CellValue (*cellOp) (const CellValue &, const CellValue &))
+{
+    auto isOnlyScalar = [] (const BoundSqlExpression & bound)
+        {
+            return bound.info->isScalar() && !bound.info->isEmbedding()
+                && !bound.info->isRow();
+        };
+
+    if (boundLhs.execBatch && boundRhs.execBatch
+        && isOnlyScalar(boundLhs) && isOnlyScalar(boundRhs)) {
+        bound.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+            {
+                BatchColumn l, r;
+                boundLhs.execBatch(batch, l);
+                boundRhs.execBatch(batch, r);
+                batchArithmetic(l, r, batchOp, cellOp, output);
+            };
+    }
+
+    return bound;
+}
+
 BoundSqlExpression
 ArithmeticExpression::
 bind(SqlBindingScope & scope) const
@@ -1261,21 +1312,29 @@ bind(SqlBindingScope & scope) const
     auto boundRhs = rhs->bind(scope);
 
     if (op == "+" && lhs) {
-        return BinaryOpHelper<BinaryPlusOp>::bind(this, boundLhs, boundRhs);
+        return addArithmeticBatch
+            (BinaryOpHelper<BinaryPlusOp>::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, BATCH_PLUS, &BinaryPlusOp::apply);
     }
     else if (op == "-" && lhs) {
-        return BinaryOpHelper<BinaryMinusOp>::bind(this, boundLhs, boundRhs);
+        return addArithmeticBatch
+            (BinaryOpHelper<BinaryMinusOp>::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, BATCH_MINUS, &BinaryMinusOp::apply);
     }
     else if (op == "-" && !lhs) {
         return doUnaryArithmetic<AtomValueInfo>(this, boundRhs, &unaryMinus);
     }
     else if (op == "*" && lhs) {
-        return BinaryOpHelper<BinaryMultiplicationOp>
-            ::bind(this, boundLhs, boundRhs);
+        return addArithmeticBatch
+            (BinaryOpHelper<BinaryMultiplicationOp>
+             ::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, BATCH_TIMES, &BinaryMultiplicationOp::apply);
     }
     else if (op == "/" && lhs) {
-        return BinaryOpHelper<BinaryDivisionOp>
-            ::bind(this, boundLhs, boundRhs);
+        return addArithmeticBatch
+            (BinaryOpHelper<BinaryDivisionOp>
+             ::bind(this, boundLhs, boundRhs),
+             boundLhs, boundRhs, BATCH_DIVIDE, &BinaryDivisionOp::apply);
     }
     else if (op == "%" && lhs) {
         return BinaryOpHelper<BinaryModulusOp>
@@ -1519,7 +1578,8 @@ bind(SqlBindingScope & scope) const
                                   + "' didn't return info");
     }
 
-    return {[=] (const SqlRowScope & row,
+    BoundSqlExpression result
+           {[=] (const SqlRowScope & row,
                  ExpressionValue & storage,
                  const VariableFilter & filter) -> const ExpressionValue &
             {
@@ -1528,6 +1588,30 @@ bind(SqlBindingScope & scope) const
             },
             this,
             getVariable.info};
+
+    if (getVariable.execBatch) {
+        result.execBatch = getVariable.execBatch;
+    }
+    else {
+        // Read the column a row at a time, so that operators over the
+        // column can still be applied in batch
+        result.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+            {
+                std::vector<ExpressionValue> values;
+                values.reserve(batch.size());
+                for (size_t i = 0;  i < batch.size();  ++i) {
+                    ExpressionValue storage;
+                    const ExpressionValue & val
+                        = getVariable(batch.getRowScope(i), storage, GET_LATEST);
+                    if (&val == &storage)
+                        values.emplace_back(std::move(storage));
+                    else values.emplace_back(val);
+                }
+                output.setValues(std::move(values));
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -1595,7 +1679,8 @@ bind(SqlBindingScope & scope) const
 {
     ExpressionValue val = constant;
 
-    return {[=] (const SqlRowScope &,
+    BoundSqlExpression result
+           {[=] (const SqlRowScope &,
                  ExpressionValue & storage,
                  const VariableFilter & filter) -> const ExpressionValue &
             {
@@ -1604,6 +1689,13 @@ bind(SqlBindingScope & scope) const
             this,
             constant.getSpecializedValueInfo(),
             true /* is constant */};
+
+    result.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+        {
+            output.setConstant(val, batch.size());
+        };
+
+    return result;
 }
 
 Utf8String
@@ -1926,7 +2018,8 @@ bind(SqlBindingScope & scope) const
     auto boundRhs = rhs->bind(scope);
 
     if (op == "AND" && lhs) {
-        return {[=] (const SqlRowScope & row,
+        BoundSqlExpression result
+               {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
                 {
@@ -1959,9 +2052,23 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>()};
+
+        if (boundLhs.execBatch && boundRhs.execBatch) {
+            result.execBatch = [=] (const SqlRowBatch & batch,
+                                    BatchColumn & output)
+                {
+                    BatchColumn l, r;
+                    boundLhs.execBatch(batch, l);
+                    boundRhs.execBatch(batch, r);
+                    batchAnd(l, r, output);
+                };
+        }
+
+        return result;
     }
     else if (op == "OR" && lhs) {
-        return {[=] (const SqlRowScope & row,
+        BoundSqlExpression result
+               {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter)
                 -> const ExpressionValue &
@@ -1997,9 +2104,23 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>()};
+
+        if (boundLhs.execBatch && boundRhs.execBatch) {
+            result.execBatch = [=] (const SqlRowBatch & batch,
+                                    BatchColumn & output)
+                {
+                    BatchColumn l, r;
+                    boundLhs.execBatch(batch, l);
+                    boundRhs.execBatch(batch, r);
+                    batchOr(l, r, output);
+                };
+        }
+
+        return result;
     }
     else if (op == "NOT" && !lhs) {
-        return {[=] (const SqlRowScope & row,
+        BoundSqlExpression result
+               {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter)
                 -> const ExpressionValue &
@@ -2012,6 +2133,18 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>()};
+
+        if (boundRhs.execBatch) {
+            result.execBatch = [=] (const SqlRowBatch & batch,
+                                    BatchColumn & output)
+                {
+                    BatchColumn r;
+                    boundRhs.execBatch(batch, r);
+                    batchNot(r, output);
+                };
+        }
+
+        return result;
     }
     else throw HttpReturnException(400, "Unknown boolean op " + op
                              + (lhs ? " binary" : " unary"));
@@ -2121,7 +2254,8 @@ bind(SqlBindingScope & scope) const
     }
     else throw HttpReturnException(400, "Unknown type `" + type + "' for IsTypeExpression");
 
-    return {[=] (const SqlRowScope & row,
+    BoundSqlExpression result
+           {[=] (const SqlRowScope & row,
                  ExpressionValue & storage,
                  const VariableFilter & filter) -> const ExpressionValue &
             {
@@ -2132,6 +2266,18 @@ bind(SqlBindingScope & scope) const
             },
             this,
             std::make_shared<BooleanValueInfo>()};
+
+    if (boundExpr.execBatch) {
+        bool notType = this->notType;
+        result.execBatch = [=] (const SqlRowBatch & batch, BatchColumn & output)
+            {
+                BatchColumn v;
+                boundExpr.execBatch(batch, v);
+                batchIsType(v, fn, notType, output);
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -3117,6 +3263,15 @@ bind(SqlBindingScope & scope) const
     BoundSqlExpression boundLeft  = left->bind(scope);
     BoundSqlExpression boundRight  = right->bind(scope);
 
+    // A constant pattern (the usual case) is only compiled once
+    std::shared_ptr<const SqlFilterMatcher> constantMatcher;
+    if (boundRight.metadata.isConstant) {
+        ExpressionValue filterEV = boundRight.constantValue();
+        if (filterEV.isString())
+            constantMatcher = std::make_shared<const SqlFilterMatcher>
+                (filterEV.toUtf8String());
+    }
+
     return {[=] (const SqlRowScope & rowScope,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
@@ -3139,10 +3294,17 @@ bind(SqlBindingScope & scope) const
                 throw HttpReturnException(400, "LIKE expression expected its right "
                         "hand value to be a string, got " + filterEV.getTypeAsString());
 
-            Utf8String valueString = value.toUtf8String();
-            Utf8String filterString = filterEV.toUtf8String();
-
-            bool matched = matchSqlFilter(valueString, filterString);
+            // Match on the string's own storage, without copying it
+            const CellValue & atom = value.getAtom();
+            bool matched;
+            if (constantMatcher) {
+                matched = (*constantMatcher)(atom.stringChars(),
+                                             atom.toStringLength());
+            }
+            else {
+                SqlFilterMatcher matcher(filterEV.toUtf8String());
+                matched = matcher(atom.stringChars(), atom.toStringLength());
+            }
 
             return storage = std::move(ExpressionValue(matched != isnegative,
                                         std::max(value.getEffectiveTimestamp(),
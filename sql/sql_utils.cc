@@ -8,10 +8,9 @@
 #include "sql_utils.h"
 #include "path.h"
 #include "http/http_exception.h"
+#include "re2/re2.h"
 
-#include <boost/regex.hpp>    //These have defines that conflits with some of our own, so we can't put regex stuff just anywhere.
-#include <boost/regex/icu.hpp>
-
+#include <cstring>
 #include <iostream>
 
 
@@ -50,69 +49,128 @@ std::string escapeSql(const char * str)
 
 bool matchSqlFilter(const Utf8String& valueString, const Utf8String& filterString)
 {
-    if (filterString.empty() || valueString.empty())
-        return false;
+    return SqlFilterMatcher(filterString)(valueString);
+}
+
+
+/*****************************************************************************/
+/* SQL FILTER MATCHER                                                        */
+/*****************************************************************************/
+
+SqlFilterMatcher::
+SqlFilterMatcher(const Utf8String & filterString)
+{
+    // Both wildcards are ASCII, and so can't be confused with part of a
+    // multi-byte UTF-8 character; we can work on the raw bytes.
+    const std::string & filter = filterString.rawString();
 
-    Utf8String regExFilter;
-
-    for (const auto& filterChar : filterString) {
-
-        switch (filterChar) {
-            case ('%'): {
-                regExFilter += ".*";
-                break;
-            }
-            case ('_'): {
-                regExFilter += ".";
-                break;
-            }
-            case ('*'): {
-                regExFilter += "[*]";
-                break;
-            }
-            case ('['): {
-                regExFilter += "\\[";
-                break;
-            }
-            case (']'): {
-                regExFilter += "\\]";
-                break;
-            }
-            case ('.'): {
-                regExFilter += "[.]";
-                break;
-            }
-            case ('|'): {
-                regExFilter += "[|]";
-                break;
-            }
-            case ('('): {
-                regExFilter += "[(]";
-                break;
-            }
-            case (')'): {
-                regExFilter += "[)]";
-                break;
-            }
-            case ('^'): {
-                regExFilter += "\\^";
-                break;
-            }
-            case ('$'): {
-                regExFilter += "[$]";
-                break;
-            }
-            default: {
-                regExFilter += filterChar;
-            }
+    if (filter.empty()) {
+        kind = NEVER;
+        return;
+    }
+
+    size_t first = filter.find_first_not_of('%');
+    if (first == std::string::npos) {
+        kind = ANY;
+        return;
+    }
+    size_t last = filter.find_last_not_of('%') + 1;
+
+    if (filter.find_first_of("%_", first) >= last) {
+        // Single literal, possibly surrounded by '%'
+        literal = filter.substr(first, last - first);
+        bool leading = first > 0;
+        bool trailing = last < filter.size();
+
+        if (leading && trailing) {
+            kind = CONTAINS;
+            shifts.resize(256, literal.size());
+            for (size_t i = 0;  i + 1 < literal.size();  ++i)
+                shifts[(unsigned char)literal[i]] = literal.size() - 1 - i;
         }
+        else if (leading)
+            kind = SUFFIX;
+        else if (trailing)
+            kind = PREFIX;
+        else kind = EXACT;
+        return;
     }
 
-    //std::cerr << "sql filter regex filter: " << regExFilter << std::endl;
-    boost::u32regex regex = boost::make_u32regex(regExFilter.rawData());
-    auto result = boost::u32regex_match(valueString.begin(), valueString.end(), regex);
+    std::string pattern;
+    std::string run;
+    for (char c: filter) {
+        if (c != '%' && c != '_') {
+            run += c;
+            continue;
+        }
+        pattern += RE2::QuoteMeta(run);
+        run.clear();
+        pattern += (c == '%' ? ".*" : ".");
+    }
+    pattern += RE2::QuoteMeta(run);
+
+    RE2::Options options;
+    options.set_dot_nl(true);
+    options.set_log_errors(false);
+
+    auto compiled = std::make_shared<RE2>(pattern, options);
+    if (!compiled->ok())
+        throw HttpReturnException(400, "Error compiling LIKE pattern '"
+                                  + filterString + "': " + compiled->error());
+    kind = REGEX;
+    regex = std::move(compiled);
+}
 
-    return result;
+bool
+SqlFilterMatcher::
+operator () (const char * str, size_t len) const
+{
+    if (len == 0)
+        return false;
+
+    switch (kind) {
+    case NEVER:
+        return false;
+    case ANY:
+        return true;
+    case EXACT:
+        return len == literal.size()
+            && std::memcmp(str, literal.data(), len) == 0;
+    case PREFIX:
+        return len >= literal.size()
+            && std::memcmp(str, literal.data(), literal.size()) == 0;
+    case SUFFIX:
+        return len >= literal.size()
+            && std::memcmp(str + len - literal.size(), literal.data(),
+                           literal.size()) == 0;
+    case CONTAINS:
+        return contains(str, len);
+    case REGEX:
+        return RE2::FullMatch(re2::StringPiece(str, len), *regex);
+    }
+
+    throw HttpReturnException(500, "Unknown LIKE pattern kind");
+}
+
+bool
+SqlFilterMatcher::
+contains(const char * str, size_t len) const
+{
+    size_t n = literal.size();
+    if (n > len)
+        return false;
+
+    const char * lit = literal.data();
+    char lastChar = lit[n - 1];
+
+    for (size_t i = 0;  i <= len - n;) {
+        char c = str[i + n - 1];
+        if (c == lastChar && std::memcmp(str + i, lit, n - 1) == 0)
+            return true;
+        i += shifts[(unsigned char)c];
+    }
+
+    return false;
 }
 
 //In a single-dataset context
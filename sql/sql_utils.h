@@ -10,6 +10,12 @@
 #pragma once
 
 #include "mldb/types/string.h"
+#include <memory>
+#include <vector>
+
+namespace re2 {
+class RE2;
+} // namespace re2
 
 namespace Datacratic {
 namespace MLDB {
@@ -23,6 +29,51 @@ std::string escapeSql(const char * str);
 bool matchSqlFilter(const Utf8String& valueString,
                     const Utf8String& filterString);
 
+/** Compiled form of the pattern on the right hand side of a LIKE
+    expression, which can be matched against many values.  In the pattern,
+    '%' matches any sequence of characters, '_' matches any single
+    character and all other characters match themselves.
+
+    Patterns that are a single literal with '%' at the beginning and/or
+    the end are matched with a plain comparison or substring search; the
+    others are compiled into a regular expression.  Matching is done
+    directly on the UTF-8 bytes of the value.
+*/
+struct SqlFilterMatcher {
+    SqlFilterMatcher(const Utf8String & filterString);
+
+    bool operator () (const char * str, size_t len) const;
+
+    bool operator () (const Utf8String & str) const
+    {
+        return operator () (str.rawData(), str.rawLength());
+    }
+
+private:
+    enum Kind {
+        NEVER,     ///< Empty pattern; matches nothing
+        ANY,       ///< Only '%'; matches any non-empty value
+        EXACT,     ///< 'abc'
+        PREFIX,    ///< 'abc%'
+        SUFFIX,    ///< '%abc'
+        CONTAINS,  ///< '%abc%'
+        REGEX      ///< Anything else
+    };
+
+    Kind kind;
+
+    /// Literal part of the pattern, for all kinds but REGEX
+    std::string literal;
+
+    /// Boyer-Moore-Horspool shift for each byte value, for CONTAINS
+    std::vector<size_t> shifts;
+
+    /// Compiled regular expression, for REGEX
+    std::shared_ptr<const re2::RE2> regex;
+
+    bool contains(const char * str, size_t len) const;
+};
+
 /** For when we have a variable reference like "x.y" in table x, when
     passing the expression through the table we need to remove it from
     the passed version.  This function does that, removing the table
@@ -0,0 +1,154 @@
+/** statement_cache.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Least recently used cache of parsed SELECT statements.
+*/
+
+#include "statement_cache.h"
+#include "sql_expression.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+namespace {
+
+struct StatementCache {
+    StatementCache()
+        : capacity(1000), hits(0), misses(0), evictions(0)
+    {
+    }
+
+    typedef std::pair<std::string, std::shared_ptr<const SelectStatement> >
+        Entry;
+
+    std::mutex mutex;           ///< Protects all of the fields below
+
+    /// Entries, most recently used first
+    std::list<Entry> entries;
+
+    /// Index of entries by the text of their statement
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+    size_t capacity;
+    uint64_t hits, misses, evictions;
+
+    /** Look up the statement, marking it as the most recently used.
+        Returns a null pointer and counts a miss if it's not there.
+    */
+    std::shared_ptr<const SelectStatement> find(const std::string & query)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        auto it = index.find(query);
+        if (it == index.end()) {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    /** Add a freshly parsed statement.  If another thread added the same
+        one in the meantime, we keep theirs.
+    */
+    void insert(const std::string & query,
+                std::shared_ptr<const SelectStatement> statement)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (capacity == 0 || index.count(query))
+            return;
+        entries.emplace_front(query, std::move(statement));
+        index[query] = entries.begin();
+        evict();
+    }
+
+    /** Remove the least recently used entries until we're within our
+        capacity.  Must be called with the mutex held.
+    */
+    void evict()
+    {
+        while (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++evictions;
+        }
+    }
+};
+
+StatementCache & getCache()
+{
+    static StatementCache cache;
+    return cache;
+}
+
+} // file scope
+
+std::shared_ptr<const SelectStatement>
+getCachedSelectStatement(const Utf8String & query)
+{
+    StatementCache & cache = getCache();
+    const std::string & text = query.rawString();
+
+    std::shared_ptr<const SelectStatement> result = cache.find(text);
+    if (result)
+        return result;
+
+    // Parse outside of the lock, so that a long statement doesn't hold up
+    // the lookups of others
+    result = std::make_shared<const SelectStatement>
+        (SelectStatement::parse(query));
+    cache.insert(text, result);
+    return result;
+}
+
+void setStatementCacheSize(size_t numEntries)
+{
+    StatementCache & cache = getCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.capacity = numEntries;
+    cache.evict();
+}
+
+size_t getStatementCacheSize()
+{
+    StatementCache & cache = getCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    return cache.capacity;
+}
+
+void clearStatementCache()
+{
+    StatementCache & cache = getCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+    cache.entries.clear();
+    cache.index.clear();
+}
+
+StatementCacheStats getStatementCacheStats()
+{
+    StatementCache & cache = getCache();
+    std::unique_lock<std::mutex> guard(cache.mutex);
+
+    StatementCacheStats result;
+    result.hits = cache.hits;
+    result.misses = cache.misses;
+    result.evictions = cache.evictions;
+    result.size = cache.entries.size();
+    result.capacity = cache.capacity;
+    return result;
+}
+
+} // namespace MLDB
+} // namespace Datacratic
@@ -0,0 +1,59 @@
+/** statement_cache.h                                              -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Process-wide cache of parsed SELECT statements, so that queries that
+    are issued over and over again are only parsed once.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include <memory>
+#include <cstdint>
+
+
+namespace Datacratic {
+namespace MLDB {
+
+struct SelectStatement;
+
+
+/*****************************************************************************/
+/* STATEMENT CACHE                                                           */
+/*****************************************************************************/
+
+/** Return the parsed form of the given SELECT statement.  Statements are
+    kept in a least recently used cache keyed by their exact text, so the
+    same text is only parsed again once it has been evicted.  Statements
+    that fail to parse throw as for SelectStatement::parse() and are not
+    cached.
+
+    The statement is shared between all of its users, and so must not be
+    modified.
+*/
+std::shared_ptr<const SelectStatement>
+getCachedSelectStatement(const Utf8String & query);
+
+/** Set the number of statements that the cache may hold.  Zero disables
+    the cache.  The default is 1000.
+*/
+void setStatementCacheSize(size_t numEntries);
+
+size_t getStatementCacheSize();
+
+/** Remove all statements from the cache. */
+void clearStatementCache();
+
+/** Counters of the statement cache. */
+struct StatementCacheStats {
+    uint64_t hits;        ///< Lookups that found a parsed statement
+    uint64_t misses;      ///< Lookups that had to parse the statement
+    uint64_t evictions;   ///< Statements removed to make space
+    size_t size;          ///< Number of statements in the cache
+    size_t capacity;      ///< Maximum number of statements
+};
+
+StatementCacheStats getStatementCacheStats();
+
+} // namespace MLDB
+} // namespace Datacratic
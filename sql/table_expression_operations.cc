@@ -59,6 +59,11 @@ bindDataset(std::shared_ptr<Dataset> dataset, Utf8String asName)
             return aliases;
         };
 
+    result.table.getRowCountEstimate = [=] () -> ssize_t
+        {
+            return dataset->getMatrixView()->getRowCount();
+        };
+
     return result;
 }
 
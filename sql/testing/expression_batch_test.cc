@@ -0,0 +1,224 @@
+/** expression_batch_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that evaluating expressions over batches of rows gives the same
+    answers as evaluating them a row at a time.
+*/
+
+#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/expression_batch.h"
+#include "mldb/sql/binding_contexts.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+
+struct TestRow: public SqlRowScope {
+    std::map<ColumnName, ExpressionValue> vars;
+
+    ExpressionValue getVariable(const ColumnName & columnName) const
+    {
+        auto it = vars.find(columnName);
+        if (it == vars.end())
+            return ExpressionValue();
+        return it->second;
+    }
+};
+
+struct TestBatch: public SqlRowBatch {
+    std::vector<TestRow> rows;
+
+    virtual size_t size() const
+    {
+        return rows.size();
+    }
+
+    virtual const SqlRowScope & getRowScope(size_t n) const
+    {
+        return rows.at(n);
+    }
+};
+
+struct TestBindingScope: public SqlBindingScope {
+    ColumnGetter doGetColumn(const Utf8String & tableName,
+                             const ColumnName & columnName)
+    {
+        return {[=] (const SqlRowScope & context,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    return storage = static_cast<const TestRow &>(context)
+                        .getVariable(columnName);
+                },
+                std::make_shared<AtomValueInfo>()};
+    }
+};
+
+static TestBatch createBatch()
+{
+    std::vector<CellValue> xs = {
+        CellValue(), 0, 1, -3, 2.5, -0.5, 1000000,
+        std::numeric_limits<double>::quiet_NaN(),
+        (long long)(1ULL << 60), "hello", "", 3
+    };
+
+    std::vector<CellValue> ys = {
+        1, CellValue(), 1.0, 2, 2.5, "world", 0, 0.0,
+        (long long)((1ULL << 60) + 1), "hello", 3, CellValue()
+    };
+
+    TestBatch result;
+    for (size_t i = 0;  i < xs.size();  ++i) {
+        for (size_t j = 0;  j < ys.size();  ++j) {
+            TestRow row;
+            Date ts = Date::fromSecondsSinceEpoch(i * 100 + j);
+            row.vars[PathElement("x")] = ExpressionValue(xs[i], ts);
+            row.vars[PathElement("y")]
+                = ExpressionValue(ys[j], ts.plusSeconds(50));
+            // These have a single type, so are stored in typed arrays
+            row.vars[PathElement("z")] = ExpressionValue(i * 1.5 - j, ts);
+            row.vars[PathElement("w")] = ExpressionValue((int)i - (int)j, ts);
+            row.vars[PathElement("s")]
+                = ExpressionValue("s" + std::to_string(j % 3), ts);
+            result.rows.emplace_back(std::move(row));
+        }
+    }
+    return result;
+}
+
+static void checkBatch(const std::string & expression)
+{
+    TestBindingScope scope;
+    auto bound = SqlExpression::parse(expression)->bind(scope);
+
+    BOOST_CHECK(bound.execBatch);
+
+    TestBatch batch = createBatch();
+    BatchColumn output;
+    bound.execRowBatch(batch, output);
+
+    BOOST_REQUIRE_EQUAL(output.size(), batch.size());
+
+    for (size_t i = 0;  i < batch.size();  ++i) {
+        ExpressionValue expected = bound(batch.rows[i], GET_LATEST);
+        ExpressionValue actual = output.getValue(i);
+
+        bool bothNaN = expected.isAtom() && actual.isAtom()
+            && expected.getAtom().isDouble() && actual.getAtom().isDouble()
+            && std::isnan(expected.getAtom().toDouble())
+            && std::isnan(actual.getAtom().toDouble());
+
+        if (!bothNaN && actual != expected) {
+            cerr << "expression " << expression << " row " << i
+                 << " expected " << expected << " got " << actual << endl;
+        }
+        BOOST_CHECK(bothNaN || actual == expected);
+        BOOST_CHECK_EQUAL(actual.getEffectiveTimestamp(),
+                          expected.getEffectiveTimestamp());
+        BOOST_CHECK_EQUAL(output.isTrue(i), expected.isTrue());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_comparison)
+{
+    for (std::string op: { "=", "!=", "<", ">", "<=", ">=" }) {
+        checkBatch("x " + op + " y");
+        checkBatch("z " + op + " 3");
+        checkBatch("w " + op + " 5");
+        checkBatch("w " + op + " z");
+        checkBatch("s " + op + " 's1'");
+        checkBatch("x " + op + " 'hello'");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_arithmetic)
+{
+    for (std::string op: { "+", "-", "*", "/" }) {
+        checkBatch("z " + op + " 2");
+        checkBatch("w " + op + " w");
+        checkBatch("x " + op + " z");
+        checkBatch("(z " + op + " 2) > 1");
+    }
+    checkBatch("x + y");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_boolean)
+{
+    checkBatch("x > 1 AND y < 3");
+    checkBatch("x > 1 OR y < 3");
+    checkBatch("NOT (x > 1)");
+    checkBatch("x AND y");
+    checkBatch("x OR y");
+    checkBatch("NOT x");
+    checkBatch("x IS NULL OR y IS NOT NULL");
+    checkBatch("x IS TRUE AND y IS NOT FALSE");
+    checkBatch("x IS STRING");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_fallback)
+{
+    // Functions aren't evaluated in batch, and nor are operators over them
+    TestBindingScope scope;
+    auto bound = SqlExpression::parse("abs(z) > 1")->bind(scope);
+    BOOST_CHECK(!bound.execBatch);
+
+    // ... but execRowBatch still works, a row at a time
+    TestBatch batch = createBatch();
+    BatchColumn output;
+    bound.execRowBatch(batch, output);
+    BOOST_REQUIRE_EQUAL(output.size(), batch.size());
+    for (size_t i = 0;  i < batch.size();  ++i) {
+        BOOST_CHECK_EQUAL(output.getValue(i),
+                          bound(batch.rows[i], GET_LATEST));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_column_types)
+{
+    BatchColumn col;
+    Date ts = Date::fromSecondsSinceEpoch(1);
+
+    col.setValues({ ExpressionValue(1, ts), ExpressionValue::null(ts),
+                    ExpressionValue(3, ts) });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::INTEGER);
+    BOOST_CHECK(col.isNull(1));
+
+    col.setValues({ ExpressionValue(1, ts), ExpressionValue(1.5, ts) });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::NUMBER);
+
+    col.setValues({ ExpressionValue("a", ts), ExpressionValue("b", ts) });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::STRING);
+
+    col.setValues({ ExpressionValue(1, ts), ExpressionValue("b", ts) });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::VALUES);
+
+    col.setValues({ ExpressionValue::null(ts), ExpressionValue::null(ts) });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::NULLS);
+
+    Date ts2 = Date::fromSecondsSinceEpoch(2);
+    col.setCells({ CellValue(1), CellValue(), CellValue(2.5) },
+                 { ts, Date::negativeInfinity(), ts2 });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::NUMBER);
+    BOOST_CHECK(col.isNull(1));
+    BOOST_CHECK_EQUAL(col.getValue(1).getEffectiveTimestamp(),
+                      Date::negativeInfinity());
+    BOOST_CHECK_EQUAL(col.getValue(2), ExpressionValue(2.5, ts2));
+
+    col.setCells({ CellValue("a"), CellValue(ts) }, { ts, ts });
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::VALUES);
+    BOOST_CHECK_EQUAL(col.getValue(1), ExpressionValue(ts, ts));
+
+    col.setConstant(ExpressionValue(2.5, ts), 4);
+    BOOST_CHECK_EQUAL(col.type, BatchColumn::NUMBER);
+    BOOST_CHECK_EQUAL(col.size(), 4);
+    BOOST_CHECK_EQUAL(col.getValue(3), ExpressionValue(2.5, ts));
+}
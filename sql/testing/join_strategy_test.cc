@@ -0,0 +1,192 @@
+/** join_strategy_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that an equijoin is executed as a hash join or as a merge join
+    according to the estimated size of each side.
+*/
+
+#include "mldb/sql/execution_pipeline.h"
+#include "mldb/sql/execution_pipeline_impl.h"
+#include "mldb/sql/table_expression_operations.h"
+#include "mldb/http/http_exception.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+namespace {
+
+/** A table whose rows have an integer id column counting up from zero.
+    Its estimated size is given separately, so that a large table can be
+    planned for without having to generate it.  An estimate of -1 means
+    that the table can't estimate its size.
+*/
+BoundTableExpression
+makeTable(const Utf8String & name, int numRows, ssize_t estimatedRows)
+{
+    BoundTableExpression result;
+    result.asName = name;
+
+    result.table.getRowInfo = [] ()
+        {
+            std::vector<KnownColumn> columns;
+            columns.emplace_back(ColumnName("id"),
+                                 std::make_shared<IntegerValueInfo>(),
+                                 COLUMN_IS_DENSE);
+            return std::make_shared<RowValueInfo>(columns, SCHEMA_CLOSED);
+        };
+
+    result.table.getFunction = [] (SqlBindingScope & scope,
+                                   const Utf8String & tableName,
+                                   const Utf8String & functionName,
+                                   const std::vector<std::shared_ptr<ExpressionValueInfo> > & args)
+        {
+            return BoundFunction();
+        };
+
+    // The rows are generated in order of their id, which is what a merge
+    // join sorts them by
+    result.table.runQuery = [=] (const SqlBindingScope & scope,
+                                 const SelectExpression & select,
+                                 const WhenExpression & when,
+                                 const SqlExpression & where,
+                                 const OrderByExpression & orderBy,
+                                 ssize_t offset,
+                                 ssize_t limit)
+        {
+            auto generateRows = [=] (ssize_t numToGenerate,
+                                     SqlRowScope & rowScope,
+                                     const BoundParameters & params)
+                {
+                    std::vector<NamedRowValue> rows;
+                    for (int i = 0;  i < numRows;  ++i) {
+                        NamedRowValue row;
+                        row.rowName = RowName(name + "_" + to_string(i));
+                        row.rowHash = row.rowName;
+                        row.columns.emplace_back
+                            (PathElement("id"),
+                             ExpressionValue(i, Date::notADate()));
+                        rows.emplace_back(std::move(row));
+                    }
+                    return rows;
+                };
+
+            return BasicRowGenerator(generateRows);
+        };
+
+    result.table.getChildAliases = [] ()
+        {
+            return std::vector<Utf8String>();
+        };
+
+    if (estimatedRows >= 0) {
+        result.table.getRowCountEstimate = [=] () -> ssize_t
+            {
+                return estimatedRows;
+            };
+    }
+
+    return result;
+}
+
+/** Bind an inner join of the two tables on their id columns, check that
+    it's executed with the expected strategy and return the number of rows
+    that it outputs.
+*/
+size_t runJoin(BoundTableExpression left,
+               BoundTableExpression right,
+               JoinElement::EquiJoinStrategy expected)
+{
+    SqlBindingScope scope;
+
+    auto element = PipelineElement::root(scope)
+        ->join(std::make_shared<DatasetExpression>(Utf8String("l"),
+                                                   Utf8String("l")),
+               std::move(left),
+               std::make_shared<DatasetExpression>(Utf8String("r"),
+                                                   Utf8String("r")),
+               std::move(right),
+               SqlExpression::parse("l.id = r.id"),
+               JOIN_INNER);
+
+    auto join = std::dynamic_pointer_cast<JoinElement>(element);
+    BOOST_REQUIRE(join);
+    BOOST_CHECK_EQUAL(join->strategy, expected);
+
+    auto bound = std::dynamic_pointer_cast<JoinElement::Bound>(join->bind());
+    BOOST_REQUIRE(bound);
+    BOOST_CHECK_EQUAL(bound->strategy_, expected);
+
+    auto getParam = [] (const Utf8String & paramName) -> ExpressionValue
+        {
+            throw HttpReturnException(400, "No parameters bound in");
+        };
+
+    auto executor = bound->start(getParam);
+    if (expected == JoinElement::MERGE_JOIN) {
+        BOOST_CHECK(std::dynamic_pointer_cast<JoinElement::EquiJoinExecutor>
+                    (executor));
+    }
+    else {
+        auto hashJoin
+            = std::dynamic_pointer_cast<JoinElement::HashJoinExecutor>
+            (executor);
+        BOOST_REQUIRE(hashJoin);
+        BOOST_CHECK_EQUAL(hashJoin->buildLeft,
+                          expected == JoinElement::HASH_JOIN_BUILD_LEFT);
+    }
+
+    size_t numRows = 0;
+    executor->takeAll([&] (std::shared_ptr<PipelineResults> & result)
+                      {
+                          ++numRows;
+                          return true;
+                      });
+    return numRows;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_small_tables_are_merged )
+{
+    size_t numRows = runJoin(makeTable("l", 100, 100),
+                             makeTable("r", 50, 50),
+                             JoinElement::MERGE_JOIN);
+    BOOST_CHECK_EQUAL(numRows, 50);
+}
+
+BOOST_AUTO_TEST_CASE( test_large_table_with_small_table_is_hashed )
+{
+    // The estimates are what the strategy is chosen on; the tables are
+    // kept small to keep the test fast
+    size_t numRows = runJoin(makeTable("l", 100, 100000),
+                             makeTable("r", 50, 50),
+                             JoinElement::HASH_JOIN_BUILD_RIGHT);
+    BOOST_CHECK_EQUAL(numRows, 50);
+
+    numRows = runJoin(makeTable("l", 50, 50),
+                      makeTable("r", 100, 100000),
+                      JoinElement::HASH_JOIN_BUILD_LEFT);
+    BOOST_CHECK_EQUAL(numRows, 50);
+}
+
+BOOST_AUTO_TEST_CASE( test_similar_large_tables_are_merged )
+{
+    size_t numRows = runJoin(makeTable("l", 100, 100000),
+                             makeTable("r", 50, 50000),
+                             JoinElement::MERGE_JOIN);
+    BOOST_CHECK_EQUAL(numRows, 50);
+}
+
+BOOST_AUTO_TEST_CASE( test_unknown_size_is_merged )
+{
+    size_t numRows = runJoin(makeTable("l", 100, 100000),
+                             makeTable("r", 50, -1),
+                             JoinElement::MERGE_JOIN);
+    BOOST_CHECK_EQUAL(numRows, 50);
+}
@@ -0,0 +1,152 @@
+/** sketches_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the accuracy and merging of the approximate aggregator sketches.
+*/
+
+#include "mldb/sql/sketches.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_hyperloglog_small_is_exact )
+{
+    HyperLogLog hll;
+    BOOST_CHECK_EQUAL(hll.estimate(), 0);
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        hll.add(CellValue(i % 500));
+        hll.add(CellValue("value " + to_string(i % 300)));
+    }
+
+    BOOST_CHECK(hll.isSparse());
+    BOOST_CHECK_EQUAL(hll.estimate(), 800);
+}
+
+BOOST_AUTO_TEST_CASE( test_hyperloglog_accuracy )
+{
+    for (uint64_t n: { 2000, 20000, 1000000 }) {
+        HyperLogLog hll;
+        for (uint64_t i = 0;  i < n;  ++i)
+            hll.addHash(i);
+        double error = fabs((double)hll.estimate() - n) / n;
+        cerr << "n = " << n << " estimate = " << hll.estimate()
+             << " error = " << error << endl;
+        // Standard error is 0.8%; allow for 4 of them
+        BOOST_CHECK_LT(error, 0.032);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_hyperloglog_merge )
+{
+    // Overlapping ranges, with one sketch sparse and the other dense
+    HyperLogLog hll1, hll2, hll3;
+    for (uint64_t i = 0;  i < 100000;  ++i)
+        hll1.addHash(i);
+    for (uint64_t i = 99500;  i < 100500;  ++i)
+        hll2.addHash(i);
+    BOOST_CHECK(hll2.isSparse());
+
+    HyperLogLog all;
+    for (uint64_t i = 0;  i < 100500;  ++i)
+        all.addHash(i);
+
+    hll3.merge(hll2);
+    hll3.merge(hll1);
+    hll1.merge(hll2);
+
+    // Merging is exact for the registers
+    BOOST_CHECK_EQUAL(hll1.estimate(), all.estimate());
+    BOOST_CHECK_EQUAL(hll3.estimate(), all.estimate());
+}
+
+BOOST_AUTO_TEST_CASE( test_tdigest_empty_and_small )
+{
+    TDigest digest;
+    BOOST_CHECK(std::isnan(digest.quantile(0.5)));
+
+    for (double v: { 5, 1, 4, 2, 3 })
+        digest.add(v);
+    BOOST_CHECK_EQUAL(digest.quantile(0.5), 3);
+    BOOST_CHECK_EQUAL(digest.quantile(0.0), 1);
+    BOOST_CHECK_EQUAL(digest.quantile(1.0), 5);
+    BOOST_CHECK_EQUAL(digest.totalWeight(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_tdigest_accuracy_and_merge )
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> dist(10.0, 3.0);
+
+    std::vector<double> values;
+    std::vector<TDigest> parts(8);
+    TDigest whole;
+    for (unsigned i = 0;  i < 200000;  ++i) {
+        double v = dist(rng);
+        values.push_back(v);
+        whole.add(v);
+        parts[i % parts.size()].add(v);
+    }
+
+    TDigest merged;
+    for (auto & p: parts)
+        merged.merge(p);
+
+    std::sort(values.begin(), values.end());
+
+    for (double q: { 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999 }) {
+        for (const TDigest * digest: { &whole, &merged }) {
+            double estimate = digest->quantile(q);
+            // Check the error in rank, which is what a t-digest bounds
+            double rank = std::lower_bound(values.begin(), values.end(),
+                                           estimate) - values.begin();
+            double rankError = fabs(rank / values.size() - q);
+            BOOST_CHECK_LT(rankError, 0.005);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_space_saving )
+{
+    // Zipf-like distribution: value i appears about 100000 / (i + 1) times
+    std::vector<uint64_t> trueCounts(2000);
+    std::vector<CellValue> stream;
+    for (unsigned i = 0;  i < trueCounts.size();  ++i) {
+        trueCounts[i] = 100000 / (i + 1);
+        for (unsigned j = 0;  j < trueCounts[i];  ++j)
+            stream.emplace_back((int)i);
+    }
+    std::shuffle(stream.begin(), stream.end(), std::mt19937(1));
+
+    SpaceSaving whole(100);
+    std::vector<SpaceSaving> parts(4, SpaceSaving(100));
+    for (unsigned i = 0;  i < stream.size();  ++i) {
+        whole.add(stream[i]);
+        parts[i % parts.size()].add(stream[i]);
+    }
+
+    SpaceSaving merged;
+    for (auto & p: parts)
+        merged.merge(p);
+    BOOST_CHECK_EQUAL(merged.capacity(), 100);
+
+    for (const SpaceSaving * summary: { &whole, &merged }) {
+        auto top = summary->top(5);
+        BOOST_REQUIRE_EQUAL(top.size(), 5);
+        for (unsigned i = 0;  i < top.size();  ++i) {
+            BOOST_CHECK_EQUAL(top[i].value, CellValue((int)i));
+            uint64_t actual = trueCounts[i];
+            BOOST_CHECK_GE(top[i].count, actual);
+            BOOST_CHECK_LE(top[i].count - top[i].error, actual);
+        }
+    }
+}
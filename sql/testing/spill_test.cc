@@ -0,0 +1,128 @@
+/** spill_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of spilling values to disk and merging sorted runs.
+*/
+
+#include "mldb/sql/spill.h"
+#include "mldb/sql/expression_value.h"
+#include "mldb/jml/db/persistent.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+static ExpressionValue roundTrip(const ExpressionValue & val)
+{
+    SpillFile file;
+    val.serialize(file.writer());
+    file.recordWritten();
+
+    auto reader = file.openReader();
+    BOOST_CHECK_EQUAL(reader->remaining, 1);
+    ExpressionValue result;
+    result.reconstitute(reader->store());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_expression_value_round_trip)
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+
+    std::vector<ExpressionValue> vals = {
+        ExpressionValue(),
+        ExpressionValue(-3, ts),
+        ExpressionValue((unsigned long long)-1, ts),
+        ExpressionValue(1.5, ts),
+        ExpressionValue("hello", ts),
+        ExpressionValue(Utf8String("h\xc3\xa9llo"), ts),
+        ExpressionValue(Date::fromSecondsSinceEpoch(10), ts),
+        ExpressionValue(CellValue::blob(std::string("a\0b", 3)), ts),
+        ExpressionValue(CellValue(PathElement("a") + PathElement("b.c")), ts),
+        ExpressionValue(std::vector<float>{ 1.0, 2.0, 3.0, 4.0 }, ts, { 2, 2 }),
+        ExpressionValue(std::vector<CellValue>{ CellValue("x"), CellValue(1) },
+                        ts)
+    };
+
+    StructValue structured;
+    structured.emplace_back(PathElement("x"), vals[1]);
+    structured.emplace_back(PathElement("y"), vals[4]);
+    structured.emplace_back(PathElement("z"), vals[9]);
+    vals.emplace_back(std::move(structured));
+
+    for (auto & v: vals) {
+        ExpressionValue v2 = roundTrip(v);
+        BOOST_CHECK_EQUAL(v2, v);
+        BOOST_CHECK_EQUAL(v2.getEffectiveTimestamp(),
+                          v.getEffectiveTimestamp());
+        BOOST_CHECK_EQUAL(v2.getTypeAsString(), v.getTypeAsString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_sorted_runs)
+{
+    typedef std::vector<ExpressionValue> Row;
+
+    auto less = [] (const Row & r1, const Row & r2)
+        {
+            return r1[0] < r2[0];
+        };
+
+    auto read = [] (ML::DB::Store_Reader & store, Row & row)
+        {
+            store >> row;
+        };
+
+    // Runs on disk hold multiples of 3 and 5; in memory holds the rest
+    std::vector<std::shared_ptr<SpillFile> > spilled;
+    std::vector<std::vector<Row> > inMemory(2);
+
+    for (int m: { 3, 5 }) {
+        auto file = std::make_shared<SpillFile>();
+        for (int i = 0;  i < 100;  i += m) {
+            file->writer() << Row{ ExpressionValue(i, Date()) };
+            file->recordWritten();
+        }
+        spilled.push_back(file);
+    }
+
+    for (int i = 0;  i < 100;  ++i) {
+        if (i % 3 == 0 || i % 5 == 0)
+            continue;
+        inMemory[i % 2].push_back({ ExpressionValue(i, Date()) });
+    }
+
+    // Merge twice, to check that spilled runs can be replayed
+    for (int pass = 0;  pass < 2;  ++pass) {
+        std::vector<std::vector<Row> > runs = inMemory;
+        SortedRunMerger<Row> merger(spilled, runs, less, read);
+
+        std::vector<int> result;
+        Row row;
+        while (merger.next(row))
+            result.push_back(row[0].getAtom().toInt());
+
+        BOOST_CHECK(std::is_sorted(result.begin(), result.end()));
+        // 15, 30, ... appear in both spilled runs
+        BOOST_CHECK_EQUAL(result.size(), 100 + 7);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_tracker)
+{
+    MemoryTracker unlimited(0);
+    BOOST_CHECK(!unlimited.allocate(1ULL << 40));
+
+    MemoryTracker tracker(1000);
+    BOOST_CHECK(!tracker.allocate(600));
+    BOOST_CHECK(tracker.allocate(600));
+    BOOST_CHECK(tracker.overBudget());
+    tracker.release(600);
+    BOOST_CHECK(!tracker.overBudget());
+}
@@ -4,3 +4,8 @@
 
 $(eval $(call test,path_test,sql_expression,boost))
 $(eval $(call test,eval_sql_test,sql_expression,boost))
+$(eval $(call test,spill_test,sql_expression,boost))
+$(eval $(call test,expression_batch_test,sql_expression,boost))
+$(eval $(call test,sketches_test,sql_expression,boost))
+$(eval $(call test,statement_cache_test,sql_expression,boost))
+$(eval $(call test,join_strategy_test,sql_expression,boost))
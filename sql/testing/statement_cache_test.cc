@@ -0,0 +1,79 @@
+/** statement_cache_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the cache of parsed SELECT statements.
+*/
+
+#include "mldb/sql/statement_cache.h"
+#include "mldb/sql/sql_expression.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+BOOST_AUTO_TEST_CASE( test_statement_cache_hits_and_misses )
+{
+    clearStatementCache();
+    setStatementCacheSize(1000);
+    StatementCacheStats before = getStatementCacheStats();
+
+    auto stm1 = getCachedSelectStatement("select x from ds where y = 1");
+    auto stm2 = getCachedSelectStatement("select x from ds where y = 1");
+    auto stm3 = getCachedSelectStatement("select x from ds where y = 2");
+
+    // The same text gives the same statement
+    BOOST_CHECK_EQUAL(stm1, stm2);
+    BOOST_CHECK_NE(stm1, stm3);
+    BOOST_CHECK_EQUAL(stm1->surface,
+                      SelectStatement::parse("select x from ds where y = 1")
+                      .surface);
+
+    StatementCacheStats after = getStatementCacheStats();
+    BOOST_CHECK_EQUAL(after.hits - before.hits, 1);
+    BOOST_CHECK_EQUAL(after.misses - before.misses, 2);
+    BOOST_CHECK_EQUAL(after.size, 2);
+
+    // Statements that don't parse throw and aren't cached
+    BOOST_CHECK_THROW(getCachedSelectStatement("not a query"),
+                      std::exception);
+    BOOST_CHECK_EQUAL(getStatementCacheStats().size, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_statement_cache_lru_eviction )
+{
+    clearStatementCache();
+    setStatementCacheSize(2);
+    StatementCacheStats before = getStatementCacheStats();
+
+    auto a = getCachedSelectStatement("select 1");
+    getCachedSelectStatement("select 2");
+
+    // Use "select 1" so that "select 2" is the least recently used
+    BOOST_CHECK_EQUAL(getCachedSelectStatement("select 1"), a);
+    getCachedSelectStatement("select 3");
+
+    StatementCacheStats stats = getStatementCacheStats();
+    BOOST_CHECK_EQUAL(stats.size, 2);
+    BOOST_CHECK_EQUAL(stats.evictions - before.evictions, 1);
+
+    // Still cached
+    BOOST_CHECK_EQUAL(getCachedSelectStatement("select 1"), a);
+    BOOST_CHECK_EQUAL(getStatementCacheStats().hits - before.hits, 2);
+
+    // Evicted, so parsed again
+    getCachedSelectStatement("select 2");
+    BOOST_CHECK_EQUAL(getStatementCacheStats().misses - before.misses, 4);
+
+    // A size of zero disables the cache
+    setStatementCacheSize(0);
+    BOOST_CHECK_EQUAL(getStatementCacheStats().size, 0);
+    BOOST_CHECK_NE(getCachedSelectStatement("select 1"), a);
+    BOOST_CHECK_EQUAL(getStatementCacheStats().size, 0);
+
+    setStatementCacheSize(1000);
+}
@@ -5,6 +5,8 @@
 # This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
 #
 
+import gzip
+import os
 import tempfile
 import unittest
 
@@ -34,6 +36,11 @@ class CsvExportAdvancedTest(unittest.TestCase):
 
         mldb.post('/v1/datasets/myDataset/commit', {})
 
+        ds = mldb.create_dataset({'id' : 'numbers', 'type' : 'sparse.mutable'})
+        for i in range(10000):
+            ds.record_row('r%d' % i, [['x', i, 0]])
+        ds.commit()
+
     def log_tmp_file(self):
         f = open(tmp_file.name, 'rt')
         for line in f.readlines():
@@ -119,6 +126,49 @@ class CsvExportAdvancedTest(unittest.TestCase):
                         'foo,,4,A4,,C4,,']
         self.assert_file_content(lines_expect)
 
+    def test_many_rows_in_order(self):
+        """
+        Rows are formatted in parallel in chunks; they must still come out
+        in the order of the query.
+        """
+        mldb.put('/v1/procedures/export', {
+            'type' : 'export.csv',
+            'params' : {
+                'exportData' :
+                    'select x, x * 2 as y from numbers '
+                    'order by x',
+                'dataFileUrl' : 'file://' + tmp_file.name
+            }
+        })
+        mldb.post('/v1/procedures/export/runs')
+
+        lines_expect = ['x,y'] + ['%d,%d' % (i, i * 2) for i in range(10000)]
+        self.assert_file_content(lines_expect)
+
+    def test_multiple_compressed_files(self):
+        tmp_dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        mldb.put('/v1/procedures/export', {
+            'type' : 'export.csv',
+            'params' : {
+                'exportData' :
+                    'select x from numbers order by x',
+                'dataFileUrl' : 'file://' + tmp_dir + '/out.csv.gz',
+                'numFiles' : 3
+            }
+        })
+        mldb.post('/v1/procedures/export/runs')
+
+        values = []
+        for i in range(3):
+            name = tmp_dir + '/out-%05d.csv.gz' % i
+            lines = gzip.open(name, 'rb').read().splitlines()
+            self.assertEqual(lines[0], 'x')
+            file_values = [int(v) for v in lines[1:]]
+            self.assertEqual(file_values, sorted(file_values))
+            values.extend(file_values)
+        self.assertEqual(sorted(values), list(range(10000)))
+        self.assertFalse(os.path.exists(tmp_dir + '/out.csv.gz'))
+
 
 if __name__ == '__main__':
     mldb.run_tests()
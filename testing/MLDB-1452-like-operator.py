@@ -228,5 +228,27 @@ class LikeTest(MldbUnitTest):  # noqa
 
         self.assertEqual(res1[1], res2[1]);
 
+    def test_like_literals(self):
+        """
+        Patterns that are a single literal are matched without a regex;
+        all of the characters other than % and _ must match themselves.
+        """
+        def like(value, pattern):
+            return mldb.query("select '%s' LIKE '%s' as v" % (value, pattern))[1][1]
+
+        self.assertEqual(like('abcdef', 'abc%'), 1)
+        self.assertEqual(like('xabcdef', 'abc%'), 0)
+        self.assertEqual(like('abcdef', '%def'), 1)
+        self.assertEqual(like('abcdefx', '%def'), 0)
+        self.assertEqual(like('abcdef', '%cde%'), 1)
+        self.assertEqual(like('abcdef', '%ced%'), 0)
+        self.assertEqual(like('abc', 'abc'), 1)
+        self.assertEqual(like('abcd', 'abc'), 0)
+        self.assertEqual(like('a+c', 'a+c'), 1)
+        self.assertEqual(like('aac', 'a+c'), 0)
+        self.assertEqual(like('a\\c', '%\\%'), 1)
+        self.assertEqual(like(u'h\u00e9llo', 'h_llo'), 1)
+        self.assertEqual(like(u'h\u00e9llo', u'%\u00e9l%'), 1)
+
 
 mldb.run_tests()
@@ -0,0 +1,91 @@
+#
+# approx_aggregators_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the approx_count_distinct, approx_quantile, approx_median and
+# approx_top_k aggregators.
+#
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class ApproxAggregatorsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(1000):
+            label = 'a' if i % 2 == 0 else 'b' if i % 3 == 0 else 'c'
+            ds.record_row('r' + str(i), [['x', i, 0],
+                                         ['y', i % 10, 0],
+                                         ['g', i % 2, 0],
+                                         ['label', label, 0]])
+        ds.commit()
+
+    def test_count_distinct(self):
+        res = mldb.query("""
+            select approx_count_distinct(y) as y,
+                   approx_count_distinct(x) as x,
+                   count_distinct(x) as exact
+            from ds""")
+        self.assertEqual(res[1][1:], [10, 1000, 1000])
+
+    def test_count_distinct_group_by(self):
+        self.assertTableResultEquals(
+            mldb.query("""
+                select g, approx_count_distinct(y) as n from ds
+                group by g order by g"""),
+            [["_rowName", "g", "n"],
+             ["[0]", 0, 5],
+             ["[1]", 1, 5]])
+
+    def test_row_wise(self):
+        res = mldb.query("""
+            select approx_count_distinct({x, y}) as d,
+                   approx_median({x, y}) as m
+            from ds""")
+        self.assertEqual(res[0][1:], ['d.x', 'd.y', 'm.x', 'm.y'])
+        self.assertEqual(res[1][1:3], [1000, 10])
+        self.assertAlmostEqual(res[1][3], 499.5, delta=5)
+        self.assertAlmostEqual(res[1][4], 4.5, delta=0.5)
+
+    def test_quantiles(self):
+        res = mldb.query("""
+            select approx_quantile(x, 0.1) as q10,
+                   approx_median(x) as q50,
+                   approx_quantile(x, 0.9) as q90
+            from ds""")
+        self.assertAlmostEqual(res[1][1], 99.5, delta=5)
+        self.assertAlmostEqual(res[1][2], 499.5, delta=5)
+        self.assertAlmostEqual(res[1][3], 899.5, delta=5)
+
+    def test_quantile_out_of_range(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("select approx_quantile(x, 2) from ds")
+
+    def test_top_k(self):
+        # label is a for 500 rows, c for 333 and b for 167
+        res = mldb.query("select approx_top_k(label, 2) as * from ds")
+        self.assertEqual(dict(zip(res[0][1:], res[1][1:])),
+                         {'0.value': 'a', '0.count': 500,
+                          '1.value': 'c', '1.count': 333})
+
+    def test_top_k_types(self):
+        # The number 1 and the string '1' are different values
+        ds = mldb.create_dataset({'id': 'mixed', 'type': 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('r' + str(i), [['v', 1 if i < 6 else '1', 0]])
+        ds.commit()
+
+        res = mldb.get('/v1/query', format='aos',
+                       q="select approx_top_k(v, 5) as top "
+                         "from mixed").json()
+        self.assertEqual(res[0]['top.0.value'], 1)
+        self.assertEqual(res[0]['top.0.count'], 6)
+        self.assertEqual(res[0]['top.1.value'], '1')
+        self.assertEqual(res[0]['top.1.count'], 4)
+
+    def test_top_k_invalid(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("select approx_top_k(label, 0) from ds")
+
+mldb.run_tests()
@@ -0,0 +1,177 @@
+#
+# boosted_trees_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the boostedtrees.binary.train procedure.
+#
+
+import math
+import random
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class BoostedTreesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1234)
+        for name in ['train', 'test']:
+            ds = mldb.create_dataset({'id': name, 'type': 'tabular'})
+            for i in range(5000):
+                x = random.uniform(-1, 1)
+                y = random.uniform(-1, 1)
+                color = random.choice(['red', 'green', 'blue'])
+                noise = random.uniform(-1, 1)
+                # Not separable by a single split on any feature
+                label = (x * y > 0) != (color == 'blue')
+                ds.record_row('r%d' % i, [['x', x, 0], ['y', y, 0],
+                                          ['color', color, 0],
+                                          ['noise', noise, 0],
+                                          ['label', label, 0]])
+            ds.commit()
+
+    def train(self, name, **params):
+        config = {
+            'trainingData': """
+                SELECT {* EXCLUDING (label)} AS features, label
+                FROM train
+            """,
+            'modelFileUrl': 'file://tmp/boosted_trees_%s.cls' % name,
+            'functionName': name,
+            'numRounds': 50,
+            'runOnCreation': True
+        }
+        config.update(params)
+        return mldb.put('/v1/procedures/' + name, {
+            'type': 'boostedtrees.binary.train',
+            'params': config
+        }).json()['status']['firstRun']['status']
+
+    def auc(self, name):
+        res = mldb.put('/v1/procedures/test_' + name, {
+            'type': 'classifier.test',
+            'params': {
+                'testingData': """
+                    SELECT {name}({{{{* EXCLUDING (label)}} AS features}})[score]
+                               AS score,
+                           label
+                    FROM test
+                """.format(name=name),
+                'runOnCreation': True
+            }
+        })
+        return res.json()['status']['firstRun']['status']['auc']
+
+    def test_train(self):
+        status = self.train('gbdt')
+        self.assertEqual(status['numTrees'], 50)
+        self.assertLess(status['trainingLoss'], 0.3)
+        self.assertGreater(self.auc('gbdt'), 0.95)
+
+    def test_score_is_log_odds(self):
+        self.train('gbdt_small', numRounds=5, maxLeaves=4)
+        res = mldb.query("""
+            SELECT gbdt_small({{* EXCLUDING (label)} AS features})[score]
+                       AS score
+            FROM test LIMIT 100
+        """)
+        for row in res[1:]:
+            # Starts from log odds near zero, and each tree adds at most
+            # a little
+            self.assertLess(abs(row[1]), 5)
+
+    def test_row_sampling(self):
+        status = self.train('gbdt_sampled', rowSamplingProp=0.5,
+                            maxLeaves=8, maxDepth=3)
+        self.assertEqual(status['numTrees'], 50)
+        self.assertGreater(self.auc('gbdt_sampled'), 0.9)
+
+    def test_missing_values(self):
+        # Rows without an x mostly have a true label, so the nulls need to
+        # go a different way from the values around them.  Rows without
+        # any nulls never take a missing branch, so the loss of the scored
+        # function over them must be as low as the one reached in training.
+        random.seed(5678)
+        ds = mldb.create_dataset({'id': 'train_missing', 'type': 'tabular'})
+        for i in range(5000):
+            x = random.uniform(-1, 1)
+            color = random.choice(['red', 'green', 'blue', None])
+            missing = random.random() < 0.3
+            label = (missing or x > 0.5) != (color == 'blue')
+            cols = [['label', label, 0]]
+            if not missing:
+                cols.append(['x', x, 0])
+            if color is not None:
+                cols.append(['color', color, 0])
+            ds.record_row('r%d' % i, cols)
+        ds.commit()
+
+        status = self.train('gbdt_missing', numRounds=20, trainingData="""
+            SELECT {* EXCLUDING (label)} AS features, label
+            FROM train_missing
+        """)
+        self.assertLess(status['trainingLoss'], 0.1)
+
+        res = mldb.get('/v1/query', format='aos', q="""
+            SELECT gbdt_missing({{* EXCLUDING (label)} AS features})[score]
+                       AS score,
+                   label
+            FROM train_missing
+            WHERE x IS NOT NULL AND color IS NOT NULL
+        """).json()
+        self.assertGreater(len(res), 2000)
+
+        loss = 0
+        for row in res:
+            p = 1.0 / (1.0 + math.exp(-row['score']))
+            loss -= math.log(p if row['label'] else 1.0 - p)
+        self.assertLess(loss / len(res), 0.1)
+
+    def test_missing_values_tree_size(self):
+        # x is mostly small, and its label flips with each value, so each
+        # split peels the smallest remaining value off and the trees are
+        # chains.  Every split is on x, which is often null; the exported
+        # trees must have a missing leaf per split rather than a copy of
+        # the rest of the chain.
+        random.seed(91011)
+        ds = mldb.create_dataset({'id': 'train_chain', 'type': 'tabular'})
+        for i in range(5000):
+            x = 0
+            while x < 30 and random.random() < 0.8:
+                x += 1
+            cols = [['label', x % 2 == 1, 0]]
+            if random.random() >= 0.2:
+                cols.append(['x', x, 0])
+            ds.record_row('r%d' % i, cols)
+        ds.commit()
+
+        max_leaves = 31
+        self.train('gbdt_chain', numRounds=3, maxLeaves=max_leaves,
+                   maxDepth=30, minLeafExamples=1, trainingData="""
+            SELECT {* EXCLUDING (label)} AS features, label
+            FROM train_chain
+        """)
+
+        def count_nodes(tree):
+            if tree is None:
+                return 0
+            if tree['type'] == 'leaf':
+                return 1
+            return 1 + sum(count_nodes(tree[child])
+                           for child in ['true', 'false', 'missing'])
+
+        details = mldb.get('/v1/functions/gbdt_chain/details').json()
+        trees = details['model']['params']['classifiers']
+        self.assertEqual(len(trees), 3)
+        for tree in trees:
+            # maxLeaves leaves and their maxLeaves - 1 splits, each of
+            # which also has a missing leaf
+            self.assertLessEqual(
+                count_nodes(tree['params']['tree']['root']),
+                3 * max_leaves - 2)
+
+    def test_invalid_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.train('gbdt_invalid', learningRate=0)
+
+mldb.run_tests()
@@ -0,0 +1,117 @@
+#
+# column_batch_scan_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that WHERE clauses evaluated over column-oriented batches of a wide
+# dataset give the same rows as evaluating them row by row.
+#
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class ColumnBatchScanTest(MldbUnitTest):  # noqa
+
+    num_rows = 5000
+    num_cols = 50
+
+    @classmethod
+    def setUpClass(cls):
+        for kind in ['tabular', 'sparse.mutable']:
+            ds = mldb.create_dataset({'id': kind, 'type': kind})
+            for i in range(cls.num_rows):
+                row = [['c' + str(j), i * j % 97, 0]
+                       for j in range(cls.num_cols)]
+                # Some values are missing, some are strings and some
+                # are floating point
+                if i % 7 != 0:
+                    row.append(['maybe', i % 13, 0])
+                row.append(['label', 'l' + str(i % 5), 0])
+                row.append(['x', i / 4.0, 0])
+                ds.record_row('r' + str(i), row)
+            ds.commit()
+
+    def rows_where(self, ds, where, extra=''):
+        res = mldb.get('/v1/query', format='aos',
+                       q='select rowName() as r from {} where {} {}'
+                         .format(ds, where, extra)).json()
+        return sorted(r['r'] for r in res)
+
+    def check(self, where, expected_count=None):
+        tabular = self.rows_where('tabular', where)
+        sparse = self.rows_where('"sparse.mutable"', where)
+        self.assertEqual(tabular, sparse)
+        if expected_count is not None:
+            self.assertEqual(len(tabular), expected_count)
+
+    def test_comparisons(self):
+        self.check('c3 > 50')
+        self.check('c3 > 50 and c7 <= 20')
+        self.check('c1 = 5 or c2 = 5')
+        self.check('not (c49 < 10)')
+        self.check('x >= 100.5 and x < 200')
+        self.check('label = \'l3\'', self.num_rows // 5)
+
+    def test_nulls(self):
+        self.check('maybe IS NULL', (self.num_rows + 6) // 7)
+        self.check('maybe > 6')
+        self.check('maybe + c1 > 100')
+        self.check('missing_column = 1', 0)
+
+    def test_alias(self):
+        res = mldb.get('/v1/query', format='aos',
+                       q='select rowName() as r from tabular as t '
+                         'where t.c3 > 50').json()
+        self.assertEqual(sorted(r['r'] for r in res),
+                         self.rows_where('tabular', 'c3 > 50'))
+
+    def test_select_few_columns(self):
+        # Rows are read with just the columns that the select uses
+        def select(ds, extra=''):
+            return mldb.get('/v1/query', format='aos',
+                            q='select c3, maybe, c7 + x as y from {} '
+                              'where c5 < 30 {}'.format(ds, extra)).json()
+
+        tabular = select('tabular', 'order by rowName()')
+        self.assertEqual(tabular,
+                         select('"sparse.mutable"', 'order by rowName()'))
+        self.assertEqual(sorted(tabular, key=lambda r: r['_rowName']),
+                         sorted(select('tabular'),
+                                key=lambda r: r['_rowName']))
+        for row in tabular:
+            i = int(row['_rowName'][1:])
+            self.assertEqual(row['c3'], i * 3 % 97)
+            self.assertEqual(row['y'], i * 7 % 97 + i / 4.0)
+            self.assertEqual(row.get('maybe'),
+                             None if i % 7 == 0 else i % 13)
+
+    def test_select_computed_columns(self):
+        # Computed columns are selected over batches of rows, which must
+        # give the same values as selecting them one row at a time
+        def select(ds):
+            res = mldb.get('/v1/query', format='aos',
+                           q='select c3 * 2 as d, maybe is null as m, '
+                             'x > 100 as big, c3 + maybe as s, '
+                             'rowName() as n from {} where c5 < 30'
+                             .format(ds)).json()
+            return sorted(res, key=lambda r: r['_rowName'])
+
+        tabular = select('tabular')
+        self.assertEqual(tabular, select('"sparse.mutable"'))
+        for row in tabular:
+            i = int(row['_rowName'][1:])
+            self.assertEqual(row['d'], i * 3 % 97 * 2)
+            self.assertEqual(row['m'], i % 7 == 0)
+            self.assertEqual(row['big'], i / 4.0 > 100)
+            self.assertEqual(row.get('s'),
+                             None if i % 7 == 0 else i * 3 % 97 + i % 13)
+            self.assertEqual(row['n'], row['_rowName'])
+
+    def test_limit_offset(self):
+        all_rows = self.rows_where('tabular', 'c5 < 30',
+                                   'order by rowName()')
+        paged = []
+        for offset in range(0, len(all_rows), 300):
+            paged += self.rows_where('tabular', 'c5 < 30',
+                                     'order by rowName() offset {} limit 300'
+                                     .format(offset))
+        self.assertEqual(sorted(paged), all_rows)
+
+mldb.run_tests()
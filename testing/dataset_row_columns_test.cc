@@ -0,0 +1,260 @@
+/** dataset_row_columns_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test that a query reads rows with just the columns that it uses, rather
+    than materializing every cell of each row.
+*/
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/bound_queries.h"
+#include "mldb/core/dataset.h"
+#include "mldb/sql/sql_expression.h"
+#include "mldb/http/http_exception.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <mutex>
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+namespace {
+
+constexpr int NUM_ROWS = 100;
+constexpr int NUM_COLUMNS = 300;
+
+/** A wide matrix whose rows are generated on demand, which counts how
+    many cells it materializes.  Row i has the value i * j in column cj.
+*/
+struct WideMatrix: public MatrixView {
+    WideMatrix()
+        : numCells(0)
+    {
+        for (int i = 0;  i < NUM_ROWS;  ++i)
+            rowNames.emplace_back("r" + to_string(i));
+        for (int j = 0;  j < NUM_COLUMNS;  ++j)
+            columnNames.emplace_back("c" + to_string(j));
+    }
+
+    std::vector<RowName> rowNames;
+    std::vector<ColumnName> columnNames;
+    mutable std::atomic<size_t> numCells;
+
+    static int number(const Path & name)
+    {
+        return std::stoi(name.toUtf8String().rawString().substr(1));
+    }
+
+    virtual std::vector<RowName>
+    getRowNames(ssize_t start = 0, ssize_t limit = -1) const
+    {
+        size_t end = limit == -1 ? rowNames.size() : start + limit;
+        end = std::min(end, rowNames.size());
+        return std::vector<RowName>(rowNames.begin() + start,
+                                    rowNames.begin() + end);
+    }
+
+    virtual std::vector<RowHash>
+    getRowHashes(ssize_t start = 0, ssize_t limit = -1) const
+    {
+        std::vector<RowHash> result;
+        for (auto & r: getRowNames(start, limit))
+            result.emplace_back(r);
+        return result;
+    }
+
+    virtual size_t getRowCount() const
+    {
+        return rowNames.size();
+    }
+
+    virtual bool knownRow(const RowName & row) const
+    {
+        return std::find(rowNames.begin(), rowNames.end(), row)
+            != rowNames.end();
+    }
+
+    virtual MatrixNamedRow getRow(const RowName & row) const
+    {
+        MatrixNamedRow result;
+        result.rowName = row;
+        result.rowHash = row;
+        int i = number(row);
+        for (int j = 0;  j < NUM_COLUMNS;  ++j)
+            result.columns.emplace_back(columnNames[j], i * j, Date());
+        numCells += result.columns.size();
+        return result;
+    }
+
+    virtual RowName getRowName(const RowHash & row) const
+    {
+        for (auto & r: rowNames)
+            if (RowHash(r) == row)
+                return r;
+        throw HttpReturnException(400, "Unknown row");
+    }
+
+    virtual bool knownColumn(const ColumnName & column) const
+    {
+        return std::find(columnNames.begin(), columnNames.end(), column)
+            != columnNames.end();
+    }
+
+    virtual ColumnName getColumnName(ColumnHash column) const
+    {
+        for (auto & c: columnNames)
+            if (ColumnHash(c) == column)
+                return c;
+        throw HttpReturnException(400, "Unknown column");
+    }
+
+    virtual std::vector<ColumnName> getColumnNames() const
+    {
+        return columnNames;
+    }
+
+    virtual size_t getColumnCount() const
+    {
+        return columnNames.size();
+    }
+};
+
+/** Dataset over a WideMatrix, which can read some columns of a row without
+    generating the others.
+*/
+struct WideDataset: public Dataset {
+    WideDataset(MldbServer * server)
+        : Dataset(server), matrix(std::make_shared<WideMatrix>())
+    {
+    }
+
+    std::shared_ptr<WideMatrix> matrix;
+
+    virtual Any getStatus() const
+    {
+        return Any();
+    }
+
+    virtual std::shared_ptr<MatrixView> getMatrixView() const
+    {
+        return matrix;
+    }
+
+    virtual std::shared_ptr<ColumnIndex> getColumnIndex() const
+    {
+        return nullptr;
+    }
+
+    virtual ExpressionValue
+    getRowColumnsExpr(const RowName & row,
+                      const std::vector<ColumnName> & columnNames) const
+    {
+        int i = WideMatrix::number(row);
+        std::vector<std::tuple<ColumnName, CellValue, Date> > result;
+        for (auto & c: columnNames)
+            result.emplace_back(c, i * WideMatrix::number(c), Date());
+        matrix->numCells += result.size();
+        return std::move(result);
+    }
+};
+
+/** Run the query over the dataset, returning its output rows by row name
+    and the number of cells that the dataset materialized for it.
+*/
+std::pair<std::map<RowName, ExpressionValue>, size_t>
+runQuery(WideDataset & dataset,
+         const std::string & select,
+         const std::string & orderBy = "")
+{
+    SelectExpression selectExpr = SelectExpression::parse(select);
+    WhenExpression when = WhenExpression::parse("true");
+    auto where = SqlExpression::parse("true");
+    OrderByExpression orderByExpr = OrderByExpression::parse(orderBy);
+
+    dataset.matrix->numCells = 0;
+
+    std::mutex mutex;
+    std::map<RowName, ExpressionValue> output;
+
+    auto onRow = [&] (RowName & rowName,
+                      ExpressionValue & val,
+                      std::vector<ExpressionValue> & calcd,
+                      int rowNum)
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            output[rowName] = std::move(val);
+            return true;
+        };
+
+    BoundSelectQuery(selectExpr, dataset, "", when, *where, orderByExpr, {})
+        .executeExpr(onRow, true /* in parallel */, 0, -1, nullptr);
+
+    return { std::move(output), dataset.matrix->numCells.load() };
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_select_some_columns )
+{
+    MldbServer server;
+    server.init();
+
+    WideDataset dataset(&server);
+
+    auto res = runQuery(dataset, "c1, c7 * 2 AS x, c299");
+    BOOST_REQUIRE_EQUAL(res.first.size(), NUM_ROWS);
+    BOOST_CHECK_EQUAL(res.second, NUM_ROWS * 3);
+
+    const ExpressionValue & row = res.first[RowName("r5")];
+    BOOST_CHECK_EQUAL(row.getColumn(PathElement("c1")).toInt(), 5);
+    BOOST_CHECK_EQUAL(row.getColumn(PathElement("x")).toInt(), 70);
+    BOOST_CHECK_EQUAL(row.getColumn(PathElement("c299")).toInt(), 1495);
+}
+
+BOOST_AUTO_TEST_CASE( test_order_by_columns_are_read )
+{
+    MldbServer server;
+    server.init();
+
+    WideDataset dataset(&server);
+
+    auto res = runQuery(dataset, "c1", "c2 DESC");
+    BOOST_CHECK_EQUAL(res.first.size(), NUM_ROWS);
+    BOOST_CHECK_EQUAL(res.second, NUM_ROWS * 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_no_columns )
+{
+    MldbServer server;
+    server.init();
+
+    WideDataset dataset(&server);
+
+    auto res = runQuery(dataset, "rowName() AS name");
+    BOOST_CHECK_EQUAL(res.first.size(), NUM_ROWS);
+    BOOST_CHECK_EQUAL(res.second, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_whole_row )
+{
+    MldbServer server;
+    server.init();
+
+    WideDataset dataset(&server);
+
+    // Wildcards and columnCount() need every column of the row
+    auto res = runQuery(dataset, "*");
+    BOOST_CHECK_EQUAL(res.first.size(), NUM_ROWS);
+    BOOST_CHECK_EQUAL(res.second, NUM_ROWS * NUM_COLUMNS);
+
+    res = runQuery(dataset, "columnCount() AS n");
+    BOOST_CHECK_EQUAL(res.second, NUM_ROWS * NUM_COLUMNS);
+    BOOST_CHECK_EQUAL(res.first[RowName("r0")]
+                      .getColumn(PathElement("n")).toInt(),
+                      NUM_COLUMNS);
+}
@@ -0,0 +1,99 @@
+#
+# embedding_hnsw_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the HNSW nearest neighbors index of the embedding dataset.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+NUM_DIMS = 16
+
+class EmbeddingHnswTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(2016)
+        cls.points = [[random.gauss(0, 1) for d in range(NUM_DIMS)]
+                      for i in range(2000)]
+
+        exact = mldb.create_dataset({'id': 'exact', 'type': 'embedding'})
+        approx = mldb.create_dataset({
+            'id': 'approx', 'type': 'embedding',
+            'params': {'index': 'hnsw', 'hnswEfSearch': 100}
+        })
+
+        for i, p in enumerate(cls.points):
+            row = [['x%d' % d, v, 0] for d, v in enumerate(p)]
+            exact.record_row('r%d' % i, row)
+            approx.record_row('r%d' % i, row)
+            # Commit the approximate one twice, so that the second half is
+            # added to an existing index
+            if i == 999:
+                approx.commit()
+        exact.commit()
+        approx.commit()
+
+        for name in ['exact', 'approx']:
+            mldb.put('/v1/functions/nn_' + name, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': name}
+            })
+
+    def neighbors(self, name, coords, num=10):
+        res = mldb.query("""
+            SELECT nn_%s({coords: %s, numNeighbors: %d})[distances] AS *
+        """ % (name, coords, num))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_recall(self):
+        hits = 0
+        for q in range(50):
+            query = [random.gauss(0, 1) for d in range(NUM_DIMS)]
+            coords = '{%s}' % ', '.join('x%d: %.6f' % (d, v)
+                                        for d, v in enumerate(query))
+            exact = self.neighbors('exact', coords)
+            approx = self.neighbors('approx', coords)
+            self.assertEqual(len(approx), 10)
+            hits += len(set(exact.keys()) & set(approx.keys()))
+            for k in approx:
+                if k in exact:
+                    self.assertAlmostEqual(approx[k], exact[k], places=4)
+        self.assertGreater(hits / 500.0, 0.9)
+
+    def test_row_neighbors(self):
+        # Both halves of the rows are found from themselves
+        for row in ['r0', 'r500', 'r1000', 'r1999']:
+            res = self.neighbors('approx', "'%s'" % row, 3)
+            self.assertEqual(res[row], 0)
+
+    def test_row_count(self):
+        self.assertEqual(mldb.query('SELECT count(*) FROM approx')[1][1],
+                         2000)
+
+    def test_cosine(self):
+        ds = mldb.create_dataset({
+            'id': 'approx_cosine', 'type': 'embedding',
+            'params': {'index': 'hnsw', 'metric': 'cosine'}
+        })
+        for i, p in enumerate(self.points[:200]):
+            ds.record_row('r%d' % i, [['x%d' % d, v, 0]
+                                      for d, v in enumerate(p)])
+        ds.commit()
+        mldb.put('/v1/functions/nn_cosine', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'approx_cosine'}
+        })
+        res = self.neighbors('cosine', "'r10'", 1)
+        self.assertEqual(list(res.keys()), ['r10'])
+
+    def test_invalid_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.put('/v1/datasets/invalid_hnsw', {
+                'type': 'embedding',
+                'params': {'index': 'hnsw', 'hnswM': 1}
+            })
+
+mldb.run_tests()
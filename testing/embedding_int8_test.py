@@ -0,0 +1,84 @@
+#
+# embedding_int8_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the int8 storage of the embedding dataset.
+#
+
+import random
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+NUM_DIMS = 20
+
+class EmbeddingInt8Test(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(8)
+        cls.points = [[random.gauss(0, 1) for d in range(NUM_DIMS)]
+                      for i in range(500)]
+
+        for name, params in [
+                ('exact', {}),
+                ('int8', {'storage': 'int8'}),
+                ('int8_hnsw', {'storage': 'int8', 'index': 'hnsw'}),
+                ('int8_cosine', {'storage': 'int8', 'metric': 'cosine'})]:
+            ds = mldb.create_dataset({'id': name, 'type': 'embedding',
+                                      'params': params})
+            for i, p in enumerate(cls.points):
+                ds.record_row('r%d' % i, [['x%d' % d, v, 0]
+                                          for d, v in enumerate(p)])
+                # Commit in two goes, to check that adding rows to an
+                # existing int8 dataset works
+                if i == 249:
+                    ds.commit()
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + name, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': name}
+            })
+
+    def neighbors(self, name, coords, num=10):
+        res = mldb.query("""
+            SELECT nn_%s({coords: %s, numNeighbors: %d})[distances] AS *
+        """ % (name, coords, num))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_values(self):
+        res = mldb.query("SELECT * FROM int8 WHERE rowName() = 'r7'")
+        point = self.points[7]
+        max_abs = max(abs(v) for v in point)
+        values = dict(zip(res[0][1:], res[1][1:]))
+        self.assertEqual(len(values), NUM_DIMS)
+        for d in range(NUM_DIMS):
+            self.assertLessEqual(abs(values['x%d' % d] - point[d]),
+                                 max_abs / 254 * 1.001)
+
+    def test_column(self):
+        res = mldb.query("SELECT x3 FROM int8 ORDER BY rowName()")
+        self.assertEqual(len(res), 501)
+
+    def test_neighbors(self):
+        for name in ['int8', 'int8_hnsw']:
+            hits = 0
+            for q in range(20):
+                query = [random.gauss(0, 1) for d in range(NUM_DIMS)]
+                coords = '{%s}' % ', '.join('x%d: %.6f' % (d, v)
+                                            for d, v in enumerate(query))
+                exact = self.neighbors('exact', coords)
+                approx = self.neighbors(name, coords)
+                self.assertEqual(len(approx), 10)
+                hits += len(set(exact.keys()) & set(approx.keys()))
+                for k in approx:
+                    if k in exact:
+                        self.assertAlmostEqual(approx[k], exact[k], delta=0.05)
+            self.assertGreater(hits / 200.0, 0.85)
+
+    def test_row_neighbors(self):
+        for name in ['int8', 'int8_hnsw', 'int8_cosine']:
+            res = self.neighbors(name, "'r300'", 1)
+            self.assertEqual(res, {'r300': 0})
+
+mldb.run_tests()
@@ -0,0 +1,135 @@
+#
+# flat_tree_scoring_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that classifiers made of decision trees, which are scored from their
+# flattened form, give the same scores for a row applied on its own, in a
+# query and in a batch.  That the flattened form scores rows like the
+# classifier it was compiled from is tested in flat_tree_ensemble_test.
+#
+
+import json
+import random
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class FlatTreeScoringTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(4321)
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(1000):
+            x = random.uniform(-1, 1)
+            y = random.uniform(-1, 1)
+            color = random.choice(['red', 'green', 'blue'])
+            row = [['x', x, 0], ['color', color, 0],
+                   ['label', (x * y > 0) != (color == 'blue'), 0],
+                   ['category', color if x > 0 else 'none', 0],
+                   ['value', x * 3 + y, 0]]
+            # Leave y missing in some rows, to go down the missing branches
+            if i % 5 != 0:
+                row.append(['y', y, 0])
+            ds.record_row('r%d' % i, row)
+        ds.commit()
+
+    def train(self, name, algorithm, mode='boolean', label='label'):
+        mldb.put('/v1/procedures/train_' + name, {
+            'type': 'classifier.train',
+            'params': {
+                'trainingData': """
+                    SELECT {x, y, color} AS features, %s AS label FROM ds
+                """ % label,
+                'algorithm': algorithm,
+                'mode': mode,
+                'modelFileUrl': 'file://tmp/flat_tree_scoring_%s.cls' % name,
+                'functionName': name,
+                'runOnCreation': True
+            }
+        })
+
+    def check_scores(self, name, output='score'):
+        res = mldb.query("""
+            SELECT x, y, color, %s({{x, y, color} AS features})[%s] AS score
+            FROM ds
+            ORDER BY rowName() LIMIT 50
+        """ % (name, output))
+
+        columns = res[0]
+        rows = [dict(zip(columns, row)) for row in res[1:]]
+        inputs = [{'features': {k: values[k] for k in ['x', 'y', 'color']
+                                if values.get(k) is not None}}
+                  for values in rows]
+
+        # The batch route scores all the rows at once
+        outputs = mldb.get('/v1/functions/%s/batch' % name,
+                           inputs=json.dumps(inputs)).json()['outputs']
+        self.assertEqual(len(outputs), len(rows))
+
+        for values, inp, out in zip(rows, inputs, outputs):
+            single = mldb.get('/v1/functions/%s/application' % name,
+                              input=json.dumps(inp)).json()
+            single = single['output']
+            self.assertEqual(out, single)
+            single = single[output]
+
+            if output == 'scores':
+                batch = {k[len('score.'):]: v for k, v in values.items()
+                         if k.startswith('score.')}
+                single = dict(single)
+                self.assertEqual(sorted(batch.keys()), sorted(single.keys()))
+                for k in batch:
+                    self.assertAlmostEqual(batch[k], single[k], places=4)
+            else:
+                self.assertAlmostEqual(values['score'], single, places=4)
+
+    def test_decision_tree(self):
+        self.train('dt', 'dt')
+        self.check_scores('dt')
+
+    def test_bagged_decision_trees(self):
+        self.train('bdt', 'bdt')
+        self.check_scores('bdt')
+
+    def test_bagged_boosted_decision_trees(self):
+        self.train('bbdt', 'bbdt')
+        self.check_scores('bbdt')
+
+    def test_categorical(self):
+        self.train('dt_cat', 'dt', mode='categorical', label='category')
+        self.check_scores('dt_cat', output='scores')
+
+    def test_regression(self):
+        self.train('dt_reg', 'dt', mode='regression', label='value')
+        self.check_scores('dt_reg')
+
+    def test_random_forest(self):
+        mldb.put('/v1/procedures/train_rf', {
+            'type': 'randomforest.binary.train',
+            'params': {
+                'trainingData': """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'modelFileUrl': 'file://tmp/flat_tree_scoring_rf.cls',
+                'functionName': 'rf',
+                'runOnCreation': True
+            }
+        })
+        self.check_scores('rf')
+
+    def test_boosted_trees(self):
+        mldb.put('/v1/procedures/train_gbdt', {
+            'type': 'boostedtrees.binary.train',
+            'params': {
+                'trainingData': """
+                    SELECT {x, y, color} AS features, label FROM ds
+                """,
+                'modelFileUrl': 'file://tmp/flat_tree_scoring_gbdt.cls',
+                'functionName': 'gbdt',
+                'numRounds': 20,
+                'runOnCreation': True
+            }
+        })
+        self.check_scores('gbdt')
+
+mldb.run_tests()
@@ -20,6 +20,8 @@
 #include "mldb/jml/utils/vector_utils.h"
 
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/vfs/filter_streams.h"
+#include <unistd.h>
 
 
 using namespace std;
@@ -89,3 +91,127 @@ BOOST_AUTO_TEST_CASE( test_forEachLine_throw )
 
     BOOST_CHECK_THROW(forEachLineStr(stream, processLine), ML::Exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_forEachLineBlock_numbering )
+{
+    // Enough data for several blocks, with empty lines, DOS line endings
+    // and no newline at the end
+    vector<string> expected;
+    string data;
+    for (int i = 0;  data.size() < 50000000;  ++i) {
+        string line = i % 7 ? to_string(i) + ",some,more,text" : "";
+        expected.push_back(line);
+        data += line + (i % 11 ? "\n" : "\r\n");
+    }
+    data += "last";
+    expected.push_back("last");
+
+    istringstream stream(data);
+
+    // Boost.Test assertions aren't thread safe, so we count problems
+    vector<string> result(expected.size());
+    atomic<int> numLines(0), numErrors(0);
+    auto onLine = [&] (const char * line, size_t length,
+                       int64_t blockNumber, int64_t lineNumber)
+        {
+            if (lineNumber < 0 || lineNumber >= result.size()) {
+                ++numErrors;
+                return true;
+            }
+            result[lineNumber].assign(line, length);
+            ++numLines;
+            return true;
+        };
+
+    forEachLineBlock(stream, onLine);
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(numLines, expected.size());
+    BOOST_CHECK(result == expected);
+
+    // With a limit, we get exactly the first lines
+    istringstream stream2(data);
+    numLines = 0;
+    int64_t maxLines = expected.size() / 2;
+    auto onLine2 = [&] (const char * line, size_t length,
+                        int64_t blockNumber, int64_t lineNumber)
+        {
+            if (lineNumber >= maxLines)
+                ++numErrors;
+            ++numLines;
+            return true;
+        };
+
+    forEachLineBlock(stream2, onLine2, maxLines);
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(numLines, maxLines);
+}
+
+BOOST_AUTO_TEST_CASE( test_forEachLineBlock_mapped )
+{
+    // A file that is memory mapped is split into blocks that point into
+    // the mapping.  Blocks are 20MB, so this gives three of them, with
+    // both block boundaries falling in the middle of a line.  There is a
+    // header line that is read before the blocks, and no newline at the
+    // end.
+    string header = "header line";
+    string data = header + "\n";
+    vector<string> expected;
+    for (int i = 0;  data.size() < 45000000;  ++i) {
+        string line = to_string(i) + string(i % 97, 'x');
+        expected.push_back(line);
+        data += line + "\n";
+    }
+    data += "last";
+    expected.push_back("last");
+
+    size_t blocksStart = header.size() + 1;
+    BOOST_REQUIRE_NE(data[blocksStart + 20000000 - 1], '\n');
+    BOOST_REQUIRE_NE(data[blocksStart + 40000000 - 1], '\n');
+
+    string filename = "build/x86_64/tmp/for_each_line_mapped.txt";
+    {
+        filter_ostream out(filename);
+        out << data;
+        out.close();
+    }
+
+    filter_istream stream(filename, { { "mapped", "true" } });
+    const char * mapped;
+    size_t mappedSize;
+    std::tie(mapped, mappedSize) = stream.mapped();
+    BOOST_REQUIRE(mapped);
+    BOOST_REQUIRE_EQUAL(mappedSize, data.size());
+
+    string firstLine;
+    getline(stream, firstLine);
+    BOOST_CHECK_EQUAL(firstLine, header);
+
+    // Boost.Test assertions aren't thread safe, so we count problems
+    vector<string> result(expected.size());
+    atomic<int> numLines(0), numErrors(0), numCopied(0);
+    auto onLine = [&] (const char * line, size_t length,
+                       int64_t blockNumber, int64_t lineNumber)
+        {
+            if (lineNumber < 0 || lineNumber >= result.size()) {
+                ++numErrors;
+                return true;
+            }
+            // Lines must come straight from the mapping
+            if (line < mapped || line + length > mapped + mappedSize)
+                ++numCopied;
+            result[lineNumber].assign(line, length);
+            ++numLines;
+            return true;
+        };
+
+    forEachLineBlock(stream, onLine);
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(numCopied, 0);
+    BOOST_CHECK_EQUAL(numLines, expected.size());
+    BOOST_CHECK(result == expected);
+
+    // The whole of the stream was consumed
+    BOOST_CHECK_EQUAL((size_t)stream.tellg(), data.size());
+
+    ::unlink(filename.c_str());
+}
@@ -0,0 +1,157 @@
+#
+# function_batch_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the /v1/functions/<id>/batch route, which applies a function to
+# many inputs in a single call.
+#
+import json
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class FunctionBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put('/v1/functions/double', {
+            'type': 'sql.expression',
+            'params': {
+                'expression': 'x * 2 AS y, x + 1 AS z'
+            }
+        })
+
+        # A small dataset to train the functions that have their own
+        # batch implementation
+        ds = mldb.create_dataset({'id': 'points', 'type': 'sparse.mutable'})
+        for i in range(60):
+            x = (i % 10) / 3.0
+            y = (i * 7 % 11) / 2.0
+            ds.record_row('r' + str(i), [
+                ['x', x, 0], ['y', y, 0], ['z', (i % 4) - x, 0],
+                ['label', x + y > 4, 0],
+                ['text', ' '.join(['w' + str(i % 5), 'w' + str(i % 3),
+                                   'w' + str(i % 7)]), 0]])
+        ds.commit()
+
+        mldb.put('/v1/procedures/cls', {
+            'type': 'classifier.train',
+            'params': {
+                'trainingData': 'select {x, y, z} as features, label '
+                                'from points',
+                'configuration': {
+                    'type': 'decision_tree',
+                    'max_depth': 4,
+                    'verbosity': 0,
+                    'update_alg': 'prob'
+                },
+                'modelFileUrl': 'file://tmp/function_batch_test.cls',
+                'mode': 'boolean',
+                'functionName': 'cls',
+                'runOnCreation': True
+            }
+        })
+
+        mldb.put('/v1/procedures/kmeans', {
+            'type': 'kmeans.train',
+            'params': {
+                'trainingData': 'select x, y, z from points',
+                'numClusters': 3,
+                'modelFileUrl': 'file://tmp/function_batch_test.kms',
+                'functionName': 'kmeans',
+                'runOnCreation': True
+            }
+        })
+
+        mldb.put('/v1/procedures/svd', {
+            'type': 'svd.train',
+            'params': {
+                'trainingData': 'select x, y, z from points',
+                'modelFileUrl': 'file://tmp/function_batch_test.svd',
+                'functionName': 'svd',
+                'runOnCreation': True
+            }
+        })
+
+        mldb.put('/v1/procedures/tfidf', {
+            'type': 'tfidf.train',
+            'params': {
+                'trainingData': "select tokenize(text, {splitChars: ' '}) "
+                                "as * from points",
+                'modelFileUrl': 'file://tmp/function_batch_test.idf',
+                'functionName': 'tfidf',
+                'runOnCreation': True
+            }
+        })
+
+    def apply_one(self, inp, fn='double', **kwargs):
+        return mldb.get('/v1/functions/{}/application'.format(fn),
+                        input=json.dumps(inp), **kwargs).json()['output']
+
+    def check_batch(self, fn, inputs):
+        res = mldb.get('/v1/functions/{}/batch'.format(fn),
+                       inputs=json.dumps(inputs)).json()
+        self.assertEqual(len(res['outputs']), len(inputs))
+        for inp, out in zip(inputs, res['outputs']):
+            self.assertEqual(out, self.apply_one(inp, fn))
+
+    def points(self, name):
+        # Some points are off the training grid and some are missing a
+        # column
+        points = []
+        for i in range(25):
+            p = {'x': i / 4.0, 'y': (i * 3 % 7) / 2.0, 'z': i % 3 - 1}
+            if i % 6 == 0:
+                del p['z']
+            points.append({name: p})
+        return points
+
+    def test_classifier(self):
+        self.check_batch('cls', self.points('features'))
+
+    def test_kmeans(self):
+        self.check_batch('kmeans', self.points('embedding'))
+
+    def test_svd_embed_row(self):
+        self.check_batch('svd', self.points('row'))
+
+    def test_tfidf(self):
+        inputs = [{'input': {'w' + str(i % 5): 2, 'w' + str(i % 9): 1}}
+                  for i in range(20)]
+        # A term that was never seen in training
+        inputs.append({'input': {'unknown': 1}})
+        self.check_batch('tfidf', inputs)
+
+    def test_batch_matches_application(self):
+        inputs = [{'x': i} for i in range(20)]
+        res = mldb.get('/v1/functions/double/batch',
+                       inputs=json.dumps(inputs)).json()
+        self.assertEqual(len(res['outputs']), 20)
+        for inp, out in zip(inputs, res['outputs']):
+            self.assertEqual(out, self.apply_one(inp))
+        self.assertEqual(res['outputs'][3], {'y': 6, 'z': 4})
+
+    def test_batch_in_body(self):
+        res = mldb.get('/v1/functions/double/batch',
+                       data={'inputs': [{'x': 1}, {'x': 2}]}).json()
+        self.assertEqual(res['outputs'], [{'y': 2, 'z': 2},
+                                          {'y': 4, 'z': 3}])
+
+    def test_keep_values(self):
+        res = mldb.get('/v1/functions/double/batch',
+                       inputs=json.dumps([{'x': 5}]),
+                       keepValues=json.dumps(['y'])).json()
+        self.assertEqual(res['outputs'][0],
+                         self.apply_one({'x': 5},
+                                        keepValues=json.dumps(['y'])))
+
+    def test_empty_batch(self):
+        res = mldb.get('/v1/functions/double/batch',
+                       inputs=json.dumps([])).json()
+        self.assertEqual(res['outputs'], [])
+
+    def test_bad_inputs(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.get('/v1/functions/double/batch', inputs='{"x": 1}')
+
+if __name__ == '__main__':
+    mldb.run_tests()
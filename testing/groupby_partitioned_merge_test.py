@@ -0,0 +1,58 @@
+#
+# groupby_partitioned_merge_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that GROUP BY gives the right answer when there are enough rows and
+# groups for the aggregation to be spread over many buckets and partitions.
+#
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class GroupByPartitionedMergeTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+    num_groups = 997
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(cls.num_rows):
+            ds.record_row('row' + str(i), [['k', i % cls.num_groups, 0],
+                                           ['s', 'str' + str(i % 3), 0],
+                                           ['x', i, 0]])
+        ds.commit()
+
+    def expected_count(self, k):
+        return self.num_rows // self.num_groups \
+            + (1 if k < self.num_rows % self.num_groups else 0)
+
+    def test_groups_in_key_order(self):
+        res = mldb.query('select k, count(*) as cnt, sum(x) as total '
+                         'from ds group by k')
+        self.assertEqual(res[0], ['_rowName', 'cnt', 'k', 'total'])
+        rows = res[1:]
+        self.assertEqual(len(rows), self.num_groups)
+        for k, row in enumerate(rows):
+            self.assertEqual(row[2], k)
+            self.assertEqual(row[1], self.expected_count(k))
+            self.assertEqual(row[3], sum(range(k, self.num_rows,
+                                               self.num_groups)))
+
+    def test_composite_key(self):
+        res = mldb.query('select count(*) as cnt from ds group by k, s')
+        rows = res[1:]
+        self.assertEqual(len(rows), 3 * self.num_groups)
+        self.assertEqual(sum(row[1] for row in rows), self.num_rows)
+
+    def test_order_by_and_limit(self):
+        res = mldb.query('select k, count(*) as cnt from ds group by k '
+                         'having k > 10 order by cnt desc, k limit 5')
+        self.assertEqual([row[2] for row in res[1:]], [11, 12, 13, 14, 15])
+
+        res = mldb.query('select k from ds group by k limit 3')
+        self.assertEqual([row[1] for row in res[1:]], [0, 1, 2])
+
+    def test_empty_group(self):
+        res = mldb.query('select count(*) as cnt from ds where x < 0')
+        self.assertEqual(res[1][1], 0)
+
+mldb.run_tests()
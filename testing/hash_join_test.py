@@ -0,0 +1,167 @@
+#
+# hash_join_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of equijoins between a large table and a much smaller one, which are
+# executed with a hash join rather than by sorting both sides.
+#
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class HashJoinTest(MldbUnitTest):  # noqa
+
+    num_facts = 20000
+    num_keys = 160
+    num_dims = 100
+    num_extra_dims = 10
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'facts', 'type': 'sparse.mutable'})
+        for i in range(cls.num_facts):
+            ds.record_row('f' + str(i), [['fk', i % cls.num_keys, 0],
+                                         ['x', i, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id': 'dims', 'type': 'sparse.mutable'})
+        for i in range(cls.num_dims):
+            ds.record_row('d' + str(i), [['id', i, 0],
+                                         ['name', 'name' + str(i), 0]])
+        # Dimension rows that no fact refers to
+        for i in range(cls.num_extra_dims):
+            ds.record_row('e' + str(i), [['id', 1000 + i, 0],
+                                         ['name', 'extra' + str(i), 0]])
+        ds.commit()
+
+        # The same again, with some of the keys null
+        ds = mldb.create_dataset({'id': 'nfacts', 'type': 'sparse.mutable'})
+        for i in range(cls.num_facts):
+            cols = [['x', i, 0]]
+            if cls.nfact_key(i) is not None:
+                cols.append(['fk', cls.nfact_key(i), 0])
+            ds.record_row('f' + str(i), cols)
+        ds.commit()
+
+        ds = mldb.create_dataset({'id': 'ndims', 'type': 'sparse.mutable'})
+        for i in range(cls.num_dims + cls.num_extra_dims):
+            cols = [['name', 'name' + str(i), 0]]
+            if cls.ndim_key(i) is not None:
+                cols.append(['id', cls.ndim_key(i), 0])
+            ds.record_row('d' + str(i), cols)
+        ds.commit()
+
+    @classmethod
+    def nfact_key(cls, i):
+        return None if i % 7 == 0 else i % cls.num_keys
+
+    @classmethod
+    def ndim_key(cls, i):
+        return None if i >= cls.num_dims else i
+
+    def join(self, kind):
+        return mldb.get('/v1/query', format='aos',
+                        q='select * from facts {} join dims '
+                          'on facts.fk = dims.id'.format(kind)).json()
+
+    def num_matched(self):
+        return sum(1 for i in range(self.num_facts)
+                   if i % self.num_keys < self.num_dims)
+
+    def check_matched(self, rows):
+        for row in rows:
+            if 'facts.fk' in row and 'dims.id' in row:
+                self.assertEqual(row['facts.fk'], row['dims.id'])
+                self.assertEqual(row['dims.name'],
+                                 'name' + str(row['facts.fk']))
+
+    def test_inner(self):
+        rows = self.join('inner')
+        self.assertEqual(len(rows), self.num_matched())
+        self.check_matched(rows)
+
+    def test_left(self):
+        rows = self.join('left')
+        self.assertEqual(len(rows), self.num_facts)
+        self.check_matched(rows)
+        self.assertEqual(sum(1 for r in rows if 'dims.id' not in r),
+                         self.num_facts - self.num_matched())
+
+    def test_right(self):
+        rows = self.join('right')
+        self.assertEqual(len(rows), self.num_matched() + self.num_extra_dims)
+        self.check_matched(rows)
+        self.assertEqual(sorted(r['dims.id'] for r in rows
+                                if 'facts.fk' not in r),
+                         [1000 + i for i in range(self.num_extra_dims)])
+
+    def test_full(self):
+        rows = self.join('full')
+        self.assertEqual(len(rows), self.num_facts + self.num_extra_dims)
+        self.check_matched(rows)
+
+    def test_with_extra_condition(self):
+        num_inner = len(self.join('inner'))
+        res = mldb.get('/v1/query', format='aos',
+                       q='select * from facts join dims '
+                         'on facts.fk = dims.id and facts.x < 1000').json()
+        self.assertEqual(len(res), sum(1 for i in range(1000)
+                                       if i % self.num_keys < self.num_dims))
+        self.assertLess(len(res), num_inner)
+        self.check_matched(res)
+
+    def expected_outer_join(self, kind, cond):
+        """
+        Rows of an outer join of nfacts and ndims on their keys and the
+        given extra condition on (x, id), as (x, name) pairs with None for
+        a missing side.  Null keys match nothing.
+        """
+        dims_by_id = {}
+        for i in range(self.num_dims + self.num_extra_dims):
+            if self.ndim_key(i) is not None:
+                dims_by_id.setdefault(self.ndim_key(i), []).append(i)
+
+        result = []
+        matched_dims = set()
+        for x in range(self.num_facts):
+            matched = False
+            for d in dims_by_id.get(self.nfact_key(x), []):
+                if cond(x, self.ndim_key(d)):
+                    result.append((x, 'name' + str(d)))
+                    matched_dims.add(d)
+                    matched = True
+            if not matched and kind in ['left', 'full']:
+                result.append((x, None))
+
+        if kind in ['right', 'full']:
+            for d in range(self.num_dims + self.num_extra_dims):
+                if d not in matched_dims:
+                    result.append((None, 'name' + str(d)))
+
+        return sorted(result, key=repr)
+
+    def check_outer_join(self, kind, on, cond):
+        rows = mldb.get('/v1/query', format='aos',
+                        q='select * from nfacts {} join ndims on {}'
+                          .format(kind, on)).json()
+        self.assertEqual(sorted([(r.get('nfacts.x'), r.get('ndims.name'))
+                                 for r in rows], key=repr),
+                         self.expected_outer_join(kind, cond))
+
+    def test_outer_with_cross_condition(self):
+        # The extra condition involves both sides, so a pair of rows whose
+        # keys are equal may still not match
+        for kind in ['left', 'right', 'full']:
+            self.check_outer_join(
+                kind,
+                'nfacts.fk = ndims.id and nfacts.x % 4 <= ndims.id % 4',
+                lambda x, id: x % 4 <= id % 4)
+
+    def test_outer_with_side_condition(self):
+        # The extra condition is on nfacts alone.  In a left or full join
+        # its rows are all kept, but only some of them can match.
+        for kind in ['left', 'right', 'full']:
+            self.check_outer_join(
+                kind,
+                'nfacts.fk = ndims.id and nfacts.x < 5000',
+                lambda x, id: x < 5000)
+
+mldb.run_tests()
@@ -0,0 +1,101 @@
+#
+# json_import_projection_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that import.json gives the same result when it only parses the
+# members of each object that select, where and named refer to.
+#
+
+import json
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class JsonImportProjectionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        with open("tmp/json_projection.json", 'w') as f:
+            for i in range(500):
+                f.write(json.dumps({
+                    'id': 'row%d' % i,
+                    'x': i,
+                    'nested': {'a': i % 7, 'b': [1, 2, {'c': '}]'}]},
+                    'tags': ['t%d' % (i % 3), 'all'],
+                    'text': 'quote " and brace { and backslash \\ %d' % i,
+                    'unused': {'deep': [[[{'q': '"]'}]]], 'v': None},
+                    'flag': i % 2 == 0
+                }) + '\n')
+
+            # Member names with escapes and unusual spacing
+            f.write('{ "id" : "esc", "x\\"y": 1 , "x" : -1.5e3 }\n')
+
+    def run_import(self, name, select, where, named):
+        mldb.post('/v1/procedures', {
+            'type': 'import.json',
+            'params': {
+                'dataFileUrl': 'file://tmp/json_projection.json',
+                'outputDataset': {'id': name, 'type': 'sparse.mutable'},
+                'select': select,
+                'where': where,
+                'named': named,
+                'runOnCreation': True
+            }
+        })
+
+    def assert_same(self, select, where='true', named='id'):
+        self.run_import('projected', select, where, named)
+
+        # Using a wildcard means that every member is needed, so this one
+        # parses each line in full
+        self.run_import('full', select,
+                        'horizontal_count({*}) >= 0 AND (' + where + ')',
+                        named)
+
+        expected = mldb.query('SELECT * FROM full ORDER BY rowName()')
+        res = mldb.query('SELECT * FROM projected ORDER BY rowName()')
+        self.assertEqual(res, expected)
+        self.assertGreater(len(res), 1)
+
+        mldb.delete('/v1/datasets/projected')
+        mldb.delete('/v1/datasets/full')
+
+    def test_simple_select(self):
+        self.assert_same('x, text')
+
+    def test_nested_and_arrays(self):
+        self.assert_same('nested.a AS a, nested, tags')
+
+    def test_where(self):
+        self.assert_same('x', where='flag AND nested.a > 2')
+
+    def test_named(self):
+        self.assert_same('x * 2 AS y', named="'r' + text")
+
+    def test_wildcard(self):
+        self.assert_same('* EXCLUDING (unused*)')
+
+    def test_bad_lines(self):
+        with open("tmp/json_projection_bad.json", 'w') as f:
+            f.write('{"x": 1, "y": 2}\n')
+            f.write('{"x": 2, "y": [1, 2}\n')
+            f.write('{"x": 3, "y": 2} extra\n')
+            f.write('{"x": 4, "y": 2}\n')
+
+        res = mldb.post('/v1/procedures', {
+            'type': 'import.json',
+            'params': {
+                'dataFileUrl': 'file://tmp/json_projection_bad.json',
+                'outputDataset': {'id': 'bad', 'type': 'sparse.mutable'},
+                'select': 'x',
+                'ignoreBadLines': True,
+                'runOnCreation': True
+            }
+        }).json()
+
+        self.assertEqual(res['status']['firstRun']['status'],
+                         {'rowCount': 2, 'numLineErrors': 2})
+
+        res = mldb.query('SELECT x FROM bad ORDER BY x')
+        self.assertEqual([r[1] for r in res[1:]], [1, 4])
+
+mldb.run_tests()
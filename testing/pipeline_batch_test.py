@@ -0,0 +1,59 @@
+#
+# pipeline_batch_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that queries executed by the pipeline (sub-selects and joins), which
+# process rows in batches spread over threads, keep their row order and
+# respect their limits.
+#
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class PipelineBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'numbers', 'type': 'sparse.mutable'})
+        for i in range(5000):
+            ds.record_row('r' + str(i), [['x', i, 0], ['y', i % 10, 0]])
+        ds.commit()
+
+        ds = mldb.create_dataset({'id': 'digits', 'type': 'sparse.mutable'})
+        for i in range(10):
+            ds.record_row('d' + str(i), [['y', i, 0], ['sq', i * i, 0]])
+        ds.commit()
+
+    def test_sub_select_order(self):
+        res = mldb.query("""
+            SELECT x * 2 AS x2
+            FROM (SELECT x FROM numbers ORDER BY x DESC)
+            WHERE x % 3 = 0
+        """)
+        values = [r[1] for r in res[1:]]
+        self.assertEqual(values, [i * 2 for i in range(4999, -1, -1)
+                                  if i % 3 == 0])
+
+    def test_sub_select_limit_offset(self):
+        res = mldb.query("""
+            SELECT x
+            FROM (SELECT x FROM numbers ORDER BY x)
+            WHERE x % 2 = 1
+            LIMIT 5 OFFSET 1000
+        """)
+        self.assertEqual([r[1] for r in res[1:]],
+                         [2001, 2003, 2005, 2007, 2009])
+
+    def test_join(self):
+        res = mldb.query("""
+            SELECT n.x AS x, d.sq AS sq
+            FROM numbers AS n JOIN digits AS d ON n.y = d.y
+            WHERE n.x < 2000
+            ORDER BY n.x
+        """)
+        self.assertEqual(len(res), 2001)
+        for r in res[1:]:
+            self.assertEqual(r[res[0].index('sq')],
+                             (r[res[0].index('x')] % 10) ** 2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,67 @@
+#
+# python_columnar_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of mldb.query_columnar() and mldb.get_embedding_array(), which return
+# query results as NumPy arrays.
+#
+import math
+import numpy
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class PythonColumnarTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        ds.record_row('a', [['x', 1, 0], ['y', 0.5, 0], ['label', 'yes', 0]])
+        ds.record_row('b', [['x', 2, 0], ['label', 'no', 0]])
+        ds.record_row('c', [['x', 3, 0], ['y', 1.5, 0]])
+        ds.commit()
+
+    def test_numeric_columns(self):
+        res = mldb.query_columnar('select x, y from ds order by rowName()')
+        self.assertEqual(res['_rowName'], ['a', 'b', 'c'])
+        self.assertIsInstance(res['x'], numpy.ndarray)
+        self.assertEqual(res['x'].dtype, numpy.float64)
+        self.assertEqual(list(res['x']), [1, 2, 3])
+        self.assertEqual(res['y'][0], 0.5)
+        self.assertTrue(math.isnan(res['y'][1]))
+        self.assertEqual(res['y'][2], 1.5)
+
+    def test_mixed_columns(self):
+        res = mldb.query_columnar('select label, x from ds order by rowName()')
+        self.assertEqual(res['label'].dtype, numpy.object_)
+        self.assertEqual(list(res['label']), ['yes', 'no', None])
+        self.assertEqual(res['x'].sum(), 6)
+
+    def test_array_outlives_query(self):
+        x = mldb.query_columnar('select x from ds order by rowName()')['x']
+        mldb.query_columnar('select y from ds')
+        self.assertEqual(list(x), [1, 2, 3])
+
+    def test_no_rows(self):
+        res = mldb.query_columnar('select x from ds where x > 10')
+        self.assertEqual(res, {'_rowName': []})
+
+    def test_embedding_array(self):
+        arr, rows, cols = mldb.get_embedding_array(
+            'select x, y from ds order by rowName()')
+        self.assertEqual(arr.shape, (3, 2))
+        self.assertEqual(rows, ['a', 'b', 'c'])
+        self.assertEqual(cols, ['x', 'y'])
+        self.assertEqual(list(arr[:, 0]), [1, 2, 3])
+        self.assertEqual(arr[2, 1], 1.5)
+        self.assertTrue(math.isnan(arr[1, 1]))
+
+    def test_embedding_array_non_numeric(self):
+        with self.assertRaises(Exception):
+            mldb.get_embedding_array('select * from ds')
+
+    def test_bad_query(self):
+        with self.assertRaises(Exception):
+            mldb.query_columnar('select x from')
+
+if __name__ == '__main__':
+    mldb.run_tests()
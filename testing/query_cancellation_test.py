@@ -0,0 +1,71 @@
+#
+# query_cancellation_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of query timeouts and memory limits, and of cancelling procedure
+# runs that are in progress.
+#
+import time
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class QueryCancellationTest(MldbUnitTest):  # noqa
+
+    # Joining this with itself three times is far too much work to finish
+    slow_query = """
+        select count(*) from ds as a join ds as b join ds as c
+    """
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(2000):
+            ds.record_row('r' + str(i), [['x', i, 0]])
+        ds.commit()
+
+    def test_timeout(self):
+        before = time.time()
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/query', q=self.slow_query, timeout=0.5)
+        self.assertEqual(re.exception.response.status_code, 504)
+        self.assertLess(time.time() - before, 30)
+
+    def test_no_timeout(self):
+        res = mldb.get('/v1/query', q='select count(*) as n from ds',
+                       timeout=60, format='table').json()
+        self.assertEqual(res[1][1], 2000)
+
+    def test_memory_limit(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/query', q='select x from ds order by x',
+                     memoryLimit=1000)
+        self.assertIn('memory limit', re.exception.response.text)
+
+        # Without a limit, the same query works
+        res = mldb.get('/v1/query', q='select x from ds order by x',
+                       memoryLimit=0, format='table').json()
+        self.assertEqual(len(res), 2001)
+
+    def test_cancel_procedure_run(self):
+        mldb.put('/v1/procedures/slow', {
+            'type': 'transform',
+            'params': {
+                'inputData': self.slow_query,
+                'outputDataset': {'id': 'slow_output',
+                                  'type': 'sparse.mutable'}
+            }
+        })
+
+        location = mldb.post_async('/v1/procedures/slow/runs') \
+            .headers['Location']
+        time.sleep(0.5)
+
+        before = time.time()
+        mldb.delete(location)
+        self.assertLess(time.time() - before, 30)
+
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get(location)
+        self.assertEqual(re.exception.response.status_code, 404)
+
+mldb.run_tests()
@@ -0,0 +1,145 @@
+#
+# query_streaming_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that query results that are large enough to be streamed come back
+# the same in each output format as when they are sent all at once.
+#
+import csv
+import json
+import multiprocessing
+import requests
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(cls.num_rows):
+            row = [['x', i, 0], ['label', 'a,"b"\n' + str(i % 3), 0]]
+            if i % 2:
+                row.append(['odd', 1.5, 0])
+            ds.record_row('r' + str(i), row)
+        ds.commit()
+
+    def query(self, fmt, extra=''):
+        return mldb.get('/v1/query',
+                        q='select * from ds order by x ' + extra,
+                        format=fmt)
+
+    def expected_aos(self, num_rows):
+        result = []
+        for i in range(num_rows):
+            row = {'_rowName': 'r' + str(i), 'x': i,
+                   'label': 'a,"b"\n' + str(i % 3)}
+            if i % 2:
+                row['odd'] = 1.5
+            result.append(row)
+        return result
+
+    def test_aos(self):
+        self.assertEqual(self.query('aos').json(),
+                         self.expected_aos(self.num_rows))
+
+    def test_ndjson(self):
+        lines = self.query('ndjson').text.splitlines()
+        self.assertEqual([json.loads(l) for l in lines],
+                         self.expected_aos(self.num_rows))
+
+    def test_full(self):
+        res = self.query('full').json()
+        self.assertEqual(len(res), self.num_rows)
+        self.assertEqual([r['rowName'] for r in res],
+                         ['r' + str(i) for i in range(self.num_rows)])
+
+    def test_sparse(self):
+        res = self.query('sparse').json()
+        self.assertEqual(len(res), self.num_rows)
+        self.assertEqual(res[1], [['_rowName', 'r1'],
+                                  ['label', 'a,"b"\n1'],
+                                  ['odd', 1.5],
+                                  ['x', 1]])
+
+    def test_table_and_csv(self):
+        table = self.query('table', 'limit 5000').json()
+        self.assertEqual(len(table), 5001)
+        header = table[0]
+        self.assertEqual(sorted(header),
+                         ['_rowName', 'label', 'odd', 'x'])
+
+        res = self.query('csv', 'limit 5000')
+        lines = list(csv.reader(res.text.splitlines(True)))
+        self.assertEqual(lines[0], header)
+        self.assertEqual(len(lines), len(table))
+        for t, c in zip(table[1:], lines[1:]):
+            self.assertEqual(c, ['' if v is None else str(v) for v in t])
+
+    def test_empty(self):
+        res = mldb.get('/v1/query', q='select * from ds where x < 0',
+                       format='aos')
+        self.assertEqual(res.json(), [])
+        res = mldb.get('/v1/query', q='select * from ds where x < 0',
+                       format='ndjson')
+        self.assertEqual(res.text, '')
+
+    def test_small_results_not_chunked(self):
+        res = self.query('aos', 'limit 2')
+        self.assertEqual(res.json(), self.expected_aos(2))
+
+    def test_errors(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/query', q='select * from ds', format='unknown')
+        self.assertEqual(re.exception.response.status_code, 400)
+
+        # Errors before any output is produced are still ordinary errors
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.get('/v1/query', q='select * from nonexistent',
+                     format='aos')
+
+    def test_slow_http_clients(self):
+        # Over a real HTTP connection, start more streaming queries than
+        # there are event loop threads, and only read the start of each.
+        # Each row is padded so that the response is far bigger than the
+        # socket buffers, which means the queries are held back waiting
+        # for their clients.
+        q = "select x, '" + 'p' * 2000 + "' as pad from ds order by x"
+        num_streams = max(16, 2 * multiprocessing.cpu_count())
+        streams = []
+        try:
+            for i in range(num_streams):
+                res = requests.get(url + '/v1/query',
+                                   params={'q': q, 'format': 'ndjson'},
+                                   stream=True, timeout=60)
+                self.assertEqual(res.status_code, 200)
+                self.assertEqual(res.headers['Transfer-Encoding'],
+                                 'chunked')
+                next(res.iter_content(1024))
+                streams.append(res)
+
+            # The server must still answer other requests meanwhile
+            res = requests.get(url + '/v1/datasets', timeout=30)
+            self.assertEqual(res.json(), ['ds'])
+
+            # Once read (which decodes the chunked framing) a held back
+            # response is complete, with every row in order
+            res = requests.get(url + '/v1/query',
+                               params={'q': q, 'format': 'ndjson'},
+                               stream=True, timeout=60)
+            num_lines = 0
+            for line in res.iter_lines():
+                row = json.loads(line)
+                self.assertEqual(row['x'], num_lines)
+                self.assertEqual(len(row['pad']), 2000)
+                num_lines += 1
+            self.assertEqual(num_lines, self.num_rows)
+        finally:
+            # Closing a stream stops its query
+            for res in streams:
+                res.close()
+
+mldb.run_tests()
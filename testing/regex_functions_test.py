@@ -0,0 +1,82 @@
+#
+# regex_functions_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test of the regex_match, regex_search and regex_replace functions.
+#
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class RegexFunctionsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        ds.record_row('a', [['x', 'row_12', 0], ['re', 'row_[0-9]+', 0]])
+        ds.record_row('b', [['x', 'hello world', 0], ['re', 'o w', 0]])
+        ds.commit()
+
+    def value(self, expr):
+        return mldb.query('select ' + expr + ' as v')[1][1]
+
+    def test_match_and_search(self):
+        self.assertEqual(self.value("regex_match('abc123', '[a-z]+[[:digit:]]+')"), 1)
+        self.assertEqual(self.value("regex_match('abc123', '[a-z]+')"), 0)
+        self.assertEqual(self.value("regex_search('abc123', '[a-z]+')"), 1)
+        self.assertEqual(self.value("regex_search('abc123', '^[0-9]')"), 0)
+        self.assertEqual(self.value("regex_match(12345, '[0-9]+')"), 1)
+        self.assertEqual(self.value("regex_match(NULL, 'a')"), None)
+
+    def test_utf8(self):
+        self.assertEqual(self.value(u"regex_match('héllo', 'h.llo')"), 1)
+        self.assertEqual(self.value(u"regex_replace('héllo', 'é', 'e')"),
+                         'hello')
+
+    def test_unicode_classes(self):
+        # As with boost, the character classes cover all of Unicode rather
+        # than just ASCII
+        self.assertEqual(self.value(u"regex_match('café', '\\w+')"), 1)
+        self.assertEqual(self.value(u"regex_match('café', '[\\w]+')"), 1)
+        self.assertEqual(self.value(u"regex_match('naïve', '[[:alpha:]]+')"), 1)
+        self.assertEqual(self.value(u"regex_search('café!', '\\W')"), 1)
+        self.assertEqual(self.value(u"regex_match('١٢٣', '\\d+')"), 1)
+        self.assertEqual(self.value(u"regex_replace('où est', '\\w+', 'x')"),
+                         'x x')
+        self.assertEqual(self.value(u"regex_search('é', '\\bé\\b')"), 1)
+
+    def test_replace(self):
+        self.assertEqual(self.value("regex_replace('row_12', 'row_', '')"), '12')
+        self.assertEqual(self.value("regex_replace('hello world', '(\\w+) (\\w+)', '$2 $1')"),
+                         'world hello')
+        self.assertEqual(self.value("regex_replace('hello', 'l', '[$&]')"),
+                         'he[l][l]o')
+        self.assertEqual(self.value("regex_replace('abc', 'x*', '-')"), '-a-b-c-')
+
+    def test_backreference(self):
+        # Not supported by RE2, so these go through the fallback engine
+        self.assertEqual(self.value("regex_match('abab', '(ab)\\1')"), 1)
+        self.assertEqual(self.value("regex_search('abc', 'a(?=b)')"), 1)
+        self.assertEqual(self.value("regex_replace('aabb', '(.)\\1', '$1')"), 'ab')
+
+    def test_pattern_from_column(self):
+        self.assertTableResultEquals(
+            mldb.query("""
+                select regex_match(x, re) as m
+                from ds order by rowName()"""),
+            [['_rowName', 'm'],
+             ['a', 1],
+             ['b', 0]])
+        self.assertTableResultEquals(
+            mldb.query("""
+                select regex_search(x, re) as s
+                from ds order by rowName()"""),
+            [['_rowName', 's'],
+             ['a', 1],
+             ['b', 1]])
+
+    def test_bad_regex(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.query("select regex_match('abc', '(abc')")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,108 @@
+#
+# tabular_dataset_persistence_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that a tabular dataset can be saved to and reloaded from its
+# dataFileUrl.
+#
+import os
+import unittest
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class TabularDatasetPersistenceTest(MldbUnitTest):  
+
+    filename = 'tmp/tabular_dataset_persistence_test.mldbds'
+
+    @classmethod
+    def setUpClass(cls):
+        if os.path.exists(cls.filename):
+            os.remove(cls.filename)
+
+        ds = mldb.create_dataset({
+            'id': 'saved',
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': 'file://' + cls.filename,
+                'unknownColumns': 'add'
+            }
+        })
+        for i in range(1000):
+            ds.record_row('row' + str(i), [['x', i, 0],
+                                           ['y', 'str' + str(i % 7), 0],
+                                           ['z', i * 0.5, 0]])
+        ds.record_row('extra', [['x', -1, 0], ['sparse', 'hello', 0]])
+        ds.commit()
+
+    def test_reload(self):
+        mldb.put('/v1/datasets/loaded', {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': 'file://' + self.filename
+            }
+        })
+
+        query = 'SELECT * FROM {} ORDER BY rowName()'
+        self.assertEqual(mldb.query(query.format('saved')),
+                         mldb.query(query.format('loaded')))
+
+        res = mldb.get('/v1/query', format='aos',
+                       q="SELECT x, y, z, sparse FROM loaded "
+                         "WHERE rowName() IN ('extra', 'row10') "
+                         "ORDER BY rowName()").json()
+        self.assertEqual(res, [
+            { '_rowName': 'extra', 'x': -1, 'sparse': 'hello' },
+            { '_rowName': 'row10', 'x': 10, 'y': 'str3', 'z': 5 }
+        ])
+
+    def test_row_lookup(self):
+        mldb.put('/v1/datasets/loaded3', {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': 'file://' + self.filename
+            }
+        })
+
+        for ds in ['saved', 'loaded3']:
+            res = mldb.query("SELECT x FROM {} WHERE rowName() = 'row123'"
+                             .format(ds))
+            self.assertEqual(res, [['_rowName', 'x'], ['row123', 123]])
+
+            res = mldb.query("SELECT x FROM {} WHERE rowName() = 'nothere'"
+                             .format(ds))
+            self.assertEqual(len(res), 1)
+
+            res = mldb.query("""
+                SELECT x FROM {}
+                WHERE rowName() IN ('row999', 'row0', 'nothere', 'extra')
+                ORDER BY rowName()""".format(ds))
+            self.assertEqual(res, [['_rowName', 'x'],
+                                   ['extra', -1],
+                                   ['row0', 0],
+                                   ['row999', 999]])
+
+    def test_duplicate_row_names(self):
+        mldb.put('/v1/datasets/dups', {'type': 'tabular'})
+        mldb.post('/v1/datasets/dups/rows', {
+            'rowName': 'a', 'columns': [['x', 1, 0]]
+        })
+        mldb.post('/v1/datasets/dups/rows', {
+            'rowName': 'a', 'columns': [['x', 2, 0]]
+        })
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post('/v1/datasets/dups/commit')
+
+    def test_loaded_is_read_only(self):
+        mldb.put('/v1/datasets/loaded2', {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': 'file://' + self.filename
+            }
+        })
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.post('/v1/datasets/loaded2/rows', {
+                'rowName': 'new', 'columns': [['x', 1, 0]]
+            })
+
+mldb.run_tests()
@@ -0,0 +1,111 @@
+/** tabular_dataset_row_index_test.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Test of the row name index for tabular datasets.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/plugins/tabular_dataset_row_index.h"
+#include "mldb/sql/path.h"
+#include "mldb/jml/db/persistent.h"
+#include <sstream>
+#include <cstring>
+
+using namespace std;
+using namespace Datacratic;
+using namespace Datacratic::MLDB;
+
+static RowName getName(size_t i)
+{
+    return RowName("row" + std::to_string(i));
+}
+
+static TabularDatasetRowIndex buildIndex(size_t numRows)
+{
+    auto getRowHashes = [] (size_t begin, size_t end, RowHash * out)
+        {
+            for (size_t i = begin;  i < end;  ++i)
+                *out++ = getName(i);
+        };
+
+    auto onDuplicate = [] (uint32_t rowNum)
+        {
+            throw ML::Exception("duplicate row %d", (int)rowNum);
+        };
+
+    return TabularDatasetRowIndex::build(numRows, 1000, getRowHashes,
+                                         onDuplicate);
+}
+
+static void checkIndex(const TabularDatasetRowIndex & index, size_t numRows)
+{
+    BOOST_CHECK_EQUAL(index.size(), numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        BOOST_REQUIRE_EQUAL(index.lookup(getName(i)), i);
+    for (size_t i = numRows;  i < numRows + 1000;  ++i)
+        BOOST_REQUIRE_EQUAL(index.lookup(getName(i)),
+                            TabularDatasetRowIndex::NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE( test_empty_index )
+{
+    TabularDatasetRowIndex index;
+    BOOST_CHECK_EQUAL(index.lookup(getName(0)),
+                      TabularDatasetRowIndex::NOT_FOUND);
+
+    checkIndex(buildIndex(0), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_build_and_lookup )
+{
+    for (size_t numRows: { 1, 2, 3, 100, 12345, 100000 })
+        checkIndex(buildIndex(numRows), numRows);
+}
+
+BOOST_AUTO_TEST_CASE( test_duplicate_rows )
+{
+    auto getRowHashes = [] (size_t begin, size_t end, RowHash * out)
+        {
+            for (size_t i = begin;  i < end;  ++i)
+                *out++ = getName(i % 500);
+        };
+
+    auto onDuplicate = [] (uint32_t rowNum)
+        {
+            throw ML::Exception("duplicate row %d", (int)rowNum);
+        };
+
+    BOOST_CHECK_THROW(TabularDatasetRowIndex::build(1000, 100, getRowHashes,
+                                                    onDuplicate),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialize_reconstitute )
+{
+    size_t numRows = 10000;
+    TabularDatasetRowIndex index = buildIndex(numRows);
+
+    std::ostringstream stream;
+    {
+        ML::DB::Store_Writer store(stream);
+        index.serialize(store);
+    }
+
+    // The reconstituted index points into this memory, which like a
+    // mapped file is 8 byte aligned
+    std::string serialized = stream.str();
+    auto buffer = std::make_shared<std::vector<uint64_t> >
+        (serialized.size() / 8 + 1);
+    std::memcpy(buffer->data(), serialized.data(), serialized.size());
+
+    ML::DB::Store_Reader store((const char *)buffer->data(),
+                               serialized.size());
+    TabularDatasetRowIndex loaded
+        = TabularDatasetRowIndex::reconstitute(store, buffer);
+    index = TabularDatasetRowIndex();
+
+    checkIndex(loaded, numRows);
+}
@@ -0,0 +1,119 @@
+#
+# tabular_zone_map_test.py
+# This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+#
+# Test that skipping chunks of a tabular dataset using their zone maps
+# doesn't change the rows returned by a WHERE clause, both before and after
+# the dataset is saved and loaded again.
+#
+import os
+import shutil
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb) # noqa
+
+class TabularZoneMapTest(MldbUnitTest):  # noqa
+
+    num_rows = 20000
+
+    @classmethod
+    def setUpClass(cls):
+        # The file mustn't exist yet, or the dataset will try to load it
+        cls.tmp_dir = tempfile.mkdtemp()
+        cls.data_file = 'file://' + os.path.join(cls.tmp_dir, 'ds.mldbds')
+
+        for kind in ['tabular', 'sparse.mutable']:
+            config = {'id': kind, 'type': kind}
+            if kind == 'tabular':
+                config['params'] = {
+                    'dataFileUrl': cls.data_file
+                }
+            ds = mldb.create_dataset(config)
+            rows = []
+            for i in range(cls.num_rows):
+                # Values are clustered by row number, as for time
+                # partitioned data
+                row = [['t', i, 0],
+                       ['bucket', i // 1000, 0],
+                       ['label', 'l' + str(i // 3000), 0],
+                       ['x', i / 8.0, 0]]
+                if i >= 10000:
+                    row.append(['late', i % 7, 0])
+                rows.append(['r' + str(i), row])
+            ds.record_rows(rows)
+            ds.commit()
+
+        # Load the saved version of the tabular dataset
+        mldb.put('/v1/datasets/loaded', {
+            'type': 'tabular',
+            'params': {
+                'dataFileUrl': cls.data_file
+            }
+        })
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.tmp_dir)
+
+    def rows_where(self, ds, where):
+        res = mldb.get('/v1/query', format='aos',
+                       q='select rowName() as r from {} where {}'
+                         .format(ds, where)).json()
+        return sorted(r['r'] for r in res)
+
+    def check(self, where, expected_count=None):
+        sparse = self.rows_where('"sparse.mutable"', where)
+        for ds in ['tabular', 'loaded']:
+            self.assertEqual(self.rows_where(ds, where), sparse)
+        if expected_count is not None:
+            self.assertEqual(len(sparse), expected_count)
+
+    def test_ranges(self):
+        self.check('t < 100', 100)
+        self.check('t >= 19990', 10)
+        self.check('t > 5000 and t <= 5010', 10)
+        self.check('x between 10 and 20', 81)
+        self.check('bucket = 7 and t % 2 = 0', 500)
+        self.check('t = -1', 0)
+        self.check('t > 20000', 0)
+
+    def test_equality(self):
+        self.check('bucket = 3', 1000)
+        self.check('bucket != 3', self.num_rows - 1000)
+        self.check('bucket in (1, 5, 19)', 3000)
+        self.check('t = 12345', 1)
+        self.check('t = 12345.5', 0)
+        self.check('bucket = \'3\'', 0)
+
+    def test_strings(self):
+        self.check('label = \'l2\'', 3000)
+        self.check('label > \'l5\'', 2000)
+        self.check('label < \'l1\'', 3000)
+        self.check('label = 3', 0)
+
+    def test_nulls(self):
+        self.check('late IS NULL', 10000)
+        self.check('late IS NOT NULL', 10000)
+        self.check('late = 3 and t < 5000', 0)
+        self.check('missing = 1', 0)
+        self.check('missing IS NULL', self.num_rows)
+
+    def test_or(self):
+        self.check('t < 10 or t >= 19990', 20)
+        self.check('t < 10 or late = 3')
+        self.check('t < 10 or t + 1 = 15000', 11)
+
+    def test_alias(self):
+        res = mldb.get('/v1/query', format='aos',
+                       q='select rowName() as r from tabular as ds '
+                         'where ds.t < 100').json()
+        self.assertEqual(sorted(r['r'] for r in res),
+                         self.rows_where('tabular', 't < 100'))
+
+    def test_limit_offset(self):
+        res = mldb.get('/v1/query', format='aos',
+                       q='select t from tabular where bucket >= 15 '
+                         'order by t offset 100 limit 10').json()
+        self.assertEqual([r['t'] for r in res], list(range(15100, 15110)))
+
+mldb.run_tests()
@@ -36,6 +36,7 @@ $(eval $(call test,expression_value_test,sql_expression,boost))
 # re-decouple them.
 $(eval $(call test,sql_expression_test,sql_expression,boost))
 $(eval $(call test,dataset_select_test,mldb,boost))
+$(eval $(call test,dataset_row_columns_test,mldb,boost))
 $(eval $(call test,embedding_dataset_test,mldb,boost))
 $(eval $(call test,procedure_run_test,mldb,boost))
 $(eval $(call test,python_procedure_test,mldb,boost manual)) #manual -- unclear why
@@ -424,4 +425,22 @@ $(eval $(call mldb_unit_test,MLDB-1869_json_payload_test.py))
 $(eval $(call mldb_unit_test,MLDB-1873_encoding_unknown_column.py))
 $(eval $(call mldb_unit_test,MLDB-1893_get_params_mixin.py))
 $(eval $(call mldb_unit_test,MLDB-1884-timestamp-consistency.py))
-$(eval $(call mldb_unit_test,MLDB-1713-wildcard-groupby.py))
\ No newline at end of file
+$(eval $(call mldb_unit_test,MLDB-1713-wildcard-groupby.py))
+$(eval $(call mldb_unit_test,tabular_dataset_persistence_test.py))
+$(eval $(call mldb_unit_test,groupby_partitioned_merge_test.py))
+$(eval $(call mldb_unit_test,hash_join_test.py))
+$(eval $(call mldb_unit_test,column_batch_scan_test.py))
+$(eval $(call mldb_unit_test,tabular_zone_map_test.py))
+$(eval $(call test,tabular_dataset_row_index_test,mldb,boost))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
+$(eval $(call mldb_unit_test,approx_aggregators_test.py))
+$(eval $(call mldb_unit_test,query_cancellation_test.py))
+$(eval $(call mldb_unit_test,function_batch_test.py))
+$(eval $(call mldb_unit_test,regex_functions_test.py))
+$(eval $(call mldb_unit_test,python_columnar_test.py))
+$(eval $(call mldb_unit_test,pipeline_batch_test.py))
+$(eval $(call mldb_unit_test,json_import_projection_test.py))
+$(eval $(call mldb_unit_test,boosted_trees_test.py))
+$(eval $(call mldb_unit_test,flat_tree_scoring_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_test.py))
+$(eval $(call mldb_unit_test,embedding_int8_test.py))
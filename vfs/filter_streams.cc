@@ -33,6 +33,7 @@
 #include <unordered_map>
 #include "ext/lzma/lzma.h"
 #include "lz4_filter.h"
+#include "parallel_decompress.h"
 #include "fs_utils.h"
 
 
@@ -652,6 +653,11 @@ openFromHandler(const UriHandler & handler,
     auto cmpIt = options.find("compression");
     if (cmpIt != options.end())
         compression = cmpIt->second;
+
+    int decompressionThreads = 0;
+    auto threadsIt = options.find("decompressionThreads");
+    if (threadsIt != options.end())
+        decompressionThreads = std::stoi(threadsIt->second);
     
     this->handlerOptions = handler.options;
     this->info_ = handler.info;
@@ -659,7 +665,8 @@ openFromHandler(const UriHandler & handler,
         throw ML::Exception("Handler for resource '" + resource
                             + "' didn't set info");
     ExcAssert(this->info_);
-    openFromStreambuf(handler.buf, handler.bufOwnership, resource, compression);
+    openFromStreambuf(handler.buf, handler.bufOwnership, resource, compression,
+                      decompressionThreads);
 }
 
 void
@@ -667,7 +674,8 @@ filter_istream::
 openFromStreambuf(std::streambuf * buf,
                   std::shared_ptr<void> bufOwnership,
                   const std::string & resource,
-                  const std::string & compression)
+                  const std::string & compression,
+                  int decompressionThreads)
 {
     // TODO: exception safety for buf
 
@@ -694,13 +702,29 @@ openFromStreambuf(std::streambuf * buf,
                      && (ends_with(resource, ".lz4")
                          || ends_with(resource, ".lz4~"))));
 
-    if (gzip) new_stream->push(gzip_decompressor());
-    if (bzip2) new_stream->push(bzip2_decompressor());
-    if (lzma) new_stream->push(lzma_decompressor());
-    if (lz4) new_stream->push(lz4_decompressor());
+    // Block-structured input can be decompressed on several threads at
+    // once, in which case the source reads buf directly
+    std::unique_ptr<ParallelDecompressingSource> parallel;
+    if (decompressionThreads > 1 && (gzip || bzip2 || lzma || lz4)) {
+        string scheme = gzip ? "gzip" : bzip2 ? "bzip2" : lzma ? "xz" : "lz4";
+        parallel = createParallelDecompressingSource
+            (buf, scheme, decompressionThreads,
+             handlerOptions.mapped, handlerOptions.mappedSize);
+    }
+
+    if (parallel) {
+        new_stream->push(*parallel);
+    }
+    else {
+        if (gzip) new_stream->push(gzip_decompressor());
+        if (bzip2) new_stream->push(bzip2_decompressor());
+        if (lzma) new_stream->push(lzma_decompressor());
+        if (lz4) new_stream->push(lz4_decompressor());
+        if (!new_stream->empty())
+            new_stream->push(*buf);
+    }
 
     if (!new_stream->empty()) {
-        new_stream->push(*buf);
         this->stream = std::move(new_stream);
 
         // MLDB-1140: if we add compression, we are no longer mappable, seekable,
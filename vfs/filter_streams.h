@@ -212,6 +212,10 @@ public:
         - "compression": if not set, it will detect.  If set to "none", it
           will not decompress no matter what it finds.  Otherwise, it can
           be set to a compression scheme to force that scheme to be used.
+        - "decompressionThreads": if set to more than one, compressed
+          input whose format allows it (multi-member gzip, bzip2, lz4 and
+          mapped multi-block xz) will be decompressed on that many threads
+          at once.
     */
     filter_istream(const std::string & uri,
                    const std::map<std::string, std::string> & options);
@@ -246,7 +250,8 @@ public:
     void openFromStreambuf(std::streambuf * buf,
                            std::shared_ptr<void> bufOwnership,
                            const std::string & resource = "",
-                           const std::string & compression = "");
+                           const std::string & compression = "",
+                           int decompressionThreads = 0);
 
     void openFromHandler(const UriHandler & handler,
                          const std::string & resource,
@@ -0,0 +1,1185 @@
+/** parallel_decompress.cc
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Multi-threaded decompression of block-structured compressed streams.
+*/
+
+#include "mldb/vfs/parallel_decompress.h"
+#include <boost/iostreams/operations.hpp>
+#include "mldb/vfs/lz4_filter.h"
+#include "mldb/arch/exception.h"
+#include "mldb/jml/utils/guard.h"
+#include "mldb/base/thread_pool.h"
+#include <zlib.h>
+#include <bzlib.h>
+#include <lzma.h>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+namespace {
+
+/// Amount of compressed input we aim to put in each block, when the
+/// format lets us choose
+static constexpr size_t TARGET_BLOCK_SIZE = 1024 * 1024;
+
+/// Minimum amount of data read from the input streambuf at once
+static constexpr size_t INPUT_READ_SIZE = 1024 * 1024;
+
+/// Size of the buffer into which zlib and libbz2 decompress
+static constexpr size_t OUTPUT_CHUNK_SIZE = 256 * 1024;
+
+/// Amount of input and output used to verify a candidate gzip header
+static constexpr size_t GZIP_TRIAL_INPUT_SIZE = 64 * 1024;
+static constexpr size_t GZIP_TRIAL_OUTPUT_SIZE = 256 * 1024;
+
+/// Bit patterns marking the start of a bzip2 block and the end of a stream
+static constexpr uint64_t BZIP2_BLOCK_MAGIC = 0x314159265359ULL;
+static constexpr uint64_t BZIP2_EOS_MAGIC = 0x177245385090ULL;
+
+/// Number of bzip2 blocks that may be merged together before we consider
+/// that we're looking at corruption rather than a false block marker
+static constexpr int BZIP2_MAX_MERGED_BLOCKS = 8;
+
+/// Largest xz block we decompress in one piece; files with larger blocks
+/// are decompressed by the serial decompressor
+static constexpr uint64_t MAX_XZ_BLOCK_SIZE = 64 * 1024 * 1024;
+
+static constexpr uint64_t NOT_FOUND = uint64_t(-1);
+
+
+/*****************************************************************************/
+/* INPUT WINDOW                                                              */
+/*****************************************************************************/
+
+/** Compressed input that has been read from the streambuf, but not yet
+    split off into a block.
+*/
+
+struct InputWindow {
+    InputWindow(std::streambuf * input)
+        : input(input), eof(false)
+    {
+    }
+
+    /** Make at least n bytes available in data, unless the end of the
+        input is reached first.  Returns the number of bytes available.
+    */
+    size_t fill(size_t n)
+    {
+        while (data.size() < n && !eof) {
+            size_t toRead = std::max(n - data.size(), INPUT_READ_SIZE);
+            size_t oldSize = data.size();
+            data.resize(oldSize + toRead);
+            std::streamsize numRead = input->sgetn(&data[oldSize], toRead);
+            if (numRead < 0)
+                numRead = 0;
+            if ((size_t)numRead < toRead)
+                eof = true;
+            data.resize(oldSize + numRead);
+        }
+        return data.size();
+    }
+
+    /// Remove and return the first n bytes
+    std::string take(size_t n)
+    {
+        std::string result(data, 0, n);
+        data.erase(0, n);
+        return result;
+    }
+
+    void skip(size_t n)
+    {
+        data.erase(0, n);
+    }
+
+    std::streambuf * input;
+    std::string data;
+    bool eof;
+};
+
+
+/*****************************************************************************/
+/* BLOCKS AND CODECS                                                         */
+/*****************************************************************************/
+
+/** A piece of compressed input, along with what's needed to decompress it
+    without looking at the rest of the input.
+*/
+
+struct Block {
+    Block()
+        : independent(false), begin(0), end(0), level(0), stored(false),
+          hasChecksum(false), checksum(0), uncompressedSize(0),
+          unpaddedSize(0)
+    {
+    }
+
+    std::string data;          ///< Compressed data
+    bool independent;          ///< Can be decompressed on its own
+    uint64_t begin, end;       ///< bzip2: range of bits in data for block
+    int level;                 ///< bzip2: compression level; xz: check
+    bool stored;               ///< lz4: block is not compressed
+    bool hasChecksum;          ///< lz4: block has a checksum
+    uint32_t checksum;         ///< lz4: expected block checksum
+    uint64_t uncompressedSize; ///< xz: size of the decompressed block
+    uint64_t unpaddedSize;     ///< xz: unpadded size from the index
+};
+
+/** Result of decompressing a block. */
+
+struct Decoded {
+    std::string output;
+
+    /** If set, the block ended part of the way through a unit of the
+        compressed stream, and the next block must be decompressed
+        following on from this state rather than on its own.
+    */
+    std::shared_ptr<void> state;
+};
+
+/** Knowledge of how to split up and decompress a given format. */
+
+struct Codec {
+    virtual ~Codec()
+    {
+    }
+
+    /** Split the next block off the input.  Called serially.  Returns
+        false once the input is exhausted.
+    */
+    virtual bool nextBlock(Block & block) = 0;
+
+    /** Decompress a block on its own.  Called in parallel from worker
+        threads for blocks marked as independent.
+    */
+    virtual Decoded decode(const Block & block) const = 0;
+
+    /** Decompress a block following on from the state left by the
+        previous one, which may be null.  Called serially, in order.
+    */
+    virtual Decoded decodeAfter(std::shared_ptr<void> state,
+                                const Block & block) const
+    {
+        if (state)
+            throw ML::Exception("compressed stream can't continue block");
+        return decode(block);
+    }
+
+    /** Called serially, in order, with each block's output. */
+    virtual void onBlockDone(const Block & block, const Decoded & decoded)
+    {
+    }
+
+    /** Called at the end of the input, with the state left by the last
+        block.
+    */
+    virtual void finish(const std::shared_ptr<void> & state)
+    {
+        if (state)
+            throw ML::Exception("premature end of compressed stream");
+    }
+};
+
+
+/*****************************************************************************/
+/* GZIP                                                                      */
+/*****************************************************************************/
+
+/** Return true if there is a plausible gzip member header at p.  If it's
+    a BGZF header, memberLength is set to the total length of the member,
+    otherwise it's set to zero.
+*/
+bool parseGzipHeader(const char * data, size_t avail, size_t & memberLength)
+{
+    const unsigned char * p = (const unsigned char *)data;
+    memberLength = 0;
+
+    if (avail < 10)
+        return false;
+    if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8)
+        return false;
+    int flags = p[3];
+    if (flags & 0xe0)
+        return false;
+    int xfl = p[8];
+    if (xfl != 0 && xfl != 2 && xfl != 4)
+        return false;
+    int os = p[9];
+    if (os > 13 && os != 255)
+        return false;
+
+    if ((flags & 4) && avail >= 12) {
+        size_t xlen = p[10] | (p[11] << 8);
+        const unsigned char * e = p + 12;
+        const unsigned char * end = p + std::min(avail, 12 + xlen);
+        while (e + 4 <= end) {
+            size_t slen = e[2] | (e[3] << 8);
+            if (e[0] == 'B' && e[1] == 'C' && slen == 2 && e + 6 <= end)
+                memberLength = (e[4] | (e[5] << 8)) + 1;
+            e += 4 + slen;
+        }
+    }
+
+    return true;
+}
+
+/** Check that the data at p inflates without error for a while, to
+    confirm that a plausible header really is the start of a member.
+*/
+bool trialInflate(const char * p, size_t avail)
+{
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, 15 + 16) != Z_OK)
+        throw ML::Exception("couldn't initialize zlib");
+    ML::Call_Guard guard([&] () { inflateEnd(&strm); });
+
+    std::unique_ptr<char[]> buf(new char[OUTPUT_CHUNK_SIZE]);
+    strm.next_in = (Bytef *)p;
+    strm.avail_in = std::min(avail, GZIP_TRIAL_INPUT_SIZE);
+
+    size_t totalOut = 0;
+    for (;;) {
+        strm.next_out = (Bytef *)buf.get();
+        strm.avail_out = OUTPUT_CHUNK_SIZE;
+        int res = inflate(&strm, Z_NO_FLUSH);
+        if (res == Z_STREAM_END)
+            return true;
+        if (res != Z_OK)
+            return res == Z_BUF_ERROR;
+        totalOut += OUTPUT_CHUNK_SIZE - strm.avail_out;
+        if (strm.avail_in == 0 || totalOut >= GZIP_TRIAL_OUTPUT_SIZE)
+            return true;
+    }
+}
+
+struct GzipState {
+    GzipState()
+        : inMember(false)
+    {
+        std::memset(&strm, 0, sizeof(strm));
+        if (inflateInit2(&strm, 15 + 16) != Z_OK)
+            throw ML::Exception("couldn't initialize zlib");
+    }
+
+    ~GzipState()
+    {
+        inflateEnd(&strm);
+    }
+
+    z_stream strm;
+    bool inMember;
+};
+
+struct GzipCodec: public Codec {
+    GzipCodec(std::streambuf * input)
+        : window(input), atMemberStart(true)
+    {
+    }
+
+    virtual bool nextBlock(Block & block)
+    {
+        if (!window.fill(1))
+            return false;
+
+        block.independent = atMemberStart;
+
+        size_t memberLength;
+        if (atMemberStart
+            && parseGzipHeader(window.data.data(), window.fill(18),
+                               memberLength)
+            && memberLength) {
+            // BGZF: members record their own length, so take as many
+            // whole members as fit in the block
+            size_t length = 0;
+            while (length < TARGET_BLOCK_SIZE) {
+                size_t avail = window.fill(length + 18);
+                if (!parseGzipHeader(window.data.data() + length,
+                                     avail - length, memberLength)
+                    || !memberLength
+                    || window.fill(length + memberLength)
+                       < length + memberLength)
+                    break;
+                length += memberLength;
+            }
+            if (length) {
+                block.data = window.take(length);
+                return true;
+            }
+        }
+
+        // Look for the start of a member past the target block size.  If
+        // there isn't one, the next block continues this one.
+        size_t avail = window.fill(2 * TARGET_BLOCK_SIZE);
+        size_t length = std::min(avail, TARGET_BLOCK_SIZE);
+        atMemberStart = false;
+
+        const char * d = window.data.data();
+        for (size_t pos = TARGET_BLOCK_SIZE;  pos + 10 <= avail;  ++pos) {
+            const char * found
+                = (const char *)std::memchr(d + pos, 0x1f, avail - pos);
+            if (!found)
+                break;
+            pos = found - d;
+            if (parseGzipHeader(d + pos, avail - pos, memberLength)
+                && trialInflate(d + pos, avail - pos)) {
+                length = pos;
+                atMemberStart = true;
+                break;
+            }
+        }
+
+        block.data = window.take(length);
+        return true;
+    }
+
+    virtual Decoded decode(const Block & block) const
+    {
+        return inflateBlock(std::make_shared<GzipState>(), block);
+    }
+
+    virtual Decoded decodeAfter(std::shared_ptr<void> state,
+                                const Block & block) const
+    {
+        if (!state)
+            return decode(block);
+        return inflateBlock(std::static_pointer_cast<GzipState>(state),
+                            block);
+    }
+
+    static Decoded inflateBlock(std::shared_ptr<GzipState> state,
+                                const Block & block)
+    {
+        Decoded result;
+        result.output.reserve(block.data.size() * 4);
+
+        std::unique_ptr<char[]> buf(new char[OUTPUT_CHUNK_SIZE]);
+        z_stream & strm = state->strm;
+        strm.next_in = (Bytef *)block.data.data();
+        strm.avail_in = block.data.size();
+
+        for (;;) {
+            if (!state->inMember) {
+                // Skip any zero padding after a member
+                while (strm.avail_in && *strm.next_in == 0) {
+                    ++strm.next_in;
+                    --strm.avail_in;
+                }
+                if (!strm.avail_in)
+                    break;
+                inflateReset(&strm);
+                state->inMember = true;
+            }
+
+            strm.next_out = (Bytef *)buf.get();
+            strm.avail_out = OUTPUT_CHUNK_SIZE;
+            int res = inflate(&strm, Z_NO_FLUSH);
+            result.output.append(buf.get(),
+                                 OUTPUT_CHUNK_SIZE - strm.avail_out);
+
+            if (res == Z_STREAM_END) {
+                state->inMember = false;
+                continue;
+            }
+            if (res == Z_OK) {
+                if (strm.avail_in == 0 && strm.avail_out != 0)
+                    break;
+                continue;
+            }
+            if (res == Z_BUF_ERROR && strm.avail_in == 0)
+                break;
+            throw ML::Exception("gzip decompression error: %s",
+                                strm.msg ? strm.msg : "unknown error");
+        }
+
+        strm.next_in = nullptr;
+        strm.next_out = nullptr;
+        if (state->inMember)
+            result.state = state;
+        return result;
+    }
+
+    InputWindow window;
+    bool atMemberStart;
+};
+
+
+/*****************************************************************************/
+/* BZIP2                                                                     */
+/*****************************************************************************/
+
+/// Return n <= 64 bits starting at bit position pos, most significant first
+uint64_t getBits(const std::string & data, uint64_t pos, int n)
+{
+    const unsigned char * p = (const unsigned char *)data.data();
+    uint64_t result = 0;
+    for (int i = 0;  i < n;  ++i, ++pos) {
+        if (pos / 8 >= data.size())
+            throw ML::Exception("bzip2: premature end of stream");
+        result = (result << 1) | ((p[pos / 8] >> (7 - pos % 8)) & 1);
+    }
+    return result;
+}
+
+/** Bitstream being built up, used to assemble a standalone bzip2 stream
+    from a block.
+*/
+struct BitWriter {
+    BitWriter()
+        : numBits(0)
+    {
+    }
+
+    void putBit(int bit)
+    {
+        if (numBits % 8 == 0)
+            data.push_back(0);
+        if (bit)
+            data.back() |= 0x80 >> (numBits % 8);
+        ++numBits;
+    }
+
+    void putBits(uint64_t value, int n)
+    {
+        for (int i = n - 1;  i >= 0;  --i)
+            putBit((value >> i) & 1);
+    }
+
+    /// Append the bits [begin, end) of src
+    void append(const std::string & src, uint64_t begin, uint64_t end)
+    {
+        const unsigned char * p = (const unsigned char *)src.data();
+        auto bitAt = [&] (uint64_t pos) { return (p[pos / 8] >> (7 - pos % 8)) & 1; };
+
+        uint64_t pos = begin;
+        while (pos < end && numBits % 8 != 0)
+            putBit(bitAt(pos++));
+
+        // We're now byte aligned, so copy whole bytes
+        size_t numBytes = (end - pos) / 8;
+        int shift = pos % 8;
+        const unsigned char * s = p + pos / 8;
+        size_t oldSize = data.size();
+        data.resize(oldSize + numBytes);
+        if (shift == 0)
+            std::memcpy(&data[oldSize], s, numBytes);
+        else {
+            for (size_t i = 0;  i < numBytes;  ++i)
+                data[oldSize + i] = (s[i] << shift) | (s[i + 1] >> (8 - shift));
+        }
+        numBits += 8 * numBytes;
+        pos += 8 * numBytes;
+
+        while (pos < end)
+            putBit(bitAt(pos++));
+    }
+
+    std::string data;
+    uint64_t numBits;
+};
+
+/** Find the first block or end of stream marker starting at or after bit
+    fromBit.  Returns NOT_FOUND if there is none in the data.
+*/
+uint64_t findBzip2Magic(const std::string & data, uint64_t fromBit,
+                        bool & isEos)
+{
+    // Whatever its bit alignment, the second byte a marker touches is
+    // entirely within it, so we look that byte up to find the candidate
+    // alignments.  Entry bit k is for a block marker starting at bit k of
+    // the previous byte, bit k + 8 for an end of stream marker.
+    struct MagicTable {
+        MagicTable()
+        {
+            std::memset(entries, 0, sizeof(entries));
+            for (int k = 0;  k < 8;  ++k) {
+                entries[(BZIP2_BLOCK_MAGIC >> (32 + k)) & 0xff] |= 1 << k;
+                entries[(BZIP2_EOS_MAGIC >> (32 + k)) & 0xff] |= 256 << k;
+            }
+        }
+
+        uint16_t entries[256];
+    };
+
+    static const MagicTable table;
+
+    const unsigned char * p = (const unsigned char *)data.data();
+    for (size_t i = fromBit / 8;  i + 7 <= data.size();  ++i) {
+        unsigned candidates = table.entries[p[i + 1]];
+        if (!candidates)
+            continue;
+        for (int k = 0;  k < 8;  ++k) {
+            uint64_t pos = 8 * i + k;
+            if (pos < fromBit)
+                continue;
+            if ((candidates & (1 << k))
+                && getBits(data, pos, 48) == BZIP2_BLOCK_MAGIC) {
+                isEos = false;
+                return pos;
+            }
+            if ((candidates & (256 << k))
+                && getBits(data, pos, 48) == BZIP2_EOS_MAGIC) {
+                isEos = true;
+                return pos;
+            }
+        }
+    }
+
+    return NOT_FOUND;
+}
+
+/** Blocks (starting with a block marker) that couldn't be decompressed on
+    their own, as they were split at something that looked like a block
+    marker but wasn't.
+*/
+struct Bzip2Partial {
+    BitWriter bits;
+    int level;
+    int numBlocks;
+};
+
+struct Bzip2Codec: public Codec {
+    Bzip2Codec(std::streambuf * input)
+        : window(input), inStream(false), level(0), bitOffset(0)
+    {
+    }
+
+    virtual bool nextBlock(Block & block)
+    {
+        for (;;) {
+            if (!inStream) {
+                // Streams start on a byte boundary
+                if (bitOffset) {
+                    window.skip(1);
+                    bitOffset = 0;
+                }
+                size_t avail = window.fill(4);
+                if (avail == 0)
+                    return false;
+                const char * d = window.data.data();
+                if (avail < 4 || d[0] != 'B' || d[1] != 'Z' || d[2] != 'h'
+                    || d[3] < '1' || d[3] > '9')
+                    throw ML::Exception("bzip2: invalid stream header");
+                level = d[3] - '0';
+                window.skip(4);
+                inStream = true;
+            }
+
+            window.fill(16);
+            uint64_t magic = getBits(window.data, bitOffset, 48);
+
+            if (magic == BZIP2_EOS_MAGIC) {
+                // Skip the marker and the combined CRC.  Each block's CRC
+                // is checked as it's decompressed.
+                uint64_t endBit = bitOffset + 48 + 32;
+                window.fill(endBit / 8 + 1);
+                window.skip(endBit / 8);
+                bitOffset = endBit % 8;
+                inStream = false;
+                continue;
+            }
+
+            if (magic != BZIP2_BLOCK_MAGIC)
+                throw ML::Exception("bzip2: invalid block header");
+
+            // The block ends where the next one or the end of stream starts
+            uint64_t fromBit = bitOffset + 48;
+            uint64_t endBit;
+            bool isEos;
+            for (;;) {
+                endBit = findBzip2Magic(window.data, fromBit, isEos);
+                if (endBit != NOT_FOUND)
+                    break;
+                if (window.eof)
+                    throw ML::Exception("bzip2: premature end of stream");
+                size_t avail = window.data.size();
+                if (avail >= 7)
+                    fromBit = std::max<uint64_t>(fromBit, 8 * (avail - 7));
+                window.fill(avail + INPUT_READ_SIZE);
+            }
+
+            block.data = window.data.substr(0, (endBit + 7) / 8);
+            block.begin = bitOffset;
+            block.end = endBit;
+            block.level = level;
+            block.independent = true;
+
+            window.skip(endBit / 8);
+            bitOffset = endBit % 8;
+            return true;
+        }
+    }
+
+    virtual Decoded decode(const Block & block) const
+    {
+        auto partial = std::make_shared<Bzip2Partial>();
+        partial->bits.append(block.data, block.begin, block.end);
+        partial->level = block.level;
+        partial->numBlocks = 1;
+        return decodePartial(partial);
+    }
+
+    virtual Decoded decodeAfter(std::shared_ptr<void> state,
+                                const Block & block) const
+    {
+        if (!state)
+            return decode(block);
+        auto partial = std::static_pointer_cast<Bzip2Partial>(state);
+        if (++partial->numBlocks > BZIP2_MAX_MERGED_BLOCKS)
+            throw ML::Exception("bzip2: corrupt compressed block");
+        partial->bits.append(block.data, block.begin, block.end);
+        return decodePartial(partial);
+    }
+
+    /** Decompress the given block bits by wrapping them in a stream with
+        only that block.  If that fails, the block is returned as state to
+        be merged with the next one.
+    */
+    static Decoded decodePartial(std::shared_ptr<Bzip2Partial> partial)
+    {
+        const BitWriter & bits = partial->bits;
+
+        BitWriter stream;
+        stream.data = "BZh";
+        stream.data += char('0' + partial->level);
+        stream.numBits = 32;
+        stream.append(bits.data, 0, bits.numBits);
+        // With a single block, the combined CRC is the block CRC
+        stream.putBits(BZIP2_EOS_MAGIC, 48);
+        stream.putBits(getBits(bits.data, 48, 32), 32);
+
+        bz_stream strm;
+        std::memset(&strm, 0, sizeof(strm));
+        if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+            throw ML::Exception("couldn't initialize bzip2");
+        ML::Call_Guard guard([&] () { BZ2_bzDecompressEnd(&strm); });
+
+        Decoded result;
+        std::unique_ptr<char[]> buf(new char[OUTPUT_CHUNK_SIZE]);
+        strm.next_in = &stream.data[0];
+        strm.avail_in = stream.data.size();
+
+        for (;;) {
+            strm.next_out = buf.get();
+            strm.avail_out = OUTPUT_CHUNK_SIZE;
+            int res = BZ2_bzDecompress(&strm);
+            result.output.append(buf.get(),
+                                 OUTPUT_CHUNK_SIZE - strm.avail_out);
+            if (res == BZ_STREAM_END)
+                return result;
+            if (res != BZ_OK
+                || (strm.avail_in == 0 && strm.avail_out != 0))
+                break;
+        }
+
+        result.output.clear();
+        result.state = partial;
+        return result;
+    }
+
+    virtual void finish(const std::shared_ptr<void> & state)
+    {
+        if (state)
+            throw ML::Exception("bzip2: corrupt compressed block");
+    }
+
+    InputWindow window;
+    bool inStream;
+    int level;
+    uint64_t bitOffset;  ///< Bit in the first byte of window where we are
+};
+
+
+/*****************************************************************************/
+/* XZ                                                                        */
+/*****************************************************************************/
+
+struct XzBlockInfo {
+    uint64_t offset;
+    uint64_t totalSize;
+    uint64_t unpaddedSize;
+    uint64_t uncompressedSize;
+    lzma_check check;
+};
+
+/** Read the indexes of all streams in the given xz file to find its
+    blocks.  Returns false if the file isn't worth decompressing in
+    parallel, or can't be indexed.
+*/
+bool indexXzBlocks(const char * data, size_t size,
+                   std::vector<XzBlockInfo> & blocks)
+{
+    const uint8_t * d = (const uint8_t *)data;
+    size_t end = size;
+
+    while (end > 0) {
+        // Skip stream padding
+        while (end >= 4 && !d[end - 1] && !d[end - 2] && !d[end - 3]
+               && !d[end - 4])
+            end -= 4;
+
+        if (end < 2 * LZMA_STREAM_HEADER_SIZE)
+            return false;
+
+        lzma_stream_flags footer;
+        if (lzma_stream_footer_decode(&footer,
+                                      d + end - LZMA_STREAM_HEADER_SIZE)
+            != LZMA_OK)
+            return false;
+
+        size_t indexEnd = end - LZMA_STREAM_HEADER_SIZE;
+        if (footer.backward_size > indexEnd)
+            return false;
+
+        lzma_index * index = nullptr;
+        uint64_t memlimit = UINT64_MAX;
+        size_t inPos = indexEnd - footer.backward_size;
+        if (lzma_index_buffer_decode(&index, &memlimit, nullptr, d, &inPos,
+                                     indexEnd) != LZMA_OK)
+            return false;
+        ML::Call_Guard guard([&] () { lzma_index_end(index, nullptr); });
+
+        uint64_t streamSize = lzma_index_stream_size(index);
+        if (streamSize > end)
+            return false;
+        size_t streamStart = end - streamSize;
+
+        lzma_stream_flags header;
+        if (lzma_stream_header_decode(&header, d + streamStart) != LZMA_OK
+            || lzma_stream_flags_compare(&header, &footer) != LZMA_OK)
+            return false;
+
+        std::vector<XzBlockInfo> streamBlocks;
+        lzma_index_iter iter;
+        lzma_index_iter_init(&iter, index);
+        while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK)) {
+            XzBlockInfo info;
+            info.offset = streamStart + iter.block.compressed_stream_offset;
+            info.totalSize = iter.block.total_size;
+            info.unpaddedSize = iter.block.unpadded_size;
+            info.uncompressedSize = iter.block.uncompressed_size;
+            info.check = header.check;
+            if (info.uncompressedSize > MAX_XZ_BLOCK_SIZE
+                || info.offset + info.totalSize > end)
+                return false;
+            streamBlocks.push_back(info);
+        }
+
+        blocks.insert(blocks.begin(), streamBlocks.begin(), streamBlocks.end());
+        end = streamStart;
+    }
+
+    return blocks.size() > 1;
+}
+
+struct XzCodec: public Codec {
+    XzCodec(const char * mapped, std::vector<XzBlockInfo> blocks)
+        : mapped(mapped), blocks(std::move(blocks)), current(0)
+    {
+    }
+
+    virtual bool nextBlock(Block & block)
+    {
+        if (current == blocks.size())
+            return false;
+        const XzBlockInfo & info = blocks[current++];
+        block.data.assign(mapped + info.offset, info.totalSize);
+        block.level = info.check;
+        block.uncompressedSize = info.uncompressedSize;
+        block.unpaddedSize = info.unpaddedSize;
+        block.independent = true;
+        return true;
+    }
+
+    virtual Decoded decode(const Block & block) const
+    {
+        const uint8_t * in = (const uint8_t *)block.data.data();
+
+        lzma_filter filters[LZMA_FILTERS_MAX + 1];
+        lzma_block lblock;
+        std::memset(&lblock, 0, sizeof(lblock));
+        lblock.version = 0;
+        lblock.check = (lzma_check)block.level;
+        lblock.filters = filters;
+        lblock.header_size = lzma_block_header_size_decode(in[0]);
+        if (lblock.header_size > block.data.size())
+            throw ML::Exception("xz: corrupt block header");
+
+        if (lzma_block_header_decode(&lblock, nullptr, in) != LZMA_OK)
+            throw ML::Exception("xz: corrupt block header");
+        ML::Call_Guard guard([&] ()
+            {
+                for (size_t i = 0;  filters[i].id != LZMA_VLI_UNKNOWN;  ++i)
+                    free(filters[i].options);
+            });
+
+        if (lzma_block_compressed_size(&lblock, block.unpaddedSize)
+            != LZMA_OK)
+            throw ML::Exception("xz: block size doesn't match index");
+
+        Decoded result;
+        result.output.resize(block.uncompressedSize);
+        size_t inPos = lblock.header_size;
+        size_t outPos = 0;
+        lzma_ret res = lzma_block_buffer_decode
+            (&lblock, nullptr, in, &inPos, block.data.size(),
+             (uint8_t *)&result.output[0], &outPos, result.output.size());
+        if (res != LZMA_OK)
+            throw ML::Exception("xz: decompression error %d", (int)res);
+        result.output.resize(outPos);
+        return result;
+    }
+
+    const char * mapped;
+    std::vector<XzBlockInfo> blocks;
+    size_t current;
+};
+
+
+/*****************************************************************************/
+/* LZ4                                                                       */
+/*****************************************************************************/
+
+struct Lz4Codec: public Codec {
+    Lz4Codec(std::streambuf * input)
+        : window(input), headerRead(false), done(false),
+          streamChecksumState(nullptr), expectedStreamChecksum(0)
+    {
+    }
+
+    ~Lz4Codec()
+    {
+        if (streamChecksumState)
+            XXH32_digest(streamChecksumState);
+    }
+
+    struct MemorySource {
+        typedef char char_type;
+        typedef boost::iostreams::source_tag category;
+
+        std::streamsize read(char * s, std::streamsize n)
+        {
+            n = std::min<std::streamsize>(n, size);
+            if (n == 0)
+                return -1;
+            std::memcpy(s, data, n);
+            data += n;
+            size -= n;
+            return n;
+        }
+
+        const char * data;
+        size_t size;
+    };
+
+    virtual bool nextBlock(Block & block)
+    {
+        if (done)
+            return false;
+
+        if (!headerRead) {
+            size_t avail = window.fill(sizeof(lz4::Header));
+            MemorySource src{ window.data.data(), avail };
+            head = lz4::Header::read(src);
+            window.skip(sizeof(lz4::Header));
+            if (head.streamChecksum())
+                streamChecksumState = XXH32_init(lz4::ChecksumSeed);
+            headerRead = true;
+        }
+
+        if (window.fill(4) < 4)
+            throw lz4_error("premature end of stream");
+        uint32_t compressedSize;
+        std::memcpy(&compressedSize, window.data.data(), 4);
+
+        // EOS marker.
+        if (compressedSize == 0) {
+            if (head.streamChecksum()) {
+                if (window.fill(8) < 8)
+                    throw lz4_error("premature end of stream");
+                std::memcpy(&expectedStreamChecksum, window.data.data() + 4, 4);
+            }
+            done = true;
+            return false;
+        }
+
+        block.stored = compressedSize & lz4::NotCompressedMask;
+        compressedSize &= ~lz4::NotCompressedMask;
+
+        size_t checksumSize = head.blockChecksum() ? 4 : 0;
+        size_t total = 4 + compressedSize + checksumSize;
+        if (window.fill(total) < total)
+            throw lz4_error("premature end of stream");
+
+        block.data = window.data.substr(4, compressedSize);
+        if (checksumSize) {
+            block.hasChecksum = true;
+            std::memcpy(&block.checksum,
+                        window.data.data() + 4 + compressedSize, 4);
+        }
+        block.independent = true;
+        window.skip(total);
+        return true;
+    }
+
+    virtual Decoded decode(const Block & block) const
+    {
+        if (block.hasChecksum
+            && XXH32(block.data.data(), block.data.size(), lz4::ChecksumSeed)
+               != block.checksum)
+            throw lz4_error("invalid checksum");
+
+        Decoded result;
+        if (block.stored) {
+            result.output = block.data;
+            return result;
+        }
+
+        result.output.resize(head.blockSize());
+        int decompressed = LZ4_decompress_safe
+            (block.data.data(), &result.output[0],
+             block.data.size(), result.output.size());
+        if (decompressed < 0)
+            throw lz4_error("malformed lz4 stream");
+        result.output.resize(decompressed);
+        return result;
+    }
+
+    virtual void onBlockDone(const Block & block, const Decoded & decoded)
+    {
+        if (streamChecksumState)
+            XXH32_update(streamChecksumState, decoded.output.data(),
+                         decoded.output.size());
+    }
+
+    virtual void finish(const std::shared_ptr<void> & state)
+    {
+        if (!streamChecksumState)
+            return;
+        uint32_t checksum = XXH32_digest(streamChecksumState);
+        streamChecksumState = nullptr;
+        if (checksum != expectedStreamChecksum)
+            throw lz4_error("invalid checksum");
+    }
+
+    InputWindow window;
+    lz4::Header head;
+    bool headerRead;
+    bool done;
+    void * streamChecksumState;
+    uint32_t expectedStreamChecksum;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSING SOURCE                                             */
+/*****************************************************************************/
+
+struct ParallelDecompressingSource::Itl {
+    Itl(std::unique_ptr<Codec> codec, int numThreads)
+        : codec(std::move(codec)),
+          threadPool(ThreadPool::instance(), numThreads),
+          maxInFlight(numThreads + 1),
+          inputDone(false), finished(false), outputPos(0)
+    {
+    }
+
+    ~Itl()
+    {
+        // Jobs still running refer to the codec and blocks
+        threadPool.waitForAll();
+    }
+
+    /** Output of a block being decompressed on the thread pool. */
+    struct Pending {
+        Pending()
+            : done(false)
+        {
+        }
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done;
+        Decoded decoded;
+        std::exception_ptr exc;
+    };
+
+    struct InFlight {
+        std::shared_ptr<Block> block;
+        std::shared_ptr<Pending> pending;  ///< Only for independent blocks
+    };
+
+    /// Split off blocks and start decompressing them, up to the limit
+    void startBlocks()
+    {
+        while (!inputDone && inFlight.size() < maxInFlight) {
+            auto block = std::make_shared<Block>();
+            if (!codec->nextBlock(*block)) {
+                inputDone = true;
+                break;
+            }
+
+            InFlight entry;
+            entry.block = block;
+            if (block->independent) {
+                auto pending = std::make_shared<Pending>();
+                entry.pending = pending;
+                const Codec * c = codec.get();
+                threadPool.add([=] ()
+                    {
+                        Decoded decoded;
+                        std::exception_ptr exc;
+                        try {
+                            decoded = c->decode(*block);
+                        } catch (...) {
+                            exc = std::current_exception();
+                        }
+
+                        std::unique_lock<std::mutex> guard(pending->mutex);
+                        pending->decoded = std::move(decoded);
+                        pending->exc = std::move(exc);
+                        pending->done = true;
+                        pending->cond.notify_all();
+                    });
+            }
+            inFlight.emplace_back(std::move(entry));
+        }
+    }
+
+    /** Wait for a block to be decompressed and return its output.  We
+        run the pool's jobs while waiting, so that the block gets done
+        even when the pool has no threads free.
+    */
+    Decoded wait(Pending & pending)
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(pending.mutex);
+                if (pending.done)
+                    break;
+            }
+            if (threadPool.work())
+                continue;
+            std::unique_lock<std::mutex> guard(pending.mutex);
+            pending.cond.wait_for(guard, std::chrono::milliseconds(1),
+                                  [&] () { return pending.done; });
+        }
+
+        if (pending.exc)
+            std::rethrow_exception(pending.exc);
+        return std::move(pending.decoded);
+    }
+
+    /// Get the output of the next block.  Returns false at the end.
+    bool nextOutput()
+    {
+        startBlocks();
+
+        if (inFlight.empty()) {
+            if (!finished) {
+                finished = true;
+                codec->finish(carry);
+            }
+            return false;
+        }
+
+        InFlight entry = std::move(inFlight.front());
+        inFlight.pop_front();
+
+        // If the previous block didn't end cleanly, anything we guessed
+        // about this one is wrong, and it has to follow on from it
+        Decoded decoded;
+        if (carry || !entry.pending)
+            decoded = codec->decodeAfter(std::move(carry), *entry.block);
+        else decoded = wait(*entry.pending);
+
+        codec->onBlockDone(*entry.block, decoded);
+        carry = std::move(decoded.state);
+        output = std::move(decoded.output);
+        outputPos = 0;
+
+        // Keep the workers busy while the caller reads this block
+        startBlocks();
+        return true;
+    }
+
+    std::streamsize read(char * s, std::streamsize n)
+    {
+        std::streamsize done = 0;
+        while (done < n) {
+            if (outputPos == output.size() && !nextOutput())
+                break;
+            size_t toCopy = std::min<size_t>(n - done,
+                                             output.size() - outputPos);
+            std::memcpy(s + done, output.data() + outputPos, toCopy);
+            outputPos += toCopy;
+            done += toCopy;
+        }
+        return done == 0 && n > 0 ? -1 : done;
+    }
+
+    std::unique_ptr<Codec> codec;
+    ThreadPool threadPool;
+    size_t maxInFlight;
+    std::deque<InFlight> inFlight;
+    bool inputDone;
+    bool finished;
+    std::shared_ptr<void> carry;  ///< State left by the previous block
+    std::string output;           ///< Output of current block
+    size_t outputPos;             ///< Amount of output already read
+};
+
+std::streamsize
+ParallelDecompressingSource::
+read(char * s, std::streamsize n)
+{
+    return itl->read(s, n);
+}
+
+std::unique_ptr<ParallelDecompressingSource>
+createParallelDecompressingSource(std::streambuf * input,
+                                  const std::string & compression,
+                                  int numThreads,
+                                  const char * mapped,
+                                  size_t mappedSize)
+{
+    std::unique_ptr<ParallelDecompressingSource> result;
+    if (numThreads < 2)
+        return result;
+
+    std::unique_ptr<Codec> codec;
+    if (compression == "gzip")
+        codec.reset(new GzipCodec(input));
+    else if (compression == "bzip2")
+        codec.reset(new Bzip2Codec(input));
+    else if (compression == "lz4")
+        codec.reset(new Lz4Codec(input));
+    else if (compression == "xz" && mapped) {
+        std::vector<XzBlockInfo> blocks;
+        if (indexXzBlocks(mapped, mappedSize, blocks))
+            codec.reset(new XzCodec(mapped, std::move(blocks)));
+    }
+
+    if (!codec)
+        return result;
+
+    result.reset(new ParallelDecompressingSource());
+    result->itl = std::make_shared<ParallelDecompressingSource::Itl>
+        (std::move(codec), numThreads);
+    return result;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,73 @@
+/** parallel_decompress.h                                           -*- C++ -*-
+    This file is part of MLDB. Copyright 2016 Datacratic. All rights reserved.
+
+    Multi-threaded decompression of gzip, bzip2, xz and lz4 streams, for
+    those files whose structure allows parts of them to be decompressed
+    independently.
+*/
+
+#pragma once
+
+#include <boost/iostreams/concepts.hpp>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSING SOURCE                                             */
+/*****************************************************************************/
+
+/** A boost::iostreams source that reads a compressed stream from a
+    streambuf and returns the decompressed data, in order, having
+    decompressed it using up to numThreads blocks at a time.
+
+    The compressed input is split into blocks which can be decompressed
+    independently of each other:
+
+    - gzip: the members of a multi-member file, such as those written by
+      bgzip (whose members record their own length) or by pigz -i or
+      concatenation.  Other member boundaries are found by looking for
+      plausible gzip headers; a block that turns out not to start on a
+      member boundary is decompressed again, in order, following on from
+      the previous one.  A file with a single member is thus decompressed
+      serially, but still overlapped with the reader.
+    - bzip2: each (bit-aligned) compressed block, which is wrapped into a
+      stream of its own.
+    - xz: each of the blocks listed in the stream index, as written by
+      xz -T.  As the index is at the end, this requires the compressed
+      file to be mapped into memory.
+    - lz4: each block of the stream, which the lz4 filter requires to be
+      independent.
+*/
+
+struct ParallelDecompressingSource {
+    typedef char char_type;
+    typedef boost::iostreams::source_tag category;
+
+    std::streamsize read(char * s, std::streamsize n);
+
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+/** Create a source that decompresses the data in the given streambuf,
+    compressed using the given scheme ("gzip", "bzip2", "xz" or "lz4"),
+    using numThreads threads.  If the whole compressed input is mapped
+    into memory, mapped and mappedSize give its location.
+
+    Returns a null pointer if the input can't be decompressed in parallel,
+    in which case the caller should fall back to the normal boost
+    decompressor.  The streambuf must outlive the returned source.
+*/
+std::unique_ptr<ParallelDecompressingSource>
+createParallelDecompressingSource(std::streambuf * input,
+                                  const std::string & compression,
+                                  int numThreads,
+                                  const char * mapped = nullptr,
+                                  size_t mappedSize = 0);
+
+} // namespace Datacratic
@@ -18,6 +18,7 @@
 #include "mldb/vfs/filter_streams_registry.h"
 #include "mldb/arch/exception.h"
 #include "mldb/arch/exception_handler.h"
+#include "mldb/base/thread_pool.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
@@ -27,7 +28,10 @@
 #include <vector>
 #include <stdint.h>
 #include <iostream>
+#include <fstream>
 #include <fcntl.h>
+#include <zlib.h>
+#include <lzma.h>
 
 #include "mldb/jml/utils/guard.h"
 #include "mldb/arch/exception_handler.h"
@@ -601,3 +605,195 @@ BOOST_AUTO_TEST_CASE(test_empty_filter_stream_mapped)
     // but we can read it without failing
     BOOST_CHECK_EQUAL(stream.readAll(), "");
 }
+
+namespace {
+
+/// Lines of text adding up to at least the given size
+string parallelTestContents(size_t size)
+{
+    string contents;
+    for (unsigned i = 0;  contents.size() < size;  ++i) {
+        contents += to_string(i) + "," + to_string(i * 2654435761U)
+            + ",the quick brown fox jumps over the lazy dog\n";
+    }
+    return contents;
+}
+
+/// Compress data into a single gzip member
+string gzipMember(const string & data, int level = Z_DEFAULT_COMPRESSION)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        throw ML::Exception("couldn't initialize zlib");
+    Call_Guard guard([&] () { deflateEnd(&strm); });
+
+    string result(deflateBound(&strm, data.size()), '\0');
+    strm.next_in = (Bytef *)data.data();
+    strm.avail_in = data.size();
+    strm.next_out = (Bytef *)&result[0];
+    strm.avail_out = result.size();
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END)
+        throw ML::Exception("gzip compression error");
+    result.resize(strm.total_out);
+    return result;
+}
+
+/// Compress data into an xz stream cut into blocks of blockSize bytes
+string xzWithBlocks(const string & data, uint64_t blockSize)
+{
+    lzma_mt options;
+    memset(&options, 0, sizeof(options));
+    options.threads = 1;
+    options.block_size = blockSize;
+    options.preset = LZMA_PRESET_DEFAULT;
+    options.check = LZMA_CHECK_CRC64;
+
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_stream_encoder_mt(&strm, &options) != LZMA_OK)
+        throw ML::Exception("couldn't initialize lzma");
+    Call_Guard guard([&] () { lzma_end(&strm); });
+
+    string result;
+    char buf[65536];
+    strm.next_in = (const uint8_t *)data.data();
+    strm.avail_in = data.size();
+    for (;;) {
+        strm.next_out = (uint8_t *)buf;
+        strm.avail_out = sizeof(buf);
+        lzma_ret res = lzma_code(&strm, LZMA_FINISH);
+        result.append(buf, sizeof(buf) - strm.avail_out);
+        if (res == LZMA_STREAM_END)
+            return result;
+        if (res != LZMA_OK)
+            throw ML::Exception("xz compression error %d", (int)res);
+    }
+}
+
+void writeRawFile(const string & filename, const string & data)
+{
+    ofstream stream(filename, ios::binary);
+    stream << data;
+    if (!stream)
+        throw ML::Exception("couldn't write " + filename);
+}
+
+/** Read the file back with parallel decompression.  numJobs is set to the
+    number of blocks that were decompressed on the thread pool, rather than
+    in order by the reader.
+*/
+string readParallel(const string & filename, uint64_t & numJobs)
+{
+    uint64_t before = getWorkloadStats(WORKLOAD_INTERACTIVE).jobsSubmitted;
+    filter_istream stream(filename,
+                          { { "mapped", "true" },
+                            { "decompressionThreads", "4" } });
+    string result = stream.readAll();
+    numJobs = getWorkloadStats(WORKLOAD_INTERACTIVE).jobsSubmitted - before;
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_parallel_decompression)
+{
+    // Enough lines to give several blocks in each format
+    string contents = parallelTestContents(6 * 1024 * 1024);
+
+    auto writeFile = [] (const string & filename, const string & data)
+        {
+            filter_ostream stream(filename);
+            stream << data;
+            stream.close();
+        };
+
+    auto readFile = [] (const string & filename)
+        {
+            filter_istream stream(filename,
+                                  { { "mapped", "true" },
+                                    { "decompressionThreads", "4" } });
+            return stream.readAll();
+        };
+
+    for (string extension: { "gz", "bz2", "xz", "lz4" }) {
+        string filename = "build/x86_64/tmp/parallel_decompression."
+            + extension;
+        FileCleanup cleanup(filename);
+        writeFile(filename, contents);
+        BOOST_CHECK(readFile(filename) == contents);
+    }
+
+    // Multi-member gzip files are decompressed a member at a time
+    string part1 = "build/x86_64/tmp/parallel_decompression.1.gz";
+    string part2 = "build/x86_64/tmp/parallel_decompression.2.gz";
+    string joined = "build/x86_64/tmp/parallel_decompression.joined.gz";
+    FileCleanup cleanup1(part1), cleanup2(part2), cleanup3(joined);
+    writeFile(part1, contents.substr(0, 4 * 1024 * 1024));
+    writeFile(part2, contents.substr(4 * 1024 * 1024));
+    system("cat " + part1 + " " + part2 + " > " + joined);
+    BOOST_CHECK(readFile(joined) == contents);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_gzip_small_members)
+{
+    // Members much smaller than a block, as written by pigz -i: several
+    // of them go into each block, and the blocks are decompressed at the
+    // same time
+    string contents = parallelTestContents(16 * 1024 * 1024);
+    string compressed;
+    for (size_t pos = 0;  pos < contents.size();  pos += 100000)
+        compressed += gzipMember(contents.substr(pos, 100000));
+    BOOST_REQUIRE_GT(compressed.size(), 2 * 1024 * 1024);
+
+    string filename = "build/x86_64/tmp/parallel_small_members.gz";
+    FileCleanup cleanup(filename);
+    writeRawFile(filename, compressed);
+
+    uint64_t numJobs;
+    BOOST_CHECK(readParallel(filename, numJobs) == contents);
+    BOOST_CHECK_GT(numJobs, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_gzip_false_member_boundary)
+{
+    // A single member stored without compression, whose contents include
+    // complete gzip files.  Those look like the start of a new member, and
+    // even inflate properly, but the block that starts there has to be
+    // decompressed again following on from the one before.
+    string embedded = gzipMember("not a member of the outer file\n");
+    string contents;
+    for (int i = 0;  i < 30;  ++i)
+        contents += parallelTestContents(100000) + embedded;
+
+    string compressed = gzipMember(contents, 0 /* stored */);
+
+    // Make sure there is a false header where the block is split
+    size_t found = compressed.find(embedded, 1024 * 1024);
+    BOOST_REQUIRE(found != string::npos && found < 2 * 1024 * 1024);
+
+    string filename = "build/x86_64/tmp/parallel_false_boundary.gz";
+    FileCleanup cleanup(filename);
+    writeRawFile(filename, compressed);
+
+    uint64_t numJobs;
+    BOOST_CHECK(readParallel(filename, numJobs) == contents);
+
+    // The block after the false boundary was started speculatively
+    BOOST_CHECK_GT(numJobs, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_xz_blocks)
+{
+    // As written by xz -T, with one block per MB of input
+    string contents = parallelTestContents(8 * 1024 * 1024);
+    string compressed = xzWithBlocks(contents, 1024 * 1024);
+
+    string filename = "build/x86_64/tmp/parallel_blocks.xz";
+    FileCleanup cleanup(filename);
+    writeRawFile(filename, compressed);
+
+    uint64_t numJobs;
+    BOOST_CHECK(readParallel(filename, numJobs) == contents);
+    BOOST_CHECK_GE(numJobs, 8);
+}
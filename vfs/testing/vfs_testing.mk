@@ -1,4 +1,4 @@
 # This file is part of MLDB. Copyright 2015 Datacratic. All rights reserved.
 
-$(eval $(call test,filter_streams_test,vfs boost_filesystem boost_system,boost))
+$(eval $(call test,filter_streams_test,vfs base boost_filesystem boost_system z lzma,boost))
 
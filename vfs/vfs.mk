@@ -3,9 +3,10 @@
 LIBVFS_SOURCES := \
 	fs_utils.cc \
         filter_streams.cc \
-	http_streambuf.cc
+	http_streambuf.cc \
+	parallel_decompress.cc
 
-LIBVFS_LINK := arch boost_iostreams lzmapp types boost_filesystem http lz4 xxhash
+LIBVFS_LINK := arch base boost_iostreams lzmapp types boost_filesystem http lz4 xxhash z bz2 lzma
 
 $(eval $(call library,vfs,$(LIBVFS_SOURCES),$(LIBVFS_LINK)))
 